@@ -0,0 +1,63 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/arena.h"
+
+#include "base/logging.h"
+
+namespace base {
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size),
+      pos_(0),
+      end_(0),
+      bytes_allocated_(0),
+      bytes_reserved_(0) {
+  DCHECK_GT(block_size, 0U);
+}
+
+Arena::~Arena() {}
+
+void Arena::Reset() {
+  blocks_.clear();
+  pos_ = 0;
+  end_ = 0;
+  bytes_allocated_ = 0;
+  bytes_reserved_ = 0;
+}
+
+void* Arena::AllocateSlow(size_t size, size_t alignment) {
+  DCHECK_EQ(0U, alignment & (alignment - 1));
+
+  // A large allocation gets its own block, so that the free space of the
+  // current block isn't wasted.
+  size_t needed = size + alignment - 1;
+  if (needed > block_size_ / 4) {
+    blocks_.emplace_back(new char[needed]);
+    bytes_reserved_ += needed;
+    bytes_allocated_ += size;
+    uintptr_t start = reinterpret_cast<uintptr_t>(blocks_.back().get());
+    return reinterpret_cast<void*>((start + alignment - 1) & ~(alignment - 1));
+  }
+
+  blocks_.emplace_back(new char[block_size_]);
+  bytes_reserved_ += block_size_;
+  pos_ = reinterpret_cast<uintptr_t>(blocks_.back().get());
+  end_ = pos_ + block_size_;
+  return Allocate(size, alignment);
+}
+
+}  // namespace base
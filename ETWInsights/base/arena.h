@@ -0,0 +1,149 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+// Allocates memory by bumping a pointer in large blocks. Individual
+// allocations are never freed: all the memory is released at once when the
+// arena is reset or destroyed. This suits the objects built while a trace is
+// analyzed, which all live until the end of the analysis.
+//
+// An Arena is not thread-safe.
+class Arena {
+ public:
+  // Default size of the blocks requested from the heap.
+  static const size_t kDefaultBlockSize = 1024 * 1024;
+
+  // @param block_size size of the blocks requested from the heap. Allocations
+  //    larger than a quarter of a block get a block of their own.
+  explicit Arena(size_t block_size = kDefaultBlockSize);
+  ~Arena();
+
+  // Allocates memory.
+  // @param size number of bytes to allocate.
+  // @param alignment alignment of the returned memory. Must be a power of 2.
+  // @returns a pointer to |size| bytes that remain valid until the arena is
+  //    reset or destroyed.
+  void* Allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - (pos_ & (alignment - 1))) & (alignment - 1);
+    if (size + padding <= end_ - pos_) {
+      void* ptr = reinterpret_cast<void*>(pos_ + padding);
+      pos_ += padding + size;
+      bytes_allocated_ += size;
+      return ptr;
+    }
+    return AllocateSlow(size, alignment);
+  }
+
+  // Releases all the memory allocated by the arena.
+  void Reset();
+
+  // @returns the number of bytes handed out by Allocate().
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+  // @returns the number of bytes requested from the heap.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  // Allocates from a new block.
+  void* AllocateSlow(size_t size, size_t alignment);
+
+  // Size of the blocks requested from the heap.
+  size_t block_size_;
+
+  // Blocks requested from the heap.
+  std::vector<std::unique_ptr<char[]>> blocks_;
+
+  // Free range of the current block.
+  uintptr_t pos_;
+  uintptr_t end_;
+
+  // Statistics.
+  size_t bytes_allocated_;
+  size_t bytes_reserved_;
+
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+// STL allocator that gets its memory from an Arena. deallocate() is a no-op:
+// the memory is released with the arena. A default-constructed ArenaAllocator
+// has no arena and uses the heap, so that containers that use it can still be
+// created without an arena. Typical usage is:
+//   Arena arena;
+//   std::vector<int, ArenaAllocator<int>> values((ArenaAllocator<int>(&arena)));
+//
+// Copies of a container use the heap, not the arena of the original: the
+// arena of a long-lived structure, such as a SystemHistory, would otherwise
+// grow with every copy made to read it, and would be used from any thread that
+// makes such a copy, although an Arena isn't thread-safe. To copy a container
+// into an arena, construct the copy with an explicit allocator:
+//   std::vector<int, ArenaAllocator<int>> copy(values.begin(), values.end(),
+//                                              ArenaAllocator<int>(&arena));
+// Assigning to a container keeps the allocator of the destination.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_(nullptr) {}
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr)
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t /* n */) {
+    if (arena_ == nullptr)
+      ::operator delete(ptr);
+  }
+
+  // Called by containers when they are copy-constructed.
+  // @returns an allocator that uses the heap.
+  ArenaAllocator select_on_container_copy_construction() const {
+    return ArenaAllocator();
+  }
+
+  Arena* arena() const { return arena_; }
+
+ private:
+  // Arena that provides the memory. nullptr to use the heap.
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+}  // namespace base
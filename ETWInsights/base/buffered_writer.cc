@@ -0,0 +1,188 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "base/buffered_writer.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace base {
+
+namespace {
+
+// Size of each buffer.
+const size_t kBufferSize = 1 << 20;
+
+// Decimal representation of the numbers from 00 to 99.
+const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+}  // namespace
+
+char* FormatUInt(uint64_t value, char* buffer_end) {
+  char* pos = buffer_end;
+
+  // Write two digits at a time.
+  while (value >= 100) {
+    size_t pair = static_cast<size_t>(value % 100) * 2;
+    value /= 100;
+    *--pos = kDigitPairs[pair + 1];
+    *--pos = kDigitPairs[pair];
+  }
+
+  if (value >= 10) {
+    size_t pair = static_cast<size_t>(value) * 2;
+    *--pos = kDigitPairs[pair + 1];
+    *--pos = kDigitPairs[pair];
+  } else {
+    *--pos = static_cast<char>('0' + value);
+  }
+  return pos;
+}
+
+BufferedWriter::BufferedWriter()
+    : is_open_(false),
+      buffer_size_(0),
+      pending_size_(0),
+      stop_flush_thread_(false) {}
+
+BufferedWriter::~BufferedWriter() {
+  if (is_open_)
+    Close();
+}
+
+bool BufferedWriter::Open(const std::wstring& path, FlushMode flush_mode) {
+  DCHECK(!is_open_);
+
+  file_.open(path, std::ios::binary);
+  if (!file_) {
+    LOG(ERROR) << "Unable to open " << WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+  is_open_ = true;
+
+  buffer_.resize(kBufferSize);
+  buffer_size_ = 0;
+
+  if (flush_mode == kFlushInBackground) {
+    pending_buffer_.resize(kBufferSize);
+    pending_size_ = 0;
+    stop_flush_thread_ = false;
+    flush_thread_ = std::thread(&BufferedWriter::FlushThread, this);
+  }
+  return true;
+}
+
+void BufferedWriter::WriteUInt(uint64_t value) {
+  if (buffer_.size() - buffer_size_ < kMaxUIntDigits)
+    FlushBuffer();
+
+  // FormatUInt() writes from the end of its buffer, so format in a local
+  // buffer and copy the digits.
+  char digits[kMaxUIntDigits];
+  char* begin = FormatUInt(value, digits + kMaxUIntDigits);
+  size_t size = digits + kMaxUIntDigits - begin;
+  memcpy(&buffer_[buffer_size_], begin, size);
+  buffer_size_ += size;
+}
+
+bool BufferedWriter::Close() {
+  DCHECK(is_open_);
+
+  FlushBuffer();
+
+  if (flush_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_flush_thread_ = true;
+    }
+    condition_.notify_all();
+    flush_thread_.join();
+  }
+
+  bool success = !file_.fail();
+  file_.close();
+  is_open_ = false;
+  return success;
+}
+
+void BufferedWriter::WriteSlow(const char* data, size_t size) {
+  while (size > 0) {
+    if (buffer_size_ == buffer_.size())
+      FlushBuffer();
+    size_t copy_size = std::min(size, buffer_.size() - buffer_size_);
+    memcpy(&buffer_[buffer_size_], data, copy_size);
+    buffer_size_ += copy_size;
+    data += copy_size;
+    size -= copy_size;
+  }
+}
+
+void BufferedWriter::FlushBuffer() {
+  if (buffer_size_ == 0)
+    return;
+
+  if (!flush_thread_.joinable()) {
+    file_.write(buffer_.data(), buffer_size_);
+    buffer_size_ = 0;
+    return;
+  }
+
+  // Wait until the background thread is done with the previous buffer, then
+  // hand it the current one.
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return pending_size_ == 0; });
+    buffer_.swap(pending_buffer_);
+    pending_size_ = buffer_size_;
+  }
+  condition_.notify_all();
+  buffer_size_ = 0;
+}
+
+void BufferedWriter::FlushThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    condition_.wait(lock,
+                    [this] { return pending_size_ != 0 || stop_flush_thread_; });
+    if (pending_size_ == 0)
+      return;
+
+    // The writer thread doesn't touch |pending_buffer_| while |pending_size_|
+    // is not 0, so the lock can be released during the write.
+    lock.unlock();
+    file_.write(pending_buffer_.data(), pending_size_);
+    lock.lock();
+
+    pending_size_ = 0;
+    condition_.notify_all();
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,137 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+// Maximum number of characters written by FormatUInt().
+const size_t kMaxUIntDigits = 20;
+
+// Writes the decimal representation of |value| at the end of |buffer|.
+// @param value the value to format.
+// @param buffer_end end of a buffer of at least kMaxUIntDigits characters.
+// @returns the position of the first character written in the buffer.
+char* FormatUInt(uint64_t value, char* buffer_end);
+
+// Writes a file through a large user-space buffer. Unlike std::ofstream, no
+// work is done per call other than copying bytes, and integers are formatted
+// without going through a locale. Optionally, full buffers are written to the
+// file by a background thread while the caller fills another buffer. Typical
+// usage is:
+//   BufferedWriter writer;
+//   writer.Open(L"output.txt", BufferedWriter::kFlushInBackground);
+//   writer.Write("count: ");
+//   writer.WriteUInt(42);
+//   writer.Close();
+class BufferedWriter {
+ public:
+  enum FlushMode {
+    // Full buffers are written to the file by the thread that fills them.
+    kFlushInline,
+    // Full buffers are written to the file by a background thread.
+    kFlushInBackground,
+  };
+
+  BufferedWriter();
+  // Closes the file if it is still open.
+  ~BufferedWriter();
+
+  // Opens a file for writing, replacing its content.
+  // @param path path of the file to write.
+  // @param flush_mode how full buffers are written to the file.
+  // @returns true if the file was opened successfully.
+  bool Open(const std::wstring& path, FlushMode flush_mode);
+
+  // Writes bytes to the file.
+  // @param data bytes to write.
+  // @param size number of bytes to write.
+  void Write(const char* data, size_t size) {
+    if (size <= buffer_.size() - buffer_size_) {
+      memcpy(&buffer_[buffer_size_], data, size);
+      buffer_size_ += size;
+      return;
+    }
+    WriteSlow(data, size);
+  }
+  void Write(const std::string& str) { Write(str.data(), str.size()); }
+  void Write(const char* str) { Write(str, strlen(str)); }
+
+  // Writes a single character to the file.
+  void WriteChar(char c) {
+    if (buffer_size_ == buffer_.size())
+      FlushBuffer();
+    buffer_[buffer_size_++] = c;
+  }
+
+  // Writes the decimal representation of an integer to the file.
+  void WriteUInt(uint64_t value);
+
+  // Writes the buffered data and closes the file.
+  // @returns true if all the data was written successfully.
+  bool Close();
+
+  // @returns true if the file is open.
+  bool is_open() const { return is_open_; }
+
+ private:
+  // Writes bytes that don't fit in the remaining space of the buffer.
+  void WriteSlow(const char* data, size_t size);
+
+  // Hands the buffer to the file, directly or through the background thread.
+  void FlushBuffer();
+
+  // Body of the background thread: writes the pending buffers to the file.
+  void FlushThread();
+
+  // Output file.
+  std::ofstream file_;
+
+  // Whether the file is open.
+  bool is_open_;
+
+  // Buffer filled by the Write*() methods.
+  std::vector<char> buffer_;
+  size_t buffer_size_;
+
+  // Buffer being written by the background thread. Protected by |mutex_|.
+  std::vector<char> pending_buffer_;
+  size_t pending_size_;
+
+  // Whether the background thread should exit once |pending_buffer_| is
+  // written. Protected by |mutex_|.
+  bool stop_flush_thread_;
+
+  // Background thread, if the flush mode is kFlushInBackground.
+  std::thread flush_thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferedWriter);
+};
+
+}  // namespace base
@@ -49,4 +49,20 @@ bool FilePathExists(const std::wstring& path) {
   return true;
 }
 
+bool GetFileSizeAndLastWriteTime(const std::wstring& path,
+                                 uint64_t* size,
+                                 uint64_t* last_write_time) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard,
+                              &attributes)) {
+    return false;
+  }
+  *size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) |
+          attributes.nFileSizeLow;
+  *last_write_time =
+      (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+      attributes.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
 }  // namespace base
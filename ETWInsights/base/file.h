@@ -16,6 +16,7 @@ limitations under the License.
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 namespace base {
@@ -33,4 +34,13 @@ std::wstring BaseName(const std::wstring& path);
 // @returns true if the file path exists, false otherwise.
 bool FilePathExists(const std::wstring& path);
 
+// @param path a file path.
+// @param size receives the size of the file, in bytes.
+// @param last_write_time receives the time of the last write to the file, as
+//     a FILETIME value.
+// @returns true if the attributes of the file were read successfully.
+bool GetFileSizeAndLastWriteTime(const std::wstring& path,
+                                 uint64_t* size,
+                                 uint64_t* last_write_time);
+
 }  // namespace base
@@ -0,0 +1,326 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/gzip_writer.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace base {
+
+namespace {
+
+// Size of the window in which matches are searched.
+const size_t kWindowSize = 32768;
+
+// Minimum and maximum length of a match.
+const size_t kMinMatch = 3;
+const size_t kMaxMatch = 258;
+
+// Number of pending bytes that triggers the compression of a block.
+const size_t kBlockSize = 65536;
+
+// Size of the hash table used to find matches.
+const size_t kHashBits = 15;
+const size_t kHashSize = static_cast<size_t>(1) << kHashBits;
+
+// Maximum number of positions visited when looking for a match.
+const size_t kMaxChainLength = 64;
+
+// Base length and number of extra bits of the deflate length codes.
+const uint16_t kLengthBase[] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtraBits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                    1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                    4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+// Base distance and number of extra bits of the deflate distance codes.
+const uint16_t kDistanceBase[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+const uint8_t kDistanceExtraBits[] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
+                                      4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
+                                      9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// End of block symbol.
+const uint32_t kEndOfBlock = 256;
+
+// First symbol of the length codes.
+const uint32_t kFirstLengthSymbol = 257;
+
+// Header of a gzip file: magic number, deflate compression method, no flags,
+// no modification time, no extra flags, unknown operating system.
+const uint8_t kGzipHeader[] = {0x1f, 0x8b, 0x08, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0xff};
+
+// Table used to compute the CRC-32 of the uncompressed data.
+struct CrcTable {
+  CrcTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+      values[i] = crc;
+    }
+  }
+
+  uint32_t values[256];
+};
+
+const CrcTable& GetCrcTable() {
+  static const CrcTable table;
+  return table;
+}
+
+uint32_t Hash(const uint8_t* bytes) {
+  return ((bytes[0] << 10) ^ (bytes[1] << 5) ^ bytes[2]) & (kHashSize - 1);
+}
+
+// @returns the index of the last element of |bases| that is smaller or equal
+//    to |value|.
+template <size_t N>
+size_t FindCode(const uint16_t (&bases)[N], size_t value) {
+  const uint16_t* it = std::upper_bound(bases, bases + N, value);
+  DCHECK(it != bases);
+  return static_cast<size_t>(it - bases) - 1;
+}
+
+void WriteLittleEndian32(uint32_t value, BufferedWriter* file) {
+  for (int i = 0; i < 4; ++i)
+    file->WriteChar(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+}  // namespace
+
+GzipWriter::GzipWriter()
+    : is_open_(false),
+      pending_pos_(0),
+      window_offset_(0),
+      bit_buffer_(0),
+      bit_count_(0),
+      crc_(0),
+      uncompressed_size_(0) {}
+
+GzipWriter::~GzipWriter() {
+  if (is_open_)
+    Close();
+}
+
+bool GzipWriter::Open(const std::wstring& path) {
+  DCHECK(!is_open_);
+
+  // Compression is CPU bound, so let a background thread write the
+  // compressed data.
+  if (!file_.Open(path, BufferedWriter::kFlushInBackground))
+    return false;
+  is_open_ = true;
+
+  window_.clear();
+  pending_pos_ = 0;
+  window_offset_ = 0;
+  hash_head_.assign(kHashSize, -1);
+  hash_prev_.assign(kWindowSize, -1);
+  bit_buffer_ = 0;
+  bit_count_ = 0;
+  crc_ = 0xFFFFFFFF;
+  uncompressed_size_ = 0;
+
+  file_.Write(reinterpret_cast<const char*>(kGzipHeader), sizeof(kGzipHeader));
+  return true;
+}
+
+void GzipWriter::Write(const char* data, size_t size) {
+  DCHECK(is_open_);
+
+  const CrcTable& crc_table = GetCrcTable();
+  for (size_t i = 0; i < size; ++i) {
+    crc_ = crc_table.values[(crc_ ^ static_cast<uint8_t>(data[i])) & 0xFF] ^
+           (crc_ >> 8);
+  }
+  uncompressed_size_ += size;
+
+  window_.insert(window_.end(), data, data + size);
+  if (window_.size() - pending_pos_ >= kBlockSize + kMaxMatch)
+    Compress(false);
+}
+
+bool GzipWriter::Close() {
+  DCHECK(is_open_);
+
+  Compress(true);
+
+  // Pad the last byte.
+  if (bit_count_ > 0)
+    WriteBits(0, 8 - bit_count_);
+
+  // Write the trailer.
+  WriteLittleEndian32(crc_ ^ 0xFFFFFFFF, &file_);
+  WriteLittleEndian32(static_cast<uint32_t>(uncompressed_size_), &file_);
+
+  bool success = file_.Close();
+  is_open_ = false;
+  return success;
+}
+
+void GzipWriter::Compress(bool is_final) {
+  size_t end = window_.size();
+  size_t limit = is_final ? end : end - kMaxMatch;
+  if (!is_final && pending_pos_ >= limit)
+    return;
+
+  // Block header: final block flag, fixed Huffman codes.
+  WriteBits(is_final ? 1 : 0, 1);
+  WriteBits(1, 2);
+
+  size_t pos = pending_pos_;
+  while (pos < limit) {
+    size_t distance = 0;
+    size_t length = 0;
+    if (pos + kMinMatch <= end)
+      length = FindMatch(pos, end, &distance);
+
+    if (length == 0) {
+      WriteLiteral(window_[pos]);
+      if (pos + kMinMatch <= end)
+        InsertHash(pos);
+      ++pos;
+      continue;
+    }
+
+    WriteMatch(length, distance);
+    for (size_t i = 0; i < length; ++i) {
+      if (pos + i + kMinMatch <= end)
+        InsertHash(pos + i);
+    }
+    pos += length;
+  }
+
+  WriteEndOfBlock();
+  pending_pos_ = pos;
+
+  // Only keep the bytes that can be referenced by future matches.
+  if (pending_pos_ > kWindowSize) {
+    size_t discarded = pending_pos_ - kWindowSize;
+    window_.erase(window_.begin(), window_.begin() + discarded);
+    pending_pos_ -= discarded;
+    window_offset_ += discarded;
+  }
+}
+
+size_t GzipWriter::FindMatch(size_t pos, size_t end, size_t* distance) const {
+  DCHECK(distance != nullptr);
+
+  const int64_t absolute_pos = static_cast<int64_t>(window_offset_ + pos);
+  const int64_t window_start = static_cast<int64_t>(window_offset_);
+  const size_t max_length = std::min(kMaxMatch, end - pos);
+
+  size_t best_length = 0;
+  int64_t candidate = hash_head_[Hash(&window_[pos])];
+  for (size_t chain = 0; chain < kMaxChainLength && candidate >= 0; ++chain) {
+    if (absolute_pos - candidate > static_cast<int64_t>(kWindowSize) ||
+        candidate < window_start) {
+      break;
+    }
+
+    size_t candidate_pos = static_cast<size_t>(candidate - window_start);
+    size_t length = 0;
+    while (length < max_length &&
+           window_[candidate_pos + length] == window_[pos + length]) {
+      ++length;
+    }
+
+    if (length > best_length) {
+      best_length = length;
+      *distance = static_cast<size_t>(absolute_pos - candidate);
+      if (best_length == max_length)
+        break;
+    }
+
+    // Entries of |hash_prev_| are overwritten as the window moves. A position
+    // that isn't before the candidate belongs to a more recent chain.
+    int64_t next = hash_prev_[static_cast<size_t>(candidate) & (kWindowSize - 1)];
+    if (next >= candidate)
+      break;
+    candidate = next;
+  }
+
+  return best_length >= kMinMatch ? best_length : 0;
+}
+
+void GzipWriter::InsertHash(size_t pos) {
+  int64_t absolute_pos = static_cast<int64_t>(window_offset_ + pos);
+  uint32_t hash = Hash(&window_[pos]);
+  hash_prev_[static_cast<size_t>(absolute_pos) & (kWindowSize - 1)] =
+      hash_head_[hash];
+  hash_head_[hash] = absolute_pos;
+}
+
+void GzipWriter::WriteLiteral(uint8_t literal) {
+  if (literal < 144)
+    WriteHuffmanCode(0x30 + literal, 8);
+  else
+    WriteHuffmanCode(0x190 + literal - 144, 9);
+}
+
+void GzipWriter::WriteMatch(size_t length, size_t distance) {
+  DCHECK_GE(length, kMinMatch);
+  DCHECK_LE(length, kMaxMatch);
+  DCHECK_LE(distance, kWindowSize);
+
+  // Length symbols 257 to 279 have 7-bit codes, 280 to 285 have 8-bit codes.
+  size_t length_code = FindCode(kLengthBase, length);
+  uint32_t symbol = kFirstLengthSymbol + static_cast<uint32_t>(length_code);
+  if (symbol < 280)
+    WriteHuffmanCode(symbol - 256, 7);
+  else
+    WriteHuffmanCode(0xC0 + symbol - 280, 8);
+  WriteBits(static_cast<uint32_t>(length - kLengthBase[length_code]),
+            kLengthExtraBits[length_code]);
+
+  // Distance codes are 5-bit codes.
+  size_t distance_code = FindCode(kDistanceBase, distance);
+  WriteHuffmanCode(static_cast<uint32_t>(distance_code), 5);
+  WriteBits(static_cast<uint32_t>(distance - kDistanceBase[distance_code]),
+            kDistanceExtraBits[distance_code]);
+}
+
+void GzipWriter::WriteEndOfBlock() {
+  WriteHuffmanCode(kEndOfBlock - 256, 7);
+}
+
+void GzipWriter::WriteBits(uint32_t value, size_t count) {
+  bit_buffer_ |= static_cast<uint64_t>(value) << bit_count_;
+  bit_count_ += count;
+  while (bit_count_ >= 8) {
+    file_.WriteChar(static_cast<char>(bit_buffer_ & 0xFF));
+    bit_buffer_ >>= 8;
+    bit_count_ -= 8;
+  }
+}
+
+void GzipWriter::WriteHuffmanCode(uint32_t code, size_t length) {
+  uint32_t reversed = 0;
+  for (size_t i = 0; i < length; ++i) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  WriteBits(reversed, length);
+}
+
+}  // namespace base
@@ -0,0 +1,119 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/buffered_writer.h"
+
+namespace base {
+
+// Writes a gzip-compressed file. Data is compressed as it is written, with
+// LZ77 matching over a 32 KB window and the fixed Huffman codes of the deflate
+// format, so that no external compression library is needed. Typical usage is:
+//   GzipWriter writer;
+//   writer.Open(L"output.gz");
+//   writer.Write(data);
+//   writer.Close();
+class GzipWriter {
+ public:
+  GzipWriter();
+  // Closes the file if it is still open.
+  ~GzipWriter();
+
+  // Opens a file and writes the gzip header.
+  // @param path path of the file to write.
+  // @returns true if the file was opened successfully.
+  bool Open(const std::wstring& path);
+
+  // Compresses data into the file.
+  // @param data data to compress.
+  // @param size number of bytes to compress.
+  void Write(const char* data, size_t size);
+  void Write(const std::string& data) { Write(data.data(), data.size()); }
+
+  // Compresses the remaining data, writes the gzip trailer and closes the
+  // file.
+  // @returns true if all the data was written successfully.
+  bool Close();
+
+ private:
+  // Compresses the pending bytes of |window_|. Unless |is_final| is true,
+  // bytes near the end of the window are kept for the next call so that
+  // matches can extend to their maximum length.
+  void Compress(bool is_final);
+
+  // Finds the longest match for the bytes at |pos| in |window_|.
+  // @param pos position in |window_|.
+  // @param end end of the bytes that can be matched in |window_|.
+  // @param distance receives the distance of the match.
+  // @returns the length of the match, or 0 if there is no match.
+  size_t FindMatch(size_t pos, size_t end, size_t* distance) const;
+
+  // Adds the bytes at |pos| in |window_| to the hash chains.
+  void InsertHash(size_t pos);
+
+  // Writes a literal byte, a match or the end of block marker with the fixed
+  // Huffman codes.
+  void WriteLiteral(uint8_t literal);
+  void WriteMatch(size_t length, size_t distance);
+  void WriteEndOfBlock();
+
+  // Writes |count| bits of |value|, least significant bit first.
+  void WriteBits(uint32_t value, size_t count);
+
+  // Writes a Huffman code, most significant bit first.
+  void WriteHuffmanCode(uint32_t code, size_t length);
+
+  // Output file.
+  BufferedWriter file_;
+
+  // Whether the file is open.
+  bool is_open_;
+
+  // Uncompressed data. Holds up to 32 KB of already compressed data, which
+  // can be referenced by matches, followed by the pending data.
+  std::vector<uint8_t> window_;
+
+  // Position of the first pending byte in |window_|.
+  size_t pending_pos_;
+
+  // Absolute position of the first byte of |window_| in the uncompressed
+  // data.
+  uint64_t window_offset_;
+
+  // Hash chains. |hash_head_| contains the last absolute position at which
+  // each hash was seen, |hash_prev_| the previous position with the same hash
+  // for each absolute position modulo the window size.
+  std::vector<int64_t> hash_head_;
+  std::vector<int64_t> hash_prev_;
+
+  // Bits waiting to be written.
+  uint64_t bit_buffer_;
+  size_t bit_count_;
+
+  // CRC-32 and size of the uncompressed data.
+  uint32_t crc_;
+  uint64_t uncompressed_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(GzipWriter);
+};
+
+}  // namespace base
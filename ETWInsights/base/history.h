@@ -17,6 +17,7 @@ limitations under the License.
 #pragma once
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "base/binary_search.h"
@@ -33,6 +34,8 @@ class History {
   struct Element {
     Element(const base::Timestamp& start_ts, const T& value)
         : start_ts(start_ts), value(value) {}
+    Element(const base::Timestamp& start_ts, T&& value)
+        : start_ts(start_ts), value(std::move(value)) {}
 
     // Time at which the element starts.
     base::Timestamp start_ts;
@@ -53,6 +56,7 @@ class History {
   // @returns true if the value is inserted successfully. Returns false if |ts|
   //    is earlier than the timestamp of the last inserted value.
   bool Insert(const base::Timestamp& start_ts, const T& value);
+  bool Insert(const base::Timestamp& start_ts, T&& value);
 
   // Gets the value for the specified timestamp.
   // @param ts timestamp for which to obtain the value.
@@ -81,6 +85,19 @@ class History {
   HistoryIterator IteratorFromTimestamp(const base::Timestamp& ts);
   HistoryConstIterator IteratorFromTimestamp(const base::Timestamp& ts) const;
 
+  // Gets the iterator that IteratorFromTimestamp() returns for each of
+  // |timestamps|, in a single pass over the history. Each search gallops from
+  // the result of the previous one, so that looking up many timestamps costs
+  // less than a binary search over the whole history for each of them.
+  // @param timestamps timestamps sorted in increasing order.
+  // @param iterators receives an iterator for each timestamp.
+  void IteratorsFromTimestamps(
+      const std::vector<base::Timestamp>& timestamps,
+      std::vector<HistoryConstIterator>* iterators) const;
+
+  // @returns an iterator to the beginning of the history.
+  HistoryConstIterator IteratorBegin() const { return history_.begin(); }
+
   // @returns an iterator to the end of the history.
   HistoryIterator IteratorEnd();
   HistoryConstIterator IteratorEnd() const;
@@ -88,6 +105,9 @@ class History {
   // @returns the number of elements in the history.
   size_t size() const { return history_.size(); }
 
+  // Reserves memory for |size| elements.
+  void Reserve(size_t size) { history_.reserve(size); }
+
  private:
   // Elements of the history, sorted by start timestamp.
   HistoryContainer history_;
@@ -106,6 +126,19 @@ bool History<T>::Insert(const base::Timestamp& start_ts, const T& value) {
   return true;
 }
 
+template <typename T>
+bool History<T>::Insert(const base::Timestamp& start_ts, T&& value) {
+  if (!history_.empty()) {
+    if (history_.back().start_ts >= start_ts)
+      return false;
+    if (history_.back().value == value)
+      return true;
+  }
+
+  history_.push_back(Element(start_ts, std::move(value)));
+  return true;
+}
+
 template <typename T>
 bool History<T>::GetValue(const base::Timestamp& ts, const T** value) const {
   DCHECK(value != nullptr);
@@ -169,6 +202,47 @@ typename History<T>::HistoryConstIterator History<T>::IteratorFromTimestamp(
   return it;
 }
 
+template <typename T>
+void History<T>::IteratorsFromTimestamps(
+    const std::vector<base::Timestamp>& timestamps,
+    std::vector<HistoryConstIterator>* iterators) const {
+  DCHECK(iterators != nullptr);
+  iterators->clear();
+  iterators->reserve(timestamps.size());
+
+  auto compare = [](const base::Timestamp& ts, const Element& value) {
+    return ts < value.start_ts;
+  };
+
+  // Index of the last element that starts at or before the previous
+  // timestamp.
+  size_t index = 0;
+  for (const base::Timestamp& ts : timestamps) {
+    DCHECK(iterators->empty() || ts >= timestamps[iterators->size() - 1]);
+
+    // Like IteratorFromTimestamp(), return the first element if all the
+    // elements start after |ts|.
+    if (history_.empty() || ts < history_[index].start_ts) {
+      iterators->push_back(history_.begin());
+      continue;
+    }
+
+    // Double the step until an element starts after |ts|, then search the
+    // last step.
+    size_t step = 1;
+    while (index + step < history_.size() &&
+           history_[index + step].start_ts <= ts) {
+      index += step;
+      step *= 2;
+    }
+    size_t end = std::min(index + step, history_.size());
+    auto it = std::upper_bound(history_.begin() + index + 1,
+                               history_.begin() + end, ts, compare);
+    index = static_cast<size_t>(it - history_.begin()) - 1;
+    iterators->push_back(history_.begin() + index);
+  }
+}
+
 template <typename T>
 typename History<T>::HistoryIterator History<T>::IteratorEnd() {
   return history_.end();
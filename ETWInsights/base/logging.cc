@@ -14,32 +14,229 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "base/logging.h"
 
 namespace base {
 
+namespace {
+
+// Maximum time during which the writer thread sleeps when the queue is
+// empty. Bounds the delay of a message whose wake up was missed.
+const std::chrono::milliseconds kMaxWriterSleep(10);
+
+// A formatted informational message in the queue.
+struct LogEntry {
+  LogEntry* next;
+  std::string text;
+};
+
+// Writes informational messages to the console from a background thread.
+// Messages are pushed on a lock-free list by the threads that log them, and
+// the writer thread takes the whole list at once. Warnings and errors are
+// written synchronously, after the queued messages, so that they appear next
+// to the output that the tools write directly to the console.
+class LogWriter {
+ public:
+  LogWriter()
+      : head_(nullptr),
+        num_pushed_(0),
+        num_written_(0),
+        stop_(false),
+        thread_(&LogWriter::ThreadMain, this) {}
+
+  // Writes the remaining messages and the summary of the suppressed messages.
+  ~LogWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_up_.notify_one();
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> console_lock(console_mutex_);
+    for (const LogSite* site : suppressed_sites_) {
+      std::cerr << GetSeverityName(site->severity()) << "(" << site->file()
+                << ":" << site->line() << "): " << site->suppressed_count()
+                << " similar messages were not written." << std::endl;
+    }
+  }
+
+  // Queues an informational message. Doesn't block.
+  void Push(std::string text) {
+    LogEntry* entry = new LogEntry;
+    entry->text.swap(text);
+    num_pushed_.fetch_add(1, std::memory_order_relaxed);
+
+    entry->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(entry->next, entry,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+
+    // Only the first message of a batch needs to wake up the writer.
+    if (entry->next == nullptr)
+      wake_up_.notify_one();
+  }
+
+  // Waits until all the messages queued before the call have been written.
+  void Flush() {
+    uint64_t target = num_pushed_.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_up_.notify_one();
+    flushed_.wait(lock, [&] { return num_written_ >= target; });
+  }
+
+  // Writes a message to stderr immediately, after the messages queued before
+  // the call.
+  void WriteNow(const std::string& text) {
+    Flush();
+    std::lock_guard<std::mutex> console_lock(console_mutex_);
+    std::cerr << text;
+    std::cerr.flush();
+  }
+
+  void AddSuppressedSite(const LogSite* site) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    suppressed_sites_.push_back(site);
+  }
+
+  static const char* GetSeverityName(LogSeverity severity) {
+    switch (severity) {
+      case LOG_INFO:
+        return "INFO";
+      case LOG_WARNING:
+        return "WARNING";
+      case LOG_ERROR:
+        return "ERROR";
+      case LOG_FATAL:
+        return "FATAL";
+    }
+    return "";
+  }
+
+ private:
+  void ThreadMain() {
+    for (;;) {
+      LogEntry* entries = head_.exchange(nullptr, std::memory_order_acquire);
+      if (entries == nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stop_ && head_.load(std::memory_order_acquire) == nullptr)
+          return;
+        wake_up_.wait_for(lock, kMaxWriterSleep, [&] {
+          return stop_ || head_.load(std::memory_order_relaxed) != nullptr;
+        });
+        continue;
+      }
+
+      // The list is in reverse order of arrival.
+      LogEntry* ordered = nullptr;
+      uint64_t count = 0;
+      while (entries != nullptr) {
+        LogEntry* next = entries->next;
+        entries->next = ordered;
+        ordered = entries;
+        entries = next;
+        ++count;
+      }
+
+      {
+        std::lock_guard<std::mutex> console_lock(console_mutex_);
+        while (ordered != nullptr) {
+          LogEntry* next = ordered->next;
+          std::cout.write(ordered->text.data(), ordered->text.size());
+          delete ordered;
+          ordered = next;
+        }
+        std::cout.flush();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_written_ += count;
+      }
+      flushed_.notify_all();
+    }
+  }
+
+  // Most recently pushed message.
+  std::atomic<LogEntry*> head_;
+
+  // Number of messages pushed on the queue.
+  std::atomic<uint64_t> num_pushed_;
+
+  // Protects the members below.
+  std::mutex mutex_;
+
+  // Number of messages written by the writer thread.
+  uint64_t num_written_;
+
+  // Whether the writer thread must exit once the queue is empty.
+  bool stop_;
+
+  // Sites for which some messages were suppressed.
+  std::vector<const LogSite*> suppressed_sites_;
+
+  // Signaled when messages are pushed or when the writer must exit.
+  std::condition_variable wake_up_;
+
+  // Signaled when messages have been written.
+  std::condition_variable flushed_;
+
+  // Serializes the writes to the console of the writer thread and of the
+  // threads that write warnings and errors.
+  std::mutex console_mutex_;
+
+  std::thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogWriter);
+};
+
+// Created when the first message is logged, and destroyed when the process
+// exits, after the remaining messages are written.
+LogWriter& GetLogWriter() {
+  static LogWriter writer;
+  return writer;
+}
+
+}  // namespace
+
+void LogSite::OnFirstSuppressedMessage() {
+  GetLogWriter().AddSuppressedSite(this);
+}
+
 LogMessage::~LogMessage() {
-  // TODO(etienneb): Implements a clever logging dispatch.
-  switch (severity_) {
-    case LOG_INFO:
-      std::cout << stream_.str();
-      break;
-    case LOG_WARNING:
-      std::cerr << "WARNING(" << file_ << ":" << line_ << "): " << stream_.str()
-                << std::endl;
-      break;
-    case LOG_ERROR:
-      std::cerr << "ERROR(" << file_ << ":" << line_ << "): " << stream_.str()
-                << std::endl;
-      break;
-    case LOG_FATAL:
-      std::cerr << "FATAL(" << file_ << ":" << line_ << "): " << stream_.str()
-                << std::endl;
-      exit(-1);  // TODO(etienneb): Do we really want this?
-      break;
+  std::string text;
+  if (severity_ == LOG_INFO) {
+    text = stream_.str();
+  } else {
+    std::ostringstream line;
+    line << LogWriter::GetSeverityName(severity_) << "(" << file_ << ":"
+         << line_ << "): " << stream_.str() << std::endl;
+    text = line.str();
   }
+
+  if (severity_ == LOG_INFO) {
+    GetLogWriter().Push(std::move(text));
+    return;
+  }
+
+  GetLogWriter().WriteNow(text);
+  if (severity_ == LOG_FATAL)
+    exit(-1);  // TODO(etienneb): Do we really want this?
+}
+
+void FlushLogs() {
+  GetLogWriter().Flush();
 }
 
 }  // namespace base
@@ -16,15 +16,74 @@ limitations under the License.
 
 #pragma once
 
+#include <stdint.h>
+#include <atomic>
 #include <cstdlib>
 #include <sstream>
 
 #include "base/base.h"
 
+// Messages with a lower severity than LOG_MIN_SEVERITY are removed at compile
+// time. For example, define LOG_MIN_SEVERITY=2 to only keep errors.
+#ifndef LOG_MIN_SEVERITY
+#define LOG_MIN_SEVERITY 0
+#endif
+
 namespace base {
 
 enum LogSeverity { LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL };
 
+// Number of warnings or errors written for a LOG() statement. Further
+// messages of the statement are counted but not formatted, and their count is
+// written when the process exits.
+const uint64_t kMaxMessagesPerLogSite = 10;
+
+// A LOG() statement. Keeps track of the number of messages that it produced.
+class LogSite {
+ public:
+  LogSite(LogSeverity severity, const char* file, int line)
+      : severity_(severity), file_(file), line_(line), count_(0) {}
+
+  // @returns true if a new message of this statement must be written.
+  bool ShouldLog() {
+    if (severity_ == LOG_INFO || severity_ == LOG_FATAL)
+      return true;
+    uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+    if (count < kMaxMessagesPerLogSite)
+      return true;
+    if (count == kMaxMessagesPerLogSite)
+      OnFirstSuppressedMessage();
+    return false;
+  }
+
+  LogSeverity severity() const { return severity_; }
+  const char* file() const { return file_; }
+  int line() const { return line_; }
+
+  // @returns the number of messages that were not written.
+  uint64_t suppressed_count() const {
+    uint64_t count = count_.load(std::memory_order_relaxed);
+    return count > kMaxMessagesPerLogSite ? count - kMaxMessagesPerLogSite : 0;
+  }
+
+ private:
+  // Registers the site, so that its suppressed count is written at exit.
+  void OnFirstSuppressedMessage();
+
+  const LogSeverity severity_;
+  const char* const file_;
+  const int line_;
+
+  // Number of messages produced, including the suppressed ones.
+  std::atomic<uint64_t> count_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogSite);
+};
+
+// Formats a message. Informational messages are queued for a background
+// thread that writes them to the console. Warnings, errors and fatal messages
+// are written immediately, after the queued messages, and fatal messages
+// terminate the process.
 class LogMessage {
  public:
   LogMessage(LogSeverity severity, const char* file, int line)
@@ -43,8 +102,37 @@ class LogMessage {
   DISALLOW_COPY_AND_ASSIGN(LogMessage);
 };
 
-#define LOG(severity) \
-  base::LogMessage(base::LOG_##severity, __FILE__, __LINE__).stream()
+// Turns the stream expression of LOG() into void, so that it can be used in a
+// conditional expression.
+class LogMessageVoidify {
+ public:
+  LogMessageVoidify() {}
+  void operator&(std::ostream&) {}
+};
+
+// Waits until all the queued messages have been written. Call it before
+// writing directly to the console, so that the messages logged before appear
+// before the output.
+void FlushLogs();
+
+#define LOG_IS_ON(severity) (base::LOG_##severity >= LOG_MIN_SEVERITY)
+
+// The LogSite of the current statement.
+#define LOG_SITE(severity)                                      \
+  ([]() -> base::LogSite* {                                     \
+    static base::LogSite site(base::LOG_##severity, __FILE__,   \
+                              __LINE__);                        \
+    return &site;                                               \
+  }())
+
+// The message is only formatted if it is written: the stream arguments aren't
+// evaluated for a message that is disabled or suppressed.
+#define LOG(severity)                                                   \
+  !(LOG_IS_ON(severity) && LOG_SITE(severity)->ShouldLog())             \
+      ? (void)0                                                         \
+      : base::LogMessageVoidify() &                                     \
+            base::LogMessage(base::LOG_##severity, __FILE__, __LINE__)  \
+                .stream()
 
 #ifndef NDEBUG
 #define DCHECK(cond) \
@@ -0,0 +1,88 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "base/memory_mapped_file.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace base {
+
+MemoryMappedFile::MemoryMappedFile()
+    : file_handle_(INVALID_HANDLE_VALUE),
+      mapping_handle_(NULL),
+      data_(nullptr),
+      size_(0) {}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  Close();
+}
+
+bool MemoryMappedFile::Open(const std::wstring& path) {
+  DCHECK(data_ == nullptr);
+
+  file_handle_ = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                               NULL);
+  if (file_handle_ == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER file_size;
+  if (!::GetFileSizeEx(file_handle_, &file_size) || file_size.QuadPart == 0 ||
+      static_cast<uint64_t>(file_size.QuadPart) >
+          static_cast<uint64_t>(SIZE_MAX)) {
+    Close();
+    return false;
+  }
+
+  mapping_handle_ =
+      ::CreateFileMappingW(file_handle_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_handle_ == NULL) {
+    LOG(ERROR) << "Unable to map " << WStringToString(path) << " in memory.";
+    Close();
+    return false;
+  }
+
+  data_ = static_cast<const uint8_t*>(
+      ::MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    LOG(ERROR) << "Unable to map " << WStringToString(path) << " in memory.";
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MemoryMappedFile::Close() {
+  if (data_ != nullptr)
+    ::UnmapViewOfFile(data_);
+  if (mapping_handle_ != NULL)
+    ::CloseHandle(mapping_handle_);
+  if (file_handle_ != INVALID_HANDLE_VALUE)
+    ::CloseHandle(file_handle_);
+
+  file_handle_ = INVALID_HANDLE_VALUE;
+  mapping_handle_ = NULL;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}  // namespace base
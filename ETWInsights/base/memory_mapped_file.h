@@ -0,0 +1,64 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "base/base.h"
+
+namespace base {
+
+// Maps a file in memory, read-only. Typical usage is:
+//   MemoryMappedFile file;
+//   if (file.Open(L"input.bin"))
+//     Parse(file.data(), file.size());
+class MemoryMappedFile {
+ public:
+  MemoryMappedFile();
+  // Unmaps the file if it is still mapped.
+  ~MemoryMappedFile();
+
+  // Maps a file in memory.
+  // @param path path of the file to map.
+  // @returns true if the file was mapped successfully. Empty files can't be
+  //    mapped.
+  bool Open(const std::wstring& path);
+
+  // Unmaps the file.
+  void Close();
+
+  // @returns the content of the file, or nullptr if no file is mapped.
+  const uint8_t* data() const { return data_; }
+
+  // @returns the size of the file, in bytes.
+  size_t size() const { return size_; }
+
+ private:
+  // Handles of the file and of the file mapping.
+  void* file_handle_;
+  void* mapping_handle_;
+
+  // Content of the file.
+  const uint8_t* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
+};
+
+}  // namespace base
@@ -0,0 +1,67 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/protobuf_encoder.h"
+
+namespace base {
+
+namespace {
+
+void AppendVarintTo(uint64_t value, std::string* str) {
+  while (value >= 0x80) {
+    str->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  str->push_back(static_cast<char>(value));
+}
+
+}  // namespace
+
+ProtobufEncoder::ProtobufEncoder() {}
+
+void ProtobufEncoder::WriteVarint(uint32_t field_number, uint64_t value) {
+  AppendTag(field_number, WIRE_TYPE_VARINT);
+  AppendVarint(value);
+}
+
+void ProtobufEncoder::WriteBytes(uint32_t field_number,
+                                 const char* data,
+                                 size_t size) {
+  AppendTag(field_number, WIRE_TYPE_LENGTH_DELIMITED);
+  AppendVarint(size);
+  data_.append(data, size);
+}
+
+void ProtobufEncoder::WritePackedVarints(uint32_t field_number,
+                                         const std::vector<uint64_t>& values) {
+  if (values.empty())
+    return;
+
+  packed_.clear();
+  for (uint64_t value : values)
+    AppendVarintTo(value, &packed_);
+  WriteBytes(field_number, packed_.data(), packed_.size());
+}
+
+void ProtobufEncoder::AppendVarint(uint64_t value) {
+  AppendVarintTo(value, &data_);
+}
+
+void ProtobufEncoder::AppendTag(uint32_t field_number, WireType wire_type) {
+  AppendVarint((static_cast<uint64_t>(field_number) << 3) | wire_type);
+}
+
+}  // namespace base
@@ -0,0 +1,83 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+// Encodes a protocol buffer message without generated code. Fields are
+// appended to a buffer in the order in which they are written. Nested messages
+// are encoded with their own encoder and written with WriteMessage(). Typical
+// usage is:
+//   ProtobufEncoder line;
+//   line.WriteVarint(1, function_id);
+//   ProtobufEncoder location;
+//   location.WriteVarint(1, location_id);
+//   location.WriteMessage(4, line);
+class ProtobufEncoder {
+ public:
+  ProtobufEncoder();
+
+  // Writes a varint field (int32, int64, uint32, uint64, bool, enum).
+  void WriteVarint(uint32_t field_number, uint64_t value);
+
+  // Writes a length-delimited field.
+  void WriteBytes(uint32_t field_number, const char* data, size_t size);
+  void WriteString(uint32_t field_number, const std::string& value) {
+    WriteBytes(field_number, value.data(), value.size());
+  }
+
+  // Writes a nested message.
+  void WriteMessage(uint32_t field_number, const ProtobufEncoder& message) {
+    WriteString(field_number, message.data());
+  }
+
+  // Writes a packed repeated varint field.
+  void WritePackedVarints(uint32_t field_number,
+                          const std::vector<uint64_t>& values);
+
+  // @returns the encoded message.
+  const std::string& data() const { return data_; }
+
+  // Removes all the fields of the message.
+  void Clear() { data_.clear(); }
+
+ private:
+  // Protocol buffer wire types.
+  enum WireType {
+    WIRE_TYPE_VARINT = 0,
+    WIRE_TYPE_LENGTH_DELIMITED = 2,
+  };
+
+  void AppendVarint(uint64_t value);
+  void AppendTag(uint32_t field_number, WireType wire_type);
+
+  // Encoded message.
+  std::string data_;
+
+  // Reusable buffer for packed fields.
+  std::string packed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProtobufEncoder);
+};
+
+}  // namespace base
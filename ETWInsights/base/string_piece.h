@@ -0,0 +1,84 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string.h>
+#include <string>
+
+namespace base {
+
+// A non-owning view of a sequence of characters. The viewed characters must
+// outlive the StringPiece.
+class StringPiece {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  StringPiece() : data_(nullptr), size_(0) {}
+  StringPiece(const char* data, size_t size) : data_(data), size_(size) {}
+  StringPiece(const char* str) : data_(str), size_(strlen(str)) {}
+  StringPiece(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+
+  char operator[](size_t i) const { return data_[i]; }
+
+  // @returns the view of |count| characters starting at |pos|, or of the
+  //    characters until the end if there are less than |count| of them.
+  StringPiece substr(size_t pos, size_t count = npos) const {
+    if (pos > size_)
+      pos = size_;
+    if (count > size_ - pos)
+      count = size_ - pos;
+    return StringPiece(data_ + pos, count);
+  }
+
+  // @returns the position of the first occurrence of |c|, or npos.
+  size_t find(char c) const {
+    if (size_ == 0)
+      return npos;
+    const void* found = memchr(data_, c, size_);
+    if (found == nullptr)
+      return npos;
+    return static_cast<const char*>(found) - data_;
+  }
+
+  // @returns a copy of the viewed characters.
+  std::string as_string() const { return std::string(data_, size_); }
+
+  // Replaces the content of |str| with the viewed characters.
+  void CopyToString(std::string* str) const { str->assign(data_, size_); }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+inline bool operator==(const StringPiece& a, const StringPiece& b) {
+  return a.size() == b.size() &&
+         (a.size() == 0 || memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+inline bool operator!=(const StringPiece& a, const StringPiece& b) {
+  return !(a == b);
+}
+
+}  // namespace base
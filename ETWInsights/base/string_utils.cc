@@ -16,11 +16,14 @@ limitations under the License.
 
 #include "base/string_utils.h"
 
+#include <string.h>
 #include <algorithm>
 #include <cctype>
 #include <functional>
 #include <sstream>
 
+#include "base/logging.h"
+
 namespace base {
 
 namespace {
@@ -179,9 +182,158 @@ std::string StringEscapeSpecialCharacter(const std::string& str) {
   return ss.str();
 }
 
+std::string QuoteCsvField(const std::string& str) {
+  if (str.find_first_of(",\"\n") == std::string::npos)
+    return str;
+
+  std::string quoted("\"");
+  for (char c : str) {
+    if (c == '"')
+      quoted.push_back('"');
+    quoted.push_back(c);
+  }
+  quoted.push_back('"');
+  return quoted;
+}
+
+std::string Unquote(const std::string& str) {
+  if (str.size() >= 2 && str.front() == '"' && str.back() == '"')
+    return str.substr(1, str.size() - 2);
+  return str;
+}
+
+std::string QuoteJsonString(const std::string& str) {
+  static const char kHexDigits[] = "0123456789abcdef";
+
+  std::string quoted("\"");
+  for (char c : str) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    if (byte >= 0x20 && byte < 0x80 && c != '"' && c != '\\') {
+      quoted.push_back(c);
+    } else if (c == '"' || c == '\\') {
+      quoted.push_back('\\');
+      quoted.push_back(c);
+    } else {
+      quoted += "\\u00";
+      quoted.push_back(kHexDigits[byte >> 4]);
+      quoted.push_back(kHexDigits[byte & 0xF]);
+    }
+  }
+  quoted.push_back('"');
+  return quoted;
+}
+
+std::string QuoteCsvOrJsonString(const std::string& str, bool json) {
+  return json ? QuoteJsonString(str) : QuoteCsvField(str);
+}
+
 std::vector<std::string> SplitString(const std::string& str,
                                      const std::string& separator) {
-  return SplitStringInternal(str, separator);
+  std::vector<StringPiece> pieces;
+  SplitView(str, separator, &pieces);
+
+  std::vector<std::string> res;
+  res.reserve(pieces.size());
+  for (const StringPiece& piece : pieces)
+    res.push_back(piece.as_string());
+  return res;
+}
+
+void SplitView(StringPiece str,
+               char separator,
+               std::vector<StringPiece>* pieces) {
+  DCHECK(pieces != nullptr);
+  pieces->clear();
+
+  const char* start = str.begin();
+  const char* end = str.end();
+  while (start < end) {
+    const char* found = static_cast<const char*>(
+        memchr(start, separator, static_cast<size_t>(end - start)));
+    if (found == nullptr)
+      found = end;
+    pieces->push_back(StringPiece(start, static_cast<size_t>(found - start)));
+    start = found + 1;
+  }
+}
+
+void SplitView(StringPiece str,
+               StringPiece separator,
+               std::vector<StringPiece>* pieces) {
+  DCHECK(pieces != nullptr);
+  DCHECK(!separator.empty());
+  if (separator.size() == 1) {
+    SplitView(str, separator[0], pieces);
+    return;
+  }
+  pieces->clear();
+
+  // Look for the first character of the separator with memchr, and compare
+  // the other characters only where it is found.
+  const char* start = str.begin();
+  const char* end = str.end();
+  while (start < end) {
+    const char* found = start;
+    for (;;) {
+      found = static_cast<const char*>(
+          memchr(found, separator[0], static_cast<size_t>(end - found)));
+      if (found == nullptr ||
+          (static_cast<size_t>(end - found) >= separator.size() &&
+           memcmp(found + 1, separator.data() + 1, separator.size() - 1) ==
+               0)) {
+        break;
+      }
+      ++found;
+    }
+    if (found == nullptr) {
+      pieces->push_back(StringPiece(start, static_cast<size_t>(end - start)));
+      break;
+    }
+    pieces->push_back(StringPiece(start, static_cast<size_t>(found - start)));
+    start = found + separator.size();
+  }
+}
+
+void SplitCsvLine(StringPiece line, std::vector<std::string>* fields) {
+  DCHECK(fields != nullptr);
+  size_t num_fields = 0;
+  size_t i = 0;
+  for (;;) {
+    if (num_fields == fields->size())
+      fields->emplace_back();
+    std::string& field = (*fields)[num_fields++];
+    field.clear();
+
+    if (i < line.size() && line[i] == '"') {
+      // Quoted field: read until the quote that isn't doubled.
+      ++i;
+      while (i < line.size()) {
+        if (line[i] == '"') {
+          if (i + 1 < line.size() && line[i + 1] == '"') {
+            field.push_back('"');
+            i += 2;
+            continue;
+          }
+          ++i;
+          break;
+        }
+        field.push_back(line[i++]);
+      }
+      // Ignore the characters between the closing quote and the comma.
+      while (i < line.size() && line[i] != ',')
+        ++i;
+    } else {
+      size_t comma = line.substr(i).find(',');
+      size_t end = comma == StringPiece::npos ? line.size() : i + comma;
+      field.assign(line.data() + i, end - i);
+      i = end;
+    }
+
+    if (i >= line.size())
+      break;
+    ++i;  // Skip the comma.
+  }
+  fields->resize(num_fields);
 }
 
 std::vector<std::wstring> SplitWString(const std::wstring& str,
@@ -197,6 +349,19 @@ std::wstring TrimW(const std::wstring& str) {
   return TrimInternal(str);
 }
 
+StringPiece TrimView(StringPiece str) {
+  // Same characters as isspace() in the "C" locale, without a function call
+  // per character.
+  auto is_space = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
+  const char* first = str.begin();
+  const char* last = str.end();
+  while (first < last && is_space(*first))
+    ++first;
+  while (last > first && is_space(*(last - 1)))
+    --last;
+  return StringPiece(first, static_cast<size_t>(last - first));
+}
+
 void ReplaceAll(const std::string& search,
                 const std::string& replace,
                 std::string* str) {
@@ -19,6 +19,8 @@ limitations under the License.
 #include <string>
 #include <vector>
 
+#include "base/string_piece.h"
+
 namespace base {
 
 // Convert between ASCII and Unicode strings.
@@ -44,16 +46,67 @@ bool WStringEndsWith(const std::wstring& str, const std::wstring& ending);
 // @returns a string escaped copy of |str|.
 std::string StringEscapeSpecialCharacter(const std::string& str);
 
+// Quotes |str| so that it can be used as a CSV field, if it contains a comma,
+// a quote or a new line.
+// @param str the field value.
+// @returns |str| or a quoted copy of |str|.
+std::string QuoteCsvField(const std::string& str);
+
+// Quotes |str| as a JSON string. Quotes, backslashes and control characters
+// are escaped, and bytes outside of the ASCII range are written as Latin-1
+// characters, so that the result is always valid JSON.
+// @param str the string to quote.
+// @returns the JSON string, with its quotes.
+std::string QuoteJsonString(const std::string& str);
+
+// Quotes |str| with QuoteJsonString() if |json| is true, or with
+// QuoteCsvField() otherwise.
+// @param str the string to quote.
+// @param json whether |str| is written in a JSON document.
+// @returns the quoted string.
+std::string QuoteCsvOrJsonString(const std::string& str, bool json);
+
+// Removes the quotes around |str|, like those of the string fields of xperf
+// events.
+// @returns |str| without its quotes, or |str| if it isn't quoted.
+std::string Unquote(const std::string& str);
+
 // Splits |str| at each occurrence of |separator|.
 std::vector<std::string> SplitString(const std::string& str,
                                      const std::string& separator);
 std::vector<std::wstring> SplitWString(const std::wstring& str,
                                        const std::wstring& separator);
 
+// Splits |str| at each occurrence of |separator|, like SplitString(), without
+// copying the pieces.
+// @param str the string to split.
+// @param separator the separator. Must not be empty.
+// @param pieces receives views of |str|. It is cleared first: reusing the same
+//    vector for many calls avoids allocating memory.
+void SplitView(StringPiece str,
+               char separator,
+               std::vector<StringPiece>* pieces);
+void SplitView(StringPiece str,
+               StringPiece separator,
+               std::vector<StringPiece>* pieces);
+
+// Splits a CSV line into its fields. The quotes around quoted fields are
+// removed and the doubled quotes inside them are unescaped. Quoted fields
+// can't span several lines.
+// @param line the line to split, without its end of line.
+// @param fields receives the fields. Its strings are reused, to avoid
+//    allocating memory when the same vector is used for many lines.
+void SplitCsvLine(StringPiece line, std::vector<std::string>* fields);
+
 // Removes spaces at the beginning and end of |str|.
 std::string Trim(const std::string& str);
 std::wstring TrimW(const std::wstring& str);
 
+// Removes spaces at the beginning and end of |str|, like Trim(), without
+// copying.
+// @returns a view of |str|.
+StringPiece TrimView(StringPiece str);
+
 // Replaces all occurrences of |search| in |str| by |replace|.
 void ReplaceAll(const std::string& search,
                 const std::string& replace,
@@ -0,0 +1,119 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/suffix_matcher.h"
+
+#include <queue>
+
+#include "base/logging.h"
+
+namespace base {
+
+namespace {
+
+// Index of the initial state of the automaton.
+const uint32_t kRootState = 0;
+
+}  // namespace
+
+SuffixMatcher::SuffixMatcher() : is_compiled_(false) {}
+
+size_t SuffixMatcher::AddPattern(const std::string& pattern) {
+  patterns_.push_back(pattern);
+  is_compiled_ = false;
+  return patterns_.size() - 1;
+}
+
+void SuffixMatcher::Clear() {
+  patterns_.clear();
+  transitions_.clear();
+  outputs_.clear();
+  is_compiled_ = false;
+}
+
+void SuffixMatcher::Compile() {
+  transitions_.assign(kAlphabetSize, kRootState);
+  outputs_.assign(1, std::vector<size_t>());
+
+  // Build a trie of the patterns. While the trie is being built, a transition
+  // to the root state means that there is no transition.
+  for (size_t pattern_index = 0; pattern_index < patterns_.size();
+       ++pattern_index) {
+    StateIndex state = kRootState;
+    for (unsigned char c : patterns_[pattern_index]) {
+      StateIndex& next = transitions_[state * kAlphabetSize + c];
+      if (next == kRootState) {
+        next = static_cast<StateIndex>(outputs_.size());
+        outputs_.push_back(std::vector<size_t>());
+        transitions_.resize(transitions_.size() + kAlphabetSize, kRootState);
+      }
+      state = transitions_[state * kAlphabetSize + c];
+    }
+    outputs_[state].push_back(pattern_index);
+  }
+
+  // Compute the failure links in breadth-first order and turn the trie into a
+  // complete transition table. Missing transitions of a state are those of
+  // its failure state, and the outputs of the failure state are appended to
+  // those of the state.
+  std::vector<StateIndex> failure(outputs_.size(), kRootState);
+  std::queue<StateIndex> queue;
+  for (size_t c = 0; c < kAlphabetSize; ++c) {
+    StateIndex child = transitions_[kRootState * kAlphabetSize + c];
+    if (child == kRootState)
+      continue;
+    failure[child] = kRootState;
+    queue.push(child);
+  }
+
+  while (!queue.empty()) {
+    StateIndex state = queue.front();
+    queue.pop();
+
+    const std::vector<size_t>& failure_outputs = outputs_[failure[state]];
+    outputs_[state].insert(outputs_[state].end(), failure_outputs.begin(),
+                           failure_outputs.end());
+
+    for (size_t c = 0; c < kAlphabetSize; ++c) {
+      StateIndex& next = transitions_[state * kAlphabetSize + c];
+      StateIndex failure_next = transitions_[failure[state] * kAlphabetSize + c];
+      if (next == kRootState) {
+        next = failure_next;
+      } else {
+        failure[next] = failure_next;
+        queue.push(next);
+      }
+    }
+  }
+
+  is_compiled_ = true;
+}
+
+void SuffixMatcher::MatchSuffixes(const std::string& str,
+                                  std::vector<size_t>* matches) const {
+  DCHECK(matches != nullptr);
+  DCHECK(is_compiled_);
+
+  StateIndex state = kRootState;
+  for (unsigned char c : str)
+    state = transitions_[state * kAlphabetSize + c];
+
+  // The outputs of the final state are the patterns that end at the last
+  // character of |str|.
+  *matches = outputs_[state];
+}
+
+}  // namespace base
@@ -0,0 +1,84 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+// Finds which patterns of a set a string ends with. The patterns are compiled
+// into an Aho-Corasick automaton, so that a string is matched against all the
+// patterns in a single pass over its characters. Typical usage is:
+//   SuffixMatcher matcher;
+//   matcher.AddPattern("Wait");
+//   matcher.AddPattern("TimedWait");
+//   matcher.Compile();
+//   matcher.MatchSuffixes("base::WaitableEvent::TimedWait", &matches);
+class SuffixMatcher {
+ public:
+  SuffixMatcher();
+
+  // Adds a pattern to the matcher. Invalidates the compiled automaton.
+  // @param pattern the pattern to add.
+  // @returns the index of the pattern.
+  size_t AddPattern(const std::string& pattern);
+
+  // Removes all the patterns.
+  void Clear();
+
+  // Compiles the patterns into an automaton. Must be called after the last
+  // pattern is added and before MatchSuffixes().
+  void Compile();
+
+  // Finds the patterns that |str| ends with.
+  // @param str the string to match.
+  // @param matches receives the indexes of the patterns that |str| ends with.
+  void MatchSuffixes(const std::string& str, std::vector<size_t>* matches) const;
+
+  // @returns the number of patterns added to the matcher.
+  size_t num_patterns() const { return patterns_.size(); }
+
+  // @returns true if the automaton is up to date with the patterns.
+  bool is_compiled() const { return is_compiled_; }
+
+ private:
+  typedef uint32_t StateIndex;
+
+  // Number of possible values for a character.
+  static const size_t kAlphabetSize = 256;
+
+  // Patterns added to the matcher.
+  std::vector<std::string> patterns_;
+
+  // Transition table of the automaton. The transition from state |s| with
+  // character |c| is at index |s * kAlphabetSize + c|.
+  std::vector<StateIndex> transitions_;
+
+  // Indexes of the patterns that end at each state.
+  std::vector<std::vector<size_t>> outputs_;
+
+  // Whether the automaton is up to date with the patterns.
+  bool is_compiled_;
+
+  DISALLOW_COPY_AND_ASSIGN(SuffixMatcher);
+};
+
+}  // namespace base
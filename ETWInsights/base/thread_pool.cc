@@ -0,0 +1,252 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "base/thread_pool.h"
+
+#include <chrono>
+
+#include "base/logging.h"
+
+namespace base {
+
+namespace {
+
+// Maximum time during which a thread that waits for a TaskGroup sleeps before
+// it looks for tasks to run again. Tasks pushed while it sleeps don't wake it
+// up.
+const std::chrono::milliseconds kMaxWaitSleep(1);
+
+// Pool and index of the worker that runs on the current thread.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : num_queued_tasks_(0), stop_(false) {
+  if (num_threads == 0)
+    num_threads = GetDefaultNumThreads();
+
+  // The thread that waits for the tasks is the last thread of the pool.
+  for (size_t i = 0; i + 1 < num_threads; ++i)
+    workers_.emplace_back(new Worker);
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->thread = std::thread(&ThreadPool::WorkerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_up_.notify_all();
+  for (auto& worker : workers_)
+    worker->thread.join();
+
+  // Without worker threads, tasks only run while a TaskGroup is waited for.
+  while (RunOneTask()) {
+  }
+}
+
+size_t ThreadPool::GetDefaultNumThreads() {
+  size_t num_threads = std::thread::hardware_concurrency();
+  return num_threads == 0 ? 1 : num_threads;
+}
+
+void ThreadPool::Push(Task task) {
+  size_t worker_index = GetCurrentWorkerIndex();
+  {
+    // The count is incremented before the task is queued, so that it never
+    // underflows. A worker that is woken up before the task is queued retries.
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_queued_tasks_;
+    if (worker_index == workers_.size())
+      shared_tasks_.push_back(std::move(task));
+  }
+  if (worker_index < workers_.size()) {
+    Worker& worker = *workers_[worker_index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+  wake_up_.notify_one();
+}
+
+bool ThreadPool::TakeTask(size_t worker_index, Task* task) {
+  DCHECK(task != nullptr);
+  if (num_queued_tasks_.load(std::memory_order_acquire) == 0)
+    return false;
+
+  bool found = false;
+
+  // Most recent task of the current worker, whose data is likely in its cache.
+  if (worker_index < workers_.size()) {
+    Worker& worker = *workers_[worker_index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty()) {
+      *task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      found = true;
+    }
+  }
+
+  // Oldest task pushed by a thread that isn't a worker.
+  if (!found) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!shared_tasks_.empty()) {
+      *task = std::move(shared_tasks_.front());
+      shared_tasks_.pop_front();
+      found = true;
+    }
+  }
+
+  // Oldest task of another worker, which is likely the largest piece of work.
+  for (size_t i = 1; !found && i <= workers_.size(); ++i) {
+    Worker& victim = *workers_[(worker_index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      found = true;
+    }
+  }
+
+  if (found)
+    num_queued_tasks_.fetch_sub(1, std::memory_order_acq_rel);
+  return found;
+}
+
+bool ThreadPool::RunOneTask() {
+  Task task;
+  if (!TakeTask(GetCurrentWorkerIndex(), &task))
+    return false;
+  RunTask(&task);
+  return true;
+}
+
+// static
+void ThreadPool::RunTask(Task* task) {
+  if (!task->group->is_canceled())
+    task->function();
+  task->group->OnTaskDone();
+}
+
+void ThreadPool::WorkerMain(size_t worker_index) {
+  current_pool = this;
+  current_worker_index = worker_index;
+
+  for (;;) {
+    Task task;
+    if (TakeTask(worker_index, &task)) {
+      RunTask(&task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_ && num_queued_tasks_ == 0)
+      return;
+    wake_up_.wait(lock, [this] { return stop_ || num_queued_tasks_ > 0; });
+  }
+}
+
+size_t ThreadPool::GetCurrentWorkerIndex() const {
+  if (current_pool != this)
+    return workers_.size();
+  return current_worker_index;
+}
+
+TaskGroup::TaskGroup(ThreadPool* pool)
+    : pool_(pool), canceled_(false), num_pending_tasks_(0) {
+  DCHECK(pool != nullptr);
+}
+
+TaskGroup::~TaskGroup() {
+  Wait();
+}
+
+void TaskGroup::Run(std::function<void()> function) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_pending_tasks_;
+  }
+  ThreadPool::Task task;
+  task.function = std::move(function);
+  task.group = this;
+  pool_->Push(std::move(task));
+}
+
+void TaskGroup::Wait() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (num_pending_tasks_ == 0)
+        return;
+    }
+
+    // Help instead of blocking, so that nested groups can't deadlock.
+    if (pool_->RunOneTask())
+      continue;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait_for(lock, kMaxWaitSleep,
+                   [this] { return num_pending_tasks_ == 0; });
+  }
+}
+
+void TaskGroup::OnTaskDone() {
+  // The group may be destroyed as soon as the count reaches 0 and the mutex
+  // is released: don't touch it after that.
+  std::lock_guard<std::mutex> lock(mutex_);
+  DCHECK_GT(num_pending_tasks_, 0U);
+  if (--num_pending_tasks_ == 0)
+    done_.notify_all();
+}
+
+void ParallelFor(ThreadPool* pool,
+                 size_t begin,
+                 size_t end,
+                 size_t grain_size,
+                 const std::function<void(size_t index)>& function,
+                 TaskGroup* group) {
+  DCHECK(pool != nullptr);
+  if (begin >= end)
+    return;
+  if (grain_size == 0)
+    grain_size = 1;
+
+  TaskGroup local_group(pool);
+  if (group == nullptr)
+    group = &local_group;
+
+  // Keeps the first half of a range and queues the second half, until the
+  // range is small enough to be processed.
+  std::function<void(size_t, size_t)> run_range = [&](size_t range_begin,
+                                                       size_t range_end) {
+    while (range_end - range_begin > grain_size && !group->is_canceled()) {
+      size_t middle = range_begin + (range_end - range_begin) / 2;
+      group->Run([&run_range, middle, range_end] {
+        run_range(middle, range_end);
+      });
+      range_end = middle;
+    }
+    for (size_t i = range_begin; i < range_end && !group->is_canceled(); ++i)
+      function(i);
+  };
+
+  run_range(begin, end);
+  group->Wait();
+}
+
+}  // namespace base
@@ -0,0 +1,180 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+
+namespace base {
+
+class TaskGroup;
+
+// Runs tasks on a fixed set of worker threads, with work stealing: each worker
+// has a deque of tasks, runs the tasks it pushed itself most recent first, and
+// takes the oldest task of another worker when its own deque is empty. Tasks
+// pushed by other threads go to a shared queue.
+//
+// Tasks are submitted through a TaskGroup. A thread that waits for a group
+// runs tasks while it waits, so a pool created with |num_threads| == 1 has no
+// worker thread and runs all the tasks on the waiting thread.
+class ThreadPool {
+ public:
+  // @param num_threads number of threads that run tasks, including the thread
+  //    that waits for them. 0 for GetDefaultNumThreads().
+  explicit ThreadPool(size_t num_threads = 0);
+
+  // Waits for the queued tasks to complete.
+  ~ThreadPool();
+
+  // @returns the number of hardware threads, or 1 if it is unknown.
+  static size_t GetDefaultNumThreads();
+
+  // @returns the number of threads that run tasks, including the thread that
+  //    waits for them.
+  size_t num_threads() const { return workers_.size() + 1; }
+
+ private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> function;
+    TaskGroup* group;
+  };
+
+  struct Worker {
+    // Protects |tasks|.
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  // Queues a task: in the deque of the current thread if it is a worker of
+  // this pool, in the shared queue otherwise.
+  void Push(Task task);
+
+  // Takes a task from the deque of |worker_index| (most recent first), from
+  // the shared queue or from another worker (oldest first).
+  // @param worker_index index of the current worker, or workers_.size() if
+  //    the current thread isn't a worker of this pool.
+  // @returns true if a task was taken.
+  bool TakeTask(size_t worker_index, Task* task);
+
+  // Takes a task and runs it.
+  // @returns true if a task was run.
+  bool RunOneTask();
+
+  // Runs a task and notifies its group.
+  static void RunTask(Task* task);
+
+  void WorkerMain(size_t worker_index);
+
+  // @returns the index of the current thread in |workers_|, or
+  //    workers_.size() if it isn't a worker of this pool.
+  size_t GetCurrentWorkerIndex() const;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Tasks pushed by threads that aren't workers. Protected by |mutex_|.
+  std::deque<Task> shared_tasks_;
+
+  // Number of tasks in all the queues.
+  std::atomic<size_t> num_queued_tasks_;
+
+  // Protects |shared_tasks_| and |stop_|. Held when |num_queued_tasks_| is
+  // incremented, so that a worker can't miss a wake up.
+  std::mutex mutex_;
+  std::condition_variable wake_up_;
+  bool stop_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// A set of tasks that run on a ThreadPool and can be waited for and canceled
+// together. Typical usage is:
+//   TaskGroup group(&pool);
+//   group.Run([] { ... });
+//   group.Run([] { ... });
+//   group.Wait();
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool* pool);
+
+  // Waits for the tasks of the group.
+  ~TaskGroup();
+
+  // Queues a task. It may run on any thread of the pool.
+  void Run(std::function<void()> function);
+
+  // Waits until all the tasks of the group have completed or have been
+  // skipped. The calling thread runs queued tasks while it waits.
+  void Wait();
+
+  // Skips the tasks of the group that haven't started. Running tasks can check
+  // is_canceled() to stop early.
+  void Cancel() { canceled_.store(true, std::memory_order_relaxed); }
+  bool is_canceled() const {
+    return canceled_.load(std::memory_order_relaxed);
+  }
+
+  ThreadPool* pool() const { return pool_; }
+
+ private:
+  friend class ThreadPool;
+
+  // Called when a task of the group has completed or has been skipped.
+  void OnTaskDone();
+
+  ThreadPool* pool_;
+
+  std::atomic<bool> canceled_;
+
+  // Protects |num_pending_tasks_|.
+  std::mutex mutex_;
+
+  // Number of tasks that haven't completed.
+  size_t num_pending_tasks_;
+
+  // Signaled when the last pending task completes.
+  std::condition_variable done_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskGroup);
+};
+
+// Calls |function| for each index in [begin, end), in parallel on the threads
+// of |pool|. The range is split in halves until the pieces have at most
+// |grain_size| indexes, so that idle threads steal large pieces. Returns when
+// all the indexes have been processed, or, if |group| is canceled, when the
+// pieces that have started have stopped.
+// @param group the group in which the tasks run, or nullptr to use a new one.
+//    All the tasks of |group| are waited for. Canceling it stops the loop.
+void ParallelFor(ThreadPool* pool,
+                 size_t begin,
+                 size_t end,
+                 size_t grain_size,
+                 const std::function<void(size_t index)>& function,
+                 TaskGroup* group = nullptr);
+
+}  // namespace base
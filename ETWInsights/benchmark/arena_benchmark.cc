@@ -0,0 +1,165 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "benchmark/arena_benchmark.h"
+
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/arena.h"
+#include "base/numeric_conversions.h"
+#include "benchmark/benchmark.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/system_history.h"
+#include "etw_reader/thread_history.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default number of call stacks in the trace.
+const uint64_t kDefaultNumStacks = 1000000;
+
+// Number of threads in the trace.
+const size_t kNumThreads = 64;
+
+// Number of distinct symbols in the call stacks.
+const SymbolId kNumSymbols = 4096;
+
+// Minimum and maximum depth of a call stack.
+const size_t kMinStackDepth = 4;
+const size_t kMaxStackDepth = 32;
+
+// Event types recorded for each stack, like the parser does.
+const char* const kEventTypes[] = {"SampledProfile", "CSwitch"};
+const size_t kNumEventTypes =
+    std::end(kEventTypes) - std::begin(kEventTypes);
+
+// Number of bytes in a megabyte.
+const double kBytesPerMegabyte = 1024.0 * 1024.0;
+
+// Last events of a thread (timestamp -> type).
+typedef std::map<
+    base::Timestamp,
+    std::string,
+    std::less<base::Timestamp>,
+    base::ArenaAllocator<std::pair<const base::Timestamp, std::string>>>
+    EventMap;
+
+// Objects built for a synthetic trace.
+struct SyntheticTrace {
+  explicit SyntheticTrace(base::Arena* arena)
+      : threads(0,
+                std::hash<base::Tid>(),
+                std::equal_to<base::Tid>(),
+                SystemHistory::ThreadHistoryMap::allocator_type(arena)) {}
+
+  SystemHistory::ThreadHistoryMap threads;
+  std::vector<EventMap> events;
+};
+
+// Builds a synthetic trace. |arena| is nullptr to use the heap.
+std::unique_ptr<SyntheticTrace> BuildTrace(base::Arena* arena,
+                                           size_t num_stacks) {
+  std::unique_ptr<SyntheticTrace> trace(new SyntheticTrace(arena));
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    trace->threads.emplace(i, ThreadHistory(i));
+    trace->events.emplace_back(std::less<base::Timestamp>(),
+                               EventMap::allocator_type(arena));
+  }
+
+  std::minstd_rand random;
+  std::uniform_int_distribution<size_t> depth_distribution(kMinStackDepth,
+                                                           kMaxStackDepth);
+  std::uniform_int_distribution<SymbolId> symbol_distribution(
+      0, kNumSymbols - 1);
+
+  StackAllocator stack_allocator(arena);
+  for (size_t i = 0; i < num_stacks; ++i) {
+    base::Tid tid = i % kNumThreads;
+    base::Timestamp ts = i;
+
+    Stack stack(stack_allocator);
+    stack.resize(depth_distribution(random));
+    for (SymbolId& symbol : stack)
+      symbol = symbol_distribution(random);
+
+    trace->threads.find(tid)->second.Stacks().Insert(ts, std::move(stack));
+    trace->events[tid][ts] = kEventTypes[i % kNumEventTypes];
+  }
+  return trace;
+}
+
+// Builds and destroys a synthetic trace, with an arena if |use_arena| is true
+// or with the heap otherwise, and prints the results.
+void MeasureAllocator(const std::string& name,
+                      bool use_arena,
+                      size_t num_stacks) {
+  ProcessMemoryUsage usage_before = {};
+  GetProcessMemoryUsage(&usage_before);
+
+  std::unique_ptr<base::Arena> arena;
+  if (use_arena)
+    arena.reset(new base::Arena);
+
+  Stopwatch stopwatch;
+  std::unique_ptr<SyntheticTrace> trace(BuildTrace(arena.get(), num_stacks));
+  double build_seconds = stopwatch.ElapsedSeconds();
+
+  ProcessMemoryUsage usage_after = {};
+  GetProcessMemoryUsage(&usage_after);
+
+  stopwatch.Restart();
+  trace.reset();
+  arena.reset();
+  double teardown_seconds = stopwatch.ElapsedSeconds();
+
+  PrintBenchmarkResult(name + "_build", build_seconds, "s");
+  PrintBenchmarkResult(name + "_teardown", teardown_seconds, "s");
+  PrintBenchmarkResult(
+      name + "_private_bytes",
+      (usage_after.private_bytes - usage_before.private_bytes) /
+          kBytesPerMegabyte,
+      "MB");
+  PrintBenchmarkResult(name + "_peak_working_set",
+                       usage_after.peak_working_set / kBytesPerMegabyte,
+                       "MB");
+}
+
+}  // namespace
+
+bool RunArenaBenchmark(const base::CommandLine& command_line) {
+  uint64_t num_stacks = kDefaultNumStacks;
+  base::StrToULong(command_line.GetSwitchValue(L"stacks"), &num_stacks);
+
+  std::wstring allocator(command_line.GetSwitchValue(L"allocator"));
+
+  // The arena runs first: it returns its blocks to the system when it is
+  // destroyed, while the heap may keep the memory it frees.
+  if (allocator.empty() || allocator == L"arena")
+    MeasureAllocator("arena/arena", true, static_cast<size_t>(num_stacks));
+  if (allocator.empty() || allocator == L"heap")
+    MeasureAllocator("arena/heap", false, static_cast<size_t>(num_stacks));
+
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,36 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Builds the thread histories and per-thread event maps of a synthetic trace
+// with the heap and with a base::Arena, and prints the build time, the
+// teardown time and the memory used by each.
+//
+// The peak working set is cumulative for the process: run each allocator in a
+// separate process with --allocator to compare it.
+//
+// Switches:
+//   --stacks: number of call stacks in the trace. Default: 1000000.
+//   --allocator: only run with the specified allocator, "heap" or "arena".
+//       Default: both.
+bool RunArenaBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
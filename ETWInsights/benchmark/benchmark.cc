@@ -0,0 +1,55 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "benchmark/benchmark.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+
+#include <iomanip>
+#include <iostream>
+
+#include "base/logging.h"
+
+#pragma comment(lib, "psapi.lib")
+
+namespace etw_insights {
+
+bool GetProcessMemoryUsage(ProcessMemoryUsage* usage) {
+  DCHECK(usage != nullptr);
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    LOG(ERROR) << "Unable to read the memory usage of the process.";
+    return false;
+  }
+  usage->private_bytes = counters.PagefileUsage;
+  usage->peak_working_set = counters.PeakWorkingSetSize;
+  return true;
+}
+
+void PrintBenchmarkResult(const std::string& name,
+                          double value,
+                          const std::string& unit) {
+  base::FlushLogs();
+  std::cout << std::left << std::setw(40) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(2) << value
+            << " " << unit << std::endl;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,71 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+#include <string>
+
+#include "base/base.h"
+
+namespace etw_insights {
+
+// Measures elapsed wall-clock time.
+class Stopwatch {
+ public:
+  Stopwatch() { Restart(); }
+
+  // Restarts the measurement.
+  void Restart() { start_ = std::chrono::steady_clock::now(); }
+
+  // @returns the number of seconds elapsed since the last restart.
+  double ElapsedSeconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start_)
+        .count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+
+  DISALLOW_COPY_AND_ASSIGN(Stopwatch);
+};
+
+// Memory usage of the current process.
+struct ProcessMemoryUsage {
+  // Private memory committed by the process, in bytes.
+  size_t private_bytes;
+
+  // Largest working set since the process started, in bytes.
+  size_t peak_working_set;
+};
+
+// Reads the memory usage of the current process.
+// @param usage receives the memory usage.
+// @returns true if the memory usage was read successfully.
+bool GetProcessMemoryUsage(ProcessMemoryUsage* usage);
+
+// Prints the result of a benchmark on the standard output.
+// @param name name of the benchmark.
+// @param value measured value.
+// @param unit unit of |value|.
+void PrintBenchmarkResult(const std::string& name,
+                          double value,
+                          const std::string& unit);
+
+}  // namespace etw_insights
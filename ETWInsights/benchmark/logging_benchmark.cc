@@ -0,0 +1,86 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "benchmark/logging_benchmark.h"
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "benchmark/benchmark.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default number of messages logged.
+const uint64_t kDefaultNumMessages = 1000000;
+
+// Number of nanoseconds in a second.
+const double kNanosecondsPerSecond = 1e9;
+
+// Runs |log_message| |num_messages| times and prints the time per message.
+void MeasureTimePerMessage(const std::string& name,
+                           uint64_t num_messages,
+                           const std::function<void(uint64_t)>& log_message) {
+  Stopwatch stopwatch;
+  for (uint64_t i = 0; i < num_messages; ++i)
+    log_message(i);
+  base::FlushLogs();
+  double elapsed_seconds = stopwatch.ElapsedSeconds();
+
+  PrintBenchmarkResult(
+      name, elapsed_seconds * kNanosecondsPerSecond / num_messages, "ns");
+}
+
+}  // namespace
+
+bool RunLoggingBenchmark(const base::CommandLine& command_line) {
+  uint64_t num_messages = kDefaultNumMessages;
+  base::StrToULong(command_line.GetSwitchValue(L"messages"), &num_messages);
+  if (num_messages == 0)
+    return true;
+
+  // Like an error reported for each malformed event of a trace. Only the first
+  // messages are written.
+  MeasureTimePerMessage("logging/suppressed_error", num_messages,
+                        [](uint64_t i) {
+                          LOG(ERROR) << "Malformed event " << i
+                                     << " (logging benchmark).";
+                        });
+
+  // Empty messages go through the queue and the writer thread without
+  // printing anything.
+  MeasureTimePerMessage("logging/queued_message", num_messages,
+                        [](uint64_t /* i */) { LOG(INFO) << ""; });
+
+  // The work that every LOG() statement used to do before writing the message
+  // synchronously.
+  std::string sink;
+  MeasureTimePerMessage("logging/ostringstream_message", num_messages,
+                        [&](uint64_t i) {
+                          std::ostringstream stream;
+                          stream << "Malformed event " << i
+                                 << " (logging benchmark).";
+                          sink = stream.str();
+                        });
+
+  return true;
+}
+
+}  // namespace etw_insights
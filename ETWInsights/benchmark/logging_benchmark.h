@@ -0,0 +1,32 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Measures the cost, in nanoseconds per message, of a repeated LOG(ERROR)
+// statement whose messages are suppressed, of queuing messages for the
+// background writer, and of formatting a message with std::ostringstream as
+// every LOG() statement used to do.
+//
+// Switches:
+//   --messages: number of messages logged. Default: 1000000.
+bool RunLoggingBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
@@ -0,0 +1,133 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <string>
+
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "benchmark/arena_benchmark.h"
+#include "benchmark/logging_benchmark.h"
+#include "benchmark/pipeline_benchmark.h"
+#include "benchmark/report_writer_benchmark.h"
+#include "benchmark/string_utils_benchmark.h"
+#include "benchmark/thread_pool_benchmark.h"
+
+using namespace etw_insights;
+
+namespace {
+
+// A benchmark that can be selected on the command line. |run| returns false if
+// the benchmark failed, e.g. because a result regressed.
+struct Benchmark {
+  const wchar_t* name;
+  bool (*run)(const base::CommandLine& command_line);
+};
+
+const Benchmark kBenchmarks[] = {
+    {L"report_writer", &RunReportWriterBenchmark},
+    {L"arena", &RunArenaBenchmark},
+    {L"logging", &RunLoggingBenchmark},
+    {L"string_utils", &RunStringUtilsBenchmark},
+    {L"thread_pool", &RunThreadPoolBenchmark},
+    {L"pipeline", &RunPipelineBenchmark},
+};
+
+void ShowUsage() {
+  base::FlushLogs();
+  std::cout << "Usage: benchmark.exe [--benchmark <name>] [options]"
+            << std::endl
+            << std::endl
+            << "Benchmarks:" << std::endl;
+  for (const Benchmark& benchmark : kBenchmarks)
+    std::cout << "  " << base::WStringToString(benchmark.name) << std::endl;
+  std::cout << std::endl
+            << "Options:" << std::endl
+            << "  --benchmark: Only run the specified benchmark. Default: run "
+               "all benchmarks."
+            << std::endl
+            << "  --stacks: Number of call stacks in the report_writer and "
+               "arena benchmarks. Default: 1000000."
+            << std::endl
+            << "  --allocator: Only run the arena benchmark with the "
+               "specified allocator, heap or arena. Default: both."
+            << std::endl
+            << "  --messages: Number of messages in the logging benchmark. "
+               "Default: 1000000."
+            << std::endl
+            << "  --lines: Number of lines in the string_utils benchmark. "
+               "Default: 1000000."
+            << std::endl
+            << "  --jobs: Maximum number of threads in the thread_pool "
+               "benchmark. Default: number of hardware threads."
+            << std::endl
+            << "  --items: Number of items in the thread_pool benchmark. "
+               "Default: 100000."
+            << std::endl
+            << "  --fixture_durations: Comma-separated durations of the "
+               "synthetic traces of the pipeline benchmark (in seconds). "
+               "Default: 1,4."
+            << std::endl
+            << "  --repetitions: Number of times that each stage of the "
+               "pipeline benchmark is run. Default: 3."
+            << std::endl
+            << "  --results: Path of a CSV file in which the results of the "
+               "pipeline benchmark are written."
+            << std::endl
+            << "  --baseline: Path of a CSV file written with --results by a "
+               "previous run. The run fails if a stage regressed."
+            << std::endl
+            << "  --max_regression: Maximum increase of the time of a stage "
+               "over the baseline (in percent). Default: 10."
+            << std::endl
+            << "  --out_dir: Directory in which temporary files are written. "
+               "Default: current directory."
+            << std::endl;
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.HasSwitch(L"help")) {
+    ShowUsage();
+    return 0;
+  }
+
+  std::wstring benchmark_filter(command_line.GetSwitchValue(L"benchmark"));
+
+  bool found = false;
+  bool failed = false;
+  for (const Benchmark& benchmark : kBenchmarks) {
+    if (!benchmark_filter.empty() && benchmark_filter != benchmark.name)
+      continue;
+    found = true;
+    if (!benchmark.run(command_line))
+      failed = true;
+  }
+
+  if (!found) {
+    base::FlushLogs();
+    std::cout << "Unknown benchmark (--benchmark)." << std::endl << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "benchmark/pipeline_benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_piece.h"
+#include "base/string_utils.h"
+#include "benchmark/benchmark.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/event_store.h"
+#include "etw_reader/generate_history_from_trace.h"
+#include "etw_reader/system_history.h"
+#include "flame_graph/clean_stack.h"
+#include "flame_graph/flame_graph.h"
+#include "trace_generator/trace_generator.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default durations of the traces, in seconds.
+const wchar_t kDefaultFixtureDurations[] = L"1,4";
+
+// Default number of times that each stage is run.
+const uint64_t kDefaultRepetitions = 3;
+
+// Default maximum increase of the time of a stage, in percent.
+const uint64_t kDefaultMaxRegression = 10;
+
+// Stages that take less time than this, in seconds, are too noisy to be
+// compared with the baseline.
+const double kMinComparedSeconds = 0.005;
+
+// Prefix of the names of the trace and report files.
+const wchar_t kFixtureFileNamePrefix[] = L"pipeline_benchmark_";
+
+// Suffixes of the files written next to a trace.
+const wchar_t kCsvFileNameSuffix[] = L".csv";
+const wchar_t kReportFileNameSuffix[] = L".flamegraph.txt";
+
+// Number of time slices scanned per thread by the scan_event_store stage.
+const uint64_t kNumScannedSlices = 10;
+
+// Header of the results file.
+const char kResultsHeader[] = "fixture,stage,seconds";
+
+// Fastest time of a stage on a fixture, in seconds.
+struct StageResult {
+  std::string fixture;
+  std::string stage;
+  double seconds;
+};
+
+// Runs |stage| |repetitions| times and appends its fastest time to |results|.
+// |prepare| is run before each run of |stage|, and isn't timed.
+void MeasureStage(const std::string& fixture,
+                  const std::string& stage,
+                  size_t repetitions,
+                  const std::function<void()>& prepare,
+                  const std::function<void()>& run,
+                  std::vector<StageResult>* results) {
+  double best_seconds = 0;
+  for (size_t i = 0; i < repetitions; ++i) {
+    prepare();
+    Stopwatch stopwatch;
+    run();
+    double seconds = stopwatch.ElapsedSeconds();
+    if (i == 0 || seconds < best_seconds)
+      best_seconds = seconds;
+  }
+  results->push_back({fixture, stage, best_seconds});
+  PrintBenchmarkResult("pipeline/" + fixture + "/" + stage,
+                       best_seconds * 1000, "ms");
+}
+
+// Splits every line of a CSV file into trimmed tokens, like ETWReader.
+// @returns the number of non-empty tokens.
+size_t TokenizeCsv(const std::wstring& csv_path) {
+  std::ifstream file(csv_path);
+  std::string line;
+  std::vector<base::StringPiece> tokens;
+  size_t num_tokens = 0;
+  while (std::getline(file, line)) {
+    base::SplitView(line, ',', &tokens);
+    for (base::StringPiece token : tokens) {
+      if (!base::TrimView(token).empty())
+        ++num_tokens;
+    }
+  }
+  return num_tokens;
+}
+
+// Measures all the stages on a trace.
+void MeasureStages(const std::string& fixture,
+                   const std::wstring& trace_path,
+                   size_t repetitions,
+                   std::vector<StageResult>* results) {
+  // The results of the stages are accumulated here, so that the work can't be
+  // optimized away.
+  size_t checksum = 0;
+  auto no_preparation = [] {};
+
+  MeasureStage(fixture, "tokenize", repetitions, no_preparation, [&] {
+    checksum += TokenizeCsv(trace_path + kCsvFileNameSuffix);
+  }, results);
+
+  // Opening the trace parses the header and reads the first event.
+  MeasureStage(fixture, "header", repetitions, no_preparation, [&] {
+    ETWReader reader;
+    if (reader.Open(trace_path))
+      checksum += (reader.begin() != reader.end()) ? 1 : 0;
+  }, results);
+
+  MeasureStage(fixture, "read_events", repetitions, no_preparation, [&] {
+    ETWReader reader;
+    if (!reader.Open(trace_path))
+      return;
+    for (auto it = reader.begin(); it != reader.end(); ++it)
+      checksum += it->type().size();
+  }, results);
+
+  // The store of the last run is scanned by the next stage.
+  std::unique_ptr<EventStore> event_store;
+  MeasureStage(fixture, "load_event_store", repetitions,
+               [&] { event_store.reset(new EventStore); },
+               [&] {
+                 if (event_store->Load(trace_path, EventFilter()))
+                   checksum += event_store->num_events();
+               },
+               results);
+
+  MeasureStage(fixture, "scan_event_store", repetitions, no_preparation, [&] {
+    for (const std::string& type : event_store->GetTypes()) {
+      const EventTable* table = event_store->GetTable(type);
+      if (table->num_rows() == 0)
+        continue;
+      base::Timestamp start_ts = table->GetTimestamp(0);
+      base::Timestamp end_ts = table->GetTimestamp(
+          static_cast<RowIndex>(table->num_rows() - 1)) + 1;
+      base::Timestamp slice = (end_ts - start_ts) / kNumScannedSlices + 1;
+      for (base::Tid tid : table->GetThreads()) {
+        for (base::Timestamp ts = start_ts; ts < end_ts; ts += slice) {
+          RowRange rows = table->GetThreadRowsInTimeRange(tid, ts, ts + slice);
+          for (size_t i = 0; i < rows.size(); ++i) {
+            if (table->GetStackId(rows[i]) != kInvalidStackId)
+              ++checksum;
+          }
+        }
+      }
+    }
+  }, results);
+  event_store.reset();
+
+  // The history of the last run is used by the next stages.
+  std::unique_ptr<SystemHistory> system_history;
+  GenerateHistoryOptions history_options;
+  history_options.use_snapshot = false;
+  MeasureStage(fixture, "generate_history", repetitions,
+               [&] { system_history.reset(new SystemHistory); },
+               [&] {
+                 GenerateHistoryFromTrace(trace_path, history_options,
+                                          system_history.get());
+               },
+               results);
+
+  std::unique_ptr<StackCleaner> stack_cleaner;
+  MeasureStage(fixture, "clean_stacks", repetitions,
+               [&] {
+                 stack_cleaner.reset(new StackCleaner);
+                 stack_cleaner->LoadDefaultRules();
+               },
+               [&] {
+                 Stack cleaned_stack;
+                 for (auto thread = system_history->threads_begin();
+                      thread != system_history->threads_end(); ++thread) {
+                   const auto& stacks = thread->second.Stacks();
+                   for (auto it = stacks.IteratorBegin();
+                        it != stacks.IteratorEnd(); ++it) {
+                     stack_cleaner->CleanStack(it->value,
+                                               system_history->symbols(),
+                                               &cleaned_stack);
+                     checksum += cleaned_stack.size();
+                   }
+                 }
+               },
+               results);
+
+  // Each run aggregates the unchanged history in a new flame graph: the
+  // stacks that it copies are allocated on the heap and released with the
+  // flame graph, not in the arena of the history (see base::ArenaAllocator).
+  // So all the runs start from the same memory state.
+  std::unique_ptr<FlameGraph> flame_graph;
+  MeasureStage(fixture, "aggregate", repetitions,
+               [&] {
+                 flame_graph.reset(new FlameGraph(system_history->symbols()));
+               },
+               [&] {
+                 for (auto thread = system_history->threads_begin();
+                      thread != system_history->threads_end(); ++thread) {
+                   flame_graph->AddThreadHistory(
+                       thread->second, system_history->first_event_ts(),
+                       system_history->last_event_ts());
+                 }
+               },
+               results);
+
+  std::wstring report_path(trace_path + kReportFileNameSuffix);
+  MeasureStage(fixture, "write_report", repetitions, no_preparation,
+               [&] { flame_graph->WriteTxtReport(report_path); }, results);
+  _wremove(report_path.c_str());
+
+  if (checksum == 0)
+    LOG(ERROR) << "The trace of fixture " << fixture << " is empty.";
+}
+
+// Writes the results in a CSV file.
+bool WriteResults(const std::vector<StageResult>& results,
+                  const std::wstring& path) {
+  std::ofstream out(path);
+  out << kResultsHeader << std::endl;
+  for (const StageResult& result : results) {
+    out << result.fixture << "," << result.stage << "," << std::fixed
+        << std::setprecision(6) << result.seconds << std::endl;
+  }
+  if (!out) {
+    LOG(ERROR) << "Unable to write the results to "
+               << base::WStringToString(path) << ".";
+    return false;
+  }
+  return true;
+}
+
+// Reads results written by WriteResults().
+// @param results receives the time of each stage, by "<fixture>/<stage>".
+bool ReadResults(const std::wstring& path,
+                 std::map<std::string, double>* results) {
+  std::ifstream in(path);
+  if (!in) {
+    LOG(ERROR) << "Unable to read the baseline "
+               << base::WStringToString(path) << ".";
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line == kResultsHeader)
+      continue;
+    std::vector<std::string> fields(base::SplitString(line, ","));
+    if (fields.size() != 3) {
+      LOG(ERROR) << "Invalid line in the baseline: " << line;
+      return false;
+    }
+    (*results)[fields[0] + "/" + fields[1]] = atof(fields[2].c_str());
+  }
+  return true;
+}
+
+// Compares the results with a baseline.
+// @returns false if a stage regressed by more than |max_regression| percent.
+bool CompareWithBaseline(const std::vector<StageResult>& results,
+                         const std::map<std::string, double>& baseline,
+                         uint64_t max_regression) {
+  bool passed = true;
+  for (const StageResult& result : results) {
+    std::string name(result.fixture + "/" + result.stage);
+    auto look = baseline.find(name);
+    if (look == baseline.end())
+      continue;
+    double baseline_seconds = look->second;
+    if (std::max(result.seconds, baseline_seconds) < kMinComparedSeconds)
+      continue;
+
+    double change = baseline_seconds == 0
+                        ? 100.0
+                        : 100.0 * (result.seconds - baseline_seconds) /
+                              baseline_seconds;
+    if (change > max_regression) {
+      base::FlushLogs();
+      std::cout << "REGRESSION pipeline/" << name << ": " << std::fixed
+                << std::setprecision(3) << baseline_seconds << " s -> "
+                << result.seconds << " s (+" << std::setprecision(1) << change
+                << "%, max " << max_regression << "%)" << std::endl;
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+}  // namespace
+
+bool RunPipelineBenchmark(const base::CommandLine& command_line) {
+  std::wstring durations_str(command_line.GetSwitchValue(L"fixture_durations"));
+  if (durations_str.empty())
+    durations_str = kDefaultFixtureDurations;
+  std::vector<uint64_t> durations;
+  for (const std::wstring& duration_str :
+       base::SplitWString(durations_str, L",")) {
+    uint64_t duration = 0;
+    if (!base::StrToULong(base::TrimW(duration_str), &duration) ||
+        duration == 0) {
+      LOG(ERROR) << "Invalid fixture duration (--fixture_durations).";
+      return false;
+    }
+    durations.push_back(duration);
+  }
+
+  uint64_t repetitions = kDefaultRepetitions;
+  std::wstring repetitions_str(command_line.GetSwitchValue(L"repetitions"));
+  if (!repetitions_str.empty() &&
+      (!base::StrToULong(repetitions_str, &repetitions) || repetitions == 0)) {
+    LOG(ERROR) << "Invalid number of repetitions (--repetitions).";
+    return false;
+  }
+
+  uint64_t max_regression = kDefaultMaxRegression;
+  std::wstring max_regression_str(
+      command_line.GetSwitchValue(L"max_regression"));
+  if (!max_regression_str.empty() &&
+      !base::StrToULong(max_regression_str, &max_regression)) {
+    LOG(ERROR) << "Invalid maximum regression (--max_regression).";
+    return false;
+  }
+
+  std::wstring path_prefix(command_line.GetSwitchValue(L"out_dir"));
+  if (!path_prefix.empty())
+    path_prefix += L"\\";
+  path_prefix += kFixtureFileNamePrefix;
+
+  std::vector<StageResult> results;
+  for (uint64_t duration : durations) {
+    std::string fixture(std::to_string(duration) + "s");
+    std::wstring trace_path(path_prefix + base::StringToWString(fixture) +
+                            L".etl");
+
+    TraceGeneratorOptions trace_options;
+    trace_options.duration = duration;
+    uint64_t csv_size = 0;
+    if (!GenerateTrace(trace_options, trace_path, &csv_size))
+      return false;
+
+    MeasureStages(fixture, trace_path, static_cast<size_t>(repetitions),
+                  &results);
+
+    _wremove((trace_path + kCsvFileNameSuffix).c_str());
+    _wremove(trace_path.c_str());
+  }
+
+  std::wstring results_path(command_line.GetSwitchValue(L"results"));
+  if (!results_path.empty() && !WriteResults(results, results_path))
+    return false;
+
+  std::wstring baseline_path(command_line.GetSwitchValue(L"baseline"));
+  if (baseline_path.empty())
+    return true;
+  std::map<std::string, double> baseline;
+  if (!ReadResults(baseline_path, &baseline))
+    return false;
+  return CompareWithBaseline(results, baseline, max_regression);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,50 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Measures each stage of the processing of a trace separately, on synthetic
+// traces of several durations generated with GenerateTrace():
+//   tokenize: split the lines of the CSV file into trimmed tokens.
+//   header: open the trace with ETWReader and parse its header.
+//   read_events: iterate through the events with ETWReader.
+//   load_event_store: EventStore::Load(), without filter.
+//   scan_event_store: scan the rows of every thread of every event table, in
+//       10 time slices, with the indexes of the store.
+//   generate_history: GenerateHistoryFromTrace(), without snapshot.
+//   clean_stacks: StackCleaner::CleanStack() on every stack, default rules.
+//   aggregate: FlameGraph::AddThreadHistory() for every thread.
+//   write_report: FlameGraph::WriteTxtReport().
+// Each stage is run several times and its fastest time is kept.
+//
+// Switches:
+//   --fixture_durations: comma-separated durations of the traces, in seconds.
+//       Default: 1,4.
+//   --repetitions: number of times that each stage is run. Default: 3.
+//   --results: path of a CSV file in which the times are written.
+//   --baseline: path of a CSV file written by a previous run with --results.
+//   --max_regression: maximum increase of the time of a stage over the
+//       baseline, in percent. Default: 10.
+//   --out_dir: directory in which the traces and reports are written.
+// @returns false if a stage regressed by more than --max_regression percent
+//    compared to --baseline, or if the results couldn't be read or written.
+bool RunPipelineBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
@@ -0,0 +1,187 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "benchmark/report_writer_benchmark.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/buffered_writer.h"
+#include "base/numeric_conversions.h"
+#include "benchmark/benchmark.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/symbol_table.h"
+#include "etw_reader/thread_history.h"
+#include "flame_graph/flame_graph.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default number of call stacks in the report.
+const uint64_t kDefaultNumStacks = 1000000;
+
+// Number of distinct symbols and modules in the call stacks.
+const size_t kNumSymbols = 4096;
+const size_t kNumModules = 32;
+
+// Minimum and maximum depth of a call stack.
+const size_t kMinStackDepth = 4;
+const size_t kMaxStackDepth = 32;
+
+// Name of the report file.
+const wchar_t kReportFileName[] = L"report_writer_benchmark.tmp";
+
+// Number of bytes in a megabyte.
+const double kBytesPerMegabyte = 1024.0 * 1024.0;
+
+// Call stacks of a synthetic flame graph report.
+struct SyntheticReport {
+  SymbolTable symbols;
+  std::vector<Stack> stacks;
+  std::vector<base::Timestamp> times;
+};
+
+// Generates the same call stacks on every run.
+void GenerateReport(size_t num_stacks, SyntheticReport* report) {
+  for (size_t i = 0; i < kNumSymbols; ++i) {
+    report->symbols.Intern("module" + std::to_string(i % kNumModules) +
+                           ".dll!Namespace::Function" + std::to_string(i));
+  }
+
+  std::minstd_rand random;
+  std::uniform_int_distribution<size_t> depth_distribution(kMinStackDepth,
+                                                           kMaxStackDepth);
+  std::uniform_int_distribution<SymbolId> symbol_distribution(
+      0, static_cast<SymbolId>(kNumSymbols - 1));
+  std::uniform_int_distribution<base::Timestamp> time_distribution(1, 100000);
+
+  report->stacks.resize(num_stacks);
+  report->times.resize(num_stacks);
+  for (size_t i = 0; i < num_stacks; ++i) {
+    Stack& stack = report->stacks[i];
+    stack.resize(depth_distribution(random));
+    for (SymbolId& symbol : stack)
+      symbol = symbol_distribution(random);
+    report->times[i] = time_distribution(random);
+  }
+}
+
+// Writes the report the way FlameGraph::WriteTxtReport used to, with
+// std::ofstream::operator<<.
+void WriteWithOfstream(const SyntheticReport& report,
+                       const std::wstring& path) {
+  std::ofstream out(path, std::ios::binary);
+  for (size_t i = 0; i < report.stacks.size(); ++i) {
+    bool first = true;
+    for (SymbolId symbol : report.stacks[i]) {
+      if (!first)
+        out << ";";
+      first = false;
+      out << report.symbols.GetSymbol(symbol);
+    }
+    out << " " << report.times[i] << "\n";
+  }
+}
+
+// Writes the report with a base::BufferedWriter.
+void WriteWithBufferedWriter(const SyntheticReport& report,
+                             const std::wstring& path,
+                             base::BufferedWriter::FlushMode flush_mode) {
+  base::BufferedWriter out;
+  if (!out.Open(path, flush_mode))
+    return;
+  for (size_t i = 0; i < report.stacks.size(); ++i) {
+    bool first = true;
+    for (SymbolId symbol : report.stacks[i]) {
+      if (!first)
+        out.WriteChar(';');
+      first = false;
+      out.Write(report.symbols.GetSymbol(symbol));
+    }
+    out.WriteChar(' ');
+    out.WriteUInt(report.times[i]);
+    out.WriteChar('\n');
+  }
+  out.Close();
+}
+
+// @returns the size of a file, in bytes.
+uint64_t GetFileSize(const std::wstring& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return 0;
+  return static_cast<uint64_t>(file.tellg());
+}
+
+// Runs |write_report|, which writes a report to |path|, and prints the
+// throughput.
+void MeasureThroughput(const std::string& name,
+                       const std::wstring& path,
+                       const std::function<void()>& write_report) {
+  Stopwatch stopwatch;
+  write_report();
+  double elapsed_seconds = stopwatch.ElapsedSeconds();
+
+  double megabytes = GetFileSize(path) / kBytesPerMegabyte;
+  PrintBenchmarkResult(name, megabytes / elapsed_seconds, "MB/s");
+  _wremove(path.c_str());
+}
+
+}  // namespace
+
+bool RunReportWriterBenchmark(const base::CommandLine& command_line) {
+  uint64_t num_stacks = kDefaultNumStacks;
+  base::StrToULong(command_line.GetSwitchValue(L"stacks"), &num_stacks);
+
+  std::wstring path(command_line.GetSwitchValue(L"out_dir"));
+  if (!path.empty())
+    path += L"\\";
+  path += kReportFileName;
+
+  SyntheticReport report;
+  GenerateReport(static_cast<size_t>(num_stacks), &report);
+
+  MeasureThroughput("report_writer/ofstream", path,
+                    [&] { WriteWithOfstream(report, path); });
+  MeasureThroughput("report_writer/buffered_inline", path, [&] {
+    WriteWithBufferedWriter(report, path, base::BufferedWriter::kFlushInline);
+  });
+  MeasureThroughput("report_writer/buffered_background", path, [&] {
+    WriteWithBufferedWriter(report, path,
+                            base::BufferedWriter::kFlushInBackground);
+  });
+
+  // End-to-end: the stacks are cleaned and merged before they are written.
+  ThreadHistory thread_history(1);
+  for (size_t i = 0; i < report.stacks.size(); ++i)
+    thread_history.Stacks().Insert(i, report.stacks[i]);
+  thread_history.set_end_ts(report.stacks.size());
+
+  FlameGraph flame_graph(report.symbols);
+  flame_graph.AddThreadHistory(thread_history, 0, report.stacks.size());
+  MeasureThroughput("report_writer/flame_graph_txt", path,
+                    [&] { flame_graph.WriteTxtReport(path); });
+
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,34 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Measures the throughput, in MB/s, of writing a flame graph report of
+// synthetic call stacks with std::ofstream and with base::BufferedWriter, and
+// of FlameGraph::WriteTxtReport.
+//
+// Switches:
+//   --stacks: number of call stacks in the report. Default: 1000000.
+//   --out_dir: directory in which the reports are written. Default: current
+//       directory.
+bool RunReportWriterBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
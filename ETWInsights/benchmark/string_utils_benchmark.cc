@@ -0,0 +1,103 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "benchmark/string_utils_benchmark.h"
+
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "base/numeric_conversions.h"
+#include "base/string_piece.h"
+#include "base/string_utils.h"
+#include "benchmark/benchmark.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default number of lines split.
+const uint64_t kDefaultNumLines = 1000000;
+
+// Lines of a CSV trace, as written by xperf.
+const char* const kLines[] = {
+    "      SampledProfile,   12345678, chrome.exe (1234),       5678, "
+    "0xfffff80002c6d9b0, ntoskrnl.exe!KeSynchronizeExecution, 1, 0x00000000, "
+    "Unbatched, 1",
+    "               Stack,   12345678,       5678,          3, "
+    "0x000007fefd3a1234, chrome.dll!base::MessageLoop::Run",
+    "             CSwitch,   12345690, chrome.exe (1234),       5678,  9, 0, "
+    "0, 0, Idle (   0),          0,   0,  127,          0, Running, Executive, "
+    "NonSwap,      0,    0,    0",
+};
+const size_t kNumLines = std::end(kLines) - std::begin(kLines);
+
+// Number of nanoseconds in a second.
+const double kNanosecondsPerSecond = 1e9;
+
+// Runs |split_line| on |num_lines| lines and prints the time per line.
+// |split_line| returns the number of characters in the tokens, which is
+// accumulated so that the work can't be optimized away.
+void MeasureTimePerLine(const std::string& name,
+                        uint64_t num_lines,
+                        const std::function<size_t(const std::string&)>&
+                            split_line) {
+  std::vector<std::string> lines(std::begin(kLines), std::end(kLines));
+
+  size_t num_characters = 0;
+  Stopwatch stopwatch;
+  for (uint64_t i = 0; i < num_lines; ++i)
+    num_characters += split_line(lines[i % kNumLines]);
+  double elapsed_seconds = stopwatch.ElapsedSeconds();
+
+  if (num_characters == 0)
+    return;
+  PrintBenchmarkResult(name,
+                       elapsed_seconds * kNanosecondsPerSecond / num_lines,
+                       "ns");
+}
+
+}  // namespace
+
+bool RunStringUtilsBenchmark(const base::CommandLine& command_line) {
+  uint64_t num_lines = kDefaultNumLines;
+  base::StrToULong(command_line.GetSwitchValue(L"lines"), &num_lines);
+  if (num_lines == 0)
+    return true;
+
+  MeasureTimePerLine("string_utils/split_string_trim", num_lines,
+                     [](const std::string& line) {
+                       size_t num_characters = 0;
+                       for (const auto& token : base::SplitString(line, ","))
+                         num_characters += base::Trim(token).size();
+                       return num_characters;
+                     });
+
+  std::vector<base::StringPiece> tokens;
+  MeasureTimePerLine("string_utils/split_view_trim_view", num_lines,
+                     [&](const std::string& line) {
+                       size_t num_characters = 0;
+                       base::SplitView(line, ',', &tokens);
+                       for (const auto& token : tokens)
+                         num_characters += base::TrimView(token).size();
+                       return num_characters;
+                     });
+
+  return true;
+}
+
+}  // namespace etw_insights
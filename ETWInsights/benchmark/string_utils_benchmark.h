@@ -0,0 +1,31 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Measures the time, in nanoseconds per line, to split lines of a CSV trace
+// into trimmed tokens with base::SplitString() and base::Trim(), which copy
+// each token, and with base::SplitView() and base::TrimView(), which don't.
+//
+// Switches:
+//   --lines: number of lines split. Default: 1000000.
+bool RunStringUtilsBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
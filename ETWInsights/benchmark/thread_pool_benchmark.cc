@@ -0,0 +1,130 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "benchmark/thread_pool_benchmark.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "base/numeric_conversions.h"
+#include "base/thread_pool.h"
+#include "benchmark/benchmark.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Default number of items in each workload.
+const uint64_t kDefaultNumItems = 100000;
+
+// Number of iterations of the work function for an item of the uniform
+// workload, and on average for an item of the skewed workload.
+const uint32_t kIterationsPerItem = 2000;
+
+// Burns CPU time without touching memory.
+// @returns a value that depends on all the iterations.
+uint64_t Work(uint64_t seed, uint32_t iterations) {
+  uint64_t x = seed | 1;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+// Runs a workload on |num_threads| threads.
+// @param iterations_for_item number of iterations for an item.
+// @returns the elapsed time, in seconds.
+double RunWorkload(size_t num_threads,
+                   size_t num_items,
+                   const std::function<uint32_t(size_t)>& iterations_for_item,
+                   uint64_t* checksum) {
+  base::ThreadPool pool(num_threads);
+  std::atomic<uint64_t> result(0);
+
+  Stopwatch stopwatch;
+  base::ParallelFor(&pool, 0, num_items, 16, [&](size_t i) {
+    result.fetch_xor(Work(i, iterations_for_item(i)),
+                     std::memory_order_relaxed);
+  });
+  double elapsed_seconds = stopwatch.ElapsedSeconds();
+
+  *checksum ^= result.load();
+  return elapsed_seconds;
+}
+
+// Prints the time and the speedup of a workload for 1, 2, 4, ... threads, up
+// to |max_threads|.
+void MeasureScaling(const std::string& name,
+                    size_t max_threads,
+                    size_t num_items,
+                    const std::function<uint32_t(size_t)>& iterations_for_item) {
+  uint64_t checksum = 0;
+  double single_thread_seconds = 0;
+  for (size_t num_threads = 1; num_threads <= max_threads;) {
+    double seconds =
+        RunWorkload(num_threads, num_items, iterations_for_item, &checksum);
+    if (num_threads == 1)
+      single_thread_seconds = seconds;
+
+    std::string prefix(name + "_" + std::to_string(num_threads) + "_threads");
+    PrintBenchmarkResult(prefix, seconds, "s");
+    PrintBenchmarkResult(prefix + "_speedup", single_thread_seconds / seconds,
+                         "x");
+
+    // Always measure |max_threads|, even if it isn't a power of 2.
+    if (num_threads == max_threads)
+      break;
+    num_threads = num_threads * 2 > max_threads ? max_threads : num_threads * 2;
+  }
+
+  // The checksum is the same for any number of threads: print it so that the
+  // work can't be optimized away.
+  if (checksum == 1)
+    PrintBenchmarkResult(name + "_checksum", 1, "");
+}
+
+}  // namespace
+
+bool RunThreadPoolBenchmark(const base::CommandLine& command_line) {
+  uint64_t max_threads = base::ThreadPool::GetDefaultNumThreads();
+  base::StrToULong(command_line.GetSwitchValue(L"jobs"), &max_threads);
+  if (max_threads == 0)
+    max_threads = 1;
+
+  uint64_t num_items = kDefaultNumItems;
+  base::StrToULong(command_line.GetSwitchValue(L"items"), &num_items);
+
+  MeasureScaling("thread_pool/uniform", static_cast<size_t>(max_threads),
+                 static_cast<size_t>(num_items),
+                 [](size_t) { return kIterationsPerItem; });
+
+  // The cost of an item is proportional to its index, so the last pieces of
+  // the range are much more expensive than the first ones.
+  size_t skewed_num_items = static_cast<size_t>(num_items);
+  MeasureScaling("thread_pool/skewed", static_cast<size_t>(max_threads),
+                 skewed_num_items, [skewed_num_items](size_t i) {
+                   return static_cast<uint32_t>(2 * kIterationsPerItem * i /
+                                                skewed_num_items);
+                 });
+
+  return true;
+}
+
+}  // namespace etw_insights
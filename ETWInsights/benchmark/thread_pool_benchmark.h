@@ -0,0 +1,34 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "base/command_line.h"
+
+namespace etw_insights {
+
+// Measures how base::ParallelFor scales with the number of threads, on a
+// workload where all the items cost the same and on a workload where the cost
+// of the items grows linearly, which relies on work stealing to stay
+// balanced. Prints the time and the speedup over 1 thread for 1, 2, 4, ...
+// threads, up to --jobs.
+//
+// Switches:
+//   --jobs: maximum number of threads. Default: number of hardware threads.
+//   --items: number of items in each workload. Default: 100000.
+bool RunThreadPoolBenchmark(const base::CommandLine& command_line);
+
+}  // namespace etw_insights
@@ -26,7 +26,7 @@ namespace etw_insights {
 
 namespace {
 // CSV column separator.
-const char kSeparator[] = ",";
+const char kSeparator = ',';
 
 // Extension for a CSV file.
 const wchar_t kCSVFileExtension[] = L".csv";
@@ -34,10 +34,16 @@ const wchar_t kCSVFileExtension[] = L".csv";
 // Invalid line index.
 const size_t kInvalidLineIndex = static_cast<size_t>(-1);
 
+// Type of the lines of a stack, which follow the event that they belong to.
+const char kStackType[] = "Stack";
+
 std::vector<std::string> ExtractTokens(const std::string& str) {
-  std::vector<std::string> tokens(base::SplitString(str, kSeparator));
-  for (auto& token : tokens)
-    token = base::Trim(token);
+  std::vector<base::StringPiece> pieces;
+  base::SplitView(str, kSeparator, &pieces);
+  std::vector<std::string> tokens;
+  tokens.reserve(pieces.size());
+  for (const auto& piece : pieces)
+    tokens.push_back(base::TrimView(piece).as_string());
   return tokens;
 }
 
@@ -65,34 +71,58 @@ std::wstring ConvertEtlToCsv(const std::wstring& etl_path) {
 
 const char* ETWReader::kEmptyEventType = "Empty";
 
-ETWReader::Line::Line() {}
+ETWReader::Line::Line() : column_names_(nullptr) {}
 
 bool ETWReader::Line::GetFieldAsString(const std::string& name,
                                        std::string* value) const {
-  auto look = values_.find(name);
-  if (look == values_.end())
+  const std::string* field = FindField(name);
+  if (field == nullptr)
     return false;
-  *value = look->second;
+  *value = *field;
   return true;
 }
 
 bool ETWReader::Line::GetFieldAsULong(const std::string& name,
                                       uint64_t* value) const {
-  std::string value_str;
-  if (!GetFieldAsString(name, &value_str))
+  const std::string* field = FindField(name);
+  if (field == nullptr)
     return false;
-  return base::StrToULong(value_str, value);
+  return base::StrToULong(*field, value);
 }
 
 bool ETWReader::Line::GetFieldAsULongHex(const std::string& name,
                                          uint64_t* value) const {
-  std::string value_str;
-  if (!GetFieldAsString(name, &value_str))
+  const std::string* field = FindField(name);
+  if (field == nullptr)
     return false;
-  return base::StrToULongHex(value_str, value);
+  return base::StrToULongHex(*field, value);
+}
+
+const std::string& ETWReader::Line::GetFieldName(size_t index) const {
+  DCHECK_LT(index, num_fields());
+  return (*column_names_)[index];
+}
+
+const std::string& ETWReader::Line::GetFieldValue(size_t index) const {
+  DCHECK_LT(index, num_fields());
+  return values_[index];
+}
+
+const std::string* ETWReader::Line::FindField(const std::string& name) const {
+  if (column_names_ == nullptr)
+    return nullptr;
+  // Lines have few fields: a linear search is faster than hashing |name|.
+  for (size_t i = 0; i < column_names_->size(); ++i) {
+    if ((*column_names_)[i] == name)
+      return &values_[i];
+  }
+  return nullptr;
 }
 
-ETWReader::Iterator::Iterator() : current_line_index_(kInvalidLineIndex) {}
+ETWReader::Iterator::Iterator()
+    : current_line_index_(kInvalidLineIndex),
+      last_event_kept_(true),
+      previous_line_kept_(true) {}
 
 bool ETWReader::Iterator::operator==(const ETWReader::Iterator& other) const {
   return current_line_index_ == other.current_line_index_;
@@ -104,71 +134,87 @@ bool ETWReader::Iterator::operator!=(const ETWReader::Iterator& other) const {
 
 ETWReader::Iterator& ETWReader::Iterator::operator++() {
   // Reset the current line values.
-  current_line_.values_.clear();
-
-  // Read the current line.
-  std::string line;
-  if (!std::getline(file_, line)) {
-    current_line_index_ = kInvalidLineIndex;
-    return *this;
-  }
-  ++current_line_index_;
-  auto tokens = ExtractTokens(line);
+  current_line_.column_names_ = nullptr;
+
+  // Read the next line that matches the filter. The fields of the lines that
+  // don't match are never copied.
+  bool is_split = false;
+  do {
+    if (!std::getline(file_, line_)) {
+      current_line_index_ = kInvalidLineIndex;
+      return *this;
+    }
+    ++current_line_index_;
+  } while (!filter_.IsEmpty() && !IsLineKept(&is_split));
+  if (!is_split)
+    base::SplitView(line_, kSeparator, &tokens_);
 
   // Check if the current line is empty.
-  if (tokens.empty()) {
+  if (tokens_.empty()) {
     current_line_.type_ = kEmptyEventType;
     return *this;
   }
 
   // Set the current line type.
-  current_line_.type_ = tokens.front();
+  base::TrimView(tokens_.front()).CopyToString(&current_line_.type_);
 
   // Get the column names for this line type.
   auto look_column_names = header_.find(current_line_.type());
-  if (look_column_names == header_.end()) {
-    current_line_.values_.clear();
+  if (look_column_names == header_.end())
     return *this;
-  }
   const auto& column_names = look_column_names->second;
 
   // Check that we got the expected number of tokens.
-  if ((tokens.size() - 1) < column_names.size()) {
+  if ((tokens_.size() - 1) < column_names.size()) {
     LOG(ERROR) << "Unexpected number of tokens for line of type "
                << current_line_.type() << ".";
     return *this;
   }
 
-  // Create a map of Column Name -> Column Value for the current line.
+  // Copy the value of each column of the current line.
+  auto& values = current_line_.values_;
+  if (values.size() < column_names.size())
+    values.resize(column_names.size());
   for (size_t column_index = 0; column_index < column_names.size();
        ++column_index) {
     size_t token_index = column_index + 1;
-    std::string value = tokens[token_index];
+    std::string& value = values[column_index];
+    base::TrimView(tokens_[token_index]).CopyToString(&value);
 
     // If this is the last column, use all the remaining tokens as the value.
     // TODO(fdoray): Find a cleaner solution.
     if (column_index == column_names.size() - 1) {
       ++token_index;
-      while (token_index < tokens.size()) {
-        value += ",";
-        value += tokens[token_index];
+      while (token_index < tokens_.size()) {
+        base::StringPiece token = base::TrimView(tokens_[token_index]);
+        value += kSeparator;
+        value.append(token.data(), token.size());
         ++token_index;
       }
     }
-
-    current_line_.values_[column_names[column_index]] = value;
   }
+  current_line_.column_names_ = &column_names;
 
   return *this;
 }
 
-ETWReader::Iterator::Iterator(const std::wstring& file_path)
-    : current_line_index_(static_cast<size_t>(0)) {
+ETWReader::Iterator::Iterator(const std::wstring& file_path,
+                              const EventFilter& filter)
+    : current_line_index_(static_cast<size_t>(0)),
+      filter_(filter),
+      last_event_kept_(true),
+      previous_line_kept_(true) {
   // Open the CSV file.
   file_.open(file_path);
 
-  // Parse the header.
+  // Parse the header, and compile the filter for each line type.
   ParseHeader();
+  if (!filter_.IsEmpty()) {
+    for (const auto& line_type : header_) {
+      compiled_filters_.insert(std::make_pair(
+          line_type.first, filter_.Compile(line_type.first, line_type.second)));
+    }
+  }
 
   // Skip the line with the trace metadata.
   std::string dummy;
@@ -210,6 +256,45 @@ void ETWReader::Iterator::ParseHeader() {
   }
 }
 
+bool ETWReader::Iterator::IsLineKept(bool* is_split) {
+  DCHECK(is_split != nullptr);
+  *is_split = false;
+
+  if (line_.empty())
+    return previous_line_kept_;
+
+  // The type is the first token. Lines of types that the filter rejects
+  // without looking at their fields aren't split.
+  base::StringPiece line(line_);
+  std::string& type = current_line_.type_;
+  base::TrimView(line.substr(0, line.find(kSeparator))).CopyToString(&type);
+  auto look_filter = compiled_filters_.find(type);
+  if (look_filter == compiled_filters_.end()) {
+    look_filter =
+        compiled_filters_
+            .insert(std::make_pair(
+                type, filter_.Compile(type, std::vector<std::string>())))
+            .first;
+  }
+  const CompiledEventFilter& compiled_filter = look_filter->second;
+
+  bool kept = false;
+  if (compiled_filter.is_constant()) {
+    kept = compiled_filter.constant_value();
+  } else {
+    base::SplitView(line_, kSeparator, &tokens_);
+    *is_split = true;
+    kept = compiled_filter.Matches(tokens_);
+  }
+
+  if (type == kStackType)
+    kept = kept || last_event_kept_;
+  else
+    last_event_kept_ = kept;
+  previous_line_kept_ = kept;
+  return kept;
+}
+
 ETWReader::ETWReader() {}
 
 bool ETWReader::Open(const std::wstring& trace_path) {
@@ -228,11 +313,39 @@ bool ETWReader::Open(const std::wstring& trace_path) {
 
 ETWReader::Iterator ETWReader::begin() const {
   DCHECK(!csv_file_path_.empty());
-  return Iterator(csv_file_path_);
+  return Iterator(csv_file_path_, filter_);
 }
 
 ETWReader::Iterator ETWReader::end() const {
   return Iterator();
 }
 
+void SplitProcessNameField(const std::string& value,
+                           std::string* process_name,
+                           base::Pid* pid) {
+  std::vector<base::StringPiece> tokens;
+  base::SplitView(value, ' ', &tokens);
+  if (tokens.empty()) {
+    LOG(ERROR) << "Empty process name field.";
+    return;
+  }
+  tokens[0].CopyToString(process_name);
+
+  // The last token is the process id, followed by ')' and optionally preceded
+  // by '('.
+  base::StringPiece pid_token = tokens.back();
+  size_t start_pos = 0;
+  if (!pid_token.empty() && pid_token[0] == '(')
+    start_pos = 1;
+
+  if (pid_token.size() <= start_pos ||
+      !base::StrToULong(
+          pid_token.substr(start_pos, pid_token.size() - 1 - start_pos)
+              .as_string(),
+          pid)) {
+    LOG(ERROR) << "Unable to extract process id from process name field ("
+               << value << ").";
+  }
+}
+
 }  // namespace etw_insights
@@ -23,6 +23,9 @@ limitations under the License.
 #include <vector>
 
 #include "base/base.h"
+#include "base/string_piece.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
 
 namespace etw_insights {
 
@@ -42,11 +45,32 @@ class ETWReader {
     bool GetFieldAsULong(const std::string& name, uint64_t* value) const;
     bool GetFieldAsULongHex(const std::string& name, uint64_t* value) const;
 
+    // @returns the number of fields of the line. 0 if the type of the line
+    //    isn't in the header.
+    size_t num_fields() const {
+      return column_names_ == nullptr ? 0 : column_names_->size();
+    }
+
+    // @param index index of a field, in the order of the header.
+    // @returns the name or the value of the field.
+    const std::string& GetFieldName(size_t index) const;
+    const std::string& GetFieldValue(size_t index) const;
+
    private:
     friend class etw_insights::ETWReader::Iterator;
 
+    // @returns the value of the field |name|, or nullptr if the line doesn't
+    //    have this field.
+    const std::string* FindField(const std::string& name) const;
+
     std::string type_;
-    std::unordered_map<std::string, std::string> values_;
+
+    // Names of the fields of the line. nullptr if the line has no field.
+    const std::vector<std::string>* column_names_;
+
+    // Values of the fields, in the order of |column_names_|. The strings are
+    // reused from one line to the next, to avoid allocating memory.
+    std::vector<std::string> values_;
   };
 
   // Iterates through the events of an ETW trace.
@@ -63,10 +87,17 @@ class ETWReader {
    private:
     friend class etw_insights::ETWReader;
 
-    Iterator(const std::wstring& file_path);
+    Iterator(const std::wstring& file_path, const EventFilter& filter);
 
     void ParseHeader();
 
+    // Evaluates the filter on the line in |line_|. Stack lines are also kept
+    // when the event that they follow is kept, and empty lines, which end
+    // stacks, are kept with the line before them.
+    // @param is_split set to true if |tokens_| were split from |line_|.
+    // @returns true if the line is kept.
+    bool IsLineKept(bool* is_split);
+
     // CSV file stream.
     std::ifstream file_;
 
@@ -76,8 +107,21 @@ class ETWReader {
     // Current line index.
     size_t current_line_index_;
 
+    // Text and tokens of the current line, reused from one line to the next.
+    std::string line_;
+    std::vector<base::StringPiece> tokens_;
+
     // Current line.
     Line current_line_;
+
+    // Filter of the lines, and its compilation for each line type.
+    EventFilter filter_;
+    std::unordered_map<std::string, CompiledEventFilter> compiled_filters_;
+
+    // Whether the last line that wasn't a stack or empty line was kept, and
+    // whether the previous line was kept.
+    bool last_event_kept_;
+    bool previous_line_kept_;
   };
 
   ETWReader();
@@ -87,6 +131,10 @@ class ETWReader {
   // @returns true if the trace was opened successfully, false otherwise.
   bool Open(const std::wstring& trace_path);
 
+  // Sets the filter of the events returned by the iterators. Lines that don't
+  // match it are skipped before their fields are copied.
+  void set_filter(const EventFilter& filter) { filter_ = filter; }
+
   // Returns an iterator to the first event of an ETW trace.
   Iterator begin() const;
 
@@ -100,7 +148,18 @@ class ETWReader {
   // Path to the CSV dump of an ETW trace.
   std::wstring csv_file_path_;
 
+  EventFilter filter_;
+
   DISALLOW_COPY_AND_ASSIGN(ETWReader);
 };
 
+// Splits the value of a "Process Name ( PID)" field, e.g. "chrome.exe (1234)".
+// @param value the value of the field.
+// @param process_name receives the name of the process.
+// @param pid receives the id of the process. Unchanged if the field doesn't
+//    end with a process id.
+void SplitProcessNameField(const std::string& value,
+                           std::string* process_name,
+                           base::Pid* pid);
+
 }  // namespace etw_insights
@@ -0,0 +1,536 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/event_filter.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "base/base.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Field of the type of an event.
+const char kTypeField[] = "type";
+
+// Maximum nesting of parentheses and ! in an expression.
+const size_t kMaxNesting = 64;
+
+// Maximum length of a number that is converted to floating-point.
+const size_t kMaxNumberLength = 64;
+
+// @returns true if |str| is a decimal or hexadecimal (0x) unsigned integer
+//    that fits in 64 bits. |value| receives the integer.
+bool ParseInteger(base::StringPiece str, uint64_t* value) {
+  uint64_t base = 10;
+  if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+    base = 16;
+    str = str.substr(2);
+  }
+  if (str.empty())
+    return false;
+
+  uint64_t result = 0;
+  for (char c : str) {
+    uint64_t digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (base == 16 && c >= 'a' && c <= 'f')
+      digit = c - 'a' + 10;
+    else if (base == 16 && c >= 'A' && c <= 'F')
+      digit = c - 'A' + 10;
+    else
+      return false;
+    if (result > (UINT64_MAX - digit) / base)
+      return false;
+    result = result * base + digit;
+  }
+  *value = result;
+  return true;
+}
+
+// @returns true if |str| is a floating-point number. |value| receives the
+//    number.
+bool ParseDouble(base::StringPiece str, double* value) {
+  // strtod() needs a null-terminated string: copy the number on the stack.
+  char buffer[kMaxNumberLength + 1];
+  if (str.empty() || str.size() > kMaxNumberLength || str[0] == ' ')
+    return false;
+  memcpy(buffer, str.data(), str.size());
+  buffer[str.size()] = '\0';
+  char* end = nullptr;
+  *value = strtod(buffer, &end);
+  return end == buffer + str.size();
+}
+
+// @returns |str| without the double quotes around it, if it has them.
+base::StringPiece UnquoteView(base::StringPiece str) {
+  if (str.size() >= 2 && str[0] == '"' && str[str.size() - 1] == '"')
+    return str.substr(1, str.size() - 2);
+  return str;
+}
+
+// @returns the result of the comparison of the value of a field with a
+//    literal.
+bool EvaluateComparison(ComparisonOperator op,
+                        const FilterLiteral& literal,
+                        base::StringPiece value) {
+  // Order of |value| relative to |literal|: -1, 0 or 1.
+  int order = 0;
+  if (literal.is_number) {
+    uint64_t integer = 0;
+    double number = 0;
+    if (literal.is_integer && ParseInteger(value, &integer)) {
+      order = integer < literal.integer_value
+                  ? -1
+                  : (integer > literal.integer_value ? 1 : 0);
+    } else if (ParseInteger(value, &integer)) {
+      number = static_cast<double>(integer);
+      order = number < literal.double_value
+                  ? -1
+                  : (number > literal.double_value ? 1 : 0);
+    } else if (ParseDouble(value, &number) && number == number) {
+      order = number < literal.double_value
+                  ? -1
+                  : (number > literal.double_value ? 1 : 0);
+    } else {
+      return false;
+    }
+  } else {
+    base::StringPiece str = UnquoteView(value);
+    size_t common_size = std::min(str.size(), literal.string_value.size());
+    order = common_size == 0
+                ? 0
+                : memcmp(str.data(), literal.string_value.data(), common_size);
+    if (order == 0 && str.size() != literal.string_value.size())
+      order = str.size() < literal.string_value.size() ? -1 : 1;
+  }
+
+  switch (op) {
+    case kEqual:
+      return order == 0;
+    case kNotEqual:
+      return order != 0;
+    case kLess:
+      return order < 0;
+    case kLessOrEqual:
+      return order <= 0;
+    case kGreater:
+      return order > 0;
+    case kGreaterOrEqual:
+      return order >= 0;
+  }
+  return false;
+}
+
+bool IsIdentifierStart(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+bool IsIdentifierPart(char c) {
+  return IsIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+}  // namespace
+
+CompiledEventFilter::CompiledEventFilter() : constant_value_(true) {}
+
+CompiledEventFilter::~CompiledEventFilter() {}
+
+bool CompiledEventFilter::Matches(
+    const std::vector<base::StringPiece>& tokens) const {
+  if (code_.empty())
+    return constant_value_;
+
+  bool value = false;
+  size_t instruction_index = 0;
+  while (instruction_index < code_.size()) {
+    const Instruction& instruction = code_[instruction_index];
+    switch (instruction.opcode) {
+      case kCompare: {
+        if (instruction.token_index >= tokens.size()) {
+          value = false;
+          break;
+        }
+        base::StringPiece token = tokens[instruction.token_index];
+        if (instruction.is_last_column) {
+          token = base::StringPiece(
+              token.data(),
+              static_cast<size_t>(tokens.back().end() - token.data()));
+        }
+        value = EvaluateComparison(instruction.op, instruction.literal,
+                                   base::TrimView(token));
+        break;
+      }
+      case kNot:
+        value = !value;
+        break;
+      case kJumpIfFalse:
+        if (!value) {
+          instruction_index = instruction.target;
+          continue;
+        }
+        break;
+      case kJumpIfTrue:
+        if (value) {
+          instruction_index = instruction.target;
+          continue;
+        }
+        break;
+    }
+    ++instruction_index;
+  }
+  return value;
+}
+
+// Recursive descent parser of filter expressions:
+//
+//   or         := and ("||" and)*
+//   and        := unary ("&&" unary)*
+//   unary      := "!" unary | "(" or ")" | comparison
+//   comparison := (identifier | string) operator (number | string)
+class EventFilter::Parser {
+ public:
+  Parser(const std::string& expression, std::vector<Node>* nodes)
+      : expression_(expression), pos_(0), nesting_(0), nodes_(nodes) {}
+
+  // @returns true if the whole expression was parsed. The root of the syntax
+  //    tree is the last node.
+  bool Parse() {
+    size_t root = 0;
+    if (!ParseOr(&root))
+      return false;
+    SkipSpaces();
+    if (pos_ != expression_.size())
+      return Error("&&, || or the end of the expression");
+    return true;
+  }
+
+ private:
+  bool ParseOr(size_t* node_index) {
+    if (!ParseAnd(node_index))
+      return false;
+    while (Consume("||")) {
+      size_t right = 0;
+      if (!ParseAnd(&right))
+        return false;
+      *node_index = AddBinaryNode(Node::kOr, *node_index, right);
+    }
+    return true;
+  }
+
+  bool ParseAnd(size_t* node_index) {
+    if (!ParseUnary(node_index))
+      return false;
+    while (Consume("&&")) {
+      size_t right = 0;
+      if (!ParseUnary(&right))
+        return false;
+      *node_index = AddBinaryNode(Node::kAnd, *node_index, right);
+    }
+    return true;
+  }
+
+  bool ParseUnary(size_t* node_index) {
+    bool is_not = Consume("!");
+    if (is_not || Consume("(")) {
+      if (++nesting_ > kMaxNesting)
+        return Error("at most 64 nested parentheses and !");
+      if (is_not) {
+        size_t operand = 0;
+        if (!ParseUnary(&operand))
+          return false;
+        Node node;
+        node.kind = Node::kNot;
+        node.left = operand;
+        *node_index = AddNode(node);
+      } else {
+        if (!ParseOr(node_index))
+          return false;
+        if (!Consume(")"))
+          return Error(")");
+      }
+      --nesting_;
+      return true;
+    }
+    return ParseComparison(node_index);
+  }
+
+  bool ParseComparison(size_t* node_index) {
+    Node node;
+    node.kind = Node::kComparison;
+
+    SkipSpaces();
+    if (pos_ < expression_.size() && expression_[pos_] == '"') {
+      if (!ParseString(&node.field))
+        return false;
+    } else if (pos_ < expression_.size() &&
+               IsIdentifierStart(expression_[pos_])) {
+      size_t start = pos_;
+      while (pos_ < expression_.size() && IsIdentifierPart(expression_[pos_]))
+        ++pos_;
+      node.field = expression_.substr(start, pos_ - start);
+    } else {
+      return Error("a field name");
+    }
+
+    // Two-character operators first, so that "<=" isn't read as "<".
+    if (Consume("=="))
+      node.op = kEqual;
+    else if (Consume("!="))
+      node.op = kNotEqual;
+    else if (Consume("<="))
+      node.op = kLessOrEqual;
+    else if (Consume(">="))
+      node.op = kGreaterOrEqual;
+    else if (Consume("<"))
+      node.op = kLess;
+    else if (Consume(">"))
+      node.op = kGreater;
+    else
+      return Error("a comparison operator");
+
+    SkipSpaces();
+    if (pos_ < expression_.size() && expression_[pos_] == '"') {
+      if (!ParseString(&node.literal.string_value))
+        return false;
+    } else if (!ParseNumber(&node.literal)) {
+      return false;
+    }
+
+    *node_index = AddNode(node);
+    return true;
+  }
+
+  // Parses a quoted string, in which \" and \\ are escaped quotes and
+  // backslashes.
+  bool ParseString(std::string* value) {
+    DCHECK_EQ('"', expression_[pos_]);
+    ++pos_;
+    value->clear();
+    while (pos_ < expression_.size() && expression_[pos_] != '"') {
+      if (expression_[pos_] == '\\' && pos_ + 1 < expression_.size())
+        ++pos_;
+      value->push_back(expression_[pos_]);
+      ++pos_;
+    }
+    if (pos_ == expression_.size())
+      return Error("a closing quote");
+    ++pos_;
+    return true;
+  }
+
+  bool ParseNumber(FilterLiteral* literal) {
+    // A number extends over its digits, letters and dots, and over the sign
+    // of an exponent.
+    size_t start = pos_;
+    while (pos_ < expression_.size()) {
+      char c = expression_[pos_];
+      bool is_sign = (c == '-' || c == '+') &&
+                     (pos_ == start ||
+                      ((expression_[pos_ - 1] == 'e' ||
+                        expression_[pos_ - 1] == 'E') &&
+                       expression_.compare(start, 2, "0x") != 0));
+      if (!IsIdentifierPart(c) && c != '.' && !is_sign)
+        break;
+      ++pos_;
+    }
+
+    base::StringPiece number(expression_.data() + start, pos_ - start);
+    literal->is_number = true;
+    literal->is_integer = ParseInteger(number, &literal->integer_value);
+    if (literal->is_integer) {
+      literal->double_value = static_cast<double>(literal->integer_value);
+    } else if (!ParseDouble(number, &literal->double_value)) {
+      pos_ = start;
+      return Error("a number or a quoted string");
+    }
+    return true;
+  }
+
+  // Skips the spaces, then consumes |token| if the expression continues with
+  // it.
+  // @returns true if |token| was consumed.
+  bool Consume(const char* token) {
+    SkipSpaces();
+    size_t size = strlen(token);
+    if (expression_.compare(pos_, size, token) != 0)
+      return false;
+    pos_ += size;
+    return true;
+  }
+
+  void SkipSpaces() {
+    while (pos_ < expression_.size() &&
+           (expression_[pos_] == ' ' || expression_[pos_] == '\t')) {
+      ++pos_;
+    }
+  }
+
+  size_t AddNode(const Node& node) {
+    nodes_->push_back(node);
+    return nodes_->size() - 1;
+  }
+
+  size_t AddBinaryNode(Node::Kind kind, size_t left, size_t right) {
+    Node node;
+    node.kind = kind;
+    node.left = left;
+    node.right = right;
+    return AddNode(node);
+  }
+
+  // Logs an error at the current position.
+  // @returns false.
+  bool Error(const char* expected) {
+    LOG(ERROR) << "Invalid filter expression: expected " << expected
+               << " at position " << pos_ << " of \"" << expression_ << "\".";
+    return false;
+  }
+
+  const std::string& expression_;
+
+  // Position of the next character to parse.
+  size_t pos_;
+
+  // Number of parentheses and ! around the current position.
+  size_t nesting_;
+
+  std::vector<Node>* nodes_;
+
+  DISALLOW_COPY_AND_ASSIGN(Parser);
+};
+
+EventFilter::EventFilter() {}
+
+EventFilter::~EventFilter() {}
+
+bool EventFilter::Parse(const std::string& expression) {
+  nodes_.clear();
+  expression_.clear();
+  if (base::TrimView(expression).empty())
+    return true;
+
+  Parser parser(expression, &nodes_);
+  if (!parser.Parse()) {
+    nodes_.clear();
+    return false;
+  }
+  expression_ = expression;
+  return true;
+}
+
+CompiledEventFilter EventFilter::Compile(
+    const std::string& type,
+    const std::vector<std::string>& column_names) const {
+  CompiledEventFilter compiled_filter;
+  if (nodes_.empty())
+    return compiled_filter;
+
+  NodeValue value =
+      CompileNode(nodes_.size() - 1, type, column_names, &compiled_filter);
+  DCHECK(value == kDynamicValue || compiled_filter.code_.empty());
+  compiled_filter.constant_value_ = value == kTrueValue;
+  return compiled_filter;
+}
+
+EventFilter::NodeValue EventFilter::CompileNode(
+    size_t node_index,
+    const std::string& type,
+    const std::vector<std::string>& column_names,
+    CompiledEventFilter* compiled_filter) const {
+  const Node& node = nodes_[node_index];
+  auto& code = compiled_filter->code_;
+
+  switch (node.kind) {
+    case Node::kComparison: {
+      if (node.field == kTypeField) {
+        return EvaluateComparison(node.op, node.literal, type) ? kTrueValue
+                                                               : kFalseValue;
+      }
+      auto column =
+          std::find(column_names.begin(), column_names.end(), node.field);
+      if (column == column_names.end())
+        return kFalseValue;
+
+      // The first token of a line is its type.
+      CompiledEventFilter::Instruction instruction;
+      instruction.opcode = CompiledEventFilter::kCompare;
+      instruction.op = node.op;
+      instruction.token_index = column - column_names.begin() + 1;
+      instruction.is_last_column = column + 1 == column_names.end();
+      instruction.literal = node.literal;
+      code.push_back(instruction);
+      return kDynamicValue;
+    }
+
+    case Node::kNot: {
+      NodeValue value =
+          CompileNode(node.left, type, column_names, compiled_filter);
+      if (value != kDynamicValue)
+        return value == kTrueValue ? kFalseValue : kTrueValue;
+      CompiledEventFilter::Instruction instruction;
+      instruction.opcode = CompiledEventFilter::kNot;
+      code.push_back(instruction);
+      return kDynamicValue;
+    }
+
+    case Node::kAnd:
+    case Node::kOr: {
+      // Value of the left operand that decides the value of the node alone.
+      NodeValue deciding_value =
+          node.kind == Node::kAnd ? kFalseValue : kTrueValue;
+
+      size_t start = code.size();
+      NodeValue left =
+          CompileNode(node.left, type, column_names, compiled_filter);
+      if (left == deciding_value)
+        return deciding_value;
+      if (left != kDynamicValue)
+        return CompileNode(node.right, type, column_names, compiled_filter);
+
+      size_t jump = code.size();
+      CompiledEventFilter::Instruction instruction;
+      instruction.opcode = node.kind == Node::kAnd
+                               ? CompiledEventFilter::kJumpIfFalse
+                               : CompiledEventFilter::kJumpIfTrue;
+      code.push_back(instruction);
+
+      NodeValue right =
+          CompileNode(node.right, type, column_names, compiled_filter);
+      if (right == deciding_value) {
+        // Comparisons have no side effect: the left operand can be dropped.
+        code.resize(start);
+        return deciding_value;
+      }
+      if (right != kDynamicValue) {
+        // The value of the node is the value of the left operand.
+        code.resize(jump);
+        return kDynamicValue;
+      }
+      code[jump].target = code.size();
+      return kDynamicValue;
+    }
+  }
+
+  return kFalseValue;
+}
+
+}  // namespace etw_insights
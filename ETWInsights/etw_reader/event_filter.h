@@ -0,0 +1,201 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/string_piece.h"
+
+namespace etw_insights {
+
+// Operators of the comparisons of an event filter.
+enum ComparisonOperator {
+  kEqual,
+  kNotEqual,
+  kLess,
+  kLessOrEqual,
+  kGreater,
+  kGreaterOrEqual,
+};
+
+// A quoted string or a number of a filter expression.
+struct FilterLiteral {
+  FilterLiteral()
+      : is_number(false), is_integer(false), integer_value(0),
+        double_value(0) {}
+
+  // Value of a quoted string, without its quotes.
+  std::string string_value;
+
+  // Whether the literal is a number, and whether it is an unsigned integer
+  // that |integer_value| holds exactly. |double_value| holds all numbers.
+  bool is_number;
+  bool is_integer;
+  uint64_t integer_value;
+  double double_value;
+};
+
+// A filter compiled for the columns of one event type. Field names are
+// resolved to token indexes, and the comparisons whose result is known from
+// the type alone are folded, so that evaluating the filter on a line only
+// compares the tokens that it needs, without copying them.
+class CompiledEventFilter {
+ public:
+  CompiledEventFilter();
+  ~CompiledEventFilter();
+
+  // @returns true if the result of the filter is known for all the lines of
+  //    the event type, without looking at their fields.
+  bool is_constant() const { return code_.empty(); }
+  bool constant_value() const { return constant_value_; }
+
+  // @param tokens tokens of a line, starting with its type, as split at each
+  //    comma by ETWReader. They don't need to be trimmed.
+  // @returns true if the line matches the filter.
+  bool Matches(const std::vector<base::StringPiece>& tokens) const;
+
+ private:
+  friend class EventFilter;
+
+  // Instructions update a single boolean register, since the left operand of
+  // && and || is consumed by a conditional jump before the right operand is
+  // evaluated.
+  enum Opcode {
+    // Sets the register to the result of a comparison.
+    kCompare,
+    // Negates the register.
+    kNot,
+    // Jumps to |target| if the register is false, or true.
+    kJumpIfFalse,
+    kJumpIfTrue,
+  };
+
+  struct Instruction {
+    Instruction()
+        : opcode(kCompare), op(kEqual), token_index(0),
+          is_last_column(false), target(0) {}
+
+    Opcode opcode;
+
+    // Comparison of the token at |token_index| with |literal|. The last
+    // column of a line extends to the end of the line, since it may contain
+    // commas.
+    ComparisonOperator op;
+    size_t token_index;
+    bool is_last_column;
+    FilterLiteral literal;
+
+    // Index of the next instruction of a jump.
+    size_t target;
+  };
+
+  // Result of the filter when |code_| is empty.
+  bool constant_value_;
+
+  std::vector<Instruction> code_;
+};
+
+// A predicate on the events of a trace, parsed once and compiled for the
+// columns of each event type of the header of the trace. For example:
+//
+//   type == "CSwitch" && "New TID" == 1234 && TimeStamp > 5e6
+//
+// A comparison has a field on the left, either an identifier or a quoted
+// column name, and a number or a quoted string on the right. |type| is the
+// type of the event. Comparisons can be combined with &&, ||, ! and
+// parentheses. Operators are ==, !=, <, <=, > and >=.
+//
+// Quotes around the value of a field are ignored. A field is compared as a
+// number when the literal is a number, exactly when both are integers
+// (decimal or hexadecimal with 0x) and as floating-point numbers otherwise.
+// A comparison is false, whatever its operator, when the event doesn't have
+// the field or when a number is compared with a value that isn't one.
+class EventFilter {
+ public:
+  EventFilter();
+  ~EventFilter();
+
+  // Parses a filter expression. An empty expression matches all the events.
+  // @param expression the expression.
+  // @returns true if the expression is valid. Otherwise, an error with the
+  //    position of the problem is logged and the filter is left empty.
+  bool Parse(const std::string& expression);
+
+  // @returns true if the filter matches all the events.
+  bool IsEmpty() const { return nodes_.empty(); }
+
+  const std::string& expression() const { return expression_; }
+
+  // Compiles the filter for the events of a type.
+  // @param type the type of the events.
+  // @param column_names the names of the columns of the events, from the
+  //    header of the trace. Empty if the type isn't in the header.
+  // @returns the compiled filter.
+  CompiledEventFilter Compile(
+      const std::string& type,
+      const std::vector<std::string>& column_names) const;
+
+ private:
+  class Parser;
+
+  // Values of a node for an event type, known or computed by the code
+  // emitted for the node.
+  enum NodeValue {
+    kFalseValue,
+    kTrueValue,
+    kDynamicValue,
+  };
+
+  // A node of the syntax tree of the expression.
+  struct Node {
+    enum Kind {
+      kComparison,
+      kNot,
+      kAnd,
+      kOr,
+    };
+
+    Kind kind;
+
+    // Operands of kNot (|left| only), kAnd and kOr, as indexes in |nodes_|.
+    size_t left;
+    size_t right;
+
+    // Comparison of |field| with |literal|.
+    std::string field;
+    ComparisonOperator op;
+    FilterLiteral literal;
+  };
+
+  // Emits the code of a node for an event type.
+  // @returns whether the value of the node is known. No code is emitted for a
+  //    node whose value is known.
+  NodeValue CompileNode(size_t node_index,
+                        const std::string& type,
+                        const std::vector<std::string>& column_names,
+                        CompiledEventFilter* compiled_filter) const;
+
+  std::string expression_;
+
+  // Nodes of the syntax tree. The root is the last node.
+  std::vector<Node> nodes_;
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,471 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/event_store.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Fields from which the timestamp, thread and process of the events are read.
+// Context switches have the fields of the thread that is switched in.
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIdField[] = "ThreadID";
+const char kProcessNameField[] = "Process Name ( PID)";
+const char kCSwitchNewTidField[] = "New TID";
+const char kCSwitchNewProcessNameField[] = "New Process Name ( PID)";
+
+// Stack event.
+const char kStackType[] = "Stack";
+const char kStackSymbolField[] = "Image!Function";
+
+const char kHexPrefix[] = "0x";
+const size_t kHexPrefixLength = 2;
+
+// @returns true if |str| is a decimal integer without leading zeros that fits
+//    in 64 bits. |value| receives the integer.
+bool ParseDecimal(base::StringPiece str, uint64_t* value) {
+  if (str.empty() || (str.size() > 1 && str[0] == '0'))
+    return false;
+
+  uint64_t result = 0;
+  for (char c : str) {
+    if (c < '0' || c > '9')
+      return false;
+    uint64_t digit = c - '0';
+    if (result > (UINT64_MAX - digit) / 10)
+      return false;
+    result = result * 10 + digit;
+  }
+  *value = result;
+  return true;
+}
+
+// @returns true if |str| is "0x" followed by at least one character.
+bool HasHexPrefix(base::StringPiece str) {
+  return str.size() > kHexPrefixLength &&
+         str.substr(0, kHexPrefixLength) == kHexPrefix;
+}
+
+// @returns true if |field| ends with a process id in parentheses, as in
+//    "chrome.exe (1234)". |pid| receives the process id.
+bool ParsePid(base::StringPiece field, base::Pid* pid) {
+  if (field.empty() || field[field.size() - 1] != ')')
+    return false;
+  size_t open_pos = field.size() - 1;
+  while (open_pos != 0 && field[open_pos] != '(')
+    --open_pos;
+  if (field[open_pos] != '(')
+    return false;
+  base::StringPiece pid_str =
+      field.substr(open_pos + 1, field.size() - open_pos - 2);
+  return ParseDecimal(base::TrimView(pid_str), pid);
+}
+
+// @returns the hexadecimal representation of |value|, prefixed with "0x".
+std::string FormatHex(uint64_t value, bool uppercase) {
+  const char* digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+  char buffer[16];
+  size_t num_digits = 0;
+  do {
+    buffer[num_digits++] = digits[value % 16];
+    value /= 16;
+  } while (value != 0);
+
+  std::string result(kHexPrefix);
+  while (num_digits != 0)
+    result += buffer[--num_digits];
+  return result;
+}
+
+// Reorders |values| so that the value at position i comes from position
+// order[i]. Does nothing if |values| is empty.
+template <typename T>
+void Permute(const std::vector<RowIndex>& order, std::vector<T>* values) {
+  if (values->empty())
+    return;
+  DCHECK_EQ(order.size(), values->size());
+  std::vector<T> permuted;
+  permuted.reserve(order.size());
+  for (RowIndex row : order)
+    permuted.push_back((*values)[row]);
+  values->swap(permuted);
+}
+
+template <typename T>
+size_t VectorMemoryUsage(const std::vector<T>& values) {
+  return values.capacity() * sizeof(T);
+}
+
+}  // namespace
+
+EventTable::Column::Column()
+    : type(kIntegerColumn), hex_case_known(false), hex_uppercase(false) {
+}
+
+void EventTable::Column::Append(base::StringPiece value,
+                                SymbolTable* strings) {
+  if (type != kStringColumn) {
+    // The first value decides whether the column is decimal or hexadecimal.
+    if (integers.empty() && HasHexPrefix(value))
+      type = kHexIntegerColumn;
+
+    uint64_t integer = 0;
+    if (type == kIntegerColumn && ParseDecimal(value, &integer)) {
+      integers.push_back(integer);
+      return;
+    }
+    if (type == kHexIntegerColumn && HasHexPrefix(value)) {
+      // Only accept the values that FormatHex() writes back the same way.
+      base::StringPiece digits = value.substr(kHexPrefixLength);
+      bool is_valid = digits.size() <= 16 &&
+                      (digits.size() == 1 || digits[0] != '0');
+      bool has_uppercase = false;
+      bool has_lowercase = false;
+      for (size_t i = 0; is_valid && i < digits.size(); ++i) {
+        char c = digits[i];
+        uint64_t digit = 0;
+        if (c >= '0' && c <= '9') {
+          digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          digit = c - 'a' + 10;
+          has_lowercase = true;
+        } else if (c >= 'A' && c <= 'F') {
+          digit = c - 'A' + 10;
+          has_uppercase = true;
+        } else {
+          is_valid = false;
+        }
+        integer = integer * 16 + digit;
+      }
+      if (has_uppercase && has_lowercase)
+        is_valid = false;
+      if (is_valid && (has_uppercase || has_lowercase)) {
+        if (!hex_case_known) {
+          hex_case_known = true;
+          hex_uppercase = has_uppercase;
+        } else if (hex_uppercase != has_uppercase) {
+          is_valid = false;
+        }
+      }
+      if (is_valid) {
+        integers.push_back(integer);
+        return;
+      }
+    }
+
+    // Demote the column to a string column: intern the text of the values
+    // appended so far.
+    string_ids.reserve(integers.size() + 1);
+    for (RowIndex row = 0; row < integers.size(); ++row)
+      string_ids.push_back(strings->Intern(GetText(row, *strings)));
+    type = kStringColumn;
+    std::vector<uint64_t>().swap(integers);
+  }
+
+  string_ids.push_back(strings->Intern(value.as_string()));
+}
+
+std::string EventTable::Column::GetText(RowIndex row,
+                                        const SymbolTable& strings) const {
+  switch (type) {
+    case kIntegerColumn:
+      return std::to_string(integers[row]);
+    case kHexIntegerColumn:
+      return FormatHex(integers[row], hex_uppercase);
+    case kStringColumn:
+      return strings.GetSymbol(string_ids[row]);
+  }
+  return std::string();
+}
+
+EventTable::EventTable(const std::string& type,
+                       const std::vector<std::string>& column_names,
+                       SymbolTable* strings)
+    : type_(type),
+      column_names_(column_names),
+      columns_(column_names.size()),
+      strings_(strings) {
+  DCHECK(strings);
+  timestamp_column_ = FindColumn(kTimestampField);
+  tid_column_ = FindColumn(kThreadIdField);
+  if (tid_column_ == kInvalidColumn)
+    tid_column_ = FindColumn(kCSwitchNewTidField);
+  pid_column_ = FindColumn(kProcessNameField);
+  if (pid_column_ == kInvalidColumn)
+    pid_column_ = FindColumn(kCSwitchNewProcessNameField);
+}
+
+EventTable::~EventTable() {
+}
+
+const std::string& EventTable::GetColumnName(size_t column) const {
+  DCHECK_LT(column, column_names_.size());
+  return column_names_[column];
+}
+
+ColumnType EventTable::GetColumnType(size_t column) const {
+  DCHECK_LT(column, columns_.size());
+  return columns_[column].type;
+}
+
+size_t EventTable::FindColumn(const std::string& name) const {
+  auto look = std::find(column_names_.begin(), column_names_.end(), name);
+  if (look == column_names_.end())
+    return kInvalidColumn;
+  return look - column_names_.begin();
+}
+
+uint64_t EventTable::GetInteger(RowIndex row, size_t column) const {
+  DCHECK_LT(column, columns_.size());
+  DCHECK_NE(kStringColumn, columns_[column].type);
+  return columns_[column].integers[row];
+}
+
+SymbolId EventTable::GetStringId(RowIndex row, size_t column) const {
+  DCHECK_LT(column, columns_.size());
+  DCHECK_EQ(kStringColumn, columns_[column].type);
+  return columns_[column].string_ids[row];
+}
+
+void EventTable::GetValue(RowIndex row,
+                          size_t column,
+                          std::string* value) const {
+  DCHECK_LT(column, columns_.size());
+  DCHECK(value);
+  *value = columns_[column].GetText(row, *strings_);
+}
+
+RowRange EventTable::GetRowsInTimeRange(base::Timestamp start_ts,
+                                        base::Timestamp end_ts) const {
+  auto begin =
+      std::lower_bound(timestamps_.begin(), timestamps_.end(), start_ts);
+  auto end = std::lower_bound(begin, timestamps_.end(), end_ts);
+  return RowRange(static_cast<RowIndex>(begin - timestamps_.begin()),
+                  static_cast<RowIndex>(end - timestamps_.begin()));
+}
+
+RowRange EventTable::GetThreadRowsInTimeRange(base::Tid tid,
+                                              base::Timestamp start_ts,
+                                              base::Timestamp end_ts) const {
+  auto look = thread_rows_.find(tid);
+  if (look == thread_rows_.end())
+    return RowRange(nullptr, 0);
+  const std::vector<RowIndex>& rows = look->second;
+
+  auto row_is_before = [this](RowIndex row, base::Timestamp ts) {
+    return timestamps_[row] < ts;
+  };
+  auto begin = std::lower_bound(rows.begin(), rows.end(), start_ts,
+                                row_is_before);
+  auto end = std::lower_bound(begin, rows.end(), end_ts, row_is_before);
+  return RowRange(rows.data() + (begin - rows.begin()), end - begin);
+}
+
+std::vector<base::Tid> EventTable::GetThreads() const {
+  std::vector<base::Tid> threads;
+  threads.reserve(thread_rows_.size());
+  for (const auto& thread : thread_rows_)
+    threads.push_back(thread.first);
+  std::sort(threads.begin(), threads.end());
+  return threads;
+}
+
+size_t EventTable::GetMemoryUsage() const {
+  size_t usage = VectorMemoryUsage(timestamps_) + VectorMemoryUsage(tids_) +
+                 VectorMemoryUsage(pids_) + VectorMemoryUsage(stack_ids_) +
+                 VectorMemoryUsage(columns_);
+  for (const auto& column : columns_) {
+    usage += VectorMemoryUsage(column.integers) +
+             VectorMemoryUsage(column.string_ids);
+  }
+  for (const auto& thread : thread_rows_)
+    usage += sizeof(thread) + VectorMemoryUsage(thread.second);
+  return usage;
+}
+
+void EventTable::AppendRow(const ETWReader::Line& line) {
+  DCHECK_EQ(columns_.size(), line.num_fields());
+  DCHECK_LT(timestamps_.size(), static_cast<size_t>(UINT32_MAX));
+
+  for (size_t column = 0; column < columns_.size(); ++column)
+    columns_[column].Append(line.GetFieldValue(column), strings_);
+
+  base::Timestamp ts = 0;
+  if (timestamp_column_ != kInvalidColumn)
+    ParseDecimal(line.GetFieldValue(timestamp_column_), &ts);
+  base::Tid tid = base::kInvalidTid;
+  if (tid_column_ != kInvalidColumn &&
+      !ParseDecimal(line.GetFieldValue(tid_column_), &tid)) {
+    tid = base::kInvalidTid;
+  }
+  base::Pid pid = base::kInvalidPid;
+  if (pid_column_ != kInvalidColumn &&
+      !ParsePid(line.GetFieldValue(pid_column_), &pid)) {
+    pid = base::kInvalidPid;
+  }
+
+  timestamps_.push_back(ts);
+  tids_.push_back(tid);
+  pids_.push_back(pid);
+  stack_ids_.push_back(kInvalidStackId);
+}
+
+void EventTable::Finish() {
+  // The events of a trace are almost always sorted. Otherwise, sort them
+  // without changing the order of the events that have the same timestamp.
+  if (!std::is_sorted(timestamps_.begin(), timestamps_.end())) {
+    std::vector<RowIndex> order(timestamps_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [this](RowIndex left, RowIndex right) {
+                       return timestamps_[left] < timestamps_[right];
+                     });
+    Permute(order, &timestamps_);
+    Permute(order, &tids_);
+    Permute(order, &pids_);
+    Permute(order, &stack_ids_);
+    for (auto& column : columns_) {
+      Permute(order, &column.integers);
+      Permute(order, &column.string_ids);
+    }
+  }
+
+  timestamps_.shrink_to_fit();
+  tids_.shrink_to_fit();
+  pids_.shrink_to_fit();
+  stack_ids_.shrink_to_fit();
+  for (auto& column : columns_) {
+    column.integers.shrink_to_fit();
+    column.string_ids.shrink_to_fit();
+  }
+
+  for (RowIndex row = 0; row < tids_.size(); ++row) {
+    if (tids_[row] != base::kInvalidTid)
+      thread_rows_[tids_[row]].push_back(row);
+  }
+  for (auto& thread : thread_rows_)
+    thread.second.shrink_to_fit();
+}
+
+EventStore::EventStore()
+    : last_table_(nullptr),
+      stack_ts_(0),
+      stack_tid_(base::kInvalidTid),
+      num_events_(0) {
+}
+
+EventStore::~EventStore() {
+}
+
+bool EventStore::Load(const std::wstring& trace_path,
+                      const EventFilter& filter) {
+  DCHECK(tables_.empty());
+
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path))
+    return false;
+  etw_reader.set_filter(filter);
+
+  LOG(INFO) << "Loading the events of the trace in memory." << std::endl;
+
+  std::string frame;
+  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+    // The lines of a stack follow the event with which it was recorded.
+    if (it->type() == kStackType) {
+      if (frames_.empty() &&
+          (!it->GetFieldAsULong(kTimestampField, &stack_ts_) ||
+           !it->GetFieldAsULong(kThreadIdField, &stack_tid_))) {
+        LOG(ERROR) << "Unable to read the timestamp or thread of a stack.";
+        continue;
+      }
+      if (it->GetFieldAsString(kStackSymbolField, &frame))
+        frames_.push_back(strings_.Intern(frame));
+      continue;
+    }
+
+    AttachStack();
+
+    // Skip empty lines and lines whose type isn't in the header.
+    if (it->num_fields() == 0)
+      continue;
+
+    std::unique_ptr<EventTable>& table = tables_[it->type()];
+    if (!table) {
+      std::vector<std::string> column_names;
+      column_names.reserve(it->num_fields());
+      for (size_t i = 0; i < it->num_fields(); ++i)
+        column_names.push_back(it->GetFieldName(i));
+      table.reset(new EventTable(it->type(), column_names, &strings_));
+    }
+    table->AppendRow(*it);
+    last_table_ = table.get();
+    ++num_events_;
+  }
+  AttachStack();
+  last_table_ = nullptr;
+
+  for (auto& table : tables_)
+    table.second->Finish();
+
+  LOG(INFO) << "Loaded " << num_events_ << " events of " << tables_.size()
+            << " types, with " << stacks_.size() << " distinct stacks and "
+            << strings_.size() << " distinct strings." << std::endl;
+  return true;
+}
+
+const EventTable* EventStore::GetTable(const std::string& type) const {
+  auto look = tables_.find(type);
+  if (look == tables_.end())
+    return nullptr;
+  return look->second.get();
+}
+
+std::vector<std::string> EventStore::GetTypes() const {
+  std::vector<std::string> types;
+  types.reserve(tables_.size());
+  for (const auto& table : tables_)
+    types.push_back(table.first);
+  return types;
+}
+
+size_t EventStore::GetMemoryUsage() const {
+  size_t usage = 0;
+  for (const auto& table : tables_)
+    usage += table.second->GetMemoryUsage();
+  return usage;
+}
+
+void EventStore::AttachStack() {
+  if (frames_.empty())
+    return;
+
+  if (last_table_ != nullptr && last_table_->num_rows() != 0 &&
+      last_table_->timestamps_.back() == stack_ts_ &&
+      last_table_->tids_.back() == stack_tid_ &&
+      last_table_->stack_ids_.back() == kInvalidStackId) {
+    last_table_->stack_ids_.back() = stacks_.Intern(frames_);
+  }
+  frames_.clear();
+}
+
+}  // namespace etw_insights
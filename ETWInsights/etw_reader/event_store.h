@@ -0,0 +1,274 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "base/string_piece.h"
+#include "base/types.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/event_filter.h"
+#include "etw_reader/stack_table.h"
+#include "etw_reader/symbol_table.h"
+
+namespace etw_insights {
+
+// Index of a row in an event table.
+typedef uint32_t RowIndex;
+
+// Rows of an event table, by increasing timestamp. The rows are either
+// consecutive or listed by an index of the table.
+class RowRange {
+ public:
+  RowRange(RowIndex begin, RowIndex end)
+      : begin_(begin), size_(end - begin), rows_(nullptr) {}
+  RowRange(const RowIndex* rows, size_t size)
+      : begin_(0), size_(size), rows_(rows) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // @param index position in the range, smaller than size().
+  // @returns the row at |index|.
+  RowIndex operator[](size_t index) const {
+    return rows_ == nullptr ? begin_ + static_cast<RowIndex>(index)
+                            : rows_[index];
+  }
+
+ private:
+  RowIndex begin_;
+  size_t size_;
+
+  // Rows of the range, or nullptr if they are consecutive from |begin_|.
+  const RowIndex* rows_;
+};
+
+// Types of the columns of an event table. The header of a trace doesn't give
+// the types of the fields, so they are inferred from the values: a column is
+// an integer column while all its values are integers written the same way,
+// and a string column otherwise.
+enum ColumnType {
+  // Decimal integers without leading zeros.
+  kIntegerColumn,
+  // Hexadecimal integers prefixed with "0x", without leading zeros and with
+  // digits of the same case.
+  kHexIntegerColumn,
+  // Strings, stored as identifiers in the string dictionary of the store.
+  kStringColumn,
+};
+
+// Events of one type, stored column by column and sorted by timestamp.
+class EventTable {
+ public:
+  // @param type the type of the events of the table.
+  // @param column_names the fields of this type, in the order of the header.
+  // @param strings the string dictionary of the store.
+  EventTable(const std::string& type,
+             const std::vector<std::string>& column_names,
+             SymbolTable* strings);
+  ~EventTable();
+
+  const std::string& type() const { return type_; }
+  size_t num_rows() const { return timestamps_.size(); }
+  size_t num_columns() const { return columns_.size(); }
+
+  // @param column index of a column, in the order of the header.
+  // @returns the name or the type of the column.
+  const std::string& GetColumnName(size_t column) const;
+  ColumnType GetColumnType(size_t column) const;
+
+  // @param name the name of a column.
+  // @returns the index of the column, or kInvalidColumn if the table has no
+  //    column |name|.
+  size_t FindColumn(const std::string& name) const;
+
+  // @param row a row of the table.
+  // @returns the timestamp, thread, process or stack of the event. The thread
+  //    and process are kInvalidTid and kInvalidPid if the type has no such
+  //    field, and the stack is kInvalidStackId if the event has none.
+  base::Timestamp GetTimestamp(RowIndex row) const { return timestamps_[row]; }
+  base::Tid GetTid(RowIndex row) const { return tids_[row]; }
+  base::Pid GetPid(RowIndex row) const { return pids_[row]; }
+  StackId GetStackId(RowIndex row) const { return stack_ids_[row]; }
+
+  // @param row a row of the table.
+  // @param column an integer column.
+  // @returns the value of the field.
+  uint64_t GetInteger(RowIndex row, size_t column) const;
+
+  // @param row a row of the table.
+  // @param column a string column.
+  // @returns the identifier of the value of the field in the string
+  //    dictionary of the store.
+  SymbolId GetStringId(RowIndex row, size_t column) const;
+
+  // Gets the value of a field of any type, as written in the trace.
+  // @param row a row of the table.
+  // @param column a column of the table.
+  // @param value receives the value of the field.
+  void GetValue(RowIndex row, size_t column, std::string* value) const;
+
+  // @param start_ts first timestamp of the range.
+  // @param end_ts timestamp after the end of the range.
+  // @returns the rows with a timestamp in [start_ts, end_ts).
+  RowRange GetRowsInTimeRange(base::Timestamp start_ts,
+                              base::Timestamp end_ts) const;
+
+  // @param tid a thread id.
+  // @param start_ts first timestamp of the range.
+  // @param end_ts timestamp after the end of the range.
+  // @returns the rows of thread |tid| with a timestamp in [start_ts, end_ts).
+  RowRange GetThreadRowsInTimeRange(base::Tid tid,
+                                    base::Timestamp start_ts,
+                                    base::Timestamp end_ts) const;
+
+  // @returns the threads that have at least one row, by increasing id.
+  std::vector<base::Tid> GetThreads() const;
+
+  // @returns the number of bytes used by the columns and indexes of the
+  //    table, excluding the string dictionary.
+  size_t GetMemoryUsage() const;
+
+  static const size_t kInvalidColumn = static_cast<size_t>(-1);
+
+ private:
+  friend class EventStore;
+
+  struct Column {
+    Column();
+
+    // Appends a value to the column. Demotes the column to a string column
+    // if the value doesn't have its type.
+    // @param value the value to append.
+    // @param strings the string dictionary of the store.
+    void Append(base::StringPiece value, SymbolTable* strings);
+
+    // @returns the value at |row|, as written in the trace.
+    std::string GetText(RowIndex row, const SymbolTable& strings) const;
+
+    ColumnType type;
+
+    // Whether the letters of the digits of a hexadecimal column are
+    // uppercase. Only known once a value with a letter has been appended.
+    bool hex_case_known;
+    bool hex_uppercase;
+
+    // Values of an integer column, or identifiers of the values of a string
+    // column.
+    std::vector<uint64_t> integers;
+    std::vector<SymbolId> string_ids;
+  };
+
+  // Appends a row to the table.
+  // @param line a line of the trace, of the type of the table.
+  void AppendRow(const ETWReader::Line& line);
+
+  // Sorts the rows by timestamp, if they aren't already, and builds the
+  // thread index.
+  void Finish();
+
+  std::string type_;
+  std::vector<std::string> column_names_;
+
+  // Columns from which the timestamp, thread and process of the rows are
+  // read, or kInvalidColumn.
+  size_t timestamp_column_;
+  size_t tid_column_;
+  size_t pid_column_;
+
+  std::vector<base::Timestamp> timestamps_;
+  std::vector<base::Tid> tids_;
+  std::vector<base::Pid> pids_;
+  std::vector<StackId> stack_ids_;
+  std::vector<Column> columns_;
+
+  // Index: Thread id -> Rows of the thread, by increasing timestamp.
+  std::unordered_map<base::Tid, std::vector<RowIndex>> thread_rows_;
+
+  // String dictionary of the store. Not owned.
+  SymbolTable* strings_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventTable);
+};
+
+// Loads the events of a trace in memory once, so that they can be scanned by
+// time range or by thread many times without reading the trace again. Stacks
+// are attached to their events and stored once in a stack table; the values
+// of string columns and the stack frames are stored once in a string
+// dictionary.
+class EventStore {
+ public:
+  EventStore();
+  ~EventStore();
+
+  // Loads the events of a trace. Can only be called once.
+  // @param trace_path path to the trace.
+  // @param filter only the events that match this filter are loaded. Can be
+  //    empty.
+  // @returns true if the trace was loaded successfully, false otherwise.
+  bool Load(const std::wstring& trace_path, const EventFilter& filter);
+
+  // @param type a type of events.
+  // @returns the table of the events of |type|, or nullptr if no event of
+  //    this type was loaded.
+  const EventTable* GetTable(const std::string& type) const;
+
+  // @returns the types of the loaded events, in alphabetical order.
+  std::vector<std::string> GetTypes() const;
+
+  const SymbolTable& strings() const { return strings_; }
+  const StackTable& stacks() const { return stacks_; }
+  size_t num_events() const { return num_events_; }
+
+  // @returns the number of bytes used by the tables, excluding the string
+  //    dictionary and the stack table.
+  size_t GetMemoryUsage() const;
+
+ private:
+  // Attaches the stack in |frames_| to the last loaded event, if the stack
+  // was recorded with it, and clears |frames_|.
+  void AttachStack();
+
+  // Tables, by event type.
+  std::map<std::string, std::unique_ptr<EventTable>> tables_;
+
+  // Dictionary of the values of string columns and of the stack frames.
+  SymbolTable strings_;
+
+  // Distinct stacks of the loaded events.
+  StackTable stacks_;
+
+  // Table of the last loaded event, and timestamp and thread of the stack
+  // being read with its frames.
+  EventTable* last_table_;
+  base::Timestamp stack_ts_;
+  base::Tid stack_tid_;
+  StackFrames frames_;
+
+  size_t num_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventStore);
+};
+
+}  // namespace etw_insights
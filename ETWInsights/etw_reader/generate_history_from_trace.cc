@@ -20,10 +20,13 @@ limitations under the License.
 #include <unordered_map>
 #include <vector>
 
+#include "base/arena.h"
+#include "base/logging.h"
 #include "base/numeric_conversions.h"
 #include "base/string_utils.h"
 #include "base/types.h"
 #include "etw_reader/etw_reader.h"
+#include "etw_reader/history_snapshot.h"
 
 namespace etw_insights {
 
@@ -92,50 +95,118 @@ const char kChromePhaseAsyncBegin[] = "\"Async End\"";
 // Unknown stack frame.
 const char kUnknownStackFrame[] = "[Unknown]";
 
+// Map from a timestamp to a value, allocated in an arena.
+template <typename T>
+using ArenaTimestampMap =
+    std::map<base::Timestamp,
+             T,
+             std::less<base::Timestamp>,
+             base::ArenaAllocator<std::pair<const base::Timestamp, T>>>;
+
 // State of a thread.
 struct ThreadState {
-  ThreadState() {}
-
-  // Active file operation.
-  std::string file_operation;
+  // @param arena arena in which the maps of the state are allocated.
+  explicit ThreadState(base::Arena* arena)
+      : last_events(std::less<base::Timestamp>(),
+                    ArenaTimestampMap<std::string>::allocator_type(arena)),
+        last_switch_out_before_switch_in_(
+            std::less<base::Timestamp>(),
+            ArenaTimestampMap<base::Timestamp>::allocator_type(arena)) {}
+
+  // Active file operation, as a synthetic stack frame. kInvalidSymbolId if
+  // there is no active file operation.
+  SymbolId file_operation = kInvalidSymbolId;
 
   // Last events encountered on the thread (timestamp -> type).
-  std::map<base::Timestamp, std::string> last_events;
+  ArenaTimestampMap<std::string> last_events;
 
   // Timestamp of the last switch out that occurred before each switch in.
   // (Switch in ts -> Switch out ts).
-  std::map<base::Timestamp, base::Timestamp> last_switch_out_before_switch_in_;
+  ArenaTimestampMap<base::Timestamp> last_switch_out_before_switch_in_;
+
+  // Whether |matches_filter| is up to date with the start event of the thread.
+  bool filter_evaluated = false;
+
+  // Whether the thread matches the thread filter of the parse.
+  bool matches_filter = false;
 };
 
-typedef std::unordered_map<base::Tid, ThreadState> ThreadStates;
+// State of each thread. The states are allocated in an arena, which releases
+// them at once when parsing is done.
+class ThreadStates {
+ public:
+  ThreadStates()
+      : states_(0,
+                std::hash<base::Tid>(),
+                std::equal_to<base::Tid>(),
+                StateMap::allocator_type(&arena_)) {}
+
+  // @returns the state of thread |tid|, which is created if needed.
+  ThreadState& operator[](base::Tid tid) {
+    auto look = states_.find(tid);
+    if (look != states_.end())
+      return look->second;
+    return states_.emplace(tid, ThreadState(&arena_)).first->second;
+  }
+
+  // @returns the state of thread |tid|, or nullptr if it doesn't exist.
+  ThreadState* Find(base::Tid tid) {
+    auto look = states_.find(tid);
+    if (look == states_.end())
+      return nullptr;
+    return &look->second;
+  }
+
+ private:
+  typedef std::unordered_map<
+      base::Tid,
+      ThreadState,
+      std::hash<base::Tid>,
+      std::equal_to<base::Tid>,
+      base::ArenaAllocator<std::pair<const base::Tid, ThreadState>>>
+      StateMap;
+
+  // Declared before |states_| so that it is destroyed after it.
+  base::Arena arena_;
+  StateMap states_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadStates);
+};
 
-Stack ConcatenateStacks(std::initializer_list<Stack> stacks) {
-  Stack stack_res;
+Stack ConcatenateStacks(const StackAllocator& allocator,
+                        std::initializer_list<Stack> stacks) {
+  Stack stack_res(allocator);
+  size_t size = 0;
+  for (const auto& stack : stacks)
+    size += stack.size();
+  stack_res.reserve(size);
   for (const auto& stack : stacks)
     stack_res.insert(stack_res.end(), stack.begin(), stack.end());
   return stack_res;
 }
 
-void SplitProcessNameField(const std::string& value,
-                           std::string* process_name,
-                           base::Pid* pid) {
-  auto tokens = base::SplitString(value, " ");
-  *process_name = tokens[0];
-
-  size_t start_pos = 0;
-  if (tokens.back()[0] == '(')
-    start_pos = 1;
-
-  if (!base::StrToULong(
-          tokens.back().substr(start_pos, tokens.back().size() - 1 - start_pos),
-          pid)) {
-    LOG(ERROR) << "Unable to extract process id from process name field ("
-               << value << ").";
+// @returns true if the events of thread |tid| must be recorded, i.e. if the
+//    thread matches |thread_filter|. The result is cached in the state of the
+//    thread until its next start event.
+bool IsThreadSelected(base::Tid tid,
+                      const ThreadFilter& thread_filter,
+                      ThreadStates* thread_states,
+                      SystemHistory* system_history) {
+  if (thread_filter.IsEmpty())
+    return true;
+
+  ThreadState& thread_state = (*thread_states)[tid];
+  if (!thread_state.filter_evaluated) {
+    thread_state.matches_filter = thread_filter.Matches(
+        system_history->GetThread(tid), *system_history);
+    thread_state.filter_evaluated = true;
   }
+  return thread_state.matches_filter;
 }
 
 void HandleStackEvent(base::Timestamp ts,
                       ETWReader::Iterator& it,
+                      const ThreadFilter& thread_filter,
                       ThreadStates* thread_states,
                       SystemHistory* system_history) {
   // Get the event tid.
@@ -143,13 +214,25 @@ void HandleStackEvent(base::Timestamp ts,
   if (!it->GetFieldAsULong(kThreadIDField, &tid))
     LOG(ERROR) << "Unable to read column ThreadID of Stack event.";
 
-  // Get the event stack.
-  Stack stack;
+  // Skip the stack of a thread that isn't selected, without interning its
+  // symbols.
+  if (!IsThreadSelected(tid, thread_filter, thread_states, system_history)) {
+    while (it->type() == kStackType)
+      ++it;
+    DCHECK_EQ(ETWReader::kEmptyEventType, it->type());
+    return;
+  }
+
+  // Get the event stack. It is allocated in the arena of the history, so that
+  // it can be moved into the stack history of the thread.
+  SymbolTable& symbols = system_history->symbols();
+  StackAllocator stack_allocator(system_history->stack_allocator());
+  Stack stack(stack_allocator);
   while (it->type() == kStackType) {
     std::string symbol;
     if (!it->GetFieldAsString(kStackSymbolField, &symbol))
       continue;
-    stack.push_back(symbol);
+    stack.push_back(symbols.Intern(symbol));
     ++it;
   }
   DCHECK_EQ(ETWReader::kEmptyEventType, it->type());
@@ -171,9 +254,9 @@ void HandleStackEvent(base::Timestamp ts,
     if (last_stack_ts == ts) {
       auto stack_history_it = stack_history.IteratorFromTimestamp(ts);
       stack_history_it->value =
-          ConcatenateStacks({stack_history_it->value, stack});
+          ConcatenateStacks(stack_allocator, {stack_history_it->value, stack});
     } else {
-      stack_history.Insert(ts, stack);
+      stack_history.Insert(ts, std::move(stack));
     }
   } else if (associated_event_type == kCSwitchType) {
     // Handle a call stack associated with a CSwitch event.
@@ -196,29 +279,29 @@ void HandleStackEvent(base::Timestamp ts,
         // previously.
         auto stack_history_it =
             stack_history.IteratorFromTimestamp(switch_out_time);
-        stack_history_it->value =
-            ConcatenateStacks({stack_history_it->value, stack});
+        stack_history_it->value = ConcatenateStacks(
+            stack_allocator, {stack_history_it->value, stack});
       } else {
         // Save the previous stack.
-        Stack previous_stack;
+        Stack previous_stack(stack_allocator);
         stack_history.GetLastElementValue(&previous_stack);
 
         // Add the blocked stack.
         Stack off_cpu_synthetic_stack;
-        if (!thread_state.file_operation.empty())
+        if (thread_state.file_operation != kInvalidSymbolId)
           off_cpu_synthetic_stack.push_back(thread_state.file_operation);
-        off_cpu_synthetic_stack.push_back(kOffCpuStackFrame);
+        off_cpu_synthetic_stack.push_back(symbols.Intern(kOffCpuStackFrame));
 
-        stack_history.Insert(
-            switch_out_time,
-            ConcatenateStacks({off_cpu_synthetic_stack, stack}));
+        stack_history.Insert(switch_out_time,
+                             ConcatenateStacks(stack_allocator,
+                                               {off_cpu_synthetic_stack, stack}));
 
         // Add the stack that follow the blocked stack.
         if (previous_stack.empty()) {
-          previous_stack.push_back(kUnknownStackFrame);
+          previous_stack.push_back(symbols.Intern(kUnknownStackFrame));
         }
 
-        stack_history.Insert(switch_in_time, previous_stack);
+        stack_history.Insert(switch_in_time, std::move(previous_stack));
       }
     }
   }
@@ -226,7 +309,9 @@ void HandleStackEvent(base::Timestamp ts,
 
 void HandleCSwitchEvent(base::Timestamp ts,
                         const ETWReader::Line& event,
-                        ThreadStates* thread_states) {
+                        const ThreadFilter& thread_filter,
+                        ThreadStates* thread_states,
+                        SystemHistory* system_history) {
   base::Tid new_tid = 0;
   base::Tid old_tid = 0;
   base::Timestamp time_since_last = 0;
@@ -237,6 +322,9 @@ void HandleCSwitchEvent(base::Timestamp ts,
     return;
   }
 
+  if (!IsThreadSelected(new_tid, thread_filter, thread_states, system_history))
+    return;
+
   ThreadState& new_thread_state = (*thread_states)[new_tid];
   new_thread_state.last_switch_out_before_switch_in_[ts] = ts - time_since_last;
 }
@@ -260,6 +348,7 @@ void HandleProcessStartEvent(base::Timestamp ts,
 
 void HandleThreadStartEvent(base::Timestamp ts,
                             const ETWReader::Line& event,
+                            ThreadStates* thread_states,
                             SystemHistory* system_history) {
   base::Tid thread_id = 0;
   std::string process_name_field;
@@ -277,6 +366,11 @@ void HandleThreadStartEvent(base::Timestamp ts,
   auto& thread_history = system_history->GetThread(thread_id);
   thread_history.set_start_ts(ts);
   thread_history.set_parent_process_id(process_id);
+
+  // The process of the thread is now known: evaluate the filter again.
+  ThreadState* thread_state = thread_states->Find(thread_id);
+  if (thread_state != nullptr)
+    thread_state->filter_evaluated = false;
 }
 
 void HandleThreadEndEvent(base::Timestamp ts,
@@ -294,7 +388,9 @@ void HandleThreadEndEvent(base::Timestamp ts,
 
 void HandleFileIoEvent(base::Timestamp ts,
                        const ETWReader::Line& event,
-                       ThreadStates* thread_states) {
+                       const ThreadFilter& thread_filter,
+                       ThreadStates* thread_states,
+                       SystemHistory* system_history) {
   base::Tid thread_id = 0;
   std::string file_name;
   if (!event.GetFieldAsULong(kFileIoLoggingThreadIdField, &thread_id) ||
@@ -303,10 +399,15 @@ void HandleFileIoEvent(base::Timestamp ts,
     return;
   }
 
+  if (!IsThreadSelected(thread_id, thread_filter, thread_states,
+                        system_history)) {
+    return;
+  }
+
   std::string event_str(std::string("[") + event.type() + ": " + file_name +
                         "]");
   auto& thread_state = (*thread_states)[thread_id];
-  thread_state.file_operation = event_str;
+  thread_state.file_operation = system_history->symbols().Intern(event_str);
 }
 
 void HandleFileIoOpEndEvent(base::Timestamp ts,
@@ -321,8 +422,11 @@ void HandleFileIoOpEndEvent(base::Timestamp ts,
     return;
   }
 
-  auto& thread_state = (*thread_states)[thread_id];
-  thread_state.file_operation.clear();
+  // A thread without a state has no active file operation, e.g. because it
+  // doesn't match the thread filter. Don't create a state for it.
+  ThreadState* thread_state = thread_states->Find(thread_id);
+  if (thread_state != nullptr)
+    thread_state->file_operation = kInvalidSymbolId;
 }
 
 void HandleChromeEvent(base::Timestamp ts,
@@ -343,17 +447,23 @@ void HandleChromeEvent(base::Timestamp ts,
   }
 }
 
-}  // namespace
-
-bool GenerateHistoryFromTrace(const std::wstring& trace_path,
-                              SystemHistory* system_history) {
+// Traverses the events of an ETW trace that match |event_filter| to fill a
+// system history. Stacks and per-thread state are only recorded for the
+// threads that match |thread_filter|, but process and thread start/end events
+// are recorded for all threads, since they are needed to evaluate
+// |thread_filter|.
+bool ParseTrace(const std::wstring& trace_path,
+                const ThreadFilter& thread_filter,
+                const EventFilter& event_filter,
+                SystemHistory* system_history) {
   // Keeps track of the current state of each thread.
-  std::unordered_map<base::Tid, ThreadState> thread_states;
+  ThreadStates thread_states;
 
   // Open the CSV trace.
   ETWReader etw_reader;
   if (!etw_reader.Open(trace_path))
     return false;
+  etw_reader.set_filter(event_filter);
 
   // Tell the user what we are doing.
   LOG(INFO) << "Reading trace events." << std::endl;
@@ -369,14 +479,15 @@ bool GenerateHistoryFromTrace(const std::wstring& trace_path,
 
     // Handle each event type.
     if (it->type() == kStackType)
-      HandleStackEvent(ts, it, &thread_states, system_history);
+      HandleStackEvent(ts, it, thread_filter, &thread_states, system_history);
     else if (it->type() == kCSwitchType)
-      HandleCSwitchEvent(ts, *it, &thread_states);
+      HandleCSwitchEvent(ts, *it, thread_filter, &thread_states,
+                         system_history);
     else if (it->type() == kProcessStartType ||
              it->type() == kProcessDCStartType)
       HandleProcessStartEvent(ts, *it, system_history);
     else if (it->type() == kThreadStartType || it->type() == kThreadDCStartType)
-      HandleThreadStartEvent(ts, *it, system_history);
+      HandleThreadStartEvent(ts, *it, &thread_states, system_history);
     else if (it->type() == kThreadEndType || it->type() == kThreadDCEndType)
       HandleThreadEndEvent(ts, *it, system_history);
     else if (it->type() == kFileIoCreateType ||
@@ -392,7 +503,8 @@ bool GenerateHistoryFromTrace(const std::wstring& trace_path,
              it->type() == kFileIoRenameType ||
              it->type() == kFileIoDirEnumType ||
              it->type() == kFileIoDirNotifyType)
-      HandleFileIoEvent(ts, *it, &thread_states);
+      HandleFileIoEvent(ts, *it, thread_filter, &thread_states,
+                        system_history);
     else if (it->type() == kFileIoOpEnd)
       HandleFileIoOpEndEvent(ts, *it, &thread_states);
     else if (it->type() == kChromeType)
@@ -402,8 +514,11 @@ bool GenerateHistoryFromTrace(const std::wstring& trace_path,
     base::Tid tid = 0;
     if (it->GetFieldAsULong(kThreadIDField, &tid) ||
         it->GetFieldAsULong(kCSwitchNewTidField, &tid)) {
-      ThreadState& thread_state = thread_states[tid];
-      thread_state.last_events[ts] = it->type();
+      if (IsThreadSelected(tid, thread_filter, &thread_states,
+                           system_history)) {
+        ThreadState& thread_state = thread_states[tid];
+        thread_state.last_events[ts] = it->type();
+      }
     }
 
     // Keep track of the timestamp of the first and last events of the trace.
@@ -426,4 +541,41 @@ bool GenerateHistoryFromTrace(const std::wstring& trace_path,
   return true;
 }
 
+}  // namespace
+
+bool GenerateHistoryFromTrace(const std::wstring& trace_path,
+                              const GenerateHistoryOptions& options,
+                              SystemHistory* system_history) {
+  DCHECK(system_history != nullptr);
+
+  TraceFileKey key;
+  std::wstring snapshot_path(GetHistorySnapshotPath(trace_path));
+  bool use_snapshot = options.use_snapshot &&
+                      options.event_filter.IsEmpty() &&
+                      GetTraceFileKey(trace_path, &key);
+
+  if (use_snapshot &&
+      ReadHistorySnapshot(snapshot_path, key, options.thread_filter,
+                          system_history)) {
+    LOG(INFO) << "Loaded history from "
+              << base::WStringToString(snapshot_path) << "." << std::endl;
+    return true;
+  }
+
+  if (!ParseTrace(trace_path, options.thread_filter, options.event_filter,
+                  system_history)) {
+    return false;
+  }
+
+  // A history that only contains some threads can't be reused by runs with a
+  // different filter. Failing to save the snapshot only means that the next
+  // run will parse the trace again.
+  if (use_snapshot && options.thread_filter.IsEmpty() &&
+      !WriteHistorySnapshot(*system_history, key, snapshot_path)) {
+    LOG(ERROR) << "Unable to write history snapshot "
+               << base::WStringToString(snapshot_path) << ".";
+  }
+  return true;
+}
+
 }  // namespace etw_insights
@@ -18,15 +18,39 @@ limitations under the License.
 
 #include <string>
 
+#include "etw_reader/event_filter.h"
 #include "etw_reader/system_history.h"
+#include "etw_reader/thread_filter.h"
 
 namespace etw_insights {
 
+// Options of GenerateHistoryFromTrace().
+struct GenerateHistoryOptions {
+  GenerateHistoryOptions() : use_snapshot(true) {}
+
+  // Whether the history is loaded from a snapshot file next to the trace when
+  // the snapshot matches the trace, and saved to it after the trace is parsed.
+  bool use_snapshot;
+
+  // Threads for which stacks are recorded. Stack events of other threads are
+  // dropped while the trace is parsed, but the start and end of all threads
+  // and the names of all processes are kept. When the filter isn't empty, the
+  // history is loaded from an existing snapshot but no snapshot is saved.
+  ThreadFilter thread_filter;
+
+  // Events of the trace from which the history is generated. Unlike
+  // |thread_filter|, it applies to all the events, and a snapshot is neither
+  // loaded nor saved when it isn't empty.
+  EventFilter event_filter;
+};
+
 // Traverses the event of an ETW trace to fill a system history.
 // @param trace_path Path to a .etl trace file.
-// @param system_history The system history to fill.
+// @param options Options of the generation.
+// @param system_history The system history to fill. Must be empty.
 // @returns true if the history was filled successfully, false otherwise.
 bool GenerateHistoryFromTrace(const std::wstring& trace_path,
+                              const GenerateHistoryOptions& options,
                               SystemHistory* system_history);
 
 }  // namespace etw_insights
@@ -0,0 +1,366 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "etw_reader/history_snapshot.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+#include "base/buffered_writer.h"
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/memory_mapped_file.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Markers at the beginning and at the end of a snapshot file.
+const char kSnapshotMagic[8] = {'E', 'T', 'W', 'I', 'H', 'S', 'N', 'P'};
+const char kSnapshotEndMarker[8] = {'E', 'T', 'W', 'I', 'H', 'E', 'N', 'D'};
+
+// Version of the snapshot format. Must be incremented whenever the format or
+// the content of SystemHistory changes.
+const uint64_t kSnapshotVersion = 1;
+
+// Suffix of the snapshot file name.
+const wchar_t kSnapshotFileNameSuffix[] = L".history";
+
+// Alignment of the values of a snapshot file.
+const size_t kAlignment = 8;
+
+// Padding written after values that aren't aligned.
+const char kPadding[kAlignment] = {};
+
+// Header of a snapshot file. Followed by the path of the trace, the symbols,
+// the process names, the threads and the end marker.
+struct SnapshotHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t trace_size;
+  uint64_t trace_last_write_time;
+  uint64_t trace_path_size;
+  uint64_t first_event_ts;
+  uint64_t last_event_ts;
+  uint64_t first_non_empty_paint_ts;
+  uint64_t num_symbols;
+  uint64_t num_processes;
+  uint64_t num_threads;
+};
+
+// @returns the number of padding bytes after a value of |size| bytes.
+size_t GetPaddingSize(size_t size) {
+  return (kAlignment - size % kAlignment) % kAlignment;
+}
+
+// Writes the values of a snapshot file.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(base::BufferedWriter* out) : out_(out) {}
+
+  void WriteUInt64(uint64_t value) {
+    out_->Write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  // Writes a size followed by bytes, padded to the alignment.
+  void WriteBytes(const void* bytes, size_t size) {
+    WriteUInt64(size);
+    out_->Write(static_cast<const char*>(bytes), size);
+    out_->Write(kPadding, GetPaddingSize(size));
+  }
+
+  void WriteString(const std::string& str) {
+    WriteBytes(str.data(), str.size());
+  }
+
+  void WriteStack(const Stack& stack) {
+    WriteBytes(stack.data(), stack.size() * sizeof(SymbolId));
+  }
+
+ private:
+  base::BufferedWriter* out_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+// Reads the values of a snapshot file mapped in memory. All reads are
+// bounds-checked, so that a corrupted file can't cause a crash.
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size)
+      : pos_(data), end_(data + size) {}
+
+  // @returns the number of bytes that haven't been read.
+  size_t remaining() const { return static_cast<size_t>(end_ - pos_); }
+
+  bool ReadUInt64(uint64_t* value) {
+    if (static_cast<size_t>(end_ - pos_) < sizeof(*value))
+      return false;
+    memcpy(value, pos_, sizeof(*value));
+    pos_ += sizeof(*value);
+    return true;
+  }
+
+  // Reads a size followed by bytes, padded to the alignment.
+  // @param element_size size of the elements of the byte array.
+  // @param bytes receives a pointer to the bytes, aligned on kAlignment.
+  // @param num_elements receives the number of elements.
+  bool ReadBytes(size_t element_size,
+                 const uint8_t** bytes,
+                 size_t* num_elements) {
+    uint64_t size = 0;
+    if (!ReadUInt64(&size) || size % element_size != 0)
+      return false;
+    size_t remaining = static_cast<size_t>(end_ - pos_);
+    if (size > remaining || GetPaddingSize(static_cast<size_t>(size)) >
+                                remaining - static_cast<size_t>(size)) {
+      return false;
+    }
+    *bytes = pos_;
+    *num_elements = static_cast<size_t>(size) / element_size;
+    pos_ += size + GetPaddingSize(static_cast<size_t>(size));
+    return true;
+  }
+
+  bool ReadString(std::string* str) {
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+    if (!ReadBytes(1, &bytes, &size))
+      return false;
+    str->assign(reinterpret_cast<const char*>(bytes), size);
+    return true;
+  }
+
+  // @param num_symbols number of symbols in the symbol table. Stacks that
+  //    reference other symbols are rejected.
+  bool ReadStack(size_t num_symbols, Stack* stack) {
+    const uint8_t* bytes = nullptr;
+    size_t depth = 0;
+    if (!ReadBytes(sizeof(SymbolId), &bytes, &depth))
+      return false;
+    const SymbolId* frames = reinterpret_cast<const SymbolId*>(bytes);
+    for (size_t i = 0; i < depth; ++i) {
+      if (frames[i] >= num_symbols)
+        return false;
+    }
+    stack->assign(frames, frames + depth);
+    return true;
+  }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotReader);
+};
+
+// Fills |system_history| with the content of a snapshot file. The stacks of
+// the threads that don't match |thread_filter| are validated but not loaded.
+// @returns true if the content of the file is valid.
+bool ParseHistorySnapshot(const SnapshotHeader& header,
+                          SnapshotReader* reader,
+                          const ThreadFilter& thread_filter,
+                          SystemHistory* system_history) {
+  system_history->set_first_event_ts(header.first_event_ts);
+  system_history->set_last_event_ts(header.last_event_ts);
+  system_history->set_first_non_empty_paint_ts(
+      header.first_non_empty_paint_ts);
+
+  // Symbols. They are interned in the order of their identifiers.
+  SymbolTable& symbols = system_history->symbols();
+  symbols.Reserve(static_cast<size_t>(header.num_symbols));
+  std::string str;
+  for (uint64_t i = 0; i < header.num_symbols; ++i) {
+    if (!reader->ReadString(&str) || symbols.Intern(str) != i)
+      return false;
+  }
+
+  // Process names.
+  for (uint64_t i = 0; i < header.num_processes; ++i) {
+    uint64_t pid = 0;
+    if (!reader->ReadUInt64(&pid) || !reader->ReadString(&str))
+      return false;
+    system_history->SetProcessName(pid, str);
+  }
+
+  // Threads. The stacks of threads that aren't loaded are read into
+  // |skipped_stack|.
+  Stack skipped_stack;
+  for (uint64_t i = 0; i < header.num_threads; ++i) {
+    uint64_t tid = 0;
+    uint64_t pid = 0;
+    uint64_t start_ts = 0;
+    uint64_t end_ts = 0;
+    uint64_t num_stacks = 0;
+    if (!reader->ReadUInt64(&tid) || !reader->ReadUInt64(&pid) ||
+        !reader->ReadUInt64(&start_ts) || !reader->ReadUInt64(&end_ts) ||
+        !reader->ReadUInt64(&num_stacks)) {
+      return false;
+    }
+
+    ThreadHistory& thread_history = system_history->GetThread(tid);
+    thread_history.set_parent_process_id(pid);
+    thread_history.set_start_ts(start_ts);
+    thread_history.set_end_ts(end_ts);
+    bool load_stacks = thread_filter.Matches(thread_history, *system_history);
+
+    // Each stack takes at least 16 bytes, which bounds the reservation for a
+    // corrupted count.
+    ThreadHistory::StackHistory& stacks = thread_history.Stacks();
+    if (load_stacks) {
+      stacks.Reserve(static_cast<size_t>(
+          std::min<uint64_t>(num_stacks, reader->remaining() / 16)));
+    }
+    for (uint64_t j = 0; j < num_stacks; ++j) {
+      uint64_t stack_ts = 0;
+      if (!reader->ReadUInt64(&stack_ts))
+        return false;
+      if (!load_stacks) {
+        if (!reader->ReadStack(symbols.size(), &skipped_stack))
+          return false;
+        continue;
+      }
+      Stack stack(system_history->stack_allocator());
+      if (!reader->ReadStack(symbols.size(), &stack) ||
+          !stacks.Insert(stack_ts, std::move(stack))) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool GetTraceFileKey(const std::wstring& trace_path, TraceFileKey* key) {
+  DCHECK(key != nullptr);
+  key->path = base::WStringToString(trace_path);
+  return base::GetFileSizeAndLastWriteTime(trace_path, &key->size,
+                                           &key->last_write_time);
+}
+
+std::wstring GetHistorySnapshotPath(const std::wstring& trace_path) {
+  return trace_path + kSnapshotFileNameSuffix;
+}
+
+bool WriteHistorySnapshot(const SystemHistory& system_history,
+                          const TraceFileKey& key,
+                          const std::wstring& snapshot_path) {
+  base::BufferedWriter out;
+  if (!out.Open(snapshot_path, base::BufferedWriter::kFlushInBackground))
+    return false;
+  SnapshotWriter writer(&out);
+
+  const SymbolTable& symbols = system_history.symbols();
+
+  SnapshotHeader header;
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.trace_size = key.size;
+  header.trace_last_write_time = key.last_write_time;
+  header.trace_path_size = key.path.size();
+  header.first_event_ts = system_history.first_event_ts();
+  header.last_event_ts = system_history.last_event_ts();
+  header.first_non_empty_paint_ts = system_history.first_non_empty_paint_ts();
+  header.num_symbols = symbols.size();
+  header.num_processes =
+      std::distance(system_history.process_names_begin(),
+                    system_history.process_names_end());
+  header.num_threads = std::distance(system_history.threads_begin(),
+                                     system_history.threads_end());
+  out.Write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  writer.WriteString(key.path);
+
+  for (SymbolId symbol = 0; symbol < symbols.size(); ++symbol)
+    writer.WriteString(symbols.GetSymbol(symbol));
+
+  for (auto it = system_history.process_names_begin();
+       it != system_history.process_names_end(); ++it) {
+    writer.WriteUInt64(it->first);
+    writer.WriteString(it->second);
+  }
+
+  for (auto it = system_history.threads_begin();
+       it != system_history.threads_end(); ++it) {
+    const ThreadHistory& thread_history = it->second;
+    const ThreadHistory::StackHistory& stacks = thread_history.Stacks();
+    writer.WriteUInt64(it->first);
+    writer.WriteUInt64(thread_history.parent_process_id());
+    writer.WriteUInt64(thread_history.start_ts());
+    writer.WriteUInt64(thread_history.end_ts());
+    writer.WriteUInt64(stacks.size());
+    for (auto stack_it = stacks.IteratorBegin();
+         stack_it != stacks.IteratorEnd(); ++stack_it) {
+      writer.WriteUInt64(stack_it->start_ts);
+      writer.WriteStack(stack_it->value);
+    }
+  }
+
+  // The end marker is written last: its absence means that the snapshot is
+  // incomplete.
+  out.Write(kSnapshotEndMarker, sizeof(kSnapshotEndMarker));
+  return out.Close();
+}
+
+bool ReadHistorySnapshot(const std::wstring& snapshot_path,
+                         const TraceFileKey& key,
+                         const ThreadFilter& thread_filter,
+                         SystemHistory* system_history) {
+  DCHECK(system_history != nullptr);
+
+  base::MemoryMappedFile file;
+  if (!file.Open(snapshot_path))
+    return false;
+
+  // Check the header, the trace key and the end marker before parsing
+  // anything else.
+  SnapshotHeader header;
+  if (file.size() < sizeof(header) + sizeof(kSnapshotEndMarker))
+    return false;
+  memcpy(&header, file.data(), sizeof(header));
+  const uint8_t* end_marker =
+      file.data() + file.size() - sizeof(kSnapshotEndMarker);
+  if (memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+      header.version != kSnapshotVersion || header.trace_size != key.size ||
+      header.trace_last_write_time != key.last_write_time ||
+      header.trace_path_size != key.path.size() ||
+      memcmp(end_marker, kSnapshotEndMarker, sizeof(kSnapshotEndMarker)) !=
+          0) {
+    return false;
+  }
+
+  SnapshotReader reader(file.data() + sizeof(header),
+                        file.size() - sizeof(header) -
+                            sizeof(kSnapshotEndMarker));
+  std::string trace_path;
+  if (!reader.ReadString(&trace_path) || trace_path != key.path)
+    return false;
+
+  if (!ParseHistorySnapshot(header, &reader, thread_filter, system_history)) {
+    LOG(ERROR) << "Corrupted history snapshot "
+               << base::WStringToString(snapshot_path) << ".";
+    system_history->Clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
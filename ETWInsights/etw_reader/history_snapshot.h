@@ -0,0 +1,82 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "etw_reader/system_history.h"
+#include "etw_reader/thread_filter.h"
+
+namespace etw_insights {
+
+// Identifies the version of a trace file from which a history was generated.
+struct TraceFileKey {
+  TraceFileKey() : size(0), last_write_time(0) {}
+
+  // Path of the trace file.
+  std::string path;
+
+  // Size of the trace file, in bytes.
+  uint64_t size;
+
+  // Time of the last write to the trace file, as a FILETIME value.
+  uint64_t last_write_time;
+};
+
+// @param trace_path path of a trace file.
+// @param key receives the key of the current version of the trace file.
+// @returns true if the attributes of the trace file were read successfully.
+bool GetTraceFileKey(const std::wstring& trace_path, TraceFileKey* key);
+
+// @param trace_path path of a trace file.
+// @returns the path of the snapshot file of the history of the trace.
+std::wstring GetHistorySnapshotPath(const std::wstring& trace_path);
+
+// Writes a system history to a snapshot file, so that it can be loaded
+// without parsing the trace again.
+//
+// The file starts with a header that contains a version number and the key of
+// the trace, and ends with a marker that is written last, so that an
+// outdated, incompatible or incomplete snapshot is detected without reading
+// the rest of the file. In between, symbols, process names and threads are
+// stored as little-endian integers aligned on 8 bytes, so that the file can be
+// parsed in place once mapped in memory.
+// @param system_history the history to write.
+// @param key key of the trace from which the history was generated.
+// @param snapshot_path path of the snapshot file.
+// @returns true if the snapshot was written successfully.
+bool WriteHistorySnapshot(const SystemHistory& system_history,
+                          const TraceFileKey& key,
+                          const std::wstring& snapshot_path);
+
+// Loads a system history from a snapshot file.
+// @param snapshot_path path of the snapshot file.
+// @param key key of the current version of the trace. The snapshot is only
+//    loaded if it was generated from the same version of the trace.
+// @param thread_filter threads for which stacks are loaded. The stacks of
+//    other threads are skipped.
+// @param system_history the history to fill. Must be empty.
+// @returns true if the snapshot was valid and loaded successfully. Otherwise,
+//    |system_history| is left empty.
+bool ReadHistorySnapshot(const std::wstring& snapshot_path,
+                         const TraceFileKey& key,
+                         const ThreadFilter& thread_filter,
+                         SystemHistory* system_history);
+
+}  // namespace etw_insights
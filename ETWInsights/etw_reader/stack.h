@@ -16,11 +16,18 @@ limitations under the License.
 
 #pragma once
 
-#include <string>
 #include <vector>
 
+#include "base/arena.h"
+#include "etw_reader/symbol_table.h"
+
 namespace etw_insights {
 
-typedef std::vector<std::string> Stack;
+// A call stack. Each frame is a symbol interned in the SymbolTable of the
+// SystemHistory. Frames are ordered from the most recent call to the oldest.
+// The frames of the stacks stored in a SystemHistory are allocated in its
+// arena. Other stacks use the heap.
+typedef base::ArenaAllocator<SymbolId> StackAllocator;
+typedef std::vector<SymbolId, StackAllocator> Stack;
 
 }  // namespace etw_insights
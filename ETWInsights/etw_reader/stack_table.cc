@@ -0,0 +1,49 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/stack_table.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+size_t StackTable::StackFramesHash::operator()(
+    const StackFrames& frames) const {
+  // FNV-1a over the symbol identifiers.
+  uint64_t hash = 14695981039346656037ULL;
+  for (SymbolId frame : frames) {
+    hash ^= frame;
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(hash);
+}
+
+StackTable::StackTable() {}
+
+StackId StackTable::Intern(const StackFrames& frames) {
+  auto insert_result =
+      ids_.insert({frames, static_cast<StackId>(stacks_.size())});
+  if (insert_result.second)
+    stacks_.push_back(&insert_result.first->first);
+  return insert_result.first->second;
+}
+
+const StackFrames& StackTable::GetStack(StackId id) const {
+  DCHECK_LT(id, stacks_.size());
+  return *stacks_[id];
+}
+
+}  // namespace etw_insights
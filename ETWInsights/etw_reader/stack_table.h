@@ -0,0 +1,71 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/symbol_table.h"
+
+namespace etw_insights {
+
+// Identifier of an interned stack. Identifiers are dense: they go from 0 to
+// the number of stacks in the table minus one.
+typedef uint32_t StackId;
+
+const StackId kInvalidStackId = static_cast<StackId>(-1);
+
+// Frames of a stack, as interned symbols.
+typedef std::vector<SymbolId> StackFrames;
+
+// Stores each distinct stack of a trace once and associates it with a small
+// integer identifier, so that events with the same stack share its frames.
+class StackTable {
+ public:
+  StackTable();
+
+  // Interns a stack.
+  // @param frames the frames of the stack to intern.
+  // @returns the identifier of |frames|. The same identifier is returned every
+  //    time the same frames are interned.
+  StackId Intern(const StackFrames& frames);
+
+  // @param id identifier of an interned stack.
+  // @returns the frames associated with |id|.
+  const StackFrames& GetStack(StackId id) const;
+
+  // @returns the number of stacks in the table.
+  size_t size() const { return stacks_.size(); }
+
+ private:
+  struct StackFramesHash {
+    size_t operator()(const StackFrames& frames) const;
+  };
+
+  // Map: Frames -> Identifier.
+  std::unordered_map<StackFrames, StackId, StackFramesHash> ids_;
+
+  // Stacks, indexed by identifier. Points to the keys of |ids_|.
+  std::vector<const StackFrames*> stacks_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackTable);
+};
+
+}  // namespace etw_insights
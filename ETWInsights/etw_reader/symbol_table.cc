@@ -0,0 +1,55 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "etw_reader/symbol_table.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+SymbolTable::SymbolTable() {}
+
+SymbolId SymbolTable::Intern(const std::string& symbol) {
+  auto insert_result =
+      ids_.insert({symbol, static_cast<SymbolId>(symbols_.size())});
+  if (insert_result.second)
+    symbols_.push_back(&insert_result.first->first);
+  return insert_result.first->second;
+}
+
+SymbolId SymbolTable::Find(const std::string& symbol) const {
+  auto look = ids_.find(symbol);
+  if (look == ids_.end())
+    return kInvalidSymbolId;
+  return look->second;
+}
+
+const std::string& SymbolTable::GetSymbol(SymbolId id) const {
+  DCHECK_LT(id, symbols_.size());
+  return *symbols_[id];
+}
+
+void SymbolTable::Reserve(size_t size) {
+  ids_.reserve(size);
+  symbols_.reserve(size);
+}
+
+void SymbolTable::Clear() {
+  ids_.clear();
+  symbols_.clear();
+}
+
+}  // namespace etw_insights
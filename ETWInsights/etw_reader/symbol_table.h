@@ -0,0 +1,75 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+
+namespace etw_insights {
+
+// Identifier of an interned symbol. Identifiers are dense: they go from 0 to
+// the number of symbols in the table minus one.
+typedef uint32_t SymbolId;
+
+const SymbolId kInvalidSymbolId = static_cast<SymbolId>(-1);
+
+// Stores each distinct symbol of a trace once and associates it with a small
+// integer identifier.
+class SymbolTable {
+ public:
+  SymbolTable();
+
+  // Interns a symbol.
+  // @param symbol the symbol to intern.
+  // @returns the identifier of |symbol|. The same identifier is returned every
+  //    time the same symbol is interned.
+  SymbolId Intern(const std::string& symbol);
+
+  // Looks up a symbol without interning it.
+  // @param symbol the symbol to look up.
+  // @returns the identifier of |symbol|, or kInvalidSymbolId if it hasn't been
+  //    interned.
+  SymbolId Find(const std::string& symbol) const;
+
+  // @param id identifier of an interned symbol.
+  // @returns the symbol associated with |id|.
+  const std::string& GetSymbol(SymbolId id) const;
+
+  // @returns the number of symbols in the table.
+  size_t size() const { return symbols_.size(); }
+
+  // Reserves memory for |size| symbols.
+  void Reserve(size_t size);
+
+  // Removes all symbols from the table.
+  void Clear();
+
+ private:
+  // Map: Symbol -> Identifier.
+  std::unordered_map<std::string, SymbolId> ids_;
+
+  // Symbols, indexed by identifier. Points to the keys of |ids_|.
+  std::vector<const std::string*> symbols_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolTable);
+};
+
+}  // namespace etw_insights
@@ -21,14 +21,26 @@ namespace etw_insights {
 SystemHistory::SystemHistory()
     : first_event_ts_(0),
       last_event_ts_(base::kInvalidTimestamp),
-      first_non_empty_paint_ts_(base::kInvalidTimestamp) {}
+      first_non_empty_paint_ts_(base::kInvalidTimestamp),
+      threads_(0,
+               std::hash<base::Tid>(),
+               std::equal_to<base::Tid>(),
+               ThreadHistoryMap::allocator_type(&arena_)) {}
+
+void SystemHistory::Clear() {
+  first_event_ts_ = 0;
+  last_event_ts_ = base::kInvalidTimestamp;
+  first_non_empty_paint_ts_ = base::kInvalidTimestamp;
+  threads_.clear();
+  symbols_.Clear();
+  process_names_.clear();
+}
 
 ThreadHistory& SystemHistory::GetThread(base::Tid tid) {
   auto look = threads_.find(tid);
   if (look != threads_.end())
     return look->second;
-  threads_[tid] = ThreadHistory(tid);
-  return threads_[tid];
+  return threads_.emplace(tid, ThreadHistory(tid)).first->second;
 }
 
 void SystemHistory::SetProcessName(base::Pid process_id,
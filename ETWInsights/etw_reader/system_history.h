@@ -16,21 +16,39 @@ limitations under the License.
 
 #pragma once
 
+#include <functional>
 #include <unordered_map>
 
+#include "base/arena.h"
 #include "base/base.h"
 #include "base/types.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/symbol_table.h"
 #include "etw_reader/thread_history.h"
 
 namespace etw_insights {
 
-// Contains the history of a system for the duration of a trace.
+// Contains the history of a system for the duration of a trace. The threads
+// and the frames of their stacks are allocated in an arena that is released at
+// once when the SystemHistory is destroyed.
 class SystemHistory {
  public:
-  typedef std::unordered_map<base::Tid, ThreadHistory> ThreadHistoryMap;
+  typedef std::unordered_map<
+      base::Tid,
+      ThreadHistory,
+      std::hash<base::Tid>,
+      std::equal_to<base::Tid>,
+      base::ArenaAllocator<std::pair<const base::Tid, ThreadHistory>>>
+      ThreadHistoryMap;
+  typedef std::unordered_map<base::Pid, std::string> ProcessNameMap;
 
   SystemHistory();
 
+  // Removes all threads, process names and symbols, and resets the
+  // timestamps. The memory of the removed threads is only released when the
+  // SystemHistory is destroyed.
+  void Clear();
+
   ThreadHistory& GetThread(base::Tid tid);
 
   void set_first_event_ts(base::Timestamp ts) { first_event_ts_ = ts; }
@@ -49,6 +67,15 @@ class SystemHistory {
   void SetProcessName(base::Pid process_id, const std::string& process_name);
   const std::string& GetProcessName(base::Pid process_id) const;
 
+  // @returns an allocator for stacks that are inserted in the stack history of
+  //    a thread. Stacks built with it are moved into the history instead of
+  //    being copied.
+  StackAllocator stack_allocator() { return StackAllocator(&arena_); }
+
+  // Symbols that appear in the stacks of the threads.
+  SymbolTable& symbols() { return symbols_; }
+  const SymbolTable& symbols() const { return symbols_; }
+
   ThreadHistoryMap::const_iterator threads_begin() const {
     return threads_.begin();
   }
@@ -56,6 +83,13 @@ class SystemHistory {
     return threads_.end();
   }
 
+  ProcessNameMap::const_iterator process_names_begin() const {
+    return process_names_.begin();
+  }
+  ProcessNameMap::const_iterator process_names_end() const {
+    return process_names_.end();
+  }
+
  private:
   // Empty string.
   std::string empty_string_;
@@ -69,11 +103,18 @@ class SystemHistory {
   // Timestamp of the first non empty paint, in Chrome.
   base::Timestamp first_non_empty_paint_ts_;
 
+  // Memory of the threads and of their stacks. Declared before |threads_| so
+  // that it is destroyed after it.
+  base::Arena arena_;
+
   // History of each thread.
   ThreadHistoryMap threads_;
 
+  // Symbols referenced by the stack histories.
+  SymbolTable symbols_;
+
   // Process names (Process ID -> Process Name).
-  std::unordered_map<base::Pid, std::string> process_names_;
+  ProcessNameMap process_names_;
 
   DISALLOW_COPY_AND_ASSIGN(SystemHistory);
 };
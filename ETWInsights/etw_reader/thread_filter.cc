@@ -0,0 +1,88 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "etw_reader/thread_filter.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Names of the conditions of a filter specification.
+const char kProcessNameCondition[] = "process_name";
+const char kPidCondition[] = "pid";
+const char kTidCondition[] = "tid";
+
+}  // namespace
+
+ThreadFilter::ThreadFilter()
+    : pid_(base::kInvalidPid), tid_(base::kInvalidTid) {}
+
+bool ThreadFilter::Parse(const std::string& spec) {
+  std::vector<std::string> conditions = base::SplitString(spec, " ");
+  for (const std::string& condition : conditions) {
+    if (condition.empty())
+      continue;
+
+    size_t separator = condition.find('=');
+    if (separator == std::string::npos) {
+      LOG(ERROR) << "Invalid thread filter condition: " << condition;
+      return false;
+    }
+    std::string name = condition.substr(0, separator);
+    std::string value = condition.substr(separator + 1);
+
+    if (name == kProcessNameCondition) {
+      process_name_ = value;
+    } else if (name == kPidCondition) {
+      if (!base::StrToULong(value, &pid_)) {
+        LOG(ERROR) << "Invalid process id in thread filter: " << value;
+        return false;
+      }
+    } else if (name == kTidCondition) {
+      if (!base::StrToULong(value, &tid_)) {
+        LOG(ERROR) << "Invalid thread id in thread filter: " << value;
+        return false;
+      }
+    } else {
+      LOG(ERROR) << "Unknown thread filter condition: " << name;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ThreadFilter::Matches(const ThreadHistory& thread_history,
+                           const SystemHistory& system_history) const {
+  if (tid_ != base::kInvalidTid && tid_ != thread_history.tid())
+    return false;
+  if (pid_ != base::kInvalidPid && pid_ != thread_history.parent_process_id())
+    return false;
+  if (!process_name_.empty() &&
+      process_name_ !=
+          system_history.GetProcessName(thread_history.parent_process_id())) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,78 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <string>
+
+#include "base/types.h"
+#include "etw_reader/system_history.h"
+#include "etw_reader/thread_history.h"
+
+namespace etw_insights {
+
+// Selects threads by process name, process id and thread id. A thread matches
+// the filter if it satisfies all the conditions that are set. An empty filter
+// matches all threads.
+//
+// A filter can be parsed from a list of space-separated conditions:
+//   process_name=<name> pid=<process id> tid=<thread id>
+class ThreadFilter {
+ public:
+  ThreadFilter();
+
+  // Parses a list of conditions and adds them to the filter.
+  // @param spec conditions, in the format described above.
+  // @returns true if |spec| was parsed successfully.
+  bool Parse(const std::string& spec);
+
+  void set_process_name(const std::string& process_name) {
+    process_name_ = process_name;
+  }
+  const std::string& process_name() const { return process_name_; }
+
+  void set_pid(base::Pid pid) { pid_ = pid; }
+  base::Pid pid() const { return pid_; }
+
+  void set_tid(base::Tid tid) { tid_ = tid; }
+  base::Tid tid() const { return tid_; }
+
+  // @returns true if the filter has no condition.
+  bool IsEmpty() const {
+    return process_name_.empty() && pid_ == base::kInvalidPid &&
+           tid_ == base::kInvalidTid;
+  }
+
+  // @param thread_history the thread to test.
+  // @param system_history the history that contains the thread, used to look
+  //    up the name of its process.
+  // @returns true if the thread matches the filter.
+  bool Matches(const ThreadHistory& thread_history,
+               const SystemHistory& system_history) const;
+
+ private:
+  // Name of the process of the thread. Empty for any process.
+  std::string process_name_;
+
+  // Id of the process of the thread. kInvalidPid for any process.
+  base::Pid pid_;
+
+  // Id of the thread. kInvalidTid for any thread.
+  base::Tid tid_;
+};
+
+}  // namespace etw_insights
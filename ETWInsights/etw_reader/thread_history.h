@@ -49,6 +49,9 @@ class ThreadHistory {
   }
   base::Timestamp parent_process_id() const { return parent_process_id_; }
 
+  // The elements of the history are kept on the heap, since the array that
+  // holds them is reallocated as it grows. The frames of the stacks can be
+  // allocated in an arena (see SystemHistory::stack_allocator()).
   typedef base::History<Stack> StackHistory;
   StackHistory& Stacks() { return stacks_; }
   const StackHistory& Stacks() const { return stacks_; }
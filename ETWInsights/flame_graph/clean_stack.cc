@@ -16,80 +16,241 @@ limitations under the License.
 
 #include "flame_graph/clean_stack.h"
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
 #include "base/string_utils.h"
 
 namespace etw_insights {
 
 namespace {
 
-const size_t kMaxStackSize = 60;
+const size_t kDefaultMaxStackSize = 60;
 
-std::string CleanSymbol(const std::string& symbol) {
-  // Don't clean special symbols.
-  if (symbol.empty() || symbol.front() == '[')
-    return symbol;
+// Remove these extensions from module names.
+const char* kDefaultModuleSuffixes[] = {".dll", ".exe"};
 
-  std::string cleaned_symbol(symbol);
+// Replace the frames from these symbols to the next [Off-CPU] frame by
+// [Page Fault].
+const char* kDefaultPageFaultFrames[] = {"ntoskrnl.exe!KiPageFault"};
 
-  // Replace semicolons colons.
-  base::ReplaceAll(";", ",", &cleaned_symbol);
+const char* kDefaultFramesToDrop[] = {
+    // Symbols at the bottom of the stack.
+    "ntdll.dll!_RtlUserThreadStart", "ntdll.dll!__RtlUserThreadStart",
+    "kernel32.dll!BaseThreadInitThunk", "chrome.exe!__tmainCRTStartup",
+    // Symbols at the top of the stack.
+    "ntoskrnl.exe!SwapContext_PatchLdMxCsr", "ntoskrnl.exe!KiSwapContext",
+    "ntoskrnl.exe!KiSwapThread", "ntoskrnl.exe!KiCommitThreadWait",
+    "ntoskrnl.exe!KeWaitForSingleObject",
+};
 
-  // Remove dll and exe extensions.
-  base::ReplaceAll(".dll!", "!", &cleaned_symbol);
-  base::ReplaceAll(".exe!", "!", &cleaned_symbol);
+// Keywords of the rules file.
+const char kStripModuleSuffixKeyword[] = "strip_module_suffix";
+const char kDropFrameKeyword[] = "drop_frame";
+const char kPageFaultFrameKeyword[] = "page_fault_frame";
+const char kMaxDepthKeyword[] = "max_depth";
+const char kCommentPrefix = '#';
 
-  return cleaned_symbol;
+// Special stack frames.
+const char kOffCpuStackFrame[] = "[Off-CPU]";
+const char kPageFaultStackFrame[] = "[Page Fault]";
+const char kTruncatedStackFrame[] = "[Truncated]";
+
+// Separator between the module and the function in a symbol.
+const char kModuleSeparator = '!';
+
+bool Contains(const std::vector<std::string>& vec, const std::string& value) {
+  return std::find(vec.begin(), vec.end(), value) != vec.end();
 }
 
 }  // namespace
 
-Stack CleanStack(const Stack& stack) {
-  Stack cleaned_stack;
+StackCleaner::StackCleaner()
+    : max_depth_(kDefaultMaxStackSize), cached_symbols_(nullptr) {
+  page_fault_id_ = cleaned_symbols_.Intern(kPageFaultStackFrame);
+  off_cpu_id_ = cleaned_symbols_.Intern(kOffCpuStackFrame);
+  truncated_id_ = cleaned_symbols_.Intern(kTruncatedStackFrame);
+}
+
+void StackCleaner::LoadDefaultRules() {
+  Clear();
+  module_suffixes_.assign(std::begin(kDefaultModuleSuffixes),
+                          std::end(kDefaultModuleSuffixes));
+  page_fault_frames_.assign(std::begin(kDefaultPageFaultFrames),
+                            std::end(kDefaultPageFaultFrames));
+  frames_to_drop_.assign(std::begin(kDefaultFramesToDrop),
+                         std::end(kDefaultFramesToDrop));
+  max_depth_ = kDefaultMaxStackSize;
+}
+
+bool StackCleaner::LoadFromFile(const std::wstring& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Unable to open clean rules file "
+               << base::WStringToString(path) << ".";
+    return false;
+  }
+
+  std::stringstream rules;
+  rules << file.rdbuf();
+
+  Clear();
+  return ParseRules(rules.str());
+}
+
+bool StackCleaner::ParseRules(const std::string& rules) {
+  cached_symbols_ = nullptr;
+
+  std::istringstream stream(rules);
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(stream, line)) {
+    ++line_number;
+    line = base::Trim(line);
+    if (line.empty() || line.front() == kCommentPrefix)
+      continue;
+
+    size_t keyword_end = line.find(' ');
+    std::string keyword = line.substr(0, keyword_end);
+    std::string argument = keyword_end == std::string::npos
+                               ? std::string()
+                               : base::Trim(line.substr(keyword_end));
+
+    if (argument.empty()) {
+      LOG(ERROR) << "Missing argument in clean rule at line " << line_number
+                 << ".";
+      return false;
+    }
+
+    if (keyword == kStripModuleSuffixKeyword) {
+      module_suffixes_.push_back(argument);
+    } else if (keyword == kDropFrameKeyword) {
+      frames_to_drop_.push_back(argument);
+    } else if (keyword == kPageFaultFrameKeyword) {
+      page_fault_frames_.push_back(argument);
+    } else if (keyword == kMaxDepthKeyword) {
+      uint64_t max_depth = 0;
+      if (!base::StrToULong(argument, &max_depth)) {
+        LOG(ERROR) << "Invalid max_depth at line " << line_number << ".";
+        return false;
+      }
+      max_depth_ = static_cast<size_t>(max_depth);
+    } else {
+      LOG(ERROR) << "Unknown clean rule '" << keyword << "' at line "
+                 << line_number << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void StackCleaner::Clear() {
+  module_suffixes_.clear();
+  frames_to_drop_.clear();
+  page_fault_frames_.clear();
+  max_depth_ = kDefaultMaxStackSize;
+  cached_symbols_ = nullptr;
+}
+
+void StackCleaner::CleanStack(const Stack& stack,
+                              const SymbolTable& symbols,
+                              Stack* cleaned_stack) {
+  DCHECK(cleaned_stack != nullptr);
+  cleaned_stack->clear();
+
+  // Discard the cached rewrites if the rules or the symbol table changed.
+  if (cached_symbols_ != &symbols) {
+    frame_rewrites_.clear();
+    cached_symbols_ = &symbols;
+  }
+  if (frame_rewrites_.size() < symbols.size())
+    frame_rewrites_.resize(symbols.size());
 
   bool is_in_page_fault = false;
 
   for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
     // Truncate tall stacks.
-    if (cleaned_stack.size() > kMaxStackSize) {
-      cleaned_stack.push_back("[Truncated]");
+    if (cleaned_stack->size() > max_depth_) {
+      cleaned_stack->push_back(truncated_id_);
       break;
     }
 
+    const FrameRewrite& rewrite = GetFrameRewrite(*it, symbols);
+
     // Simplify page fault call stack.
-    if (*it == "ntoskrnl.exe!KiPageFault") {
+    if (rewrite.action == FRAME_PAGE_FAULT)
       is_in_page_fault = true;
-    }
     if (is_in_page_fault) {
-      if (*it == "[Off-CPU]") {
+      if (rewrite.action == FRAME_OFF_CPU) {
         is_in_page_fault = false;
-        cleaned_stack.push_back("[Page Fault]");
-        cleaned_stack.push_back("[Off-CPU]");
+        cleaned_stack->push_back(page_fault_id_);
+        cleaned_stack->push_back(off_cpu_id_);
       }
       continue;
     }
 
-    // Ignore some symbols at the bottom of the stack.
-    if (*it == "ntdll.dll!_RtlUserThreadStart" ||
-        *it == "ntdll.dll!__RtlUserThreadStart" ||
-        *it == "kernel32.dll!BaseThreadInitThunk" ||
-        *it == "chrome.exe!__tmainCRTStartup") {
-      continue;
-    }
-
-    // Ignore some symbols at the top of the stack.
-    if (*it == "ntoskrnl.exe!SwapContext_PatchLdMxCsr" ||
-        *it == "ntoskrnl.exe!KiSwapContext" ||
-        *it == "ntoskrnl.exe!KiSwapThread" ||
-        *it == "ntoskrnl.exe!KiCommitThreadWait" ||
-        *it == "ntoskrnl.exe!KeWaitForSingoeObject") {
+    // Ignore uninteresting symbols.
+    if (rewrite.action == FRAME_DROP)
       continue;
-    }
 
     // Add the symbol to the cleaned stack.
-    cleaned_stack.push_back(CleanSymbol(*it));
+    cleaned_stack->push_back(rewrite.cleaned_id);
+  }
+}
+
+const StackCleaner::FrameRewrite& StackCleaner::GetFrameRewrite(
+    SymbolId symbol_id,
+    const SymbolTable& symbols) {
+  DCHECK_LT(symbol_id, frame_rewrites_.size());
+  FrameRewrite& rewrite = frame_rewrites_[symbol_id];
+  if (rewrite.action != FRAME_NOT_COMPUTED)
+    return rewrite;
+
+  const std::string& symbol = symbols.GetSymbol(symbol_id);
+  if (symbol == kOffCpuStackFrame) {
+    rewrite.action = FRAME_OFF_CPU;
+    rewrite.cleaned_id = off_cpu_id_;
+  } else if (Contains(page_fault_frames_, symbol)) {
+    rewrite.action = FRAME_PAGE_FAULT;
+  } else if (Contains(frames_to_drop_, symbol)) {
+    rewrite.action = FRAME_DROP;
+  } else {
+    rewrite.action = FRAME_KEEP;
+    rewrite.cleaned_id = cleaned_symbols_.Intern(CleanSymbol(symbol));
   }
 
-  return cleaned_stack;
+  return rewrite;
+}
+
+std::string StackCleaner::CleanSymbol(const std::string& symbol) const {
+  // Don't clean special symbols.
+  if (symbol.empty() || symbol.front() == '[')
+    return symbol;
+
+  std::string cleaned_symbol(symbol);
+
+  // Replace semicolons by commas, since semicolons separate frames in the
+  // reports.
+  std::replace(cleaned_symbol.begin(), cleaned_symbol.end(), ';', ',');
+
+  // Remove the extension of the module name.
+  size_t module_end = cleaned_symbol.find(kModuleSeparator);
+  if (module_end == std::string::npos)
+    return cleaned_symbol;
+  for (const auto& suffix : module_suffixes_) {
+    if (suffix.size() <= module_end &&
+        cleaned_symbol.compare(module_end - suffix.size(), suffix.size(),
+                               suffix) == 0) {
+      cleaned_symbol.erase(module_end - suffix.size(), suffix.size());
+      break;
+    }
+  }
+
+  return cleaned_symbol;
 }
 
 }  // namespace etw_insights
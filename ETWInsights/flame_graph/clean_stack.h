@@ -16,16 +16,117 @@ limitations under the License.
 
 #pragma once
 
-#include "etw_reader/stack.h"
-
 #include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/symbol_table.h"
 
 namespace etw_insights {
 
-// Cleans a call stack.
+// Cleans call stacks before they are written to a report.
 // - Tall call stacks are truncated.
 // - Frames related to page faults are replaced by [Page Fault].
 // - Uninteresting frames are removed.
-Stack CleanStack(const Stack& stack);
+// - Module extensions are removed from symbols and semicolons are replaced by
+//   commas.
+//
+// The rules can be read from a text file that contains one rule per line.
+// Empty lines and lines that start with '#' are ignored.
+//   strip_module_suffix <suffix>
+//     Remove <suffix> from module names (e.g. ".dll").
+//   drop_frame <symbol>
+//     Remove frames whose symbol is <symbol>.
+//   page_fault_frame <symbol>
+//     Replace the frames from <symbol> to the next [Off-CPU] frame by
+//     [Page Fault].
+//   max_depth <depth>
+//     Truncate call stacks that have more than <depth> frames.
+//
+// Symbols are rewritten once per symbol id and the result is cached.
+class StackCleaner {
+ public:
+  StackCleaner();
+
+  // Replaces the current rules with the default rules.
+  void LoadDefaultRules();
+
+  // Replaces the current rules with the rules read from a file.
+  // @param path path to the rules file.
+  // @returns true if the file was read and parsed successfully.
+  bool LoadFromFile(const std::wstring& path);
+
+  // Adds the rules described by |rules| to the current rules.
+  // @param rules rules, in the format described above.
+  // @returns true if |rules| was parsed successfully.
+  bool ParseRules(const std::string& rules);
+
+  // Removes all rules.
+  void Clear();
+
+  // Cleans a call stack.
+  // @param stack the call stack to clean.
+  // @param symbols the symbol table of |stack|. The cached rewrites are
+  //    discarded when a different symbol table is used.
+  // @param cleaned_stack receives the cleaned stack, from the oldest call to
+  //    the most recent. Its frames are interned in cleaned_symbols().
+  void CleanStack(const Stack& stack,
+                  const SymbolTable& symbols,
+                  Stack* cleaned_stack);
+
+  // @returns the symbol table of the cleaned stacks.
+  const SymbolTable& cleaned_symbols() const { return cleaned_symbols_; }
+
+ private:
+  // What to do with a frame.
+  enum FrameAction {
+    FRAME_NOT_COMPUTED,
+    FRAME_KEEP,
+    FRAME_DROP,
+    FRAME_PAGE_FAULT,
+    FRAME_OFF_CPU,
+  };
+
+  // Result of applying the rules to a symbol.
+  struct FrameRewrite {
+    FrameRewrite() : action(FRAME_NOT_COMPUTED), cleaned_id(kInvalidSymbolId) {}
+
+    // What to do with the frame.
+    FrameAction action;
+
+    // Identifier of the cleaned symbol in |cleaned_symbols_|.
+    SymbolId cleaned_id;
+  };
+
+  // @returns the rewrite for |symbol_id|, computing it if necessary.
+  const FrameRewrite& GetFrameRewrite(SymbolId symbol_id,
+                                      const SymbolTable& symbols);
+
+  // @returns the cleaned version of |symbol|.
+  std::string CleanSymbol(const std::string& symbol) const;
+
+  // Rules.
+  std::vector<std::string> module_suffixes_;
+  std::vector<std::string> frames_to_drop_;
+  std::vector<std::string> page_fault_frames_;
+  size_t max_depth_;
+
+  // Interned special frames.
+  SymbolId page_fault_id_;
+  SymbolId off_cpu_id_;
+  SymbolId truncated_id_;
+
+  // Cached rewrites, indexed by symbol id.
+  std::vector<FrameRewrite> frame_rewrites_;
+
+  // Symbol table for which the rewrites were cached.
+  const SymbolTable* cached_symbols_;
+
+  // Symbols of the cleaned stacks.
+  SymbolTable cleaned_symbols_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackCleaner);
+};
 
 }  // namespace etw_insights
@@ -0,0 +1,152 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/flame_chart.h"
+
+#include <algorithm>
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Header of the CSV report.
+const char kCsvHeader[] = "ThreadID,Depth,Start,End,Duration,Frame\n";
+
+}  // namespace
+
+FlameChart::FlameChart(const SymbolTable& symbols)
+    : symbols_(symbols), min_span_width_(0) {
+  ignore_rules_.LoadDefaultRules();
+  stack_cleaner_.LoadDefaultRules();
+}
+
+void FlameChart::WalkThreadHistory(const ThreadHistory& thread_history,
+                                   base::Timestamp start_ts,
+                                   base::Timestamp end_ts,
+                                   const SpanCallback& callback) {
+  // Frames of the current call stack, from the oldest call to the most recent,
+  // with the time at which they became active.
+  std::vector<std::pair<SymbolId, base::Timestamp>> open_frames;
+  base::Timestamp last_end_ts = start_ts;
+
+  // Ends the spans of the current call stack from |depth| to the top.
+  auto close_frames = [&](size_t depth, base::Timestamp ts) {
+    while (open_frames.size() > depth) {
+      FlameChartSpan span;
+      span.tid = thread_history.tid();
+      span.depth = open_frames.size() - 1;
+      span.symbol = open_frames.back().first;
+      span.start_ts = open_frames.back().second;
+      span.end_ts = ts;
+      callback(span);
+      open_frames.pop_back();
+    }
+  };
+
+  Stack cleaned_stack;
+  auto it = thread_history.Stacks().IteratorFromTimestamp(start_ts);
+  auto end_it = thread_history.Stacks().IteratorEnd();
+
+  for (; it != end_it && it->start_ts < end_ts; ++it) {
+    base::Timestamp stack_start_ts = std::max(start_ts, it->start_ts);
+
+    base::Timestamp stack_end_ts = std::min(end_ts, thread_history.end_ts());
+    auto next_it = it + 1;
+    if (next_it != end_it && next_it->start_ts < stack_end_ts)
+      stack_end_ts = next_it->start_ts;
+
+    if (stack_end_ts < stack_start_ts)
+      continue;
+
+    // Short call stacks are absorbed by the call stack that precedes them.
+    if (stack_end_ts - stack_start_ts < min_span_width_ &&
+        !open_frames.empty()) {
+      last_end_ts = stack_end_ts;
+      continue;
+    }
+
+    // Ignored call stacks are shown as idle time.
+    if (ignore_rules_.ShouldIgnoreStack(it->value, symbols_))
+      cleaned_stack.clear();
+    else
+      stack_cleaner_.CleanStack(it->value, symbols_, &cleaned_stack);
+
+    // Keep the spans of the frames shared with the previous call stack open.
+    size_t common_depth = 0;
+    while (common_depth < open_frames.size() &&
+           common_depth < cleaned_stack.size() &&
+           open_frames[common_depth].first == cleaned_stack[common_depth]) {
+      ++common_depth;
+    }
+
+    close_frames(common_depth, stack_start_ts);
+    for (size_t depth = common_depth; depth < cleaned_stack.size(); ++depth)
+      open_frames.push_back({cleaned_stack[depth], stack_start_ts});
+
+    last_end_ts = stack_end_ts;
+  }
+
+  close_frames(0, last_end_ts);
+}
+
+void FlameChart::AddThreadHistory(const ThreadHistory& thread_history,
+                                  base::Timestamp start_ts,
+                                  base::Timestamp end_ts) {
+  size_t first_span_index = spans_.size();
+  WalkThreadHistory(
+      thread_history, start_ts, end_ts,
+      [this](const FlameChartSpan& span) { spans_.push_back(span); });
+
+  // Spans are reported when they end. Sort them by start time.
+  std::sort(spans_.begin() + first_span_index, spans_.end(),
+            [](const FlameChartSpan& a, const FlameChartSpan& b) {
+              if (a.start_ts != b.start_ts)
+                return a.start_ts < b.start_ts;
+              return a.depth < b.depth;
+            });
+}
+
+void FlameChart::WriteCsvReport(const std::wstring& path) {
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground))
+    return;
+  out.Write(kCsvHeader);
+
+  const SymbolTable& cleaned_symbols = stack_cleaner_.cleaned_symbols();
+  for (const auto& span : spans_) {
+    out.WriteUInt(span.tid);
+    out.WriteChar(',');
+    out.WriteUInt(span.depth);
+    out.WriteChar(',');
+    out.WriteUInt(span.start_ts);
+    out.WriteChar(',');
+    out.WriteUInt(span.end_ts);
+    out.WriteChar(',');
+    out.WriteUInt(span.end_ts - span.start_ts);
+    out.WriteChar(',');
+    out.Write(base::QuoteCsvField(cleaned_symbols.GetSymbol(span.symbol)));
+    out.WriteChar('\n');
+  }
+
+  if (!out.Close())
+    LOG(ERROR) << "Error while writing " << base::WStringToString(path);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,121 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/symbol_table.h"
+#include "etw_reader/thread_history.h"
+#include "flame_graph/clean_stack.h"
+#include "flame_graph/ignore_rules.h"
+
+namespace etw_insights {
+
+// A span of a flame chart: a frame that stays at the same depth of the call
+// stack of a thread during a contiguous interval of time.
+struct FlameChartSpan {
+  // Thread on which the frame was active.
+  base::Tid tid;
+
+  // Depth of the frame in the call stack. The oldest call has depth 0.
+  size_t depth;
+
+  // Symbol of the frame, interned in the cleaned symbols of the flame chart.
+  SymbolId symbol;
+
+  // Time at which the frame became active.
+  base::Timestamp start_ts;
+
+  // Time at which the frame stopped being active.
+  base::Timestamp end_ts;
+};
+
+// A flame chart shows what each thread was doing over time. Unlike a flame
+// graph, it preserves the order of the call stacks: adjacent identical frames
+// of a thread are coalesced into spans.
+class FlameChart {
+ public:
+  typedef std::function<void(const FlameChartSpan& span)> SpanCallback;
+
+  // @param symbols the symbol table of the thread histories that will be
+  //    added to the flame chart.
+  explicit FlameChart(const SymbolTable& symbols);
+
+  // Rules used to exclude call stacks from the chart. Excluded call stacks
+  // are shown as idle time. Initialized with the default rules.
+  IgnoreRules& ignore_rules() { return ignore_rules_; }
+
+  // Cleans the call stacks before they are added to the chart. Initialized
+  // with the default rules.
+  StackCleaner& stack_cleaner() { return stack_cleaner_; }
+
+  // @returns the symbol table of the spans.
+  const SymbolTable& cleaned_symbols() const {
+    return stack_cleaner_.cleaned_symbols();
+  }
+
+  // Sets the minimum duration of a call stack. A call stack that lasts less
+  // than this is considered part of the call stack that precedes it, which
+  // bounds the number of spans generated for a long trace.
+  // @param min_span_width minimum duration, in microseconds.
+  void set_min_span_width(base::Timestamp min_span_width) {
+    min_span_width_ = min_span_width;
+  }
+
+  // Walks the call stacks of a thread in time order and reports the spans
+  // they form. Only the current call stack is kept in memory.
+  // @param thread_history the history of the thread.
+  // @param start_ts start of the time range to walk.
+  // @param end_ts end of the time range to walk.
+  // @param callback invoked for each span, when the span ends.
+  void WalkThreadHistory(const ThreadHistory& thread_history,
+                         base::Timestamp start_ts,
+                         base::Timestamp end_ts,
+                         const SpanCallback& callback);
+
+  // Adds the spans of a thread to the chart.
+  void AddThreadHistory(const ThreadHistory& thread_history,
+                        base::Timestamp start_ts,
+                        base::Timestamp end_ts);
+
+  // Writes the spans of the chart in a CSV file, one span per line.
+  void WriteCsvReport(const std::wstring& path);
+
+ private:
+  // Symbol table of the stacks.
+  const SymbolTable& symbols_;
+
+  // Rules used to exclude call stacks from the chart.
+  IgnoreRules ignore_rules_;
+
+  // Cleans the call stacks before they are added to the chart.
+  StackCleaner stack_cleaner_;
+
+  // Minimum duration of a call stack, in microseconds.
+  base::Timestamp min_span_width_;
+
+  // Spans of the chart, grouped by thread and sorted by start time.
+  std::vector<FlameChartSpan> spans_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlameChart);
+};
+
+}  // namespace etw_insights
@@ -19,80 +19,240 @@ limitations under the License.
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
-#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
+#include "base/buffered_writer.h"
 #include "base/child_process.h"
 #include "base/file.h"
+#include "base/gzip_writer.h"
+#include "base/logging.h"
+#include "base/protobuf_encoder.h"
 #include "base/string_utils.h"
-#include "flame_graph/clean_stack.h"
 
 namespace etw_insights {
 
 namespace {
 
-// Ignore call stacks that contain these sequences of frames.
-const char* kSequencesToIgnore[][2] = {
-    {"base::SequencedWorkerPool::Inner::ThreadLoop",
-     "base::WinVistaCondVar::TimedWait"},
-    {"base::SequencedWorkerPool::Inner::ThreadLoop",
-     "base::WinVistaCondVar::Wait"},
-    {"base::SequencedWorkerPool::Worker::Worker", "base::WaitableEvent::Wait"},
-    {"base::MessageLoop::RunHandler", "base::WaitableEvent::Wait"},
-    {"base::MessagePumpDefault::Run", "base::WaitableEvent::TimedWait"},
-    {"base::MessagePumpForIO::DoRunLoop",
-     "base::MessagePumpForIO::WaitForIOCompletion"},
-    {"base::MessagePumpForUI::DoRunLoop", "MsgWaitForMultipleObjectsEx"},
-    {"base::trace_event::TraceEventETWExport::ETWKeywordUpdateThread::"
-     "ThreadMain",
-     "base::PlatformThread::Sleep"},
-    {"cc::TaskGraphRunner::Run", "base::WinVistaCondVar::Wait"},
-    {"MojoWaitMany", "mojo::system::Core::WaitMany"},
-    {"TppWorkerThread", "ZwWaitForWorkViaWorkerFactory"},
-    {"sandbox::BrokerServicesBase::TargetEventsThread",
-     "GetQueuedCompletionStatus"},
+// Field numbers of the pprof Profile message and its nested messages. See
+// https://github.com/google/pprof/blob/master/proto/profile.proto
+const uint32_t kProfileSampleTypeField = 1;
+const uint32_t kProfileSampleField = 2;
+const uint32_t kProfileLocationField = 4;
+const uint32_t kProfileFunctionField = 5;
+const uint32_t kProfileStringTableField = 6;
+const uint32_t kProfileDefaultSampleTypeField = 14;
+const uint32_t kValueTypeTypeField = 1;
+const uint32_t kValueTypeUnitField = 2;
+const uint32_t kSampleLocationIdField = 1;
+const uint32_t kSampleValueField = 2;
+const uint32_t kLocationIdField = 1;
+const uint32_t kLocationLineField = 4;
+const uint32_t kLineFunctionIdField = 1;
+const uint32_t kFunctionIdField = 1;
+const uint32_t kFunctionNameField = 2;
+const uint32_t kFunctionSystemNameField = 3;
+const uint32_t kFunctionFilenameField = 4;
+
+// Sample types of the pprof profile.
+const char kOnCpuSampleType[] = "on_cpu";
+const char kOffCpuSampleType[] = "off_cpu";
+const char kNanosecondsUnit[] = "nanoseconds";
+
+// [Off-CPU] stack frame.
+const char kOffCpuStackFrame[] = "[Off-CPU]";
+
+// First character of the frames that aren't functions, e.g. "[Off-CPU]".
+const char kPseudoFramePrefix = '[';
+
+// Number of nanoseconds in a trace timestamp unit.
+const uint64_t kNanosecondsPerTimestampUnit = 1000;
+
+// Deduplicated string table of a pprof profile.
+class PprofStringTable {
+ public:
+  // The first string of the table must be the empty string.
+  PprofStringTable() { GetIndex(std::string()); }
+
+  // @returns the index of |str| in the table, adding it if necessary.
+  uint64_t GetIndex(const std::string& str) {
+    auto insert_result = indexes_.insert({str, strings_.size()});
+    if (insert_result.second)
+      strings_.push_back(&insert_result.first->first);
+    return insert_result.first->second;
+  }
+
+  // Writes the string table fields of the profile.
+  void Write(base::GzipWriter* writer) const {
+    base::ProtobufEncoder field;
+    for (const std::string* str : strings_) {
+      field.WriteString(kProfileStringTableField, *str);
+      writer->Write(field.data());
+      field.Clear();
+    }
+  }
+
+ private:
+  std::unordered_map<std::string, uint64_t> indexes_;
+  std::vector<const std::string*> strings_;
 };
-const size_t kSequencesToIgnoreSize = ARRAYSIZE(kSequencesToIgnore);
 
-// Ignore call stacks that contain these frames.
-const char* kFramesToIgnore[] = {
-    "EtwpQueueStackWalkApc", "EtwpTraceStackWalk", "EtwpLogKernelEvent",
+// Header of the hot functions report.
+const char kHotFunctionsCsvHeader[] =
+    "Type,Name,SelfTime,InclusiveTime,SelfPercent,InclusivePercent\n";
+
+// Types of the entries of the hot functions report.
+const char kFunctionEntryType[] = "function";
+const char kModuleEntryType[] = "module";
+
+// Time spent in a function or in a module.
+struct HotFunctionTime {
+  HotFunctionTime()
+      : self_time(0), inclusive_time(0), last_stack_index(SIZE_MAX) {}
+
+  base::Timestamp self_time;
+  base::Timestamp inclusive_time;
+
+  // Index of the last call stack counted in |inclusive_time|. Used to count
+  // recursive calls once per call stack.
+  size_t last_stack_index;
 };
-const size_t kFramesToIgnoreSize = ARRAYSIZE(kFramesToIgnore);
 
-bool ShouldIgnoreStack(const Stack& stack) {
-  if (stack.empty())
-    return true;
+// Adds the time of a call stack to the inclusive time of |entry|, unless it
+// has already been added.
+void AddInclusiveTime(size_t stack_index,
+                      base::Timestamp time,
+                      HotFunctionTime* entry) {
+  if (entry->last_stack_index == stack_index)
+    return;
+  entry->last_stack_index = stack_index;
+  entry->inclusive_time += time;
+}
 
-  bool is_off_cpu = stack.front() == "[Off-CPU]";
+// @returns the module of a symbol, or the symbol itself if it doesn't have a
+//    module (e.g. [Off-CPU]).
+std::string GetModuleName(const std::string& symbol) {
+  size_t module_end = symbol.find('!');
+  if (module_end == std::string::npos)
+    return symbol;
+  return symbol.substr(0, module_end);
+}
 
-  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
-    // Ignore sequences of frames.
-    auto next_it = it + 1;
-    if (is_off_cpu && next_it != stack.rend()) {
-      for (size_t sequence_index = 0; sequence_index < kSequencesToIgnoreSize;
-           ++sequence_index) {
-        if (base::StringEndsWith(*it, kSequencesToIgnore[sequence_index][0]) &&
-            base::StringEndsWith(*next_it,
-                                 kSequencesToIgnore[sequence_index][1])) {
-          return true;
-        }
-      }
-    }
+// @param symbol a symbol of a cleaned call stack.
+// @returns true if |symbol| is a frame added by the tools, such as
+//    [Off-CPU], [Truncated] or a file operation, rather than a function.
+bool IsPseudoFrame(const std::string& symbol) {
+  return !symbol.empty() && symbol[0] == kPseudoFramePrefix;
+}
 
-    // Ignore single frames.
-    for (size_t frame_index = 0; frame_index < kFramesToIgnoreSize;
-         ++frame_index) {
-      if (base::StringEndsWith(*it, kFramesToIgnore[frame_index]))
-        return true;
-    }
+// Writes |time| as a percentage of |total_time|, with two decimals.
+void WritePercentage(base::Timestamp time,
+                     base::Timestamp total_time,
+                     base::BufferedWriter* out) {
+  uint64_t hundredths =
+      total_time == 0 ? 0 : (time * 10000 + total_time / 2) / total_time;
+  out->WriteUInt(hundredths / 100);
+  out->WriteChar('.');
+  out->WriteChar(static_cast<char>('0' + hundredths / 10 % 10));
+  out->WriteChar(static_cast<char>('0' + hundredths % 10));
+}
+
+// Writes the entries of the hot functions report with the most self time.
+// @param type type of the entries.
+// @param names name of each entry.
+// @param times time spent in each entry.
+// @param total_time time spent in all call stacks.
+// @param max_entries maximum number of entries to write, 0 for no limit.
+// @param out the output file.
+void WriteHotFunctionsEntries(const char* type,
+                              const std::vector<const std::string*>& names,
+                              const std::vector<HotFunctionTime>& times,
+                              base::Timestamp total_time,
+                              size_t max_entries,
+                              base::BufferedWriter* out) {
+  DCHECK_EQ(names.size(), times.size());
+
+  std::vector<size_t> indexes;
+  for (size_t i = 0; i < times.size(); ++i) {
+    if (times[i].inclusive_time != 0)
+      indexes.push_back(i);
   }
 
-  return false;
+  size_t num_entries = indexes.size();
+  if (max_entries != 0 && max_entries < num_entries)
+    num_entries = max_entries;
+
+  std::partial_sort(indexes.begin(), indexes.begin() + num_entries,
+                    indexes.end(), [&](size_t a, size_t b) {
+                      if (times[a].self_time != times[b].self_time)
+                        return times[a].self_time > times[b].self_time;
+                      if (times[a].inclusive_time != times[b].inclusive_time)
+                        return times[a].inclusive_time >
+                               times[b].inclusive_time;
+                      return *names[a] < *names[b];
+                    });
+
+  for (size_t i = 0; i < num_entries; ++i) {
+    const HotFunctionTime& time = times[indexes[i]];
+    out->Write(type);
+    out->WriteChar(',');
+    out->Write(base::QuoteCsvField(*names[indexes[i]]));
+    out->WriteChar(',');
+    out->WriteUInt(time.self_time);
+    out->WriteChar(',');
+    out->WriteUInt(time.inclusive_time);
+    out->WriteChar(',');
+    WritePercentage(time.self_time, total_time, out);
+    out->WriteChar(',');
+    WritePercentage(time.inclusive_time, total_time, out);
+    out->WriteChar('\n');
+  }
+}
+
+// Writes a top-level field of the profile.
+void WriteProfileMessage(uint32_t field_number,
+                         const base::ProtobufEncoder& message,
+                         base::ProtobufEncoder* field,
+                         base::GzipWriter* writer) {
+  field->Clear();
+  field->WriteMessage(field_number, message);
+  writer->Write(field->data());
+}
+
+// Sorts call stacks by the text of their frames, so that the order of the
+// reports doesn't depend on the order in which the symbols were interned.
+// @param stack_time map: call stack -> time spent in the call stack.
+// @param symbols the symbol table of the frames of the call stacks.
+// @returns pointers to the entries of |stack_time|, sorted.
+template <typename StackTimeMap>
+std::vector<const typename StackTimeMap::value_type*> SortStacksByFrameText(
+    const StackTimeMap& stack_time,
+    const SymbolTable& symbols) {
+  std::vector<const typename StackTimeMap::value_type*> sorted;
+  sorted.reserve(stack_time.size());
+  for (const auto& stack_and_time : stack_time)
+    sorted.push_back(&stack_and_time);
+
+  auto symbol_is_less = [&](SymbolId a, SymbolId b) {
+    return a != b && symbols.GetSymbol(a) < symbols.GetSymbol(b);
+  };
+  std::sort(sorted.begin(), sorted.end(),
+            [&](const typename StackTimeMap::value_type* a,
+                const typename StackTimeMap::value_type* b) {
+              return std::lexicographical_compare(
+                  a->first.begin(), a->first.end(), b->first.begin(),
+                  b->first.end(), symbol_is_less);
+            });
+  return sorted;
 }
 
 }  // namespace
 
-FlameGraph::FlameGraph() {}
+FlameGraph::FlameGraph(const SymbolTable& symbols) : symbols_(symbols) {
+  ignore_rules_.LoadDefaultRules();
+  stack_cleaner_.LoadDefaultRules();
+}
 
 void FlameGraph::AddThreadHistory(const ThreadHistory& thread_history,
                                   base::Timestamp start_ts,
@@ -112,28 +272,231 @@ void FlameGraph::AddThreadHistory(const ThreadHistory& thread_history,
       continue;
     }
 
+    // The key is a copy of the stack on the heap, so the arena of the history,
+    // which other reports may be reading, isn't modified.
     base::Timestamp stack_duration = stack_end_ts - stack_start_ts;
     stack_time_[it->value] += stack_duration;
   }
 }
 
 void FlameGraph::WriteTxtReport(const std::wstring& path) {
-  std::ofstream out(path, std::ios::binary);
+  StackTimeMap cleaned_stack_time;
+  GetCleanedStacks(&cleaned_stack_time);
 
-  for (const auto& stack_and_time : stack_time_) {
-    if (ShouldIgnoreStack(stack_and_time.first))
-      continue;
+  const SymbolTable& cleaned_symbols = stack_cleaner_.cleaned_symbols();
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground))
+    return;
 
-    Stack stack = CleanStack(stack_and_time.first);
+  for (const auto* stack_and_time :
+       SortStacksByFrameText(cleaned_stack_time, cleaned_symbols)) {
     bool first = true;
-    for (const auto& symbol : stack) {
+    for (SymbolId symbol : stack_and_time->first) {
       if (!first)
-        out << ";";
+        out.WriteChar(';');
       first = false;
-      out << symbol;
+      out.Write(cleaned_symbols.GetSymbol(symbol));
+    }
+
+    out.WriteChar(' ');
+    out.WriteUInt(stack_and_time->second);
+    out.WriteChar('\n');
+  }
+
+  if (!out.Close())
+    LOG(ERROR) << "Error while writing " << base::WStringToString(path);
+}
+
+bool FlameGraph::WritePprof(const std::wstring& path) {
+  StackTimeMap cleaned_stack_time;
+  GetCleanedStacks(&cleaned_stack_time);
+
+  const SymbolTable& cleaned_symbols = stack_cleaner_.cleaned_symbols();
+  SymbolId off_cpu_symbol = cleaned_symbols.Find(kOffCpuStackFrame);
+
+  base::GzipWriter writer;
+  if (!writer.Open(path))
+    return false;
+
+  PprofStringTable string_table;
+  base::ProtobufEncoder message;
+  base::ProtobufEncoder field;
+
+  // Sample types: on-CPU time and off-CPU time.
+  uint64_t on_cpu_type_index = string_table.GetIndex(kOnCpuSampleType);
+  for (const char* sample_type : {kOnCpuSampleType, kOffCpuSampleType}) {
+    message.Clear();
+    message.WriteVarint(kValueTypeTypeField,
+                        string_table.GetIndex(sample_type));
+    message.WriteVarint(kValueTypeUnitField,
+                        string_table.GetIndex(kNanosecondsUnit));
+    WriteProfileMessage(kProfileSampleTypeField, message, &field, &writer);
+  }
+
+  // Samples. There is one location per symbol. The locations are numbered
+  // from 1, since 0 isn't a valid location id, in the order in which they
+  // first appear in the sorted samples.
+  std::vector<uint64_t> symbol_location_ids(cleaned_symbols.size(), 0);
+  std::vector<SymbolId> used_symbols;
+  std::vector<uint64_t> location_ids;
+  std::vector<uint64_t> values(2);
+  for (const auto* stack_and_time :
+       SortStacksByFrameText(cleaned_stack_time, cleaned_symbols)) {
+    const Stack& stack = stack_and_time->first;
+
+    // pprof locations go from the most recent call to the oldest.
+    location_ids.clear();
+    bool is_off_cpu = false;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+      uint64_t& location_id = symbol_location_ids[*it];
+      if (location_id == 0) {
+        used_symbols.push_back(*it);
+        location_id = used_symbols.size();
+      }
+      location_ids.push_back(location_id);
+      if (*it == off_cpu_symbol)
+        is_off_cpu = true;
+    }
+
+    uint64_t duration =
+        stack_and_time->second * kNanosecondsPerTimestampUnit;
+    values[0] = is_off_cpu ? 0 : duration;
+    values[1] = is_off_cpu ? duration : 0;
+
+    message.Clear();
+    message.WritePackedVarints(kSampleLocationIdField, location_ids);
+    message.WritePackedVarints(kSampleValueField, values);
+    WriteProfileMessage(kProfileSampleField, message, &field, &writer);
+  }
+
+  // Functions and locations of the symbols that appear in the samples.
+  base::ProtobufEncoder line;
+  for (SymbolId symbol : used_symbols) {
+    uint64_t id = symbol_location_ids[symbol];
+    const std::string& name = cleaned_symbols.GetSymbol(symbol);
+    uint64_t name_index = string_table.GetIndex(name);
+
+    // Use the module of the symbol as the file name.
+    size_t module_end = name.find('!');
+    uint64_t filename_index =
+        module_end == std::string::npos
+            ? 0
+            : string_table.GetIndex(name.substr(0, module_end));
+
+    message.Clear();
+    message.WriteVarint(kFunctionIdField, id);
+    message.WriteVarint(kFunctionNameField, name_index);
+    message.WriteVarint(kFunctionSystemNameField, name_index);
+    message.WriteVarint(kFunctionFilenameField, filename_index);
+    WriteProfileMessage(kProfileFunctionField, message, &field, &writer);
+
+    line.Clear();
+    line.WriteVarint(kLineFunctionIdField, id);
+    message.Clear();
+    message.WriteVarint(kLocationIdField, id);
+    message.WriteMessage(kLocationLineField, line);
+    WriteProfileMessage(kProfileLocationField, message, &field, &writer);
+  }
+
+  field.Clear();
+  field.WriteVarint(kProfileDefaultSampleTypeField, on_cpu_type_index);
+  writer.Write(field.data());
+
+  // The string table is written last, once all the strings are known.
+  string_table.Write(&writer);
+
+  return writer.Close();
+}
+
+void FlameGraph::WriteHotFunctionsReport(const std::wstring& path,
+                                         size_t max_entries) {
+  StackTimeMap cleaned_stack_time;
+  GetCleanedStacks(&cleaned_stack_time);
+
+  const SymbolTable& cleaned_symbols = stack_cleaner_.cleaned_symbols();
+
+  // Module of each symbol, and whether it is a pseudo-frame.
+  std::vector<size_t> symbol_modules(cleaned_symbols.size());
+  std::vector<bool> pseudo_frames(cleaned_symbols.size());
+  std::unordered_map<std::string, size_t> module_indexes;
+  std::vector<std::string> module_names;
+  for (SymbolId symbol = 0; symbol < cleaned_symbols.size(); ++symbol) {
+    pseudo_frames[symbol] = IsPseudoFrame(cleaned_symbols.GetSymbol(symbol));
+    std::string module_name = GetModuleName(cleaned_symbols.GetSymbol(symbol));
+    auto insert_result =
+        module_indexes.insert({module_name, module_names.size()});
+    if (insert_result.second)
+      module_names.push_back(module_name);
+    symbol_modules[symbol] = insert_result.first->second;
+  }
+
+  // Accumulate the time of each call stack in the functions and modules that
+  // it contains, in a single pass over the aggregated call stacks.
+  std::vector<HotFunctionTime> function_times(cleaned_symbols.size());
+  std::vector<HotFunctionTime> module_times(module_names.size());
+  base::Timestamp total_time = 0;
+  size_t stack_index = 0;
+  for (const auto& stack_and_time : cleaned_stack_time) {
+    const Stack& stack = stack_and_time.first;
+    base::Timestamp time = stack_and_time.second;
+    if (stack.empty())
+      continue;
+
+    for (SymbolId symbol : stack) {
+      AddInclusiveTime(stack_index, time, &function_times[symbol]);
+      AddInclusiveTime(stack_index, time,
+                       &module_times[symbol_modules[symbol]]);
+    }
+
+    // The self time goes to the most recent frame that is a function: no
+    // function runs in a pseudo-frame such as [Off-CPU] or [Truncated]. A
+    // stack without functions has no self time.
+    auto self_it = stack.rbegin();
+    while (self_it != stack.rend() && pseudo_frames[*self_it])
+      ++self_it;
+    if (self_it != stack.rend()) {
+      function_times[*self_it].self_time += time;
+      module_times[symbol_modules[*self_it]].self_time += time;
     }
 
-    out << " " << stack_and_time.second << "\n";
+    total_time += time;
+    ++stack_index;
+  }
+
+  std::vector<const std::string*> function_names;
+  function_names.reserve(cleaned_symbols.size());
+  for (SymbolId symbol = 0; symbol < cleaned_symbols.size(); ++symbol)
+    function_names.push_back(&cleaned_symbols.GetSymbol(symbol));
+
+  std::vector<const std::string*> module_name_ptrs;
+  module_name_ptrs.reserve(module_names.size());
+  for (const std::string& module_name : module_names)
+    module_name_ptrs.push_back(&module_name);
+
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInline))
+    return;
+
+  out.Write(kHotFunctionsCsvHeader);
+  WriteHotFunctionsEntries(kFunctionEntryType, function_names, function_times,
+                           total_time, max_entries, &out);
+  WriteHotFunctionsEntries(kModuleEntryType, module_name_ptrs, module_times,
+                           total_time, max_entries, &out);
+
+  if (!out.Close())
+    LOG(ERROR) << "Error while writing " << base::WStringToString(path);
+}
+
+void FlameGraph::GetCleanedStacks(StackTimeMap* cleaned_stack_time) {
+  DCHECK(cleaned_stack_time != nullptr);
+
+  Stack cleaned_stack;
+  for (const auto& stack_and_time : stack_time_) {
+    if (ignore_rules_.ShouldIgnoreStack(stack_and_time.first, symbols_))
+      continue;
+
+    stack_cleaner_.CleanStack(stack_and_time.first, symbols_, &cleaned_stack);
+    (*cleaned_stack_time)[cleaned_stack] += stack_and_time.second;
   }
 }
 
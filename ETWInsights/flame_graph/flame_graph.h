@@ -20,25 +20,71 @@ limitations under the License.
 
 #include "base/base.h"
 #include "base/types.h"
+#include "etw_reader/symbol_table.h"
 #include "etw_reader/thread_history.h"
+#include "flame_graph/clean_stack.h"
+#include "flame_graph/ignore_rules.h"
 
 namespace etw_insights {
 
 class FlameGraph {
  public:
-  FlameGraph();
+  // @param symbols the symbol table of the thread histories that will be
+  //    added to the flame graph.
+  explicit FlameGraph(const SymbolTable& symbols);
 
   void AddThreadHistory(const ThreadHistory& thread_history,
                         base::Timestamp start_ts,
                         base::Timestamp end_ts);
 
+  // Rules used to exclude call stacks from the reports. Initialized with the
+  // default rules.
+  IgnoreRules& ignore_rules() { return ignore_rules_; }
+
+  // Cleans the call stacks before they are written to the reports.
+  // Initialized with the default rules.
+  StackCleaner& stack_cleaner() { return stack_cleaner_; }
+
   void WriteTxtReport(const std::wstring& path);
 
+  // Writes the flame graph as a gzip-compressed pprof profile. On-CPU and
+  // off-CPU time are reported as two sample types, in nanoseconds.
+  // @param path path of the profile file.
+  // @returns true if the profile was written successfully.
+  bool WritePprof(const std::wstring& path);
+
+  // Writes the functions and the modules in which the most time was spent,
+  // in CSV format. The self time of a function is the time spent in call
+  // stacks whose most recent frame is the function, ignoring pseudo-frames
+  // such as [Off-CPU] and [Truncated]. Its inclusive time is the time spent
+  // in call stacks that contain the function, counted once per call stack
+  // even if the function is recursive. Modules are aggregated the same way.
+  // @param path path of the report file.
+  // @param max_entries maximum number of functions and of modules to write,
+  //    sorted by decreasing self time. 0 to write all of them.
+  void WriteHotFunctionsReport(const std::wstring& path, size_t max_entries);
+
  private:
-  // Map: Stack -> Total time spent in the call stack.
+  // Symbol table of the stacks.
+  const SymbolTable& symbols_;
+
+  // Rules used to exclude call stacks from the reports.
+  IgnoreRules ignore_rules_;
+
+  // Cleans the call stacks before they are written to the reports.
+  StackCleaner stack_cleaner_;
+
+  // Map: Stack -> Total time spent in the call stack. The stacks are copies
+  // allocated on the heap.
   typedef std::map<Stack, base::Timestamp> StackTimeMap;
   StackTimeMap stack_time_;
 
+  // Removes the ignored stacks from |stack_time_|, cleans the other stacks
+  // and merges the stacks that are identical once cleaned.
+  // @param cleaned_stack_time receives the total time spent in each cleaned
+  //    stack. Its frames are interned in stack_cleaner_.cleaned_symbols().
+  void GetCleanedStacks(StackTimeMap* cleaned_stack_time);
+
   DISALLOW_COPY_AND_ASSIGN(FlameGraph);
 };
 
@@ -0,0 +1,241 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/ignore_rules.h"
+
+#include <fstream>
+#include <sstream>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Ignore call stacks that contain these sequences of frames.
+const char* kDefaultSequencesToIgnore[][2] = {
+    {"base::SequencedWorkerPool::Inner::ThreadLoop",
+     "base::WinVistaCondVar::TimedWait"},
+    {"base::SequencedWorkerPool::Inner::ThreadLoop",
+     "base::WinVistaCondVar::Wait"},
+    {"base::SequencedWorkerPool::Worker::Worker", "base::WaitableEvent::Wait"},
+    {"base::MessageLoop::RunHandler", "base::WaitableEvent::Wait"},
+    {"base::MessagePumpDefault::Run", "base::WaitableEvent::TimedWait"},
+    {"base::MessagePumpForIO::DoRunLoop",
+     "base::MessagePumpForIO::WaitForIOCompletion"},
+    {"base::MessagePumpForUI::DoRunLoop", "MsgWaitForMultipleObjectsEx"},
+    {"base::trace_event::TraceEventETWExport::ETWKeywordUpdateThread::"
+     "ThreadMain",
+     "base::PlatformThread::Sleep"},
+    {"cc::TaskGraphRunner::Run", "base::WinVistaCondVar::Wait"},
+    {"MojoWaitMany", "mojo::system::Core::WaitMany"},
+    {"TppWorkerThread", "ZwWaitForWorkViaWorkerFactory"},
+    {"sandbox::BrokerServicesBase::TargetEventsThread",
+     "GetQueuedCompletionStatus"},
+};
+
+// Ignore call stacks that contain these frames.
+const char* kDefaultFramesToIgnore[] = {
+    "EtwpQueueStackWalkApc", "EtwpTraceStackWalk", "EtwpLogKernelEvent",
+};
+
+// Keywords of the rules file.
+const char kFrameKeyword[] = "frame";
+const char kSequenceKeyword[] = "sequence";
+const char kSequenceSeparator[] = " -> ";
+const char kCommentPrefix = '#';
+
+// [Off-CPU] stack frame.
+const char kOffCpuStackFrame[] = "[Off-CPU]";
+
+}  // namespace
+
+IgnoreRules::IgnoreRules() : cached_symbols_(nullptr) {}
+
+void IgnoreRules::LoadDefaultRules() {
+  Clear();
+  for (const auto& sequence : kDefaultSequencesToIgnore)
+    AddSequenceRule(sequence[0], sequence[1]);
+  for (const auto& frame : kDefaultFramesToIgnore)
+    AddFrameRule(frame);
+}
+
+bool IgnoreRules::LoadFromFile(const std::wstring& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Unable to open ignore rules file "
+               << base::WStringToString(path) << ".";
+    return false;
+  }
+
+  std::stringstream rules;
+  rules << file.rdbuf();
+
+  Clear();
+  return ParseRules(rules.str());
+}
+
+bool IgnoreRules::ParseRules(const std::string& rules) {
+  std::istringstream stream(rules);
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(stream, line)) {
+    ++line_number;
+    line = base::Trim(line);
+    if (line.empty() || line.front() == kCommentPrefix)
+      continue;
+
+    size_t keyword_end = line.find(' ');
+    std::string keyword = line.substr(0, keyword_end);
+    std::string argument = keyword_end == std::string::npos
+                               ? std::string()
+                               : base::Trim(line.substr(keyword_end));
+
+    if (argument.empty()) {
+      LOG(ERROR) << "Missing suffix in ignore rule at line " << line_number
+                 << ".";
+      return false;
+    }
+
+    if (keyword == kFrameKeyword) {
+      AddFrameRule(argument);
+    } else if (keyword == kSequenceKeyword) {
+      size_t separator_pos = argument.find(kSequenceSeparator);
+      if (separator_pos == std::string::npos) {
+        LOG(ERROR) << "Expected '<caller> -> <callee>' in ignore rule at line "
+                   << line_number << ".";
+        return false;
+      }
+      std::string caller = base::Trim(argument.substr(0, separator_pos));
+      std::string callee = base::Trim(
+          argument.substr(separator_pos + sizeof(kSequenceSeparator) - 1));
+      if (!AddSequenceRule(caller, callee)) {
+        LOG(ERROR) << "Too many sequence rules at line " << line_number
+                   << " (maximum is " << kMaxSequenceRules << ").";
+        return false;
+      }
+    } else {
+      LOG(ERROR) << "Unknown ignore rule '" << keyword << "' at line "
+                 << line_number << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void IgnoreRules::AddFrameRule(const std::string& suffix) {
+  frame_rules_.push_back(suffix);
+  matcher_.AddPattern(suffix);
+  patterns_.push_back({PATTERN_FRAME, frame_rules_.size() - 1});
+  cached_symbols_ = nullptr;
+}
+
+bool IgnoreRules::AddSequenceRule(const std::string& caller_suffix,
+                                  const std::string& callee_suffix) {
+  if (sequence_rules_.size() >= kMaxSequenceRules)
+    return false;
+
+  sequence_rules_.push_back({caller_suffix, callee_suffix});
+  matcher_.AddPattern(caller_suffix);
+  patterns_.push_back({PATTERN_CALLER, sequence_rules_.size() - 1});
+  matcher_.AddPattern(callee_suffix);
+  patterns_.push_back({PATTERN_CALLEE, sequence_rules_.size() - 1});
+  cached_symbols_ = nullptr;
+  return true;
+}
+
+void IgnoreRules::Clear() {
+  frame_rules_.clear();
+  sequence_rules_.clear();
+  patterns_.clear();
+  matcher_.Clear();
+  cached_symbols_ = nullptr;
+}
+
+bool IgnoreRules::ShouldIgnoreStack(const Stack& stack,
+                                    const SymbolTable& symbols) {
+  if (stack.empty())
+    return true;
+
+  // Discard the cached match results if the rules or the symbol table changed.
+  if (cached_symbols_ != &symbols) {
+    Compile();
+    frame_matches_.clear();
+    cached_symbols_ = &symbols;
+  }
+  if (frame_matches_.size() < symbols.size())
+    frame_matches_.resize(symbols.size());
+
+  bool is_off_cpu = GetFrameMatch(stack.front(), symbols).is_off_cpu;
+
+  // Frames are ordered from callee to caller.
+  for (size_t i = 0; i < stack.size(); ++i) {
+    const FrameMatch& match = GetFrameMatch(stack[i], symbols);
+
+    // Ignore single frames.
+    if (match.ignore_frame)
+      return true;
+
+    // Ignore sequences of frames.
+    if (is_off_cpu && match.callee_mask != 0 && i + 1 < stack.size()) {
+      const FrameMatch& caller_match = GetFrameMatch(stack[i + 1], symbols);
+      if ((caller_match.caller_mask & match.callee_mask) != 0)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+void IgnoreRules::Compile() {
+  if (!matcher_.is_compiled())
+    matcher_.Compile();
+}
+
+const IgnoreRules::FrameMatch& IgnoreRules::GetFrameMatch(
+    SymbolId symbol_id,
+    const SymbolTable& symbols) {
+  DCHECK_LT(symbol_id, frame_matches_.size());
+  FrameMatch& match = frame_matches_[symbol_id];
+  if (match.is_computed)
+    return match;
+
+  const std::string& symbol = symbols.GetSymbol(symbol_id);
+  match.is_off_cpu = symbol == kOffCpuStackFrame;
+
+  matcher_.MatchSuffixes(symbol, &matched_patterns_);
+  for (size_t pattern_index : matched_patterns_) {
+    const auto& pattern = patterns_[pattern_index];
+    switch (pattern.first) {
+      case PATTERN_FRAME:
+        match.ignore_frame = true;
+        break;
+      case PATTERN_CALLER:
+        match.caller_mask |= static_cast<uint64_t>(1) << pattern.second;
+        break;
+      case PATTERN_CALLEE:
+        match.callee_mask |= static_cast<uint64_t>(1) << pattern.second;
+        break;
+    }
+  }
+
+  match.is_computed = true;
+  return match;
+}
+
+}  // namespace etw_insights
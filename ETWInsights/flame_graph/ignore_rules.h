@@ -0,0 +1,145 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/suffix_matcher.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/symbol_table.h"
+
+namespace etw_insights {
+
+// Rules that determine which call stacks are excluded from a flame graph.
+//
+// Rules are read from a text file that contains one rule per line. Empty lines
+// and lines that start with '#' are ignored.
+//   frame <suffix>
+//     Ignore call stacks that contain a frame that ends with <suffix>.
+//   sequence <caller suffix> -> <callee suffix>
+//     Ignore off-CPU call stacks in which a frame that ends with
+//     <caller suffix> directly calls a frame that ends with <callee suffix>.
+//
+// All the suffixes are compiled into a single automaton. The result of
+// matching a symbol against the rules is cached by symbol id, so checking a
+// stack costs one table lookup per frame once its symbols have been seen.
+class IgnoreRules {
+ public:
+  IgnoreRules();
+
+  // Replaces the current rules with the default rules.
+  void LoadDefaultRules();
+
+  // Replaces the current rules with the rules read from a file.
+  // @param path path to the rules file.
+  // @returns true if the file was read and parsed successfully.
+  bool LoadFromFile(const std::wstring& path);
+
+  // Adds the rules described by |rules| to the current rules.
+  // @param rules rules, in the format described above.
+  // @returns true if |rules| was parsed successfully.
+  bool ParseRules(const std::string& rules);
+
+  // Adds a rule to ignore call stacks that contain a frame ending with |suffix|.
+  void AddFrameRule(const std::string& suffix);
+
+  // Adds a rule to ignore off-CPU call stacks in which a frame ending with
+  // |caller_suffix| directly calls a frame ending with |callee_suffix|.
+  // @returns false if the maximum number of sequence rules is reached.
+  bool AddSequenceRule(const std::string& caller_suffix,
+                       const std::string& callee_suffix);
+
+  // Removes all rules.
+  void Clear();
+
+  // @param stack a call stack.
+  // @param symbols the symbol table of |stack|. The cached match results are
+  //    discarded when a different symbol table is used.
+  // @returns true if |stack| should be excluded from the flame graph.
+  bool ShouldIgnoreStack(const Stack& stack, const SymbolTable& symbols);
+
+  // Maximum number of sequence rules.
+  static const size_t kMaxSequenceRules = 64;
+
+ private:
+  // Result of matching a symbol against the rules.
+  struct FrameMatch {
+    FrameMatch()
+        : is_computed(false),
+          is_off_cpu(false),
+          ignore_frame(false),
+          caller_mask(0),
+          callee_mask(0) {}
+
+    // Whether the other fields have been computed.
+    bool is_computed;
+
+    // Whether the symbol is the [Off-CPU] frame.
+    bool is_off_cpu;
+
+    // Whether the symbol matches a frame rule.
+    bool ignore_frame;
+
+    // Bit i is set if the symbol matches the caller of sequence rule i.
+    uint64_t caller_mask;
+
+    // Bit i is set if the symbol matches the callee of sequence rule i.
+    uint64_t callee_mask;
+  };
+
+  // What a pattern of the matcher stands for.
+  enum PatternKind {
+    PATTERN_FRAME,
+    PATTERN_CALLER,
+    PATTERN_CALLEE,
+  };
+
+  // Compiles the rules into |matcher_|.
+  void Compile();
+
+  // @returns the match result for |symbol_id|, computing it if necessary.
+  //    |frame_matches_| must be large enough to hold |symbol_id|.
+  const FrameMatch& GetFrameMatch(SymbolId symbol_id,
+                                  const SymbolTable& symbols);
+
+  // Rules.
+  std::vector<std::string> frame_rules_;
+  std::vector<std::pair<std::string, std::string>> sequence_rules_;
+
+  // Automaton that matches all the suffixes of the rules.
+  base::SuffixMatcher matcher_;
+
+  // For each pattern of |matcher_|: kind and index of the associated rule.
+  std::vector<std::pair<PatternKind, size_t>> patterns_;
+
+  // Cached match results, indexed by symbol id.
+  std::vector<FrameMatch> frame_matches_;
+
+  // Symbol table for which the match results were cached.
+  const SymbolTable* cached_symbols_;
+
+  // Reusable buffer for matched pattern indexes.
+  std::vector<size_t> matched_patterns_;
+
+  DISALLOW_COPY_AND_ASSIGN(IgnoreRules);
+};
+
+}  // namespace etw_insights
@@ -19,24 +19,77 @@ limitations under the License.
 #undef min
 #undef max
 
+#include <atomic>
+#include <cctype>
 #include <iostream>
+#include <set>
+#include <vector>
 
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/numeric_conversions.h"
 #include "base/string_utils.h"
+#include "base/thread_pool.h"
+#include "etw_reader/event_filter.h"
 #include "etw_reader/generate_history_from_trace.h"
 #include "etw_reader/system_history.h"
+#include "etw_reader/thread_filter.h"
+#include "flame_graph/flame_chart.h"
 #include "flame_graph/flame_graph.h"
+#include "flame_graph/thread_grouper.h"
+#include "flame_graph/trace_event_writer.h"
 
 using namespace etw_insights;
 
 namespace {
 
+// Output formats.
+const wchar_t kTxtFormat[] = L"txt";
+const wchar_t kChartFormat[] = L"chart";
+const wchar_t kPprofFormat[] = L"pprof";
+const wchar_t kTraceEventFormat[] = L"trace_event";
+const wchar_t kHotFunctionsFormat[] = L"hot_functions";
+
 // Suffix for a flame graph file name.
 const wchar_t kFlameGraphFileNameSuffix[] = L".flamegraph.txt";
 
+// Suffix for a pprof profile file name.
+const wchar_t kPprofFileNameSuffix[] = L".pb.gz";
+
+// Suffix for a flame chart file name.
+const wchar_t kFlameChartFileNameSuffix[] = L".flamechart.csv";
+
+// Suffix for a Trace Event file name.
+const wchar_t kTraceEventFileNameSuffix[] = L".trace.json";
+
+// Suffix for a hot functions report file name.
+const wchar_t kHotFunctionsFileNameSuffix[] = L".hotfunctions.csv";
+
+// Default minimum duration of a call stack in a flame chart, in microseconds.
+const uint64_t kDefaultMinSpanWidth = 1000;
+
+// Default number of functions and modules in a hot functions report.
+const uint64_t kDefaultTopEntries = 50;
+
+// Values of the --group_by switch.
+const wchar_t kGroupByProcessName[] = L"process_name";
+const wchar_t kGroupByPid[] = L"pid";
+const wchar_t kGroupByTid[] = L"tid";
+
+// Name of the group of the threads whose process has no name, in file names.
+const char kUnknownGroupName[] = "unknown";
+
+// Options of the reports.
+struct ReportOptions {
+  std::wstring format;
+  std::wstring ignore_rules_path;
+  std::wstring clean_rules_path;
+  uint64_t min_span_width;
+  uint64_t top_entries;
+};
+
 void ShowUsage() {
+  base::FlushLogs();
   std::cout
       << "Usage: flame_graph.exe --trace <trace_file_path> [options]"
       << std::endl
@@ -46,16 +99,229 @@ void ShowUsage() {
          "specified name."
       << std::endl
       << "  --tid: Only include stacks from the specified thread." << std::endl
+      << "  --group_by: Write one report per 'process_name', 'pid' or 'tid'. "
+         "The group name is inserted in the output file name."
+      << std::endl
+      << "  --groups: Path to a file with one group per line: a group name "
+         "followed by conditions 'process_name=<name>', 'pid=<pid>' or "
+         "'tid=<tid>'. Writes one report per group."
+      << std::endl
       << "  --start_ts: Only include stacks that occurred after the specified "
          "timestamp (in microseconds)."
       << std::endl
       << "  --end_ts: Only include stacks that occurred before the specified "
          "timestamp (in microseconds)."
       << std::endl
-      << "  --out: Output file path. Default: <trace_file_path>.flamegraph.txt"
+      << "  --where: Only read the events that match a filter expression, "
+         "e.g. 'type == \"CSwitch\" && \"New TID\" == 1234'. The history "
+         "cache isn't used."
+      << std::endl
+      << "  --ignore_rules: Path to a file with rules to exclude call stacks "
+         "from the flame graph. Default: built-in rules."
+      << std::endl
+      << "  --clean_rules: Path to a file with rules to clean call stacks "
+         "before they are written. Default: built-in rules."
+      << std::endl
+      << "  --format: Output format. 'txt' for a flame graph, 'pprof' for a "
+         "gzip-compressed pprof profile, 'chart' for a flame chart in CSV "
+         "format, 'trace_event' for a flame chart in Trace Event JSON format "
+         "(chrome://tracing, Perfetto), 'hot_functions' for the functions "
+         "and modules with the most self and inclusive time in CSV format. "
+         "Default: txt."
+      << std::endl
+      << "  --min_span_width: Minimum duration of a call stack in a flame "
+         "chart or trace_event output (in microseconds). Default: 1000."
+      << std::endl
+      << "  --top: Number of functions and of modules in a hot_functions "
+         "report, 0 for all of them. Default: 50."
+      << std::endl
+      << "  --no_history_cache: Always parse the trace, instead of loading "
+         "the history saved in <trace_file_path>.history by a previous run."
+      << std::endl
+      << "  --jobs: Number of threads that write the reports of the groups. "
+         "Default: number of hardware threads."
+      << std::endl
+      << "  --out: Output file path. With --group_by or --groups, prefix of the "
+         "output file paths. Default: "
+         "<trace_file_path>.flamegraph.txt, <trace_file_path>.pb.gz, "
+         "<trace_file_path>.flamechart.csv, <trace_file_path>.trace.json or "
+         "<trace_file_path>.hotfunctions.csv"
       << std::endl;
 }
 
+// Loads the rules specified on the command line.
+// @returns true if the rules were loaded successfully.
+bool LoadRules(const std::wstring& ignore_rules_path,
+               const std::wstring& clean_rules_path,
+               IgnoreRules* ignore_rules,
+               StackCleaner* stack_cleaner) {
+  if (!ignore_rules_path.empty() &&
+      !ignore_rules->LoadFromFile(ignore_rules_path)) {
+    LOG(ERROR) << "Error while loading ignore rules.";
+    return false;
+  }
+  if (!clean_rules_path.empty() &&
+      !stack_cleaner->LoadFromFile(clean_rules_path)) {
+    LOG(ERROR) << "Error while loading clean rules.";
+    return false;
+  }
+  return true;
+}
+
+// @returns the suffix of the default output file name for |format|.
+const wchar_t* GetFileNameSuffix(const std::wstring& format) {
+  if (format == kChartFormat)
+    return kFlameChartFileNameSuffix;
+  if (format == kTraceEventFormat)
+    return kTraceEventFileNameSuffix;
+  if (format == kPprofFormat)
+    return kPprofFileNameSuffix;
+  if (format == kHotFunctionsFormat)
+    return kHotFunctionsFileNameSuffix;
+  return kFlameGraphFileNameSuffix;
+}
+
+// Gets the output file path of the report of a group: |prefix|, followed by
+// the group name, with characters that aren't valid in file names replaced by
+// '_', followed by |suffix|. Different group names can give the same file
+// name, e.g. "a b.exe" and "a_b.exe", so a numeric suffix is added to the
+// group name if its file name is already used.
+// @param prefix prefix of the path.
+// @param group_name name of the group.
+// @param suffix suffix of the path.
+// @param used_file_names file names already used by other groups, in lower
+//    case since file names are case-insensitive. Receives the file name of
+//    this group.
+// @returns the output file path of the report of the group.
+std::wstring GetGroupOutputPath(const std::wstring& prefix,
+                                const std::string& group_name,
+                                const wchar_t* suffix,
+                                std::set<std::string>* used_file_names) {
+  std::string file_name_part(group_name.empty() ? kUnknownGroupName
+                                                : group_name);
+  for (char& c : file_name_part) {
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' &&
+        c != '_') {
+      c = '_';
+    }
+  }
+
+  std::string unique_file_name_part(file_name_part);
+  for (size_t index = 2;; ++index) {
+    std::string lower_case_name(unique_file_name_part);
+    for (char& c : lower_case_name)
+      c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    if (used_file_names->insert(lower_case_name).second)
+      break;
+    unique_file_name_part = file_name_part + "_" + std::to_string(index);
+  }
+
+  return prefix + L"." + base::StringToWString(unique_file_name_part) + suffix;
+}
+
+// Writes a report of the call stacks of |threads|.
+// @param options options of the report.
+// @param system_history the history that contains the threads.
+// @param threads the threads to include in the report.
+// @param start_ts start of the time range to include in the report.
+// @param end_ts end of the time range to include in the report.
+// @param output_path path of the report file.
+// @returns true if the report was written successfully.
+bool WriteReport(const ReportOptions& options,
+                 const SystemHistory& system_history,
+                 const std::vector<const ThreadHistory*>& threads,
+                 base::Timestamp start_ts,
+                 base::Timestamp end_ts,
+                 const std::wstring& output_path) {
+  if (options.format == kChartFormat) {
+    // Tell the user what we are doing.
+    LOG(INFO) << "Generating flame chart." << std::endl;
+
+    FlameChart flame_chart(system_history.symbols());
+    if (!LoadRules(options.ignore_rules_path, options.clean_rules_path,
+                   &flame_chart.ignore_rules(), &flame_chart.stack_cleaner())) {
+      return false;
+    }
+    flame_chart.set_min_span_width(options.min_span_width);
+
+    for (const ThreadHistory* thread : threads)
+      flame_chart.AddThreadHistory(*thread, start_ts, end_ts);
+
+    // Write the flame chart in a CSV file.
+    flame_chart.WriteCsvReport(output_path);
+
+    // Tell the user that the flame chart was generated.
+    LOG(INFO) << "Wrote flame chart data in file "
+              << base::WStringToString(output_path) << std::endl;
+
+    return true;
+  }
+
+  if (options.format == kTraceEventFormat) {
+    // Tell the user what we are doing.
+    LOG(INFO) << "Generating trace events." << std::endl;
+
+    FlameChart flame_chart(system_history.symbols());
+    if (!LoadRules(options.ignore_rules_path, options.clean_rules_path,
+                   &flame_chart.ignore_rules(), &flame_chart.stack_cleaner())) {
+      return false;
+    }
+    flame_chart.set_min_span_width(options.min_span_width);
+
+    // Stream the events of each thread to the output file.
+    TraceEventWriter writer(system_history, &flame_chart);
+    if (!writer.Open(output_path))
+      return false;
+    for (const ThreadHistory* thread : threads)
+      writer.WriteThread(*thread, start_ts, end_ts);
+    if (!writer.Close()) {
+      LOG(ERROR) << "Error while writing trace events.";
+      return false;
+    }
+
+    // Tell the user that the trace events were generated.
+    LOG(INFO) << "Wrote trace events in file "
+              << base::WStringToString(output_path) << std::endl;
+
+    return true;
+  }
+
+  // Tell the user what we are doing.
+  LOG(INFO) << "Generating flame graph." << std::endl;
+
+  // Create a flame graph.
+  FlameGraph flame_graph(system_history.symbols());
+  if (!LoadRules(options.ignore_rules_path, options.clean_rules_path,
+                 &flame_graph.ignore_rules(), &flame_graph.stack_cleaner())) {
+    return false;
+  }
+
+  // Add the threads to the flame graph.
+  for (const ThreadHistory* thread : threads)
+    flame_graph.AddThreadHistory(*thread, start_ts, end_ts);
+
+  if (options.format == kPprofFormat) {
+    // Write the flame graph in a pprof profile.
+    if (!flame_graph.WritePprof(output_path)) {
+      LOG(ERROR) << "Error while writing pprof profile.";
+      return false;
+    }
+  } else if (options.format == kHotFunctionsFormat) {
+    // Write the hot functions report in a CSV file.
+    flame_graph.WriteHotFunctionsReport(
+        output_path, static_cast<size_t>(options.top_entries));
+  } else {
+    // Write the flame graph in a text file.
+    flame_graph.WriteTxtReport(output_path);
+  }
+
+  // Tell the user that the flame graph was generated.
+  LOG(INFO) << "Wrote flame graph data in file "
+            << base::WStringToString(output_path) << std::endl;
+
+  return true;
+}
+
 }  // namespace
 
 int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
@@ -69,35 +335,147 @@ int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
 
   std::wstring trace_path = command_line.GetSwitchValue(L"trace");
   if (trace_path.empty()) {
+    base::FlushLogs();
     std::cout << "Please specify a trace path (--trace)." << std::endl
               << std::endl;
     ShowUsage();
     return 1;
   }
 
+  ThreadFilter thread_filter;
+
   std::wstring thread_id_filter_str = command_line.GetSwitchValue(L"tid");
   uint64_t thread_id_filter = base::kInvalidTid;
   if (!thread_id_filter_str.empty() &&
       !base::StrToULong(thread_id_filter_str, &thread_id_filter)) {
+    base::FlushLogs();
     std::cout << "Thread id must be numeric (--tid)." << std::endl << std::endl;
     ShowUsage();
     return 1;
   }
+  thread_filter.set_tid(thread_id_filter);
 
-  std::string process_name_filter(
+  thread_filter.set_process_name(
       base::WStringToString(command_line.GetSwitchValue(L"process_name")));
 
+  EventFilter event_filter;
+  if (!event_filter.Parse(
+          base::WStringToString(command_line.GetSwitchValue(L"where")))) {
+    base::FlushLogs();
+    std::cout << "Invalid filter expression (--where)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  ThreadGrouper thread_grouper;
+
+  std::wstring group_by(command_line.GetSwitchValue(L"group_by"));
+  if (group_by == kGroupByProcessName) {
+    thread_grouper.set_group_by(ThreadGrouper::kGroupByProcessName);
+  } else if (group_by == kGroupByPid) {
+    thread_grouper.set_group_by(ThreadGrouper::kGroupByPid);
+  } else if (group_by == kGroupByTid) {
+    thread_grouper.set_group_by(ThreadGrouper::kGroupByTid);
+  } else if (!group_by.empty()) {
+    base::FlushLogs();
+    std::cout << "Unknown group attribute (--group_by)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring groups_path(command_line.GetSwitchValue(L"groups"));
+  if (!groups_path.empty()) {
+    if (!group_by.empty()) {
+      base::FlushLogs();
+      std::cout << "--group_by and --groups can't be used together."
+                << std::endl
+                << std::endl;
+      ShowUsage();
+      return 1;
+    }
+    if (!thread_grouper.LoadGroupFilters(groups_path)) {
+      LOG(ERROR) << "Error while loading groups.";
+      return 1;
+    }
+  }
+
   uint64_t start_ts = 0;
   base::StrToULong(command_line.GetSwitchValue(L"start_ts"), &start_ts);
 
   uint64_t end_ts = base::kInvalidTimestamp;
   base::StrToULong(command_line.GetSwitchValue(L"end_ts"), &end_ts);
 
+  ReportOptions report_options;
+
+  report_options.ignore_rules_path =
+      command_line.GetSwitchValue(L"ignore_rules");
+
+  report_options.clean_rules_path = command_line.GetSwitchValue(L"clean_rules");
+
+  std::wstring& format = report_options.format;
+  format = command_line.GetSwitchValue(L"format");
+  if (format.empty())
+    format = kTxtFormat;
+  if (format != kTxtFormat && format != kPprofFormat &&
+      format != kChartFormat && format != kTraceEventFormat &&
+      format != kHotFunctionsFormat) {
+    base::FlushLogs();
+    std::cout << "Unknown output format (--format)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  report_options.min_span_width = kDefaultMinSpanWidth;
+  std::wstring min_span_width_str(
+      command_line.GetSwitchValue(L"min_span_width"));
+  if (!min_span_width_str.empty() &&
+      !base::StrToULong(min_span_width_str, &report_options.min_span_width)) {
+    base::FlushLogs();
+    std::cout << "Minimum span width must be numeric (--min_span_width)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  report_options.top_entries = kDefaultTopEntries;
+  std::wstring top_entries_str(command_line.GetSwitchValue(L"top"));
+  if (!top_entries_str.empty() &&
+      !base::StrToULong(top_entries_str, &report_options.top_entries)) {
+    base::FlushLogs();
+    std::cout << "Number of entries must be numeric (--top)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  // 0 for the number of hardware threads.
+  uint64_t num_jobs = 0;
+  std::wstring num_jobs_str(command_line.GetSwitchValue(L"jobs"));
+  if (!num_jobs_str.empty() &&
+      (!base::StrToULong(num_jobs_str, &num_jobs) || num_jobs == 0)) {
+    base::FlushLogs();
+    std::cout << "Number of jobs must be a positive number (--jobs)."
+              << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
   std::wstring output_path(command_line.GetSwitchValue(L"out"));
 
+  GenerateHistoryOptions history_options;
+  history_options.use_snapshot = !command_line.HasSwitch(L"no_history_cache");
+  history_options.thread_filter = thread_filter;
+  history_options.event_filter = event_filter;
+
   // Generate a system history from the trace.
   SystemHistory system_history;
-  if (!GenerateHistoryFromTrace(trace_path, &system_history)) {
+  if (!GenerateHistoryFromTrace(trace_path, history_options,
+                                &system_history)) {
     LOG(ERROR) << "Error while generating history from trace.";
     return 1;
   }
@@ -107,43 +485,66 @@ int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
       std::min(std::min(end_ts, system_history.last_event_ts()),
                system_history.first_non_empty_paint_ts());
 
-  // Tell the user what we are doing.
-  LOG(INFO) << "Generating flame graph." << std::endl;
+  base::Timestamp analysis_start_ts =
+      std::max(start_ts, system_history.first_event_ts());
 
-  // Create a flame graph.
-  FlameGraph flame_graph;
-
-  // Traverse all threads and add those that match the filter to the history.
+  // Traverse all threads once, and add those that match the filter to their
+  // groups.
   for (auto threads_it = system_history.threads_begin();
        threads_it != system_history.threads_end(); ++threads_it) {
-    // Thread id filter.
-    if (thread_id_filter != base::kInvalidTid &&
-        thread_id_filter != threads_it->first)
-      continue;
-
-    // Process name filter.
-    if (!process_name_filter.empty()) {
-      std::string process_name =
-          system_history.GetProcessName(threads_it->second.parent_process_id());
-      if (process_name_filter != process_name)
-        continue;
-    }
+    if (thread_filter.Matches(threads_it->second, system_history))
+      thread_grouper.AddThread(threads_it->second, system_history);
+  }
 
-    // The current thread matches the filter. Add it to the flame graph.
-    flame_graph.AddThreadHistory(
-        threads_it->second,
-        std::max(start_ts, system_history.first_event_ts()),
-        analysis_end_ts);
+  if (thread_grouper.group_by() == ThreadGrouper::kSingleGroup) {
+    const ThreadGrouper::GroupMap& groups = thread_grouper.groups();
+    std::vector<const ThreadHistory*> threads;
+    if (!groups.empty())
+      threads = groups.begin()->second;
+
+    if (output_path.empty())
+      output_path = trace_path + GetFileNameSuffix(report_options.format);
+    if (!WriteReport(report_options, system_history, threads,
+                     analysis_start_ts, analysis_end_ts, output_path)) {
+      return 1;
+    }
+    return 0;
   }
 
-  // Write the flame graph in a text file.
-  if (output_path.empty())
-    output_path = trace_path + kFlameGraphFileNameSuffix;
-  flame_graph.WriteTxtReport(output_path);
+  // Write one report per group, in parallel. The reports only read the
+  // history: the stacks that they copy out of it are allocated on the heap,
+  // not in the arena of the history (see base::ArenaAllocator). Stop at the
+  // first error.
+  std::wstring output_prefix(output_path.empty() ? trace_path : output_path);
+  // The output paths are chosen before the reports are written, so that no
+  // two reports write the same file.
+  std::vector<ThreadGrouper::GroupMap::const_iterator> groups;
+  std::vector<std::wstring> group_output_paths;
+  std::set<std::string> used_file_names;
+  for (auto it = thread_grouper.groups().begin();
+       it != thread_grouper.groups().end(); ++it) {
+    groups.push_back(it);
+    group_output_paths.push_back(
+        GetGroupOutputPath(output_prefix, it->first,
+                           GetFileNameSuffix(report_options.format),
+                           &used_file_names));
+  }
 
-  // Tell the user that the flame graph was generated.
-  LOG(INFO) << "Wrote flame graph data in file "
-            << base::WStringToString(output_path);
+  base::ThreadPool thread_pool(static_cast<size_t>(num_jobs));
+  base::TaskGroup report_tasks(&thread_pool);
+  std::atomic<bool> failed(false);
+  base::ParallelFor(&thread_pool, 0, groups.size(), 1, [&](size_t i) {
+    const auto& group = *groups[i];
+    LOG(INFO) << "Group " << group.first << ": " << group.second.size()
+              << " threads." << std::endl;
+    if (!WriteReport(report_options, system_history, group.second,
+                     analysis_start_ts, analysis_end_ts,
+                     group_output_paths[i])) {
+      failed = true;
+      report_tasks.Cancel();
+    }
+  }, &report_tasks);
 
-  return 0;
+  return failed ? 1 : 0;
 }
+
@@ -0,0 +1,126 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "flame_graph/thread_grouper.h"
+
+#include <fstream>
+#include <sstream>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Lines that start with this character are comments.
+const char kCommentPrefix = '#';
+
+// Prefixes of the names of the groups of processes and threads.
+const char kPidGroupPrefix[] = "pid";
+const char kTidGroupPrefix[] = "tid";
+
+// Adds a thread to a group, unless it is already the last thread of the
+// group.
+void AddToGroup(const ThreadHistory& thread_history,
+                std::vector<const ThreadHistory*>* group) {
+  if (group->empty() || group->back() != &thread_history)
+    group->push_back(&thread_history);
+}
+
+}  // namespace
+
+ThreadGrouper::ThreadGrouper() : group_by_(kSingleGroup) {}
+
+void ThreadGrouper::set_group_by(GroupBy group_by) {
+  group_by_ = group_by;
+  if (group_by_ != kGroupByFilters)
+    group_filters_.clear();
+}
+
+bool ThreadGrouper::LoadGroupFilters(const std::wstring& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Unable to open groups file " << base::WStringToString(path)
+               << ".";
+    return false;
+  }
+
+  std::stringstream groups;
+  groups << file.rdbuf();
+
+  group_filters_.clear();
+  group_by_ = kGroupByFilters;
+  return ParseGroupFilters(groups.str());
+}
+
+bool ThreadGrouper::ParseGroupFilters(const std::string& groups) {
+  std::istringstream stream(groups);
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(stream, line)) {
+    ++line_number;
+    line = base::Trim(line);
+    if (line.empty() || line.front() == kCommentPrefix)
+      continue;
+
+    size_t name_end = line.find(' ');
+    std::string name = line.substr(0, name_end);
+
+    ThreadFilter filter;
+    if (name_end != std::string::npos &&
+        !filter.Parse(line.substr(name_end + 1))) {
+      LOG(ERROR) << "Invalid thread filter at line " << line_number << ".";
+      return false;
+    }
+
+    group_filters_.push_back(std::make_pair(name, filter));
+  }
+  group_by_ = kGroupByFilters;
+  return true;
+}
+
+void ThreadGrouper::AddThread(const ThreadHistory& thread_history,
+                              const SystemHistory& system_history) {
+  switch (group_by_) {
+    case kSingleGroup:
+      groups_[std::string()].push_back(&thread_history);
+      break;
+    case kGroupByProcessName:
+      groups_[system_history.GetProcessName(
+                  thread_history.parent_process_id())]
+          .push_back(&thread_history);
+      break;
+    case kGroupByPid:
+      groups_[kPidGroupPrefix +
+              std::to_string(thread_history.parent_process_id())]
+          .push_back(&thread_history);
+      break;
+    case kGroupByTid:
+      groups_[kTidGroupPrefix + std::to_string(thread_history.tid())]
+          .push_back(&thread_history);
+      break;
+    case kGroupByFilters:
+      for (const auto& name_and_filter : group_filters_) {
+        if (name_and_filter.second.Matches(thread_history, system_history))
+          AddToGroup(thread_history, &groups_[name_and_filter.first]);
+      }
+      break;
+  }
+}
+
+}  // namespace etw_insights
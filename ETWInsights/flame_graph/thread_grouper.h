@@ -0,0 +1,100 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "etw_reader/system_history.h"
+#include "etw_reader/thread_filter.h"
+#include "etw_reader/thread_history.h"
+
+namespace etw_insights {
+
+// Splits threads into named groups, so that one report can be generated per
+// group from a single system history. By default, all threads are in a
+// single group with an empty name.
+//
+// Groups can be read from a text file that contains one group per line, with
+// a group name followed by a thread filter (see ThreadFilter). Empty lines and
+// lines that start with '#' are ignored. A thread is added to every group
+// whose filter it matches, and lines with the same group name are combined.
+//   browser process_name=chrome.exe pid=1234
+//   gpu pid=5678
+class ThreadGrouper {
+ public:
+  enum GroupBy {
+    // All threads are in the same group.
+    kSingleGroup,
+    // One group per process name.
+    kGroupByProcessName,
+    // One group per process id, named pid<process id>.
+    kGroupByPid,
+    // One group per thread id, named tid<thread id>.
+    kGroupByTid,
+    // One group per filter read from a file.
+    kGroupByFilters,
+  };
+
+  ThreadGrouper();
+
+  // Sets the attribute that determines the group of a thread. Removes the
+  // group filters if |group_by| isn't kGroupByFilters.
+  void set_group_by(GroupBy group_by);
+  GroupBy group_by() const { return group_by_; }
+
+  // Replaces the group filters with the filters read from a file, and groups
+  // threads by filters.
+  // @param path path to the groups file.
+  // @returns true if the file was read and parsed successfully.
+  bool LoadGroupFilters(const std::wstring& path);
+
+  // Adds the groups described by |groups| to the group filters.
+  // @param groups groups, in the format described above.
+  // @returns true if |groups| was parsed successfully.
+  bool ParseGroupFilters(const std::string& groups);
+
+  // Adds a thread to the groups it belongs to.
+  // @param thread_history the thread to add. Must outlive the grouper.
+  // @param system_history the history that contains the thread.
+  void AddThread(const ThreadHistory& thread_history,
+                 const SystemHistory& system_history);
+
+  // Map: Group name -> Threads of the group.
+  typedef std::map<std::string, std::vector<const ThreadHistory*>> GroupMap;
+
+  // @returns the groups that contain at least one thread.
+  const GroupMap& groups() const { return groups_; }
+
+ private:
+  // Attribute that determines the group of a thread.
+  GroupBy group_by_;
+
+  // Name and filter of each group, for kGroupByFilters.
+  std::vector<std::pair<std::string, ThreadFilter>> group_filters_;
+
+  // Threads of each group.
+  GroupMap groups_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadGrouper);
+};
+
+}  // namespace etw_insights
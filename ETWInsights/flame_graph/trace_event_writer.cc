@@ -0,0 +1,194 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "flame_graph/trace_event_writer.h"
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Beginning and end of the JSON document.
+const char kDocumentBegin[] = "{\"traceEvents\":[\n";
+const char kDocumentEnd[] = "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+// Names of the thread instant events.
+const char kThreadStartEventName[] = "ThreadStart";
+const char kThreadEndEventName[] = "ThreadEnd";
+
+// Prefix of the tid in the name of a thread.
+const char kThreadNamePrefix[] = "thread ";
+
+// Category of the call stack slices.
+const char kStackCategory[] = "stack";
+
+}  // namespace
+
+TraceEventWriter::TraceEventWriter(const SystemHistory& system_history,
+                                   FlameChart* flame_chart)
+    : system_history_(system_history),
+      flame_chart_(flame_chart),
+      has_events_(false) {
+  DCHECK(flame_chart != nullptr);
+}
+
+TraceEventWriter::~TraceEventWriter() {
+  if (out_.is_open())
+    Close();
+}
+
+bool TraceEventWriter::Open(const std::wstring& path) {
+  if (!out_.Open(path, base::BufferedWriter::kFlushInBackground))
+    return false;
+
+  has_events_ = false;
+  named_processes_.clear();
+  out_.Write(kDocumentBegin);
+  return true;
+}
+
+void TraceEventWriter::WriteThread(const ThreadHistory& thread_history,
+                                   base::Timestamp start_ts,
+                                   base::Timestamp end_ts) {
+  base::Pid pid = thread_history.parent_process_id();
+  base::Tid tid = thread_history.tid();
+
+  if (named_processes_.insert(pid).second)
+    WriteProcessName(pid);
+  WriteThreadName(pid, tid);
+
+  if (thread_history.start_ts() != base::kInvalidTimestamp &&
+      thread_history.start_ts() >= start_ts &&
+      thread_history.start_ts() < end_ts) {
+    WriteInstantEvent(kThreadStartEventName, pid, tid,
+                      thread_history.start_ts());
+  }
+
+  // Write the call stack slices as the flame chart generates them.
+  const SymbolTable& symbols = flame_chart_->cleaned_symbols();
+  flame_chart_->WalkThreadHistory(
+      thread_history, start_ts, end_ts,
+      [this, pid, tid, &symbols](const FlameChartSpan& span) {
+        BeginEvent();
+        out_.Write("{\"name\":");
+        WriteEscapedString(symbols.GetSymbol(span.symbol));
+        out_.Write(",\"cat\":\"");
+        out_.Write(kStackCategory);
+        out_.Write("\",\"ph\":\"X\",\"ts\":");
+        out_.WriteUInt(span.start_ts);
+        out_.Write(",\"dur\":");
+        out_.WriteUInt(span.end_ts - span.start_ts);
+        out_.Write(",\"pid\":");
+        out_.WriteUInt(pid);
+        out_.Write(",\"tid\":");
+        out_.WriteUInt(tid);
+        out_.Write("}");
+      });
+
+  if (thread_history.end_ts() != base::kInvalidTimestamp &&
+      thread_history.end_ts() >= start_ts &&
+      thread_history.end_ts() < end_ts) {
+    WriteInstantEvent(kThreadEndEventName, pid, tid, thread_history.end_ts());
+  }
+}
+
+bool TraceEventWriter::Close() {
+  out_.Write(kDocumentEnd);
+  return out_.Close();
+}
+
+void TraceEventWriter::BeginEvent() {
+  if (has_events_)
+    out_.Write(",\n");
+  has_events_ = true;
+}
+
+void TraceEventWriter::WriteProcessName(base::Pid pid) {
+  const std::string& process_name = system_history_.GetProcessName(pid);
+  if (process_name.empty())
+    return;
+
+  BeginEvent();
+  out_.Write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+  out_.WriteUInt(pid);
+  out_.Write(",\"tid\":0,\"args\":{\"name\":");
+  WriteEscapedString(process_name);
+  out_.Write("}}");
+}
+
+void TraceEventWriter::WriteThreadName(base::Pid pid, base::Tid tid) {
+  std::string thread_name = system_history_.GetProcessName(pid);
+  if (!thread_name.empty())
+    thread_name += ' ';
+  thread_name += kThreadNamePrefix;
+  thread_name += std::to_string(tid);
+
+  BeginEvent();
+  out_.Write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+  out_.WriteUInt(pid);
+  out_.Write(",\"tid\":");
+  out_.WriteUInt(tid);
+  out_.Write(",\"args\":{\"name\":");
+  WriteEscapedString(thread_name);
+  out_.Write("}}");
+}
+
+void TraceEventWriter::WriteInstantEvent(const char* name,
+                                         base::Pid pid,
+                                         base::Tid tid,
+                                         base::Timestamp ts) {
+  BeginEvent();
+  out_.Write("{\"name\":\"");
+  out_.Write(name);
+  out_.Write("\",\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+  out_.WriteUInt(ts);
+  out_.Write(",\"pid\":");
+  out_.WriteUInt(pid);
+  out_.Write(",\"tid\":");
+  out_.WriteUInt(tid);
+  out_.Write("}");
+}
+
+void TraceEventWriter::WriteEscapedString(const std::string& str) {
+  static const char kHexDigits[] = "0123456789abcdef";
+
+  out_.WriteChar('"');
+  size_t unescaped_begin = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+      continue;
+
+    // Write the characters that don't need to be escaped, then the escaped
+    // character. Bytes outside of the ASCII range are written as Latin-1
+    // characters, so that the output is always valid JSON.
+    out_.Write(str.data() + unescaped_begin, i - unescaped_begin);
+    unescaped_begin = i + 1;
+    if (c == '"' || c == '\\') {
+      char escaped[] = {'\\', static_cast<char>(c)};
+      out_.Write(escaped, sizeof(escaped));
+    } else {
+      char escaped[] = {'\\', 'u', '0', '0', kHexDigits[c >> 4],
+                        kHexDigits[c & 0xF]};
+      out_.Write(escaped, sizeof(escaped));
+    }
+  }
+  out_.Write(str.data() + unescaped_begin, str.size() - unescaped_begin);
+  out_.WriteChar('"');
+}
+
+}  // namespace etw_insights
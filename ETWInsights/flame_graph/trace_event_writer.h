@@ -0,0 +1,107 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_set>
+
+#include "base/base.h"
+#include "base/buffered_writer.h"
+#include "base/types.h"
+#include "etw_reader/system_history.h"
+#include "etw_reader/thread_history.h"
+#include "flame_graph/flame_chart.h"
+
+namespace etw_insights {
+
+// Writes a system history in the Trace Event JSON format, which can be opened
+// in chrome://tracing or in the Perfetto UI. Each thread gets its call stacks
+// as nested slices, and instant events for its start and end. Processes are
+// named after the names recorded in the system history. The history has no
+// thread names, so threads are named after their process and their tid.
+//
+// Events are written as they are generated, through a BufferedWriter, so
+// memory usage doesn't depend on the size of the trace. Typical usage is:
+//   TraceEventWriter writer(system_history, &flame_chart);
+//   writer.Open(L"trace.json");
+//   writer.WriteThread(thread_history, start_ts, end_ts);
+//   writer.Close();
+class TraceEventWriter {
+ public:
+  // @param system_history the history that contains the threads to write.
+  // @param flame_chart generates the call stack slices of the threads. Must
+  //    use the symbol table of |system_history|.
+  TraceEventWriter(const SystemHistory& system_history,
+                   FlameChart* flame_chart);
+  ~TraceEventWriter();
+
+  // Opens the output file and writes the beginning of the JSON document.
+  // @param path path of the output file.
+  // @returns true if the file was opened successfully.
+  bool Open(const std::wstring& path);
+
+  // Writes the name and the events of a thread, and the name of its process if
+  // it hasn't been written yet.
+  // @param thread_history the history of the thread.
+  // @param start_ts start of the time range to write.
+  // @param end_ts end of the time range to write.
+  void WriteThread(const ThreadHistory& thread_history,
+                   base::Timestamp start_ts,
+                   base::Timestamp end_ts);
+
+  // Writes the end of the JSON document and closes the file.
+  // @returns true if all the events were written successfully.
+  bool Close();
+
+ private:
+  // Writes an event separator if this isn't the first event.
+  void BeginEvent();
+
+  // Writes the metadata event that names a process.
+  void WriteProcessName(base::Pid pid);
+
+  // Writes the metadata event that names a thread.
+  void WriteThreadName(base::Pid pid, base::Tid tid);
+
+  // Writes an instant event on a thread.
+  void WriteInstantEvent(const char* name,
+                         base::Pid pid,
+                         base::Tid tid,
+                         base::Timestamp ts);
+
+  // Writes |str| as a quoted JSON string.
+  void WriteEscapedString(const std::string& str);
+
+  // The history that contains the threads to write.
+  const SystemHistory& system_history_;
+
+  // Generates the call stack slices of the threads.
+  FlameChart* flame_chart_;
+
+  // Output file.
+  base::BufferedWriter out_;
+
+  // Whether an event has been written.
+  bool has_events_;
+
+  // Processes whose name has been written.
+  std::unordered_set<base::Pid> named_processes_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceEventWriter);
+};
+
+}  // namespace etw_insights
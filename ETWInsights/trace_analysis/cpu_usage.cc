@@ -0,0 +1,366 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/cpu_usage.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Common fields.
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIDField[] = "ThreadID";
+const char kProcessNameField[] = "Process Name ( PID)";
+
+// CSwitch event.
+const char kCSwitchType[] = "CSwitch";
+const char kCSwitchNewTidField[] = "New TID";
+const char kCSwitchOldTidField[] = "Old TID";
+const char kCSwitchNewProcessNameField[] = "New Process Name ( PID)";
+const char kCSwitchOldProcessNameField[] = "Old Process Name ( PID)";
+const char kCSwitchCpuField[] = "CPU";
+
+// Thread start events.
+const char kThreadStartType[] = "T-Start";
+const char kThreadDCStartType[] = "T-DCStart";
+
+// SampledProfile event, used to find the end of the trace.
+const char kSampledProfileType[] = "SampledProfile";
+
+// Thread id of the idle thread.
+const base::Tid kIdleTid = 0;
+
+// Headers of the CSV output.
+const char kCsvProcessHeader[] =
+    "ts,pid,process_name,cpu_time,cpu_percent\n";
+const char kCsvThreadHeader[] =
+    "ts,pid,process_name,tid,cpu_time,cpu_percent\n";
+
+}  // namespace
+
+CpuUsageTimeline::CpuUsageTimeline(const CpuUsageOptions& options)
+    : options_(options),
+      wrote_row_(false),
+      bucket_start_(base::kInvalidTimestamp),
+      num_mismatched_switches_(0),
+      num_out_of_order_switches_(0),
+      num_invalid_cpu_switches_(0) {
+  DCHECK_GT(options_.bucket_width, 0U);
+}
+
+CpuUsageTimeline::~CpuUsageTimeline() {}
+
+bool CpuUsageTimeline::Open(const std::wstring& path) {
+  if (!out_.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  if (options_.format == kJsonFormat) {
+    out_.Write("{\"bucket_width\":");
+    out_.WriteUInt(options_.bucket_width);
+    out_.Write(",\"rows\":[\n");
+  } else if (options_.group_by == CpuUsageOptions::kGroupByThread) {
+    out_.Write(kCsvThreadHeader);
+  } else {
+    out_.Write(kCsvProcessHeader);
+  }
+  return true;
+}
+
+void CpuUsageTimeline::SetThreadProcess(base::Tid tid,
+                                        base::Pid pid,
+                                        const std::string& process_name) {
+  thread_pids_[tid] = pid;
+  std::string& name = process_names_[pid];
+  if (name != process_name)
+    name = process_name;
+}
+
+void CpuUsageTimeline::AddContextSwitch(base::Timestamp ts,
+                                        uint64_t cpu,
+                                        base::Tid new_tid,
+                                        base::Tid old_tid) {
+  // The CPU number comes from the trace: don't let it size |cpus_|
+  // arbitrarily.
+  if (cpu >= kMaxCpus) {
+    ++num_invalid_cpu_switches_;
+    return;
+  }
+
+  AdvanceTo(ts);
+
+  if (cpu >= cpus_.size())
+    cpus_.resize(static_cast<size_t>(cpu) + 1);
+  CpuState& state = cpus_[static_cast<size_t>(cpu)];
+
+  // The first context switch on a CPU only tells which thread runs next.
+  if (state.running) {
+    if (ts < state.since_ts) {
+      // The time until |state.since_ts| has already been accounted for, and
+      // may have been written in a previous bucket.
+      ++num_out_of_order_switches_;
+    } else if (state.tid == old_tid) {
+      if (old_tid != kIdleTid)
+        AddCpuTime(old_tid, ts - state.since_ts);
+    } else {
+      ++num_mismatched_switches_;
+    }
+  }
+
+  state.running = true;
+  state.tid = new_tid;
+  state.since_ts = std::max(state.since_ts, ts);
+}
+
+bool CpuUsageTimeline::Close(base::Timestamp end_ts) {
+  if (bucket_start_ != base::kInvalidTimestamp && end_ts > bucket_start_) {
+    AdvanceTo(end_ts);
+    AccountRunningThreads(end_ts);
+    WriteBucket(end_ts);
+  }
+
+  if (options_.format == kJsonFormat)
+    out_.Write("\n]}\n");
+  return out_.Close();
+}
+
+void CpuUsageTimeline::AddCpuTime(base::Tid tid, base::Timestamp cpu_time) {
+  if (cpu_time != 0)
+    bucket_cpu_time_[tid] += cpu_time;
+}
+
+void CpuUsageTimeline::AdvanceTo(base::Timestamp ts) {
+  if (bucket_start_ == base::kInvalidTimestamp) {
+    bucket_start_ = ts - ts % options_.bucket_width;
+    return;
+  }
+
+  while (ts >= bucket_start_ + options_.bucket_width) {
+    base::Timestamp bucket_end = bucket_start_ + options_.bucket_width;
+    AccountRunningThreads(bucket_end);
+    WriteBucket(bucket_end);
+    bucket_start_ = bucket_end;
+
+    // Skip the empty buckets at once when all the CPUs are idle.
+    bool idle = std::none_of(cpus_.begin(), cpus_.end(),
+                             [](const CpuState& state) {
+                               return state.running && state.tid != kIdleTid;
+                             });
+    if (idle)
+      bucket_start_ = std::max(bucket_start_, ts - ts % options_.bucket_width);
+  }
+}
+
+void CpuUsageTimeline::AccountRunningThreads(base::Timestamp ts) {
+  for (CpuState& state : cpus_) {
+    if (!state.running || ts <= state.since_ts)
+      continue;
+    if (state.tid != kIdleTid)
+      AddCpuTime(state.tid, ts - state.since_ts);
+    state.since_ts = ts;
+  }
+}
+
+void CpuUsageTimeline::WriteBucket(base::Timestamp bucket_end) {
+  if (bucket_cpu_time_.empty())
+    return;
+  base::Timestamp bucket_duration = bucket_end - bucket_start_;
+
+  if (options_.group_by == CpuUsageOptions::kGroupByThread) {
+    // Rows are sorted by process and thread.
+    std::vector<std::pair<std::pair<base::Pid, base::Tid>, base::Timestamp>>
+        rows;
+    rows.reserve(bucket_cpu_time_.size());
+    for (const auto& thread_cpu_time : bucket_cpu_time_) {
+      auto look_pid = thread_pids_.find(thread_cpu_time.first);
+      base::Pid pid =
+          look_pid != thread_pids_.end() ? look_pid->second : base::kInvalidPid;
+      rows.push_back(std::make_pair(
+          std::make_pair(pid, thread_cpu_time.first), thread_cpu_time.second));
+    }
+    std::sort(rows.begin(), rows.end());
+    for (const auto& row : rows)
+      WriteRow(bucket_duration, row.first.first, row.first.second, row.second);
+  } else {
+    std::map<base::Pid, base::Timestamp> process_cpu_time;
+    for (const auto& thread_cpu_time : bucket_cpu_time_) {
+      auto look_pid = thread_pids_.find(thread_cpu_time.first);
+      base::Pid pid =
+          look_pid != thread_pids_.end() ? look_pid->second : base::kInvalidPid;
+      process_cpu_time[pid] += thread_cpu_time.second;
+    }
+    for (const auto& row : process_cpu_time)
+      WriteRow(bucket_duration, row.first, base::kInvalidTid, row.second);
+  }
+
+  bucket_cpu_time_.clear();
+}
+
+void CpuUsageTimeline::WriteRow(base::Timestamp bucket_duration,
+                                base::Pid pid,
+                                base::Tid tid,
+                                base::Timestamp cpu_time) {
+  // Percentage of one CPU, with 2 decimals.
+  uint64_t hundredths_of_percent = cpu_time * 10000 / bucket_duration;
+  char decimals[] = {static_cast<char>('0' + hundredths_of_percent / 10 % 10),
+                     static_cast<char>('0' + hundredths_of_percent % 10)};
+
+  const std::string& process_name = GetProcessName(pid);
+  bool json = options_.format == kJsonFormat;
+  if (json) {
+    if (wrote_row_)
+      out_.Write(",\n");
+    out_.Write("{\"ts\":");
+    out_.WriteUInt(bucket_start_);
+    out_.Write(",\"pid\":");
+    out_.WriteUInt(pid);
+    out_.Write(",\"process_name\":");
+    out_.Write(base::QuoteJsonString(process_name));
+    if (tid != base::kInvalidTid) {
+      out_.Write(",\"tid\":");
+      out_.WriteUInt(tid);
+    }
+    out_.Write(",\"cpu_time\":");
+  } else {
+    out_.WriteUInt(bucket_start_);
+    out_.WriteChar(',');
+    out_.WriteUInt(pid);
+    out_.WriteChar(',');
+    out_.Write(base::QuoteCsvField(process_name));
+    out_.WriteChar(',');
+    if (tid != base::kInvalidTid) {
+      out_.WriteUInt(tid);
+      out_.WriteChar(',');
+    }
+  }
+
+  out_.WriteUInt(cpu_time);
+  out_.Write(json ? ",\"cpu_percent\":" : ",");
+  out_.WriteUInt(hundredths_of_percent / 100);
+  out_.WriteChar('.');
+  out_.Write(decimals, sizeof(decimals));
+  out_.Write(json ? "}" : "\n");
+  wrote_row_ = true;
+}
+
+const std::string& CpuUsageTimeline::GetProcessName(base::Pid pid) const {
+  static const std::string kEmptyName;
+  auto look = process_names_.find(pid);
+  if (look == process_names_.end())
+    return kEmptyName;
+  return look->second;
+}
+
+bool GenerateCpuUsageTimeline(const std::wstring& trace_path,
+                              const CpuUsageOptions& options,
+                              const std::wstring& output_path) {
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path))
+    return false;
+  etw_reader.set_filter(options.event_filter);
+
+  CpuUsageTimeline timeline(options);
+  if (!timeline.Open(output_path))
+    return false;
+
+  LOG(INFO) << "Reading trace events." << std::endl;
+
+  // Reused for all the events, to avoid allocating memory.
+  std::string process_name_field;
+  std::string process_name;
+
+  // Records the process of a thread from one of the fields of the event.
+  auto set_thread_process = [&](const ETWReader::Line& event, base::Tid tid,
+                                const char* field) {
+    if (!event.GetFieldAsString(field, &process_name_field))
+      return;
+    base::Pid pid = base::kInvalidPid;
+    SplitProcessNameField(process_name_field, &process_name, &pid);
+    timeline.SetThreadProcess(tid, pid, process_name);
+  };
+
+  base::Timestamp last_ts = 0;
+  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+    const std::string& type = it->type();
+    base::Timestamp ts = 0;
+
+    if (type == kCSwitchType) {
+      base::Tid new_tid = 0;
+      base::Tid old_tid = 0;
+      uint64_t cpu = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULong(kCSwitchNewTidField, &new_tid) ||
+          !it->GetFieldAsULong(kCSwitchOldTidField, &old_tid) ||
+          !it->GetFieldAsULong(kCSwitchCpuField, &cpu)) {
+        LOG(ERROR) << "Missing some fields in CSwitch event.";
+        continue;
+      }
+      if (!timeline.HasThreadProcess(new_tid))
+        set_thread_process(*it, new_tid, kCSwitchNewProcessNameField);
+      if (!timeline.HasThreadProcess(old_tid))
+        set_thread_process(*it, old_tid, kCSwitchOldProcessNameField);
+      timeline.AddContextSwitch(ts, cpu, new_tid, old_tid);
+    } else if (type == kThreadStartType || type == kThreadDCStartType) {
+      // Thread ids are reused: the process of a thread is updated when it
+      // starts.
+      base::Tid tid = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULong(kThreadIDField, &tid)) {
+        LOG(ERROR) << "Missing some fields in Thread Start event.";
+        continue;
+      }
+      set_thread_process(*it, tid, kProcessNameField);
+    } else if (type == kSampledProfileType) {
+      it->GetFieldAsULong(kTimestampField, &ts);
+    }
+
+    last_ts = std::max(last_ts, ts);
+  }
+
+  if (timeline.num_mismatched_switches() != 0) {
+    LOG(WARNING) << timeline.num_mismatched_switches()
+                 << " context switches didn't switch out the thread that was "
+                    "running on their CPU.";
+  }
+  if (timeline.num_out_of_order_switches() != 0) {
+    LOG(WARNING) << timeline.num_out_of_order_switches()
+                 << " context switches were earlier than the previous context "
+                    "switch on their CPU.";
+  }
+  if (timeline.num_invalid_cpu_switches() != 0) {
+    LOG(WARNING) << timeline.num_invalid_cpu_switches()
+                 << " context switches had an invalid CPU number.";
+  }
+
+  if (!timeline.Close(last_ts)) {
+    LOG(ERROR) << "Unable to write " << base::WStringToString(output_path)
+               << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,203 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "base/buffered_writer.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a CPU usage timeline.
+struct CpuUsageOptions {
+  enum GroupBy {
+    kGroupByProcess,
+    kGroupByThread,
+  };
+
+  CpuUsageOptions()
+      : bucket_width(100000),
+        group_by(kGroupByProcess),
+        format(kCsvFormat) {}
+
+  // Width of a time bucket, in microseconds.
+  base::Timestamp bucket_width;
+
+  // Whether the on-CPU time is reported per process or per thread.
+  GroupBy group_by;
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Accumulates the on-CPU time of threads into fixed-width time buckets, from
+// the context switches of a trace received in timestamp order. A thread is
+// on-CPU from the context switch that switches it in on a CPU to the next
+// context switch on the same CPU. Time on the idle thread (tid 0) isn't
+// reported.
+//
+// The times of a bucket are written to the output as soon as a later context
+// switch is received, so memory usage is proportional to the number of CPUs
+// and of threads, not to the duration of the trace. Typical usage is:
+//   CpuUsageTimeline timeline(options);
+//   timeline.Open(L"cpu_usage.csv");
+//   timeline.SetThreadProcess(tid, pid, "chrome.exe");
+//   timeline.AddContextSwitch(ts, cpu, new_tid, old_tid);
+//   timeline.Close(last_event_ts);
+class CpuUsageTimeline {
+ public:
+  explicit CpuUsageTimeline(const CpuUsageOptions& options);
+  ~CpuUsageTimeline();
+
+  // Opens the output file and writes the header of the timeline.
+  // @param path path of the output file.
+  // @returns true if the file was opened successfully.
+  bool Open(const std::wstring& path);
+
+  // Sets the process of a thread, and the name of the process.
+  void SetThreadProcess(base::Tid tid,
+                        base::Pid pid,
+                        const std::string& process_name);
+
+  // @returns true if the process of thread |tid| is known.
+  bool HasThreadProcess(base::Tid tid) const {
+    return thread_pids_.find(tid) != thread_pids_.end();
+  }
+
+  // Accounts for a context switch. A context switch with a timestamp lower
+  // than the previous one on its CPU only changes the running thread, and a
+  // context switch on a CPU numbered kMaxCpus or above is ignored.
+  // @param ts timestamp of the context switch.
+  // @param cpu CPU on which the context switch occurred.
+  // @param new_tid thread switched in.
+  // @param old_tid thread switched out.
+  void AddContextSwitch(base::Timestamp ts,
+                        uint64_t cpu,
+                        base::Tid new_tid,
+                        base::Tid old_tid);
+
+  // Accounts for the threads that are still running at |end_ts|, writes the
+  // remaining buckets and closes the output file.
+  // @param end_ts timestamp of the end of the trace.
+  // @returns true if the timeline was written successfully.
+  bool Close(base::Timestamp end_ts);
+
+  // Number of context switches whose old thread wasn't the thread switched
+  // in by the previous context switch on the same CPU. Their old thread isn't
+  // accounted for.
+  uint64_t num_mismatched_switches() const { return num_mismatched_switches_; }
+
+  // Number of context switches whose timestamp was lower than the previous
+  // one on the same CPU. No time is accounted for them.
+  uint64_t num_out_of_order_switches() const {
+    return num_out_of_order_switches_;
+  }
+
+  // Number of context switches ignored because of an invalid CPU.
+  uint64_t num_invalid_cpu_switches() const {
+    return num_invalid_cpu_switches_;
+  }
+
+  // CPU numbers from this one are considered invalid. Windows supports up to
+  // 2048 logical processors.
+  static const uint64_t kMaxCpus = 2048;
+
+ private:
+  // Thread running on a CPU.
+  struct CpuState {
+    CpuState() : running(false), tid(0), since_ts(0) {}
+
+    // Whether the running thread is known.
+    bool running;
+    base::Tid tid;
+
+    // Time since which |tid| has been accounted for.
+    base::Timestamp since_ts;
+  };
+
+  // Adds on-CPU time to a thread, in the current bucket.
+  void AddCpuTime(base::Tid tid, base::Timestamp cpu_time);
+
+  // Writes the buckets that end before or at |ts|.
+  void AdvanceTo(base::Timestamp ts);
+
+  // Accounts for the running threads up to |ts|, which is within the current
+  // bucket.
+  void AccountRunningThreads(base::Timestamp ts);
+
+  // Writes the rows of the current bucket and clears its times.
+  // @param bucket_end end of the bucket, lower than the end of a full bucket
+  //    for the last bucket of the trace.
+  void WriteBucket(base::Timestamp bucket_end);
+
+  void WriteRow(base::Timestamp bucket_duration,
+                base::Pid pid,
+                base::Tid tid,
+                base::Timestamp cpu_time);
+
+  // @returns the name of a process, or an empty string.
+  const std::string& GetProcessName(base::Pid pid) const;
+
+  const CpuUsageOptions options_;
+
+  base::BufferedWriter out_;
+
+  // Whether a row has been written, for JSON separators.
+  bool wrote_row_;
+
+  // State of each CPU, by CPU index.
+  std::vector<CpuState> cpus_;
+
+  // Start of the current bucket. kInvalidTimestamp before the first context
+  // switch.
+  base::Timestamp bucket_start_;
+
+  // On-CPU time of each thread in the current bucket.
+  std::unordered_map<base::Tid, base::Timestamp> bucket_cpu_time_;
+
+  // Process of each thread, and name of each process.
+  std::unordered_map<base::Tid, base::Pid> thread_pids_;
+  std::unordered_map<base::Pid, std::string> process_names_;
+
+  uint64_t num_mismatched_switches_;
+  uint64_t num_out_of_order_switches_;
+  uint64_t num_invalid_cpu_switches_;
+
+  DISALLOW_COPY_AND_ASSIGN(CpuUsageTimeline);
+};
+
+// Reads the CSwitch events of a trace in a single pass and writes the on-CPU
+// time of its processes or threads in each time bucket.
+// @param trace_path path to a .etl trace file.
+// @param options options of the timeline.
+// @param output_path path of the output file.
+// @returns true if the timeline was written successfully.
+bool GenerateCpuUsageTimeline(const std::wstring& trace_path,
+                              const CpuUsageOptions& options,
+                              const std::wstring& output_path);
+
+}  // namespace etw_insights
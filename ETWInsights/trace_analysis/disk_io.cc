@@ -0,0 +1,375 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/disk_io.h"
+
+#include <algorithm>
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Common fields.
+const char kTimestampField[] = "TimeStamp";
+const char kProcessNameField[] = "Process Name ( PID)";
+const char kIrpPtrField[] = "IrpPtr";
+const char kFileNameField[] = "FileName";
+const char kElapsedTimeField[] = "ElapsedTime";
+
+// FileIo events that start an operation.
+const char* const kFileIoStartTypes[] = {
+    "FileIoCreate",   "FileIoCleanup",  "FileIoClose",    "FileIoFlush",
+    "FileIoRead",     "FileIoWrite",    "FileIoSetInfo",  "FileIoQueryInfo",
+    "FileIoFSCTL",    "FileIoDelete",   "FileIoRename",   "FileIoDirEnum",
+    "FileIoDirNotify",
+};
+const char kFileIoSizeField[] = "Size";
+
+// FileIo events whose FileIoOpEnd event has the number of transferred bytes in
+// its ExtraInfo field. For the other operations, ExtraInfo has another
+// meaning, e.g. the disposition of a create.
+const char* const kFileIoTransferTypes[] = {
+    "FileIoRead", "FileIoWrite",
+};
+
+// FileIoOpEnd event.
+const char kFileIoOpEndType[] = "FileIoOpEnd";
+const char kFileIoOpEndExtraInfoField[] = "ExtraInfo";
+
+// Disk events, logged when the operation completes.
+const char* const kDiskIoTypes[] = {
+    "DiskRead", "DiskWrite", "DiskFlush",
+};
+const char kDiskIoSizeField[] = "IOSize";
+
+// Name of the files beyond DiskIoOptions::max_files.
+const char kOtherFilesName[] = "[Other files]";
+
+const size_t kInvalidId = static_cast<size_t>(-1);
+
+const char kCsvHeader[] =
+    "scope,pid,process_name,file_name,operation,count,bytes,total_latency,"
+    "p50,p99,max\n";
+
+template <size_t N>
+bool IsOneOf(const std::string& type, const char* const (&types)[N]) {
+  for (const char* candidate : types) {
+    if (type == candidate)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+DiskIoReport::DiskIoReport(const DiskIoOptions& options)
+    : options_(options), other_files_id_(kInvalidId) {}
+
+DiskIoReport::~DiskIoReport() {}
+
+void DiskIoReport::StartOperation(base::Timestamp ts,
+                                  uint64_t irp,
+                                  const std::string& type,
+                                  base::Pid pid,
+                                  const std::string& file_name,
+                                  uint64_t size) {
+  PendingOperation& operation = pending_operations_[irp];
+  operation.ts = ts;
+  operation.type_id = GetTypeId(type);
+  operation.pid = pid;
+  operation.file_id = GetFileId(file_name);
+  operation.size = size;
+  operation.transfers_bytes = IsOneOf(type, kFileIoTransferTypes);
+}
+
+bool DiskIoReport::EndOperation(base::Timestamp ts,
+                                uint64_t irp,
+                                base::Timestamp elapsed_time,
+                                uint64_t bytes) {
+  auto look = pending_operations_.find(irp);
+  if (look == pending_operations_.end())
+    return false;
+  const PendingOperation& operation = look->second;
+
+  base::Timestamp latency = elapsed_time;
+  if (latency == base::kInvalidTimestamp)
+    latency = ts >= operation.ts ? ts - operation.ts : 0;
+  if (!operation.transfers_bytes || bytes == 0)
+    bytes = operation.size;
+  AddLatency(operation.type_id, operation.pid, operation.file_id, latency,
+             bytes);
+
+  pending_operations_.erase(look);
+  return true;
+}
+
+void DiskIoReport::AddOperation(const std::string& type,
+                                base::Pid pid,
+                                const std::string& file_name,
+                                base::Timestamp latency,
+                                uint64_t bytes) {
+  AddLatency(GetTypeId(type), pid, GetFileId(file_name), latency, bytes);
+}
+
+void DiskIoReport::SetProcessName(base::Pid pid,
+                                  const std::string& process_name) {
+  std::string& name = process_names_[pid];
+  if (name != process_name)
+    name = process_name;
+}
+
+bool DiskIoReport::Write(const std::wstring& path) const {
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  bool json = options_.format == kJsonFormat;
+
+  // Writes the rows of a scope, by decreasing total latency.
+  auto write_scope = [&](const char* scope, const StatsMap& stats_map,
+                         bool per_process) {
+    std::vector<StatsMap::const_iterator> rows;
+    rows.reserve(stats_map.size());
+    for (auto it = stats_map.begin(); it != stats_map.end(); ++it)
+      rows.push_back(it);
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](StatsMap::const_iterator a, StatsMap::const_iterator b) {
+                       return a->second.latency.total() >
+                              b->second.latency.total();
+                     });
+
+    if (json) {
+      out.WriteChar('"');
+      out.Write(scope);
+      out.Write("\":[");
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+      const StatsKey& key = rows[i]->first;
+      const IoStats& stats = rows[i]->second;
+      const LatencyHistogram& latency = stats.latency;
+
+      if (json) {
+        out.Write(i == 0 ? "\n{" : ",\n{");
+        if (per_process) {
+          auto look_name = process_names_.find(key.first);
+          out.Write("\"pid\":");
+          out.WriteUInt(key.first);
+          out.Write(",\"process_name\":");
+          out.Write(base::QuoteCsvOrJsonString(
+              look_name != process_names_.end() ? look_name->second : "",
+              json));
+        } else {
+          out.Write("\"file_name\":");
+          out.Write(base::QuoteCsvOrJsonString(file_names_[key.first], json));
+        }
+        out.Write(",\"operation\":");
+        out.Write(base::QuoteCsvOrJsonString(type_names_[key.second], json));
+        out.Write(",\"count\":");
+        out.WriteUInt(latency.count());
+        out.Write(",\"bytes\":");
+        out.WriteUInt(stats.bytes);
+        out.Write(",\"total_latency\":");
+        out.WriteUInt(latency.total());
+        out.Write(",\"p50\":");
+        out.WriteUInt(latency.GetQuantile(0.5));
+        out.Write(",\"p99\":");
+        out.WriteUInt(latency.GetQuantile(0.99));
+        out.Write(",\"max\":");
+        out.WriteUInt(latency.max());
+        out.WriteChar('}');
+      } else {
+        out.Write(scope);
+        out.WriteChar(',');
+        if (per_process) {
+          auto look_name = process_names_.find(key.first);
+          out.WriteUInt(key.first);
+          out.WriteChar(',');
+          out.Write(base::QuoteCsvOrJsonString(
+              look_name != process_names_.end() ? look_name->second : "",
+              json));
+          out.Write(",,");
+        } else {
+          out.Write(",,");
+          out.Write(base::QuoteCsvOrJsonString(file_names_[key.first], json));
+          out.WriteChar(',');
+        }
+        out.Write(base::QuoteCsvOrJsonString(type_names_[key.second], json));
+        out.WriteChar(',');
+        out.WriteUInt(latency.count());
+        out.WriteChar(',');
+        out.WriteUInt(stats.bytes);
+        out.WriteChar(',');
+        out.WriteUInt(latency.total());
+        out.WriteChar(',');
+        out.WriteUInt(latency.GetQuantile(0.5));
+        out.WriteChar(',');
+        out.WriteUInt(latency.GetQuantile(0.99));
+        out.WriteChar(',');
+        out.WriteUInt(latency.max());
+        out.WriteChar('\n');
+      }
+    }
+    if (json)
+      out.Write("\n]");
+  };
+
+  if (json) {
+    out.WriteChar('{');
+    write_scope("processes", process_stats_, true);
+    out.WriteChar(',');
+    write_scope("files", file_stats_, false);
+    out.Write("}\n");
+  } else {
+    out.Write(kCsvHeader);
+    write_scope("process", process_stats_, true);
+    write_scope("file", file_stats_, false);
+  }
+
+  return out.Close();
+}
+
+size_t DiskIoReport::GetTypeId(const std::string& type) {
+  // There are few types: a linear search is faster than hashing |type|.
+  for (size_t i = 0; i < type_names_.size(); ++i) {
+    if (type_names_[i] == type)
+      return i;
+  }
+  type_names_.push_back(type);
+  return type_names_.size() - 1;
+}
+
+size_t DiskIoReport::GetFileId(const std::string& file_name) {
+  auto look = file_ids_.find(file_name);
+  if (look != file_ids_.end())
+    return look->second;
+
+  if (file_ids_.size() < options_.max_files) {
+    file_names_.push_back(file_name);
+    file_ids_.insert({file_name, file_names_.size() - 1});
+    return file_names_.size() - 1;
+  }
+
+  if (other_files_id_ == kInvalidId) {
+    file_names_.push_back(kOtherFilesName);
+    other_files_id_ = file_names_.size() - 1;
+  }
+  return other_files_id_;
+}
+
+void DiskIoReport::AddLatency(size_t type_id,
+                              base::Pid pid,
+                              size_t file_id,
+                              base::Timestamp latency,
+                              uint64_t bytes) {
+  IoStats& process_stats = process_stats_[StatsKey(pid, type_id)];
+  process_stats.latency.Add(latency);
+  process_stats.bytes += bytes;
+
+  IoStats& file_stats = file_stats_[StatsKey(file_id, type_id)];
+  file_stats.latency.Add(latency);
+  file_stats.bytes += bytes;
+}
+
+bool GenerateDiskIoReport(const std::wstring& trace_path,
+                          const DiskIoOptions& options,
+                          const std::wstring& output_path) {
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path))
+    return false;
+  etw_reader.set_filter(options.event_filter);
+
+  DiskIoReport report(options);
+
+  LOG(INFO) << "Reading trace events." << std::endl;
+
+  // Reused for all the events, to avoid allocating memory.
+  std::string process_name_field;
+  std::string process_name;
+  std::string file_name;
+
+  // Reads the process of an event and records its name.
+  auto read_pid = [&](const ETWReader::Line& event) {
+    base::Pid pid = base::kInvalidPid;
+    if (event.GetFieldAsString(kProcessNameField, &process_name_field)) {
+      SplitProcessNameField(process_name_field, &process_name, &pid);
+      report.SetProcessName(pid, process_name);
+    }
+    return pid;
+  };
+
+  uint64_t num_unmatched_ends = 0;
+  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+    const std::string& type = it->type();
+    base::Timestamp ts = 0;
+
+    if (type == kFileIoOpEndType) {
+      uint64_t irp = 0;
+      base::Timestamp elapsed_time = base::kInvalidTimestamp;
+      uint64_t bytes = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULongHex(kIrpPtrField, &irp)) {
+        LOG(ERROR) << "Missing some fields in FileIoOpEnd event.";
+        continue;
+      }
+      it->GetFieldAsULong(kElapsedTimeField, &elapsed_time);
+      it->GetFieldAsULongHex(kFileIoOpEndExtraInfoField, &bytes);
+      if (!report.EndOperation(ts, irp, elapsed_time, bytes))
+        ++num_unmatched_ends;
+    } else if (IsOneOf(type, kFileIoStartTypes)) {
+      uint64_t irp = 0;
+      uint64_t size = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULongHex(kIrpPtrField, &irp) ||
+          !it->GetFieldAsString(kFileNameField, &file_name)) {
+        LOG(ERROR) << "Missing some fields in " << type << " event.";
+        continue;
+      }
+      it->GetFieldAsULongHex(kFileIoSizeField, &size);
+      report.StartOperation(ts, irp, type, read_pid(*it), file_name, size);
+    } else if (IsOneOf(type, kDiskIoTypes)) {
+      base::Timestamp elapsed_time = 0;
+      uint64_t size = 0;
+      if (!it->GetFieldAsULong(kElapsedTimeField, &elapsed_time) ||
+          !it->GetFieldAsString(kFileNameField, &file_name)) {
+        LOG(ERROR) << "Missing some fields in " << type << " event.";
+        continue;
+      }
+      it->GetFieldAsULongHex(kDiskIoSizeField, &size);
+      report.AddOperation(type, read_pid(*it), file_name, elapsed_time, size);
+    }
+  }
+
+  if (num_unmatched_ends != 0) {
+    LOG(WARNING) << num_unmatched_ends
+                 << " FileIoOpEnd events had no matching start event.";
+  }
+  if (report.num_pending_operations() != 0) {
+    LOG(WARNING) << report.num_pending_operations()
+                 << " file operations didn't end before the end of the trace.";
+  }
+
+  return report.Write(output_path);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,170 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "trace_analysis/latency_histogram.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a disk I/O analysis.
+struct DiskIoOptions {
+  DiskIoOptions() : max_files(10000), format(kCsvFormat) {}
+
+  // Maximum number of files with their own statistics. Operations on other
+  // files are reported together.
+  uint64_t max_files;
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Accumulates the latency and the bytes of the file and disk operations of a
+// trace, per process and per file, for each type of operation. A file
+// operation is paired with its completion by the address of its IRP. Memory
+// usage is bounded by the number of processes, of operation types, of pending
+// IRPs and by DiskIoOptions::max_files.
+class DiskIoReport {
+ public:
+  explicit DiskIoReport(const DiskIoOptions& options);
+  ~DiskIoReport();
+
+  // Records the start of a file operation.
+  // @param ts timestamp of the operation.
+  // @param irp address of the IRP of the operation. A pending operation with
+  //    the same IRP is replaced.
+  // @param type type of the operation, e.g. "FileIoRead".
+  // @param pid process that issued the operation.
+  // @param file_name name of the file.
+  // @param size requested number of bytes, or 0.
+  void StartOperation(base::Timestamp ts,
+                      uint64_t irp,
+                      const std::string& type,
+                      base::Pid pid,
+                      const std::string& file_name,
+                      uint64_t size);
+
+  // Records the end of the file operation started with |irp|.
+  // @param ts timestamp of the end of the operation.
+  // @param elapsed_time duration of the operation, or kInvalidTimestamp to
+  //    use the time since its start.
+  // @param bytes transferred number of bytes, or 0 to use the requested size.
+  //    Only used for reads and writes: the other operations use their
+  //    requested size.
+  // @returns false if no operation is pending with |irp|.
+  bool EndOperation(base::Timestamp ts,
+                    uint64_t irp,
+                    base::Timestamp elapsed_time,
+                    uint64_t bytes);
+
+  // Records an operation logged once with its duration, e.g. a disk read.
+  void AddOperation(const std::string& type,
+                    base::Pid pid,
+                    const std::string& file_name,
+                    base::Timestamp latency,
+                    uint64_t bytes);
+
+  void SetProcessName(base::Pid pid, const std::string& process_name);
+
+  // Writes the statistics of each process and of each file, sorted by
+  // decreasing total latency.
+  // @param path path of the output file.
+  // @returns true if the report was written successfully.
+  bool Write(const std::wstring& path) const;
+
+  size_t num_pending_operations() const { return pending_operations_.size(); }
+
+ private:
+  // Latency and bytes of a set of operations.
+  struct IoStats {
+    IoStats() : bytes(0) {}
+
+    LatencyHistogram latency;
+    uint64_t bytes;
+  };
+
+  // Operations of a type, on a file or from a process.
+  typedef std::pair<size_t, size_t> StatsKey;
+  typedef std::map<StatsKey, IoStats> StatsMap;
+
+  struct PendingOperation {
+    base::Timestamp ts;
+    size_t type_id;
+    base::Pid pid;
+    size_t file_id;
+    uint64_t size;
+
+    // Whether the end of the operation has the number of transferred bytes.
+    bool transfers_bytes;
+  };
+
+  size_t GetTypeId(const std::string& type);
+  size_t GetFileId(const std::string& file_name);
+
+  void AddLatency(size_t type_id,
+                  base::Pid pid,
+                  size_t file_id,
+                  base::Timestamp latency,
+                  uint64_t bytes);
+
+  const DiskIoOptions options_;
+
+  // Names of the operation types and of the files, by id.
+  std::vector<std::string> type_names_;
+  std::vector<std::string> file_names_;
+  std::unordered_map<std::string, size_t> file_ids_;
+
+  // Id shared by the files beyond DiskIoOptions::max_files, or kInvalidId.
+  size_t other_files_id_;
+
+  // Statistics by (process id, type id) and by (file id, type id).
+  StatsMap process_stats_;
+  StatsMap file_stats_;
+
+  // Operations that have started and not ended, by IRP.
+  std::unordered_map<uint64_t, PendingOperation> pending_operations_;
+
+  std::unordered_map<base::Pid, std::string> process_names_;
+
+  DISALLOW_COPY_AND_ASSIGN(DiskIoReport);
+};
+
+// Reads the file and disk operations of a trace in a single pass and writes
+// their latency histograms and byte counts per process and per file.
+// @param trace_path path to a .etl trace file.
+// @param options options of the analysis.
+// @param output_path path of the output file.
+// @returns true if the report was written successfully.
+bool GenerateDiskIoReport(const std::wstring& trace_path,
+                          const DiskIoOptions& options,
+                          const std::wstring& output_path);
+
+}  // namespace etw_insights
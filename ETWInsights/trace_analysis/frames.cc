@@ -0,0 +1,257 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/frames.h"
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/generate_history_from_trace.h"
+
+namespace etw_insights {
+
+namespace {
+
+// RenderFrameMark event of the Multi-FrameRate provider.
+const char kFrameMarkType[] = "Multi-FrameRate/Frame/RenderFrameMark";
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIdField[] = "ThreadID";
+const char kFrameNumberField[] = "Frame number";
+
+const char kCsvHeader[] =
+    "kind,tid,frame,ts,duration,on_cpu,off_cpu,count,long_frames,p50,p90,"
+    "p99,max,stack\n";
+
+// Number of empty columns between the time and the stack of a stack row.
+const size_t kNumEmptyColumnsBeforeStack = 8;
+
+}  // namespace
+
+FrameTimeReport::FrameTimeReport(const FrameOptions& options)
+    : options_(options) {}
+
+FrameTimeReport::~FrameTimeReport() {}
+
+void FrameTimeReport::AddFrameMark(base::Tid tid,
+                                   base::Timestamp ts,
+                                   uint64_t frame_number) {
+  RenderThread& render_thread = render_threads_[tid];
+  base::Timestamp start_ts = render_thread.last_mark_ts;
+  render_thread.last_mark_ts = ts;
+  if (start_ts == base::kInvalidTimestamp || ts < start_ts)
+    return;
+
+  base::Timestamp frame_time = ts - start_ts;
+  render_thread.frame_times.Add(frame_time);
+  if (frame_time > options_.budget) {
+    render_thread.long_frames.push_back(LongFrame(frame_number, start_ts, ts));
+  }
+}
+
+std::vector<base::Tid> FrameTimeReport::GetRenderThreads() const {
+  std::vector<base::Tid> tids;
+  for (const auto& render_thread : render_threads_)
+    tids.push_back(render_thread.first);
+  return tids;
+}
+
+void FrameTimeReport::AttributeLongFrames(
+    const SystemHistory& system_history) {
+  std::vector<IntervalStacks*> intervals;
+  for (auto it = system_history.threads_begin();
+       it != system_history.threads_end(); ++it) {
+    auto look = render_threads_.find(it->first);
+    if (look == render_threads_.end())
+      continue;
+    intervals.clear();
+    for (LongFrame& long_frame : look->second.long_frames)
+      intervals.push_back(&long_frame.stacks);
+    AttributeIntervalsToStacks(it->second, system_history.symbols(),
+                               options_.top_stacks, intervals);
+  }
+}
+
+bool FrameTimeReport::Write(const SystemHistory& system_history,
+                            const std::wstring& path) const {
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  bool json = options_.format == kJsonFormat;
+  const SymbolTable& symbols = system_history.symbols();
+
+  // Writes the top stacks of a long frame. In CSV, |prefix| follows the kind
+  // of each row.
+  auto write_stacks = [&](const char* kind, const std::string& prefix,
+                          const std::vector<StackTime>& stack_times) {
+    WriteStackTimes(stack_times, symbols, options_.format, kind, prefix,
+                    kNumEmptyColumnsBeforeStack, &out);
+  };
+
+  if (json) {
+    out.Write("{\"budget\":");
+    out.WriteUInt(options_.budget);
+    out.Write(",\"threads\":[");
+  } else {
+    out.Write(kCsvHeader);
+  }
+
+  bool first_thread = true;
+  for (const auto& tid_and_thread : render_threads_) {
+    base::Tid tid = tid_and_thread.first;
+    const RenderThread& render_thread = tid_and_thread.second;
+    const LatencyHistogram& frame_times = render_thread.frame_times;
+
+    const char* const kJsonNames[] = {",\"total\":", ",\"count\":",
+                                      ",\"long_frames\":", ",\"p50\":",
+                                      ",\"p90\":", ",\"p99\":", ",\"max\":"};
+    const uint64_t values[] = {frame_times.total(),
+                               frame_times.count(),
+                               render_thread.long_frames.size(),
+                               frame_times.GetQuantile(0.5),
+                               frame_times.GetQuantile(0.9),
+                               frame_times.GetQuantile(0.99),
+                               frame_times.max()};
+    if (json) {
+      out.Write(first_thread ? "\n{\"tid\":" : ",\n{\"tid\":");
+      out.WriteUInt(tid);
+      for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        out.Write(kJsonNames[i]);
+        out.WriteUInt(values[i]);
+      }
+      out.Write(",\"frames\":[");
+    } else {
+      out.Write("thread,");
+      out.WriteUInt(tid);
+      out.Write(",,,");
+      out.WriteUInt(values[0]);
+      out.Write(",,");
+      for (size_t i = 1; i < sizeof(values) / sizeof(values[0]); ++i) {
+        out.WriteChar(',');
+        out.WriteUInt(values[i]);
+      }
+      out.Write(",\n");
+    }
+    first_thread = false;
+
+    for (size_t i = 0; i < render_thread.long_frames.size(); ++i) {
+      const LongFrame& long_frame = render_thread.long_frames[i];
+      const IntervalStacks& stacks = long_frame.stacks;
+      if (json) {
+        out.Write(i == 0 ? "\n{\"frame\":" : ",\n{\"frame\":");
+        out.WriteUInt(long_frame.frame_number);
+        out.Write(",\"ts\":");
+        out.WriteUInt(stacks.start_ts);
+        out.Write(",\"duration\":");
+        out.WriteUInt(stacks.end_ts - stacks.start_ts);
+        out.Write(",\"on_cpu\":");
+        out.WriteUInt(stacks.on_cpu_time);
+        out.Write(",\"off_cpu\":");
+        out.WriteUInt(stacks.off_cpu_time);
+        write_stacks("on_cpu_stack", std::string(), stacks.on_cpu_stacks);
+        write_stacks("off_cpu_stack", std::string(), stacks.off_cpu_stacks);
+        out.WriteChar('}');
+      } else {
+        out.Write("long_frame,");
+        out.WriteUInt(tid);
+        out.WriteChar(',');
+        out.WriteUInt(long_frame.frame_number);
+        out.WriteChar(',');
+        out.WriteUInt(stacks.start_ts);
+        out.WriteChar(',');
+        out.WriteUInt(stacks.end_ts - stacks.start_ts);
+        out.WriteChar(',');
+        out.WriteUInt(stacks.on_cpu_time);
+        out.WriteChar(',');
+        out.WriteUInt(stacks.off_cpu_time);
+        out.Write(",,,,,,,\n");
+
+        // Rows of the stacks: kind, tid, frame, empty ts, then the time in
+        // the duration column.
+        std::string prefix("," + std::to_string(tid) + "," +
+                           std::to_string(long_frame.frame_number) + ",,");
+        write_stacks("on_cpu_stack", prefix, stacks.on_cpu_stacks);
+        write_stacks("off_cpu_stack", prefix, stacks.off_cpu_stacks);
+      }
+    }
+    if (json)
+      out.Write("\n]}");
+  }
+  if (json)
+    out.Write("\n]}\n");
+
+  return out.Close();
+}
+
+bool GenerateFrameTimeReport(const std::wstring& trace_path,
+                             const FrameOptions& options,
+                             const std::wstring& output_path) {
+  FrameTimeReport report(options);
+
+  {
+    ETWReader etw_reader;
+    if (!etw_reader.Open(trace_path))
+      return false;
+    etw_reader.set_filter(options.event_filter);
+
+    LOG(INFO) << "Reading frame marks." << std::endl;
+
+    for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+      if (it->type() != kFrameMarkType)
+        continue;
+      base::Timestamp ts = 0;
+      base::Tid tid = base::kInvalidTid;
+      uint64_t frame_number = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULong(kThreadIdField, &tid)) {
+        LOG(ERROR) << "Missing some fields in RenderFrameMark event.";
+        continue;
+      }
+      it->GetFieldAsULong(kFrameNumberField, &frame_number);
+      report.AddFrameMark(tid, ts, frame_number);
+    }
+  }
+
+  std::vector<base::Tid> render_threads = report.GetRenderThreads();
+  if (render_threads.empty()) {
+    LOG(ERROR) << "No RenderFrameMark event in the trace.";
+    return false;
+  }
+
+  // Only the stacks of the render thread are needed. With several render
+  // threads, the stacks of all the threads are read.
+  GenerateHistoryOptions history_options;
+  history_options.use_snapshot = options.use_history_snapshot;
+  history_options.event_filter = options.event_filter;
+  if (render_threads.size() == 1)
+    history_options.thread_filter.set_tid(render_threads.front());
+
+  SystemHistory system_history;
+  if (!GenerateHistoryFromTrace(trace_path, history_options,
+                                &system_history)) {
+    LOG(ERROR) << "Error while generating history from trace.";
+    return false;
+  }
+
+  report.AttributeLongFrames(system_history);
+  return report.Write(system_history, output_path);
+}
+
+}  // namespace etw_insights
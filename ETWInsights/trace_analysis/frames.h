@@ -0,0 +1,133 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "etw_reader/system_history.h"
+#include "trace_analysis/interval_stacks.h"
+#include "trace_analysis/latency_histogram.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a frame time analysis.
+struct FrameOptions {
+  FrameOptions()
+      : budget(16667),
+        top_stacks(3),
+        use_history_snapshot(true),
+        format(kCsvFormat) {}
+
+  // Frames that last longer than this number of microseconds are long frames.
+  base::Timestamp budget;
+
+  // Number of on-CPU and of off-CPU stacks reported for each long frame.
+  uint64_t top_stacks;
+
+  // Whether the history of the render threads is loaded from and saved to a
+  // snapshot next to the trace (see GenerateHistoryOptions::use_snapshot).
+  bool use_history_snapshot;
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Accumulates the frame times of the threads that log ETWRenderFrameMark
+// events, and finds the stacks of the render thread during its long frames. A
+// frame goes from a frame mark to the next frame mark of the same thread.
+// Memory usage is bounded by the number of render threads and of long frames.
+class FrameTimeReport {
+ public:
+  explicit FrameTimeReport(const FrameOptions& options);
+  ~FrameTimeReport();
+
+  // Records a frame mark, which ends the frame that began at the previous
+  // frame mark of |tid|.
+  // @param tid thread that logged the frame mark.
+  // @param ts timestamp of the frame mark.
+  // @param frame_number frame number logged with the frame mark.
+  void AddFrameMark(base::Tid tid, base::Timestamp ts, uint64_t frame_number);
+
+  // @returns the threads that logged frame marks.
+  std::vector<base::Tid> GetRenderThreads() const;
+
+  // Attributes the time of the render threads during their long frames to
+  // their on-CPU and off-CPU stacks. The history of each render thread is
+  // searched once for all its long frames.
+  // @param system_history history of the trace. The report refers to its
+  //    stacks, so it must outlive the report.
+  void AttributeLongFrames(const SystemHistory& system_history);
+
+  // Writes the frame time distribution of each render thread, followed by
+  // its long frames and their top stacks.
+  // @param system_history history given to AttributeLongFrames().
+  // @param path path of the output file.
+  // @returns true if the report was written successfully.
+  bool Write(const SystemHistory& system_history,
+             const std::wstring& path) const;
+
+ private:
+  struct LongFrame {
+    LongFrame(uint64_t frame_number,
+              base::Timestamp start_ts,
+              base::Timestamp end_ts)
+        : frame_number(frame_number), stacks(start_ts, end_ts) {}
+
+    uint64_t frame_number;
+
+    // Interval of the frame, with the stacks of the render thread.
+    IntervalStacks stacks;
+  };
+
+  struct RenderThread {
+    RenderThread() : last_mark_ts(base::kInvalidTimestamp) {}
+
+    base::Timestamp last_mark_ts;
+    LatencyHistogram frame_times;
+    // Frames longer than FrameOptions::budget, in chronological order.
+    std::vector<LongFrame> long_frames;
+  };
+
+  const FrameOptions options_;
+
+  std::map<base::Tid, RenderThread> render_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameTimeReport);
+};
+
+// Reads the ETWRenderFrameMark events of a trace in a first streaming pass,
+// then the history of the render threads, and writes the frame time
+// distribution and the long frames with the top stacks of the render threads.
+// @param trace_path path to a .etl trace file.
+// @param options options of the analysis.
+// @param output_path path of the output file.
+// @returns true if the report was written successfully.
+bool GenerateFrameTimeReport(const std::wstring& trace_path,
+                             const FrameOptions& options,
+                             const std::wstring& output_path);
+
+}  // namespace etw_insights
@@ -0,0 +1,373 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/heap_snapshot_diff.h"
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Columns of a heap snapshot export.
+const char kStackRefColumn[] = "Stack Ref #";
+const char kSizeColumn[] = "Size";
+const char kCountColumn[] = "Count";
+const char kStackColumn[] = "Stack";
+
+const size_t kMissingColumn = static_cast<size_t>(-1);
+
+// Parses a number, ignoring thousands separators and spaces.
+bool ParseNumber(const std::string& value, uint64_t* number) {
+  DCHECK(number != nullptr);
+  *number = 0;
+  bool has_digits = false;
+  for (char c : value) {
+    if (c >= '0' && c <= '9') {
+      *number = *number * 10 + static_cast<uint64_t>(c - '0');
+      has_digits = true;
+    } else if (c != ',' && c != ' ') {
+      return false;
+    }
+  }
+  return has_digits;
+}
+
+size_t FindColumn(const std::vector<std::string>& header, const char* name) {
+  for (size_t i = 0; i < header.size(); ++i) {
+    if (base::Trim(header[i]) == name)
+      return i;
+  }
+  return kMissingColumn;
+}
+
+void WriteInt(int64_t value, base::BufferedWriter* out) {
+  if (value < 0) {
+    out->WriteChar('-');
+    out->WriteUInt(static_cast<uint64_t>(-(value + 1)) + 1);
+  } else {
+    out->WriteUInt(static_cast<uint64_t>(value));
+  }
+}
+
+}  // namespace
+
+HeapSnapshotDiff::HeapSnapshotDiff(const HeapSnapshotDiffOptions& options)
+    : options_(options) {
+  DCHECK(!options_.stack_separator.empty());
+}
+
+HeapSnapshotDiff::~HeapSnapshotDiff() {}
+
+bool HeapSnapshotDiff::AddSnapshot(const std::wstring& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path) << ".";
+    return false;
+  }
+
+  std::string line;
+  std::vector<std::string> fields;
+  if (!std::getline(file, line)) {
+    LOG(ERROR) << "Empty heap snapshot " << base::WStringToString(path) << ".";
+    return false;
+  }
+  base::SplitCsvLine(base::TrimView(line), &fields);
+  size_t stack_ref_column = FindColumn(fields, kStackRefColumn);
+  size_t size_column = FindColumn(fields, kSizeColumn);
+  size_t count_column = FindColumn(fields, kCountColumn);
+  size_t stack_column = FindColumn(fields, kStackColumn);
+  if (size_column == kMissingColumn || stack_column == kMissingColumn) {
+    LOG(ERROR) << "The heap snapshot " << base::WStringToString(path)
+               << " must have the columns " << kSizeColumn << " and "
+               << kStackColumn << ".";
+    return false;
+  }
+
+  snapshots_.emplace_back();
+  Snapshot& snapshot = snapshots_.back();
+  snapshot.path = path;
+
+  // Stacks of the Stack Ref # of this snapshot. References aren't comparable
+  // between snapshots.
+  std::unordered_map<uint64_t, StackId> stacks_by_ref;
+
+  // Reused for all the lines, to avoid allocating memory.
+  std::vector<base::StringPiece> frame_names;
+  StackFrames frames;
+
+  uint64_t line_number = 1;
+  while (std::getline(file, line)) {
+    ++line_number;
+    base::StringPiece trimmed_line = base::TrimView(line);
+    if (trimmed_line.empty())
+      continue;
+    base::SplitCsvLine(trimmed_line, &fields);
+
+    uint64_t size = 0;
+    uint64_t count = 1;
+    if (size_column >= fields.size() ||
+        !ParseNumber(fields[size_column], &size) ||
+        (count_column < fields.size() &&
+         !ParseNumber(fields[count_column], &count))) {
+      LOG(ERROR) << "Invalid allocation at line " << line_number << " of "
+                 << base::WStringToString(path) << ".";
+      continue;
+    }
+
+    uint64_t stack_ref = 0;
+    bool has_stack_ref = stack_ref_column < fields.size() &&
+                         ParseNumber(fields[stack_ref_column], &stack_ref);
+    StackId stack = kInvalidStackId;
+    if (has_stack_ref) {
+      auto look = stacks_by_ref.find(stack_ref);
+      if (look != stacks_by_ref.end())
+        stack = look->second;
+    }
+
+    if (stack == kInvalidStackId) {
+      frames.clear();
+      if (stack_column < fields.size()) {
+        base::SplitView(fields[stack_column], options_.stack_separator,
+                        &frame_names);
+        for (base::StringPiece frame_name : frame_names) {
+          base::StringPiece trimmed_frame = base::TrimView(frame_name);
+          if (!trimmed_frame.empty())
+            frames.push_back(symbols_.Intern(trimmed_frame.as_string()));
+        }
+      }
+      stack = stacks_.Intern(frames);
+      if (has_stack_ref)
+        stacks_by_ref[stack_ref] = stack;
+    }
+
+    if (stack >= snapshot.stacks.size())
+      snapshot.stacks.resize(stack + 1);
+    snapshot.stacks[stack].bytes += size;
+    snapshot.stacks[stack].count += count;
+    snapshot.total.bytes += size;
+    snapshot.total.count += count;
+  }
+
+  size_t num_stacks = std::count_if(
+      snapshot.stacks.begin(), snapshot.stacks.end(),
+      [](const Allocations& allocations) { return allocations.count != 0; });
+  LOG(INFO) << base::WStringToString(path) << ": "
+            << snapshot.total.bytes / (1024 * 1024) << " MB from "
+            << snapshot.total.count << " allocations on " << num_stacks
+            << " stacks." << std::endl;
+  return true;
+}
+
+bool HeapSnapshotDiff::Write(const std::wstring& path) const {
+  // Stacks, ranked by bytes.
+  std::vector<Row> stack_rows(stacks_.size());
+  for (StackId stack = 0; stack < stacks_.size(); ++stack) {
+    Row& row = stack_rows[stack];
+    row.id = stack;
+    for (const Snapshot& snapshot : snapshots_) {
+      row.allocations.push_back(stack < snapshot.stacks.size()
+                                    ? snapshot.stacks[stack]
+                                    : Allocations());
+    }
+  }
+  KeepTopRows(true, &stack_rows);
+
+  // The names of the stacks are only built for the reported ones.
+  for (Row& row : stack_rows) {
+    for (SymbolId frame : stacks_.GetStack(static_cast<StackId>(row.id))) {
+      if (!row.name.empty())
+        row.name.push_back(';');
+      row.name.append(symbols_.GetSymbol(frame));
+    }
+  }
+
+  // Frames, ranked by number of allocations.
+  std::vector<std::vector<Allocations>> frame_allocations;
+  GetFrameAllocations(&frame_allocations);
+  std::vector<Row> frame_rows(symbols_.size());
+  for (SymbolId frame = 0; frame < symbols_.size(); ++frame) {
+    Row& row = frame_rows[frame];
+    row.id = frame;
+    for (const auto& snapshot_frames : frame_allocations)
+      row.allocations.push_back(snapshot_frames[frame]);
+  }
+  KeepTopRows(false, &frame_rows);
+  for (Row& row : frame_rows)
+    row.name = symbols_.GetSymbol(static_cast<SymbolId>(row.id));
+
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  if (options_.format == kJsonFormat) {
+    out.Write("{\"snapshots\":[");
+    for (size_t i = 0; i < snapshots_.size(); ++i) {
+      const Snapshot& snapshot = snapshots_[i];
+      out.Write(i == 0 ? "\n{\"path\":" : ",\n{\"path\":");
+      out.Write(
+          base::QuoteJsonString(base::WStringToString(snapshot.path)));
+      out.Write(",\"bytes\":");
+      out.WriteUInt(snapshot.total.bytes);
+      out.Write(",\"count\":");
+      out.WriteUInt(snapshot.total.count);
+      out.WriteChar('}');
+    }
+    out.Write("\n],\"stacks\":[");
+    WriteRows("stack", stack_rows, &out);
+    out.Write("\n],\"frames\":[");
+    WriteRows("frame", frame_rows, &out);
+    out.Write("\n]}\n");
+  } else {
+    out.Write("kind,name,bytes_growth,count_growth");
+    for (size_t i = 1; i <= snapshots_.size(); ++i) {
+      out.Write(",bytes_");
+      out.WriteUInt(i);
+      out.Write(",count_");
+      out.WriteUInt(i);
+    }
+    out.WriteChar('\n');
+    WriteRows("stack", stack_rows, &out);
+    WriteRows("frame", frame_rows, &out);
+  }
+
+  return out.Close();
+}
+
+void HeapSnapshotDiff::GetFrameAllocations(
+    std::vector<std::vector<Allocations>>* frames) const {
+  DCHECK(frames != nullptr);
+  frames->assign(snapshots_.size(), std::vector<Allocations>(symbols_.size()));
+
+  // Last stack in which each frame was counted, so that recursive frames are
+  // counted once per stack.
+  std::vector<StackId> last_stack(symbols_.size(), kInvalidStackId);
+  for (size_t i = 0; i < snapshots_.size(); ++i) {
+    const Snapshot& snapshot = snapshots_[i];
+    std::vector<Allocations>& snapshot_frames = (*frames)[i];
+    std::fill(last_stack.begin(), last_stack.end(), kInvalidStackId);
+    for (StackId stack = 0; stack < snapshot.stacks.size(); ++stack) {
+      const Allocations& allocations = snapshot.stacks[stack];
+      if (allocations.count == 0)
+        continue;
+      for (SymbolId frame : stacks_.GetStack(stack)) {
+        if (last_stack[frame] == stack)
+          continue;
+        last_stack[frame] = stack;
+        snapshot_frames[frame].bytes += allocations.bytes;
+        snapshot_frames[frame].count += allocations.count;
+      }
+    }
+  }
+}
+
+void HeapSnapshotDiff::KeepTopRows(bool by_bytes,
+                                   std::vector<Row>* rows) const {
+  DCHECK(rows != nullptr);
+  for (Row& row : *rows) {
+    // With a single snapshot, the growth is from an empty heap.
+    const Allocations& last = row.allocations.back();
+    Allocations first;
+    if (row.allocations.size() > 1)
+      first = row.allocations.front();
+    row.bytes_growth = static_cast<int64_t>(last.bytes - first.bytes);
+    row.count_growth = static_cast<int64_t>(last.count - first.count);
+  }
+
+  auto growth = [by_bytes](const Row& row) {
+    return by_bytes ? row.bytes_growth : row.count_growth;
+  };
+  size_t num_rows =
+      std::min(rows->size(), static_cast<size_t>(options_.top));
+  std::partial_sort(rows->begin(), rows->begin() + num_rows, rows->end(),
+                    [&growth](const Row& a, const Row& b) {
+                      if (growth(a) != growth(b))
+                        return growth(a) > growth(b);
+                      return a.id < b.id;
+                    });
+  rows->resize(num_rows);
+}
+
+void HeapSnapshotDiff::WriteRows(const char* kind,
+                                 const std::vector<Row>& rows,
+                                 base::BufferedWriter* out) const {
+  DCHECK(out != nullptr);
+  bool json = options_.format == kJsonFormat;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const Row& row = rows[i];
+    if (json) {
+      out->Write(i == 0 ? "\n{\"name\":" : ",\n{\"name\":");
+      out->Write(base::QuoteJsonString(row.name));
+      out->Write(",\"bytes_growth\":");
+      WriteInt(row.bytes_growth, out);
+      out->Write(",\"count_growth\":");
+      WriteInt(row.count_growth, out);
+      out->Write(",\"bytes\":[");
+      for (size_t j = 0; j < row.allocations.size(); ++j) {
+        if (j != 0)
+          out->WriteChar(',');
+        out->WriteUInt(row.allocations[j].bytes);
+      }
+      out->Write("],\"count\":[");
+      for (size_t j = 0; j < row.allocations.size(); ++j) {
+        if (j != 0)
+          out->WriteChar(',');
+        out->WriteUInt(row.allocations[j].count);
+      }
+      out->Write("]}");
+    } else {
+      out->Write(kind);
+      out->WriteChar(',');
+      out->Write(base::QuoteCsvField(row.name));
+      out->WriteChar(',');
+      WriteInt(row.bytes_growth, out);
+      out->WriteChar(',');
+      WriteInt(row.count_growth, out);
+      for (const Allocations& allocations : row.allocations) {
+        out->WriteChar(',');
+        out->WriteUInt(allocations.bytes);
+        out->WriteChar(',');
+        out->WriteUInt(allocations.count);
+      }
+      out->WriteChar('\n');
+    }
+  }
+}
+
+bool GenerateHeapSnapshotDiff(const std::vector<std::wstring>& snapshot_paths,
+                              const HeapSnapshotDiffOptions& options,
+                              const std::wstring& output_path) {
+  HeapSnapshotDiff diff(options);
+  for (const std::wstring& path : snapshot_paths) {
+    if (!diff.AddSnapshot(path))
+      return false;
+  }
+  if (diff.num_snapshots() == 0) {
+    LOG(ERROR) << "No heap snapshot to compare.";
+    return false;
+  }
+  return diff.Write(output_path);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,146 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/base.h"
+#include "base/buffered_writer.h"
+#include "etw_reader/stack_table.h"
+#include "etw_reader/symbol_table.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a heap snapshot diff.
+struct HeapSnapshotDiffOptions {
+  HeapSnapshotDiffOptions()
+      : top(40), stack_separator("/"), format(kCsvFormat) {}
+
+  // Number of stacks and of frames reported.
+  uint64_t top;
+
+  // Separator of the frames in the Stack column, which lists them from the
+  // root to the leaf.
+  std::string stack_separator;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Compares heap snapshots exported to CSV, e.g. from the Heap Snapshot table
+// of WPA. A snapshot has a header line followed by one line per allocation or
+// per group of allocations, with the columns "Stack Ref #" (optional), "Size",
+// "Count" (optional, 1 by default) and "Stack".
+//
+// The allocations are summed per interned stack, so memory usage is
+// proportional to the number of distinct stacks and of snapshots, not to the
+// number of allocations. Stacks are compared by their frames, so snapshots of
+// different processes can be compared. The stack of a Stack Ref # is only
+// parsed the first time it appears in a snapshot. Typical usage is:
+//   HeapSnapshotDiff diff(options);
+//   diff.AddSnapshot(L"before.csv");
+//   diff.AddSnapshot(L"after.csv");
+//   diff.Write(L"diff.csv");
+class HeapSnapshotDiff {
+ public:
+  explicit HeapSnapshotDiff(const HeapSnapshotDiffOptions& options);
+  ~HeapSnapshotDiff();
+
+  // Reads a snapshot in a single pass and adds it after the previous ones.
+  // @param path path of the CSV export of the snapshot.
+  // @returns true if the snapshot was read successfully.
+  bool AddSnapshot(const std::wstring& path);
+
+  // Writes the stacks and the frames with the largest growth from the first
+  // to the last snapshot, with their allocations in each snapshot. With a
+  // single snapshot, the growth is from an empty heap. Frames are ranked by
+  // the number of allocations whose stack contains them, like the hottest
+  // stack frames of HeapSnapshotCompare.
+  // @param path path of the output file.
+  // @returns true if the report was written successfully.
+  bool Write(const std::wstring& path) const;
+
+  size_t num_snapshots() const { return snapshots_.size(); }
+
+ private:
+  // Allocations of a stack or of a frame in a snapshot.
+  struct Allocations {
+    Allocations() : bytes(0), count(0) {}
+
+    uint64_t bytes;
+    uint64_t count;
+  };
+
+  struct Snapshot {
+    std::wstring path;
+
+    // Allocations of each stack, by StackId.
+    std::vector<Allocations> stacks;
+
+    Allocations total;
+  };
+
+  // A reported stack or frame, with its allocations in each snapshot.
+  struct Row {
+    Row() : id(0), bytes_growth(0), count_growth(0) {}
+
+    // StackId or SymbolId.
+    size_t id;
+    std::string name;
+    std::vector<Allocations> allocations;
+    int64_t bytes_growth;
+    int64_t count_growth;
+  };
+
+  // Sums the allocations of each frame, counting each frame once per stack.
+  // @param frames receives the allocations of each frame, by snapshot and by
+  //    SymbolId.
+  void GetFrameAllocations(
+      std::vector<std::vector<Allocations>>* frames) const;
+
+  // Sorts |rows| by decreasing growth and keeps the |options_.top| first.
+  void KeepTopRows(bool by_bytes, std::vector<Row>* rows) const;
+
+  void WriteRows(const char* kind,
+                 const std::vector<Row>& rows,
+                 base::BufferedWriter* out) const;
+
+  const HeapSnapshotDiffOptions options_;
+
+  SymbolTable symbols_;
+  StackTable stacks_;
+
+  std::vector<Snapshot> snapshots_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapSnapshotDiff);
+};
+
+// Compares heap snapshots and writes their differences.
+// @param snapshot_paths paths of the CSV exports of the snapshots, in
+//    chronological order.
+// @param options options of the diff.
+// @param output_path path of the output file.
+// @returns true if the diff was written successfully.
+bool GenerateHeapSnapshotDiff(const std::vector<std::wstring>& snapshot_paths,
+                              const HeapSnapshotDiffOptions& options,
+                              const std::wstring& output_path);
+
+}  // namespace etw_insights
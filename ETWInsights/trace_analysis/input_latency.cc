@@ -0,0 +1,436 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/input_latency.h"
+
+#include <algorithm>
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/generate_history_from_trace.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Common fields.
+const char kTimestampField[] = "TimeStamp";
+const char kProcessNameField[] = "Process Name ( PID)";
+const char kThreadIdField[] = "ThreadID";
+
+// Input events of the Multi-Input provider.
+const char kKeyDownType[] = "Multi-Input/Keyboard/KeyDown";
+const char kKeyNameField[] = "Key name";
+const char kMouseDownType[] = "Multi-Input/Mouse/MouseDown";
+const char kMouseButtonField[] = "Button Type";
+
+// Names of the mouse buttons, by button type.
+const char* const kMouseButtonNames[] = {"left", "middle", "right"};
+
+// Label of a key down event without a key name.
+const char kUnknownKeyLabel[] = "<unknown key>";
+
+// Events that end an interaction.
+const char kFrameMarkType[] = "Multi-FrameRate/Frame/RenderFrameMark";
+const char kChromeType[] = "Chrome//win:Info";
+const char kChromeNameField[] = "Name";
+
+// Names of the input types, in the order of InputType, and of all the inputs.
+const char* const kInputTypeNames[] = {"key", "mouse"};
+const char kAllInputsName[] = "all";
+
+const char kCsvHeader[] =
+    "kind,input,label,ts,tid,latency,count,p50,p90,p99,max,on_cpu,off_cpu,"
+    "stack\n";
+
+// Number of empty columns between the time and the stack of a stack row.
+const size_t kNumEmptyColumnsBeforeStack = 7;
+
+// Orders the interactions so that the heap of the worst interactions has the
+// smallest latency first.
+template <typename T>
+bool HasLargerLatency(const T& a, const T& b) {
+  return a.latency() > b.latency();
+}
+
+}  // namespace
+
+std::string AnonymizeKeyLabel(const std::string& label) {
+  // The key follows the last '+' of the modifiers, and may itself be '+'.
+  size_t key_pos = 0;
+  if (label.size() >= 2 && label.back() == '+')
+    key_pos = label.size() - 1;
+  else if (label.rfind('+') != std::string::npos)
+    key_pos = label.rfind('+') + 1;
+  if (key_pos + 1 != label.size())
+    return label;
+
+  char key = label[key_pos];
+  if ((key >= 'A' && key <= 'Z') || (key >= 'a' && key <= 'z'))
+    return label.substr(0, key_pos) + 'A';
+  if (key >= '0' && key <= '9')
+    return label.substr(0, key_pos) + '0';
+  return label;
+}
+
+InputLatencyReport::InputLatencyReport(const InputLatencyOptions& options)
+    : options_(options), num_interactions_(0), num_unmatched_inputs_(0) {}
+
+InputLatencyReport::~InputLatencyReport() {}
+
+void InputLatencyReport::AddInput(base::Timestamp ts,
+                                  InputType type,
+                                  const std::string& label) {
+  DropExpiredInputs(ts);
+  pending_inputs_.push_back({ts, type, GetLabelId(label)});
+}
+
+void InputLatencyReport::AddPaint(base::Timestamp ts, base::Tid tid) {
+  DropExpiredInputs(ts);
+
+  for (const PendingInput& input : pending_inputs_) {
+    Interaction interaction(input, ts, tid);
+    LatencyKey key(input.type, GetLabelId(AnonymizeKeyLabel(
+                                   labels_[input.label_id])));
+    latencies_[key].Add(interaction.latency());
+    ++num_interactions_;
+
+    // Keep the interactions with the largest latency.
+    if (worst_interactions_.size() < options_.top) {
+      worst_interactions_.push_back(interaction);
+      std::push_heap(worst_interactions_.begin(), worst_interactions_.end(),
+                     HasLargerLatency<Interaction>);
+    } else if (!worst_interactions_.empty() &&
+               interaction.latency() >
+                   worst_interactions_.front().latency()) {
+      std::pop_heap(worst_interactions_.begin(), worst_interactions_.end(),
+                    HasLargerLatency<Interaction>);
+      worst_interactions_.back() = interaction;
+      std::push_heap(worst_interactions_.begin(), worst_interactions_.end(),
+                     HasLargerLatency<Interaction>);
+    }
+  }
+  pending_inputs_.clear();
+}
+
+void InputLatencyReport::Finish() {
+  num_unmatched_inputs_ += pending_inputs_.size();
+  pending_inputs_.clear();
+}
+
+std::vector<base::Tid> InputLatencyReport::GetPaintThreads() const {
+  std::vector<base::Tid> tids;
+  for (const Interaction& interaction : worst_interactions_)
+    tids.push_back(interaction.tid);
+  std::sort(tids.begin(), tids.end());
+  tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+  return tids;
+}
+
+void InputLatencyReport::AttributeInteractions(
+    const SystemHistory& system_history) {
+  // The intervals of each thread must be sorted by start timestamp.
+  std::vector<Interaction*> interactions;
+  for (Interaction& interaction : worst_interactions_)
+    interactions.push_back(&interaction);
+  std::stable_sort(interactions.begin(), interactions.end(),
+                   [](const Interaction* a, const Interaction* b) {
+                     return a->stacks.start_ts < b->stacks.start_ts;
+                   });
+
+  std::vector<IntervalStacks*> intervals;
+  for (auto it = system_history.threads_begin();
+       it != system_history.threads_end(); ++it) {
+    intervals.clear();
+    for (Interaction* interaction : interactions) {
+      if (interaction->tid == it->first)
+        intervals.push_back(&interaction->stacks);
+    }
+    if (!intervals.empty()) {
+      AttributeIntervalsToStacks(it->second, system_history.symbols(),
+                                 options_.top_stacks, intervals);
+    }
+  }
+}
+
+bool InputLatencyReport::Write(const SystemHistory& system_history,
+                               const std::wstring& path) const {
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  bool json = options_.format == kJsonFormat;
+  const SymbolTable& symbols = system_history.symbols();
+
+  // Distributions: all the inputs, then each input type and label by
+  // decreasing number of inputs.
+  LatencyHistogram all_latencies;
+  std::vector<std::map<LatencyKey, LatencyHistogram>::const_iterator> rows;
+  for (auto it = latencies_.begin(); it != latencies_.end(); ++it) {
+    all_latencies.Merge(it->second);
+    rows.push_back(it);
+  }
+  std::stable_sort(
+      rows.begin(), rows.end(),
+      [](std::map<LatencyKey, LatencyHistogram>::const_iterator a,
+         std::map<LatencyKey, LatencyHistogram>::const_iterator b) {
+        return a->second.count() > b->second.count();
+      });
+
+  auto write_distribution = [&](const char* input, const std::string& label,
+                                const LatencyHistogram& latencies,
+                                bool first) {
+    const char* const kJsonNames[] = {",\"count\":", ",\"p50\":", ",\"p90\":",
+                                      ",\"p99\":", ",\"max\":"};
+    const uint64_t values[] = {latencies.count(), latencies.GetQuantile(0.5),
+                               latencies.GetQuantile(0.9),
+                               latencies.GetQuantile(0.99), latencies.max()};
+    if (json) {
+      out.Write(first ? "\n{\"input\":\"" : ",\n{\"input\":\"");
+      out.Write(input);
+      out.Write("\",\"label\":");
+      out.Write(base::QuoteCsvOrJsonString(label, json));
+    } else {
+      out.Write("latency,");
+      out.Write(input);
+      out.WriteChar(',');
+      out.Write(base::QuoteCsvOrJsonString(label, json));
+      out.Write(",,,");
+    }
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      out.Write(json ? kJsonNames[i] : ",");
+      out.WriteUInt(values[i]);
+    }
+    out.Write(json ? "}" : ",,,\n");
+  };
+
+  if (json)
+    out.Write("{\"latency\":[");
+  else
+    out.Write(kCsvHeader);
+  write_distribution(kAllInputsName, std::string(), all_latencies, true);
+  for (const auto& row : rows) {
+    write_distribution(kInputTypeNames[row->first.first],
+                       labels_[row->first.second], row->second, false);
+  }
+
+  // Interactions by decreasing latency.
+  std::vector<const Interaction*> interactions;
+  for (const Interaction& interaction : worst_interactions_)
+    interactions.push_back(&interaction);
+  std::stable_sort(interactions.begin(), interactions.end(),
+                   [](const Interaction* a, const Interaction* b) {
+                     return HasLargerLatency(*a, *b);
+                   });
+
+  // Writes the top stacks of an interaction. In CSV, |prefix| follows the
+  // kind of each row.
+  auto write_stacks = [&](const char* kind, const std::string& prefix,
+                          const std::vector<StackTime>& stack_times) {
+    WriteStackTimes(stack_times, symbols, options_.format, kind, prefix,
+                    kNumEmptyColumnsBeforeStack, &out);
+  };
+
+  if (json)
+    out.Write("\n],\"interactions\":[");
+  for (size_t i = 0; i < interactions.size(); ++i) {
+    const Interaction& interaction = *interactions[i];
+    const IntervalStacks& stacks = interaction.stacks;
+    if (json) {
+      out.Write(i == 0 ? "\n{\"input\":\"" : ",\n{\"input\":\"");
+      out.Write(kInputTypeNames[interaction.type]);
+      out.Write("\",\"label\":");
+      out.Write(
+          base::QuoteCsvOrJsonString(labels_[interaction.label_id], json));
+      out.Write(",\"ts\":");
+      out.WriteUInt(stacks.start_ts);
+      out.Write(",\"tid\":");
+      out.WriteUInt(interaction.tid);
+      out.Write(",\"latency\":");
+      out.WriteUInt(interaction.latency());
+      out.Write(",\"on_cpu\":");
+      out.WriteUInt(stacks.on_cpu_time);
+      out.Write(",\"off_cpu\":");
+      out.WriteUInt(stacks.off_cpu_time);
+      write_stacks("on_cpu_stack", std::string(), stacks.on_cpu_stacks);
+      write_stacks("off_cpu_stack", std::string(), stacks.off_cpu_stacks);
+      out.WriteChar('}');
+    } else {
+      out.Write("interaction,");
+      out.Write(kInputTypeNames[interaction.type]);
+      out.WriteChar(',');
+      out.Write(
+          base::QuoteCsvOrJsonString(labels_[interaction.label_id], json));
+      out.WriteChar(',');
+      out.WriteUInt(stacks.start_ts);
+      out.WriteChar(',');
+      out.WriteUInt(interaction.tid);
+      out.WriteChar(',');
+      out.WriteUInt(interaction.latency());
+      out.Write(",,,,,,");
+      out.WriteUInt(stacks.on_cpu_time);
+      out.WriteChar(',');
+      out.WriteUInt(stacks.off_cpu_time);
+      out.Write(",\n");
+
+      // Rows of the stacks: kind, empty input and label, the ts and tid of
+      // the interaction, then the time in the latency column.
+      std::string prefix(",,," + std::to_string(stacks.start_ts) + "," +
+                         std::to_string(interaction.tid) + ",");
+      write_stacks("on_cpu_stack", prefix, stacks.on_cpu_stacks);
+      write_stacks("off_cpu_stack", prefix, stacks.off_cpu_stacks);
+    }
+  }
+  if (json)
+    out.Write("\n]}\n");
+
+  return out.Close();
+}
+
+size_t InputLatencyReport::GetLabelId(const std::string& label) {
+  auto look = label_ids_.find(label);
+  if (look != label_ids_.end())
+    return look->second;
+  labels_.push_back(label);
+  label_ids_.insert({label, labels_.size() - 1});
+  return labels_.size() - 1;
+}
+
+void InputLatencyReport::DropExpiredInputs(base::Timestamp ts) {
+  // An input later than |ts|, e.g. because events are out of order, hasn't
+  // expired.
+  while (!pending_inputs_.empty() && ts > pending_inputs_.front().ts &&
+         ts - pending_inputs_.front().ts > options_.max_latency) {
+    pending_inputs_.pop_front();
+    ++num_unmatched_inputs_;
+  }
+}
+
+bool GenerateInputLatencyReport(const std::wstring& trace_path,
+                                const InputLatencyOptions& options,
+                                const std::wstring& output_path) {
+  InputLatencyReport report(options);
+
+  {
+    ETWReader etw_reader;
+    if (!etw_reader.Open(trace_path))
+      return false;
+    etw_reader.set_filter(options.event_filter);
+
+    LOG(INFO) << "Reading input and paint events." << std::endl;
+
+    // Reused for all the events, to avoid allocating memory.
+    std::string field;
+    std::string process_name;
+
+    // @returns true if |event| is logged by the process that handles the
+    // input.
+    auto is_target_process = [&](const ETWReader::Line& event) {
+      if (options.process_name.empty() && options.pid == base::kInvalidPid)
+        return true;
+      base::Pid pid = base::kInvalidPid;
+      if (!event.GetFieldAsString(kProcessNameField, &field))
+        return false;
+      SplitProcessNameField(field, &process_name, &pid);
+      return (options.process_name.empty() ||
+              process_name == options.process_name) &&
+             (options.pid == base::kInvalidPid || pid == options.pid);
+    };
+
+    for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+      const std::string& type = it->type();
+      bool is_paint = type == kFrameMarkType;
+      if (type == kChromeType) {
+        is_paint = it->GetFieldAsString(kChromeNameField, &field) &&
+                   base::Unquote(field) == options.paint_event;
+      }
+      if (!is_paint && type != kKeyDownType && type != kMouseDownType)
+        continue;
+
+      base::Timestamp ts = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts)) {
+        LOG(ERROR) << "Missing some fields in " << type << " event.";
+        continue;
+      }
+
+      if (type == kKeyDownType) {
+        std::string label = kUnknownKeyLabel;
+        if (it->GetFieldAsString(kKeyNameField, &field) &&
+            !base::Unquote(field).empty()) {
+          label = base::Unquote(field);
+        }
+        report.AddInput(ts, kKeyInput, label);
+      } else if (type == kMouseDownType) {
+        uint64_t button = 0;
+        it->GetFieldAsULong(kMouseButtonField, &button);
+        report.AddInput(ts, kMouseInput,
+                        button < sizeof(kMouseButtonNames) /
+                                     sizeof(kMouseButtonNames[0])
+                            ? kMouseButtonNames[button]
+                            : "button " + std::to_string(button));
+      } else if (is_target_process(*it)) {
+        base::Tid tid = base::kInvalidTid;
+        if (!it->GetFieldAsULong(kThreadIdField, &tid)) {
+          LOG(ERROR) << "Missing some fields in " << type << " event.";
+          continue;
+        }
+        report.AddPaint(ts, tid);
+      }
+    }
+    report.Finish();
+  }
+
+  if (report.num_unmatched_inputs() != 0) {
+    LOG(WARNING) << report.num_unmatched_inputs()
+                 << " inputs weren't followed by a frame or a paint.";
+  }
+  if (report.num_interactions() == 0) {
+    LOG(ERROR) << "No input event followed by a frame or a paint in the "
+                  "trace.";
+    return false;
+  }
+
+  // Only the stacks of the threads that painted are needed. With several
+  // threads, the stacks of all the threads of the target process are read.
+  std::vector<base::Tid> paint_threads = report.GetPaintThreads();
+  GenerateHistoryOptions history_options;
+  history_options.use_snapshot = options.use_history_snapshot;
+  history_options.event_filter = options.event_filter;
+  if (paint_threads.size() == 1) {
+    history_options.thread_filter.set_tid(paint_threads.front());
+  } else {
+    history_options.thread_filter.set_pid(options.pid);
+    history_options.thread_filter.set_process_name(options.process_name);
+  }
+
+  SystemHistory system_history;
+  if (!paint_threads.empty() &&
+      !GenerateHistoryFromTrace(trace_path, history_options,
+                                &system_history)) {
+    LOG(ERROR) << "Error while generating history from trace.";
+    return false;
+  }
+
+  report.AttributeInteractions(system_history);
+  return report.Write(system_history, output_path);
+}
+
+}  // namespace etw_insights
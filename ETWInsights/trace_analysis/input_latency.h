@@ -0,0 +1,209 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "etw_reader/system_history.h"
+#include "trace_analysis/interval_stacks.h"
+#include "trace_analysis/latency_histogram.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of an input latency analysis.
+struct InputLatencyOptions {
+  InputLatencyOptions()
+      : pid(base::kInvalidPid),
+        paint_event("RenderWidget::OnSwapBuffersComplete"),
+        max_latency(1000000),
+        top(20),
+        top_stacks(3),
+        use_history_snapshot(true),
+        format(kCsvFormat) {}
+
+  // Process that handles the input: only its frame marks and paint events end
+  // interactions. Empty or kInvalidPid for any process.
+  std::string process_name;
+  base::Pid pid;
+
+  // Name of the Chrome event that marks a paint.
+  std::string paint_event;
+
+  // Inputs that aren't followed by a frame mark or a paint event within this
+  // number of microseconds have no interaction.
+  base::Timestamp max_latency;
+
+  // Number of interactions with the largest latency that are reported with
+  // their stacks.
+  uint64_t top;
+
+  // Number of on-CPU and of off-CPU stacks reported for each interaction.
+  uint64_t top_stacks;
+
+  // Whether the history is loaded from and saved to a snapshot next to the
+  // trace (see GenerateHistoryOptions::use_snapshot).
+  bool use_history_snapshot;
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Types of input events logged by the Multi-Input provider.
+enum InputType {
+  kKeyInput,
+  kMouseInput,
+  kNumInputTypes,
+};
+
+// Measures the latency from each input event to the next frame mark or paint
+// event of the process that handles it. Latencies are accumulated per input
+// type and label, and the interactions with the largest latency are kept to
+// be attributed to the stacks of the thread that painted. Memory usage is
+// bounded by the number of labels, of pending inputs and by
+// InputLatencyOptions::top.
+class InputLatencyReport {
+ public:
+  explicit InputLatencyReport(const InputLatencyOptions& options);
+  ~InputLatencyReport();
+
+  // Records an input event.
+  // @param ts timestamp of the event.
+  // @param type type of the input.
+  // @param label name of the key, which may be anonymized, or of the mouse
+  //    button.
+  void AddInput(base::Timestamp ts, InputType type, const std::string& label);
+
+  // Records a frame mark or a paint event of the process that handles the
+  // input. It ends the interactions of the inputs that precede it.
+  // @param ts timestamp of the event.
+  // @param tid thread that logged the event.
+  void AddPaint(base::Timestamp ts, base::Tid tid);
+
+  // Ends the inputs that are still pending at the end of the trace.
+  void Finish();
+
+  // @returns the threads that painted at the end of the reported
+  //    interactions.
+  std::vector<base::Tid> GetPaintThreads() const;
+
+  // Attributes the time of the painting thread during each reported
+  // interaction to its on-CPU and off-CPU stacks.
+  // @param system_history history of the trace. The report refers to its
+  //    stacks, so it must outlive the report.
+  void AttributeInteractions(const SystemHistory& system_history);
+
+  // Writes the latency distribution of each input type and label, followed by
+  // the reported interactions by decreasing latency, with their stacks.
+  // @param system_history history given to AttributeInteractions().
+  // @param path path of the output file.
+  // @returns true if the report was written successfully.
+  bool Write(const SystemHistory& system_history,
+             const std::wstring& path) const;
+
+  uint64_t num_interactions() const { return num_interactions_; }
+  uint64_t num_unmatched_inputs() const { return num_unmatched_inputs_; }
+
+ private:
+  struct PendingInput {
+    base::Timestamp ts;
+    InputType type;
+    size_t label_id;
+  };
+
+  // An input and the frame mark or paint event that follows it.
+  struct Interaction {
+    Interaction(const PendingInput& input,
+                base::Timestamp paint_ts,
+                base::Tid tid)
+        : type(input.type),
+          label_id(input.label_id),
+          tid(tid),
+          stacks(input.ts, paint_ts) {}
+
+    base::Timestamp latency() const { return stacks.end_ts - stacks.start_ts; }
+
+    InputType type;
+    size_t label_id;
+    // Thread that painted.
+    base::Tid tid;
+    // Interval from the input to the paint, with the stacks of |tid|.
+    IntervalStacks stacks;
+  };
+
+  // Latencies of the inputs of a type with the same anonymized label.
+  typedef std::pair<InputType, size_t> LatencyKey;
+
+  size_t GetLabelId(const std::string& label);
+
+  // Drops the pending inputs that are more than InputLatencyOptions::
+  // max_latency before |ts|.
+  void DropExpiredInputs(base::Timestamp ts);
+
+  const InputLatencyOptions options_;
+
+  // Labels, by id.
+  std::vector<std::string> labels_;
+  std::unordered_map<std::string, size_t> label_ids_;
+
+  std::map<LatencyKey, LatencyHistogram> latencies_;
+
+  // Inputs that precede the next paint, by increasing timestamp.
+  std::deque<PendingInput> pending_inputs_;
+
+  // Interactions with the largest latency, as a heap whose first element has
+  // the smallest latency.
+  std::vector<Interaction> worst_interactions_;
+
+  uint64_t num_interactions_;
+  uint64_t num_unmatched_inputs_;
+
+  DISALLOW_COPY_AND_ASSIGN(InputLatencyReport);
+};
+
+// Removes the details of a key label like KeyLoggerThread does when keyboard
+// details aren't logged: letters become "A" and digits "0". Modifiers such as
+// "Ctrl+" are kept. This groups the same inputs of anonymized and detailed
+// traces.
+std::string AnonymizeKeyLabel(const std::string& label);
+
+// Reads the ETWKeyDown and ETWMouseDown events and the frame marks and paint
+// events of a trace in a first streaming pass, then the history of the
+// threads that painted at the end of the worst interactions, and writes the
+// input latency distribution and the worst interactions with their stacks.
+// @param trace_path path to a .etl trace file.
+// @param options options of the analysis.
+// @param output_path path of the output file.
+// @returns true if the report was written successfully.
+bool GenerateInputLatencyReport(const std::wstring& trace_path,
+                                const InputLatencyOptions& options,
+                                const std::wstring& output_path);
+
+}  // namespace etw_insights
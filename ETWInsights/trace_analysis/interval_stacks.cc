@@ -0,0 +1,146 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/interval_stacks.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_utils.h"
+
+namespace etw_insights {
+
+namespace {
+
+// First frame of the off-CPU stacks of the history.
+const char kOffCpuStackFrame[] = "[Off-CPU]";
+
+void AddStackTime(const Stack& stack,
+                  base::Timestamp time,
+                  std::vector<StackTime>* stack_times) {
+  for (StackTime& stack_time : *stack_times) {
+    if (*stack_time.stack == stack) {
+      stack_time.time += time;
+      return;
+    }
+  }
+  stack_times->push_back({&stack, time});
+}
+
+void KeepTopStacks(uint64_t top_stacks, std::vector<StackTime>* stack_times) {
+  std::stable_sort(stack_times->begin(), stack_times->end(),
+                   [](const StackTime& a, const StackTime& b) {
+                     return a.time > b.time;
+                   });
+  if (stack_times->size() > top_stacks)
+    stack_times->resize(static_cast<size_t>(top_stacks));
+}
+
+}  // namespace
+
+void AttributeIntervalsToStacks(const ThreadHistory& thread_history,
+                                const SymbolTable& symbols,
+                                uint64_t top_stacks,
+                                const std::vector<IntervalStacks*>& intervals) {
+  const ThreadHistory::StackHistory& stacks = thread_history.Stacks();
+  SymbolId off_cpu_symbol = symbols.Find(kOffCpuStackFrame);
+
+  std::vector<base::Timestamp> start_timestamps;
+  start_timestamps.reserve(intervals.size());
+  for (const IntervalStacks* interval : intervals)
+    start_timestamps.push_back(interval->start_ts);
+  std::vector<ThreadHistory::StackHistory::HistoryConstIterator> iterators;
+  stacks.IteratorsFromTimestamps(start_timestamps, &iterators);
+
+  for (size_t i = 0; i < intervals.size(); ++i) {
+    IntervalStacks* interval = intervals[i];
+    for (auto it = iterators[i];
+         it != stacks.IteratorEnd() && it->start_ts < interval->end_ts; ++it) {
+      // A stack lasts until the next stack of the thread, or until the end
+      // of the thread.
+      auto next = it + 1;
+      base::Timestamp end_ts = next != stacks.IteratorEnd()
+                                   ? next->start_ts
+                                   : thread_history.end_ts();
+      base::Timestamp start_ts = std::max(it->start_ts, interval->start_ts);
+      end_ts = std::min(end_ts, interval->end_ts);
+      if (end_ts <= start_ts)
+        continue;
+
+      const Stack& stack = it->value;
+      bool off_cpu = off_cpu_symbol != kInvalidSymbolId &&
+                     std::find(stack.begin(), stack.end(), off_cpu_symbol) !=
+                         stack.end();
+      if (off_cpu) {
+        interval->off_cpu_time += end_ts - start_ts;
+        AddStackTime(stack, end_ts - start_ts, &interval->off_cpu_stacks);
+      } else {
+        interval->on_cpu_time += end_ts - start_ts;
+        AddStackTime(stack, end_ts - start_ts, &interval->on_cpu_stacks);
+      }
+    }
+    KeepTopStacks(top_stacks, &interval->on_cpu_stacks);
+    KeepTopStacks(top_stacks, &interval->off_cpu_stacks);
+  }
+}
+
+std::string FormatStack(const Stack& stack, const SymbolTable& symbols) {
+  std::string formatted;
+  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+    if (!formatted.empty())
+      formatted.push_back(';');
+    formatted += symbols.GetSymbol(*it);
+  }
+  return formatted;
+}
+
+void WriteStackTimes(const std::vector<StackTime>& stack_times,
+                     const SymbolTable& symbols,
+                     OutputFormat format,
+                     const char* kind,
+                     const std::string& csv_prefix,
+                     size_t num_empty_columns,
+                     base::BufferedWriter* out) {
+  DCHECK(out != nullptr);
+  bool json = format == kJsonFormat;
+  if (json) {
+    out->Write(",\"");
+    out->Write(kind);
+    out->Write("s\":[");
+  }
+  for (size_t i = 0; i < stack_times.size(); ++i) {
+    std::string stack = FormatStack(*stack_times[i].stack, symbols);
+    if (json) {
+      out->Write(i == 0 ? "{\"stack\":" : ",{\"stack\":");
+      out->Write(base::QuoteJsonString(stack));
+      out->Write(",\"time\":");
+      out->WriteUInt(stack_times[i].time);
+      out->WriteChar('}');
+    } else {
+      out->Write(kind);
+      out->Write(csv_prefix);
+      out->WriteUInt(stack_times[i].time);
+      for (size_t column = 0; column <= num_empty_columns; ++column)
+        out->WriteChar(',');
+      out->Write(base::QuoteCsvField(stack));
+      out->WriteChar('\n');
+    }
+  }
+  if (json)
+    out->WriteChar(']');
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,91 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "base/buffered_writer.h"
+#include "base/types.h"
+#include "etw_reader/stack.h"
+#include "etw_reader/symbol_table.h"
+#include "etw_reader/thread_history.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Time spent by a thread in a stack during an interval.
+struct StackTime {
+  const Stack* stack;
+  base::Timestamp time;
+};
+
+// Time of a thread on and off the CPU during an interval, and its stacks
+// with the most time, by decreasing time.
+struct IntervalStacks {
+  IntervalStacks(base::Timestamp start_ts, base::Timestamp end_ts)
+      : start_ts(start_ts), end_ts(end_ts), on_cpu_time(0), off_cpu_time(0) {}
+
+  base::Timestamp start_ts;
+  base::Timestamp end_ts;
+
+  base::Timestamp on_cpu_time;
+  base::Timestamp off_cpu_time;
+  std::vector<StackTime> on_cpu_stacks;
+  std::vector<StackTime> off_cpu_stacks;
+};
+
+// Attributes the time of a thread during each interval to the stacks of its
+// stack history. A stack lasts until the next stack of the history, and
+// stacks with the [Off-CPU] frame are off-CPU stacks. The history is searched
+// once for all the intervals.
+// @param thread_history the thread.
+// @param symbols symbols of the stacks of |thread_history|.
+// @param top_stacks number of on-CPU and of off-CPU stacks kept for each
+//    interval.
+// @param intervals intervals sorted by start timestamp. Their stacks point to
+//    the stack history of |thread_history|.
+void AttributeIntervalsToStacks(const ThreadHistory& thread_history,
+                                const SymbolTable& symbols,
+                                uint64_t top_stacks,
+                                const std::vector<IntervalStacks*>& intervals);
+
+// Formats a stack from the root to the leaf, with frames separated by ';'.
+std::string FormatStack(const Stack& stack, const SymbolTable& symbols);
+
+// Writes stacks and their time in a report. In JSON, writes a "<kind>s"
+// member with an array of {"stack", "time"} objects. In CSV, writes a row per
+// stack: |kind|, |csv_prefix|, the time, |num_empty_columns| empty columns and
+// the stack.
+// @param stack_times the stacks to write, in order.
+// @param symbols symbols of the stacks.
+// @param format format of the report.
+// @param kind kind of the stacks, e.g. "on_cpu_stack".
+// @param csv_prefix columns that follow |kind| in CSV, with their separators.
+// @param num_empty_columns number of empty columns between the time and the
+//    stack in CSV.
+// @param out the report.
+void WriteStackTimes(const std::vector<StackTime>& stack_times,
+                     const SymbolTable& symbols,
+                     OutputFormat format,
+                     const char* kind,
+                     const std::string& csv_prefix,
+                     size_t num_empty_columns,
+                     base::BufferedWriter* out);
+
+}  // namespace etw_insights
@@ -0,0 +1,99 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/latency_histogram.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Number of bits needed to index the sub-buckets of a power of 2.
+const size_t kSubBucketBits = 3;
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), total_(0), max_(0) {
+  static_assert(kSubBuckets == 1 << kSubBucketBits,
+                "kSubBuckets must be 2 ^ kSubBucketBits.");
+}
+
+void LatencyHistogram::Add(base::Timestamp duration) {
+  size_t bucket = GetBucket(duration);
+  if (bucket >= buckets_.size())
+    buckets_.resize(bucket + 1);
+  ++buckets_[bucket];
+  ++count_;
+  total_ += duration;
+  max_ = std::max(max_, duration);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  if (other.buckets_.size() > buckets_.size())
+    buckets_.resize(other.buckets_.size());
+  for (size_t i = 0; i < other.buckets_.size(); ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+}
+
+base::Timestamp LatencyHistogram::GetQuantile(double quantile) const {
+  if (count_ == 0)
+    return 0;
+  DCHECK_GE(quantile, 0.0);
+  DCHECK_LE(quantile, 1.0);
+
+  // Rank of the quantile, from 1 to |count_|.
+  uint64_t rank = static_cast<uint64_t>(quantile * count_ + 0.5);
+  rank = std::max<uint64_t>(1, std::min(rank, count_));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if (seen >= rank)
+      return std::min(GetBucketUpperBound(i), max_);
+  }
+  return max_;
+}
+
+size_t LatencyHistogram::GetBucket(base::Timestamp duration) {
+  if (duration < kSubBuckets)
+    return static_cast<size_t>(duration);
+
+  // Index of the most significant bit of |duration|, at least kSubBucketBits.
+  size_t exponent = kSubBucketBits;
+  while (duration >> (exponent + 1) != 0)
+    ++exponent;
+
+  // The bits that follow the most significant bit select the sub-bucket.
+  size_t shift = exponent - kSubBucketBits;
+  size_t sub_bucket = static_cast<size_t>(duration >> shift) & (kSubBuckets - 1);
+  return (shift + 1) * kSubBuckets + sub_bucket;
+}
+
+base::Timestamp LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+  if (bucket < kSubBuckets)
+    return bucket;
+  size_t shift = bucket / kSubBuckets - 1;
+  base::Timestamp sub_bucket = bucket % kSubBuckets;
+  return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,65 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "base/types.h"
+
+namespace etw_insights {
+
+// Histogram of durations with logarithmic buckets. Durations below
+// kSubBuckets have their own bucket, and each larger power of 2 is split into
+// kSubBuckets buckets, so quantiles have a relative error below
+// 1 / kSubBuckets with a few hundred counters at most. Histograms can be
+// merged without losing precision.
+class LatencyHistogram {
+ public:
+  static const uint64_t kSubBuckets = 8;
+
+  LatencyHistogram();
+
+  void Add(base::Timestamp duration);
+
+  // Adds the durations of |other| to this histogram.
+  void Merge(const LatencyHistogram& other);
+
+  // @param quantile quantile, between 0 and 1.
+  // @returns an upper bound of the quantile of the durations, no larger than
+  //    the maximum duration. 0 if the histogram is empty.
+  base::Timestamp GetQuantile(double quantile) const;
+
+  uint64_t count() const { return count_; }
+  base::Timestamp total() const { return total_; }
+  base::Timestamp max() const { return max_; }
+
+ private:
+  static size_t GetBucket(base::Timestamp duration);
+  static base::Timestamp GetBucketUpperBound(size_t bucket);
+
+  // Number of durations in each bucket. Only grows up to the bucket of the
+  // largest duration.
+  std::vector<uint64_t> buckets_;
+
+  uint64_t count_;
+  base::Timestamp total_;
+  base::Timestamp max_;
+};
+
+}  // namespace etw_insights
@@ -0,0 +1,512 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "etw_reader/event_filter.h"
+#include "trace_analysis/cpu_usage.h"
+#include "trace_analysis/disk_io.h"
+#include "trace_analysis/frames.h"
+#include "trace_analysis/heap_snapshot_diff.h"
+#include "trace_analysis/input_latency.h"
+#include "trace_analysis/regions.h"
+#include "trace_analysis/wait_chain.h"
+
+using namespace etw_insights;
+
+namespace {
+
+void ShowUsage() {
+  base::FlushLogs();
+  std::cout
+      << "Usage: trace_analysis.exe --trace <trace_file_path> "
+         "--analysis <analysis> [options]"
+      << std::endl
+      << "       trace_analysis.exe --analysis heap_diff --snapshots "
+         "<snapshot.csv>[,<snapshot.csv>...] [options]"
+      << std::endl
+      << std::endl
+      << "Analyses:" << std::endl
+      << "  cpu_usage: On-CPU time of each process or thread, per time "
+         "bucket, from the context switches of the trace."
+      << std::endl
+      << "  disk_io: Latency percentiles and bytes of the file and disk "
+         "operations, per process and per file."
+      << std::endl
+      << "  frames: Frame time distribution of the threads that log "
+         "ETWRenderFrameMark events, and stacks of their long frames."
+      << std::endl
+      << "  heap_diff: Growth of the heap allocations per stack and per "
+         "frame, between heap snapshots exported to CSV."
+      << std::endl
+      << "  input_latency: Latency from the ETWKeyDown and ETWMouseDown "
+         "events to the next frame or paint, and stacks of the slowest "
+         "interactions."
+      << std::endl
+      << "  regions: Duration percentiles of the regions of ETWBegin/ETWEnd "
+         "and ETWWorkerBegin/ETWWorkerEnd, per name and per nesting path."
+      << std::endl
+      << "  wait_chain: Critical path that led to an event, from the "
+         "context switches and the ReadyThread events of the trace."
+      << std::endl
+      << std::endl
+      << "Options:" << std::endl
+      << "  --out: Output file. Default: <trace_file_path>.<analysis>.<format>"
+      << std::endl
+      << "  --format: csv or json. Default: csv." << std::endl
+      << "  --where: Only analyze the events that match a filter expression, "
+         "e.g. 'type == \"CSwitch\" && \"New TID\" == 1234 && TimeStamp > "
+         "5e6'. Comparisons (==, !=, <, <=, >, >=) have a field on the left "
+         "and a number or a quoted string on the right, and are combined "
+         "with &&, || and !. Not used by heap_diff."
+      << std::endl
+      << std::endl
+      << "cpu_usage options:" << std::endl
+      << "  --bucket_width: Width of a time bucket (in microseconds). "
+         "Default: 100000."
+      << std::endl
+      << "  --group_by: process or thread. Default: process." << std::endl
+      << std::endl
+      << "disk_io options:" << std::endl
+      << "  --max_files: Maximum number of files reported separately. "
+         "Default: 10000."
+      << std::endl
+      << std::endl
+      << "frames options:" << std::endl
+      << "  --budget: Frames longer than this budget (in microseconds) are "
+         "long frames. Default: 16667."
+      << std::endl
+      << "  --top_stacks: Number of on-CPU and of off-CPU stacks reported for "
+         "each long frame. Default: 3."
+      << std::endl
+      << "  --no_history_cache: Don't load or save a history snapshot next to "
+         "the trace."
+      << std::endl
+      << std::endl
+      << "heap_diff options:" << std::endl
+      << "  --snapshots: Comma-separated paths of the snapshots, in "
+         "chronological order. --out is required without --trace."
+      << std::endl
+      << "  --top: Number of stacks and of frames reported. Default: 40."
+      << std::endl
+      << "  --stack_separator: Separator of the frames in the Stack column. "
+         "Default: /."
+      << std::endl
+      << std::endl
+      << "input_latency options:" << std::endl
+      << "  --process_name, --pid: Process that handles the input. Only its "
+         "frames and paints end interactions. Default: any process."
+      << std::endl
+      << "  --paint_event: Name of the Chrome event that marks a paint. "
+         "Default: RenderWidget::OnSwapBuffersComplete."
+      << std::endl
+      << "  --max_latency: Inputs without a frame or a paint within this "
+         "time (in microseconds) are ignored. Default: 1000000."
+      << std::endl
+      << "  --top: Number of interactions reported with their stacks. "
+         "Default: 20."
+      << std::endl
+      << "  --top_stacks: Number of on-CPU and of off-CPU stacks reported for "
+         "each interaction. Default: 3."
+      << std::endl
+      << "  --no_history_cache: Don't load or save a history snapshot next to "
+         "the trace."
+      << std::endl
+      << std::endl
+      << "wait_chain options:" << std::endl
+      << "  --end_event: Name of the Chrome event at which the critical path "
+         "ends. Default: Startup.FirstWebContents.NonEmptyPaint."
+      << std::endl
+      << "  --end_ts, --end_tid: Time (in microseconds) and thread at which "
+         "the critical path ends, instead of --end_event."
+      << std::endl;
+}
+
+// Reads the options shared by all analyses. |extension| is set to the
+// extension of the default output file.
+bool ReadFormat(const base::CommandLine& command_line,
+                OutputFormat* format,
+                std::wstring* extension) {
+  std::wstring value = command_line.GetSwitchValue(L"format");
+  if (value.empty() || value == L"csv") {
+    *format = kCsvFormat;
+    *extension = L"csv";
+  } else if (value == L"json") {
+    *format = kJsonFormat;
+    *extension = L"json";
+  } else {
+    base::FlushLogs();
+    std::cout << "Invalid format (--format)." << std::endl << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Reads the filter of the events of the analyses that read a trace.
+bool ReadEventFilter(const base::CommandLine& command_line,
+                     EventFilter* event_filter) {
+  if (!event_filter->Parse(
+          base::WStringToString(command_line.GetSwitchValue(L"where")))) {
+    base::FlushLogs();
+    std::cout << "Invalid filter expression (--where)." << std::endl
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool RunCpuUsage(const std::wstring& trace_path,
+                 const base::CommandLine& command_line) {
+  CpuUsageOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  std::wstring bucket_width = command_line.GetSwitchValue(L"bucket_width");
+  if (!bucket_width.empty() &&
+      (!base::StrToULong(bucket_width, &options.bucket_width) ||
+       options.bucket_width == 0)) {
+    base::FlushLogs();
+    std::cout << "Bucket width must be a positive number (--bucket_width)."
+              << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring group_by = command_line.GetSwitchValue(L"group_by");
+  if (group_by == L"thread") {
+    options.group_by = CpuUsageOptions::kGroupByThread;
+  } else if (!group_by.empty() && group_by != L"process") {
+    base::FlushLogs();
+    std::cout << "Invalid grouping (--group_by)." << std::endl << std::endl;
+    return false;
+  }
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".cpu_usage." + extension;
+
+  if (!GenerateCpuUsageTimeline(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the CPU usage timeline in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunDiskIo(const std::wstring& trace_path,
+               const base::CommandLine& command_line) {
+  DiskIoOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  std::wstring max_files = command_line.GetSwitchValue(L"max_files");
+  if (!max_files.empty() && !base::StrToULong(max_files, &options.max_files)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--max_files)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".disk_io." + extension;
+
+  if (!GenerateDiskIoReport(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the disk I/O report in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunFrames(const std::wstring& trace_path,
+               const base::CommandLine& command_line) {
+  FrameOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  std::wstring budget = command_line.GetSwitchValue(L"budget");
+  if (!budget.empty() &&
+      (!base::StrToULong(budget, &options.budget) || options.budget == 0)) {
+    base::FlushLogs();
+    std::cout << "Budget must be a positive number (--budget)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring top_stacks = command_line.GetSwitchValue(L"top_stacks");
+  if (!top_stacks.empty() &&
+      !base::StrToULong(top_stacks, &options.top_stacks)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--top_stacks)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  options.use_history_snapshot = !command_line.HasSwitch(L"no_history_cache");
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".frames." + extension;
+
+  if (!GenerateFrameTimeReport(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the frame time report in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunInputLatency(const std::wstring& trace_path,
+                     const base::CommandLine& command_line) {
+  InputLatencyOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  options.process_name =
+      base::WStringToString(command_line.GetSwitchValue(L"process_name"));
+
+  std::wstring pid = command_line.GetSwitchValue(L"pid");
+  if (!pid.empty() && !base::StrToULong(pid, &options.pid)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--pid)." << std::endl << std::endl;
+    return false;
+  }
+
+  std::wstring paint_event = command_line.GetSwitchValue(L"paint_event");
+  if (!paint_event.empty())
+    options.paint_event = base::WStringToString(paint_event);
+
+  std::wstring max_latency = command_line.GetSwitchValue(L"max_latency");
+  if (!max_latency.empty() &&
+      !base::StrToULong(max_latency, &options.max_latency)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--max_latency)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring top = command_line.GetSwitchValue(L"top");
+  if (!top.empty() && !base::StrToULong(top, &options.top)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--top)." << std::endl << std::endl;
+    return false;
+  }
+
+  std::wstring top_stacks = command_line.GetSwitchValue(L"top_stacks");
+  if (!top_stacks.empty() &&
+      !base::StrToULong(top_stacks, &options.top_stacks)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--top_stacks)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  options.use_history_snapshot = !command_line.HasSwitch(L"no_history_cache");
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".input_latency." + extension;
+
+  if (!GenerateInputLatencyReport(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the input latency report in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunRegions(const std::wstring& trace_path,
+                const base::CommandLine& command_line) {
+  RegionOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".regions." + extension;
+
+  if (!GenerateRegionReport(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the region report in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunWaitChain(const std::wstring& trace_path,
+                  const base::CommandLine& command_line) {
+  WaitChainOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+  if (!ReadEventFilter(command_line, &options.event_filter))
+    return false;
+
+  std::wstring end_event = command_line.GetSwitchValue(L"end_event");
+  if (!end_event.empty())
+    options.end_event = base::WStringToString(end_event);
+
+  std::wstring end_ts = command_line.GetSwitchValue(L"end_ts");
+  std::wstring end_tid = command_line.GetSwitchValue(L"end_tid");
+  if (end_ts.empty() != end_tid.empty()) {
+    base::FlushLogs();
+    std::cout << "Please specify both --end_ts and --end_tid." << std::endl
+              << std::endl;
+    return false;
+  }
+  if (!end_ts.empty() && (!base::StrToULong(end_ts, &options.end_ts) ||
+                          !base::StrToULong(end_tid, &options.end_tid))) {
+    base::FlushLogs();
+    std::cout << "Values must be numeric (--end_ts, --end_tid)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty())
+    output_path = trace_path + L".wait_chain." + extension;
+
+  if (!GenerateWaitChain(trace_path, options, output_path))
+    return false;
+
+  LOG(INFO) << "Wrote the critical path in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+bool RunHeapDiff(const std::wstring& trace_path,
+                 const base::CommandLine& command_line) {
+  HeapSnapshotDiffOptions options;
+  std::wstring extension;
+  if (!ReadFormat(command_line, &options.format, &extension))
+    return false;
+
+  std::wstring snapshots = command_line.GetSwitchValue(L"snapshots");
+  if (snapshots.empty()) {
+    base::FlushLogs();
+    std::cout << "Please specify the heap snapshots (--snapshots)."
+              << std::endl
+              << std::endl;
+    return false;
+  }
+
+  std::wstring top = command_line.GetSwitchValue(L"top");
+  if (!top.empty() && !base::StrToULong(top, &options.top)) {
+    base::FlushLogs();
+    std::cout << "Value must be numeric (--top)." << std::endl << std::endl;
+    return false;
+  }
+
+  std::wstring stack_separator =
+      command_line.GetSwitchValue(L"stack_separator");
+  if (!stack_separator.empty())
+    options.stack_separator = base::WStringToString(stack_separator);
+
+  std::wstring output_path = command_line.GetSwitchValue(L"out");
+  if (output_path.empty() && !trace_path.empty())
+    output_path = trace_path + L".heap_diff." + extension;
+  if (output_path.empty()) {
+    base::FlushLogs();
+    std::cout << "Please specify an output file (--out)." << std::endl
+              << std::endl;
+    return false;
+  }
+
+  if (!GenerateHeapSnapshotDiff(base::SplitWString(snapshots, L","), options,
+                                output_path)) {
+    return false;
+  }
+
+  LOG(INFO) << "Wrote the heap snapshot diff in "
+            << base::WStringToString(output_path) << "." << std::endl;
+  return true;
+}
+
+// An analysis and the function that runs it.
+struct Analysis {
+  const wchar_t* name;
+  bool (*run)(const std::wstring& trace_path,
+              const base::CommandLine& command_line);
+  // Whether the analysis reads the trace given with --trace.
+  bool reads_trace;
+};
+
+const Analysis kAnalyses[] = {
+    {L"cpu_usage", &RunCpuUsage, true},
+    {L"disk_io", &RunDiskIo, true},
+    {L"frames", &RunFrames, true},
+    {L"heap_diff", &RunHeapDiff, false},
+    {L"input_latency", &RunInputLatency, true},
+    {L"regions", &RunRegions, true},
+    {L"wait_chain", &RunWaitChain, true},
+};
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  // Read command line arguments.
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.GetNumSwitches() == 0) {
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring trace_path = command_line.GetSwitchValue(L"trace");
+  std::wstring analysis_name = command_line.GetSwitchValue(L"analysis");
+  for (const Analysis& analysis : kAnalyses) {
+    if (analysis_name != analysis.name)
+      continue;
+    if (analysis.reads_trace && trace_path.empty()) {
+      base::FlushLogs();
+      std::cout << "Please specify a trace path (--trace)." << std::endl
+                << std::endl;
+      ShowUsage();
+      return 1;
+    }
+    if (!analysis.run(trace_path, command_line)) {
+      ShowUsage();
+      return 1;
+    }
+    return 0;
+  }
+
+  base::FlushLogs();
+  std::cout << "Please specify a valid analysis (--analysis)." << std::endl
+            << std::endl;
+  ShowUsage();
+  return 1;
+}
@@ -0,0 +1,346 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/regions.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Begin and End events of each provider, in the order of RegionProvider.
+const char* const kBeginTypes[] = {
+    "Multi-Main/Block/Begin", "Multi-Worker/BlockWorker/Begin",
+};
+const char* const kEndTypes[] = {
+    "Multi-Main/Block/End", "Multi-Worker/BlockWorker/End",
+};
+const char* const kProviderNames[] = {
+    "Multi-Main", "Multi-Worker",
+};
+static_assert(sizeof(kProviderNames) / sizeof(kProviderNames[0]) ==
+                  kNumRegionProviders,
+              "kProviderNames must have a name per provider.");
+
+// Fields of the Begin and End events.
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIdField[] = "ThreadID";
+const char kDescriptionField[] = "Description";
+const char kDepthField[] = "Depth";
+
+// Separator of the region names in a nesting path.
+const char kPathSeparator = ';';
+
+const size_t kNoParent = static_cast<size_t>(-1);
+
+const char kCsvHeader[] =
+    "scope,provider,name,count,total,self,p50,p90,p99,max\n";
+
+// Durations of the regions with the same name, from all nesting paths.
+struct RegionStats {
+  RegionStats() : self_time(0) {}
+
+  LatencyHistogram durations;
+  base::Timestamp self_time;
+};
+
+}  // namespace
+
+RegionReport::RegionReport(const RegionOptions& options)
+    : options_(options), num_discarded_regions_(0) {
+  for (size_t i = 0; i < kNumRegionProviders; ++i) {
+    nodes_.push_back(
+        Node(kNoParent, kNoParent, static_cast<RegionProvider>(i)));
+  }
+}
+
+RegionReport::~RegionReport() {}
+
+void RegionReport::BeginRegion(RegionProvider provider,
+                               base::Tid tid,
+                               base::Timestamp ts,
+                               const std::string& name,
+                               uint64_t depth) {
+  OpenRegions& regions = open_regions_[provider][tid];
+  DiscardRegions(depth, &regions);
+
+  size_t parent = regions.empty() ? static_cast<size_t>(provider)
+                                  : regions.back().node;
+  regions.push_back({ts, depth, GetNode(parent, GetNameId(name)), 0});
+}
+
+bool RegionReport::EndRegion(RegionProvider provider,
+                             base::Tid tid,
+                             base::Timestamp ts,
+                             uint64_t depth) {
+  auto look = open_regions_[provider].find(tid);
+  if (look == open_regions_[provider].end())
+    return false;
+  OpenRegions& regions = look->second;
+  DiscardRegions(depth + 1, &regions);
+  if (regions.empty() || regions.back().depth != depth)
+    return false;
+
+  const OpenRegion& region = regions.back();
+  base::Timestamp duration = ts >= region.ts ? ts - region.ts : 0;
+  Node& node = nodes_[region.node];
+  node.durations.Add(duration);
+  node.self_time += duration - std::min(duration, region.nested_time);
+  regions.pop_back();
+
+  if (!regions.empty())
+    regions.back().nested_time += duration;
+  return true;
+}
+
+bool RegionReport::Write(const std::wstring& path) const {
+  base::BufferedWriter out;
+  if (!out.Open(path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(path)
+               << " for writing.";
+    return false;
+  }
+
+  bool json = options_.format == kJsonFormat;
+
+  // Writes the statistics that follow the name of a row.
+  auto write_stats = [&](const LatencyHistogram& durations,
+                         base::Timestamp self_time) {
+    const char* const kJsonNames[] = {",\"count\":", ",\"total\":",
+                                      ",\"self\":",  ",\"p50\":",
+                                      ",\"p90\":",   ",\"p99\":",
+                                      ",\"max\":"};
+    const uint64_t values[] = {durations.count(),
+                               durations.total(),
+                               self_time,
+                               durations.GetQuantile(0.5),
+                               durations.GetQuantile(0.9),
+                               durations.GetQuantile(0.99),
+                               durations.max()};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      out.Write(json ? kJsonNames[i] : ",");
+      out.WriteUInt(values[i]);
+    }
+  };
+
+  // Merge the nodes of each region name.
+  typedef std::pair<RegionProvider, size_t> RegionKey;
+  std::map<RegionKey, RegionStats> region_stats;
+  std::vector<std::vector<size_t>> children(nodes_.size());
+  for (const auto& child : child_nodes_) {
+    const Node& node = nodes_[child.second];
+    RegionStats& stats = region_stats[RegionKey(node.provider, node.name_id)];
+    stats.durations.Merge(node.durations);
+    stats.self_time += node.self_time;
+    children[child.first.first].push_back(child.second);
+  }
+  for (std::vector<size_t>& node_children : children) {
+    std::stable_sort(node_children.begin(), node_children.end(),
+                     [this](size_t a, size_t b) {
+                       return nodes_[a].durations.total() >
+                              nodes_[b].durations.total();
+                     });
+  }
+
+  // Regions by decreasing total duration.
+  std::vector<std::map<RegionKey, RegionStats>::const_iterator> rows;
+  rows.reserve(region_stats.size());
+  for (auto it = region_stats.begin(); it != region_stats.end(); ++it)
+    rows.push_back(it);
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](std::map<RegionKey, RegionStats>::const_iterator a,
+                      std::map<RegionKey, RegionStats>::const_iterator b) {
+                     return a->second.durations.total() >
+                            b->second.durations.total();
+                   });
+
+  if (json)
+    out.Write("{\"regions\":[");
+  else
+    out.Write(kCsvHeader);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const RegionKey& key = rows[i]->first;
+    if (json) {
+      out.Write(i == 0 ? "\n{\"provider\":" : ",\n{\"provider\":");
+      out.Write(base::QuoteCsvOrJsonString(kProviderNames[key.first], json));
+      out.Write(",\"name\":");
+      out.Write(base::QuoteCsvOrJsonString(names_[key.second], json));
+    } else {
+      out.Write("region,");
+      out.Write(kProviderNames[key.first]);
+      out.WriteChar(',');
+      out.Write(base::QuoteCsvOrJsonString(names_[key.second], json));
+    }
+    write_stats(rows[i]->second.durations, rows[i]->second.self_time);
+    out.Write(json ? "}" : "\n");
+  }
+
+  // Nesting paths, in depth-first order. In JSON, nested regions are in the
+  // "children" array of their parent, as expected by flame graph viewers.
+  std::function<void(size_t, const std::string&)> write_node =
+      [&](size_t node_index, const std::string& parent_path) {
+        const Node& node = nodes_[node_index];
+        const std::string& name = names_[node.name_id];
+        std::string path(name);
+        if (json) {
+          out.Write("{\"name\":");
+          out.Write(base::QuoteCsvOrJsonString(name, json));
+          write_stats(node.durations, node.self_time);
+          out.Write(",\"children\":[");
+        } else {
+          if (!parent_path.empty())
+            path = parent_path + kPathSeparator + name;
+          out.Write("path,");
+          out.Write(kProviderNames[node.provider]);
+          out.WriteChar(',');
+          out.Write(base::QuoteCsvOrJsonString(path, json));
+          write_stats(node.durations, node.self_time);
+          out.WriteChar('\n');
+        }
+        const std::vector<size_t>& node_children = children[node_index];
+        for (size_t i = 0; i < node_children.size(); ++i) {
+          if (json && i != 0)
+            out.WriteChar(',');
+          write_node(node_children[i], path);
+        }
+        if (json)
+          out.Write("]}");
+      };
+
+  if (json)
+    out.Write("\n],\"flame\":{");
+  for (size_t provider = 0; provider < kNumRegionProviders; ++provider) {
+    const std::vector<size_t>& roots = children[provider];
+    if (json) {
+      if (provider != 0)
+        out.WriteChar(',');
+      out.Write(base::QuoteCsvOrJsonString(kProviderNames[provider], json));
+      out.Write(":[");
+    }
+    for (size_t i = 0; i < roots.size(); ++i) {
+      if (json)
+        out.Write(i == 0 ? "\n" : ",\n");
+      write_node(roots[i], std::string());
+    }
+    if (json)
+      out.Write("\n]");
+  }
+  if (json)
+    out.Write("}}\n");
+
+  return out.Close();
+}
+
+uint64_t RegionReport::GetNumUnendedRegions() const {
+  uint64_t num_unended_regions = num_discarded_regions_;
+  for (const auto& provider_regions : open_regions_) {
+    for (const auto& thread_regions : provider_regions)
+      num_unended_regions += thread_regions.second.size();
+  }
+  return num_unended_regions;
+}
+
+size_t RegionReport::GetNameId(const std::string& name) {
+  auto look = name_ids_.find(name);
+  if (look != name_ids_.end())
+    return look->second;
+  names_.push_back(name);
+  name_ids_.insert({name, names_.size() - 1});
+  return names_.size() - 1;
+}
+
+size_t RegionReport::GetNode(size_t parent, size_t name_id) {
+  auto look = child_nodes_.find({parent, name_id});
+  if (look != child_nodes_.end())
+    return look->second;
+  nodes_.push_back(Node(parent, name_id, nodes_[parent].provider));
+  child_nodes_.insert({{parent, name_id}, nodes_.size() - 1});
+  return nodes_.size() - 1;
+}
+
+void RegionReport::DiscardRegions(uint64_t depth, OpenRegions* regions) {
+  while (!regions->empty() && regions->back().depth >= depth) {
+    regions->pop_back();
+    ++num_discarded_regions_;
+  }
+}
+
+bool GenerateRegionReport(const std::wstring& trace_path,
+                          const RegionOptions& options,
+                          const std::wstring& output_path) {
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path))
+    return false;
+  etw_reader.set_filter(options.event_filter);
+
+  RegionReport report(options);
+
+  LOG(INFO) << "Reading trace events." << std::endl;
+
+  // Reused for all the events, to avoid allocating memory.
+  std::string description;
+
+  uint64_t num_unmatched_ends = 0;
+  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+    const std::string& type = it->type();
+    for (size_t i = 0; i < kNumRegionProviders; ++i) {
+      bool begin = type == kBeginTypes[i];
+      if (!begin && type != kEndTypes[i])
+        continue;
+
+      base::Timestamp ts = 0;
+      base::Tid tid = base::kInvalidTid;
+      uint64_t depth = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) ||
+          !it->GetFieldAsULong(kThreadIdField, &tid) ||
+          !it->GetFieldAsULong(kDepthField, &depth) ||
+          (begin && !it->GetFieldAsString(kDescriptionField, &description))) {
+        LOG(ERROR) << "Missing some fields in " << type << " event.";
+        break;
+      }
+
+      RegionProvider provider = static_cast<RegionProvider>(i);
+      if (begin) {
+        report.BeginRegion(provider, tid, ts, base::Unquote(description),
+                           depth);
+      } else if (!report.EndRegion(provider, tid, ts, depth)) {
+        ++num_unmatched_ends;
+      }
+      break;
+    }
+  }
+
+  if (num_unmatched_ends != 0) {
+    LOG(WARNING) << num_unmatched_ends
+                 << " End events had no matching Begin event.";
+  }
+  uint64_t num_unended_regions = report.GetNumUnendedRegions();
+  if (num_unended_regions != 0) {
+    LOG(WARNING) << num_unended_regions
+                 << " regions began and never ended.";
+  }
+
+  return report.Write(output_path);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,165 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "trace_analysis/latency_histogram.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a region analysis.
+struct RegionOptions {
+  RegionOptions() : format(kCsvFormat) {}
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// Providers of the regions: ETWBegin/ETWEnd log to Multi-Main and
+// ETWWorkerBegin/ETWWorkerEnd to Multi-Worker. Each provider counts the depth
+// of its regions separately on each thread.
+enum RegionProvider {
+  kMainRegionProvider,
+  kWorkerRegionProvider,
+  kNumRegionProviders,
+};
+
+// Accumulates the durations of the regions delimited by the Begin and End
+// events of ETWProviders, per region name and per nesting path. A region is
+// paired with its end by the depth logged with both events, on the same
+// thread. Memory usage is bounded by the number of distinct nesting paths and
+// of open regions.
+class RegionReport {
+ public:
+  explicit RegionReport(const RegionOptions& options);
+  ~RegionReport();
+
+  // Records the beginning of a region. Regions of |provider| that began on
+  // |tid| at the same depth or deeper never ended, and are discarded.
+  // @param provider provider of the Begin event.
+  // @param tid thread that began the region.
+  // @param ts timestamp of the Begin event.
+  // @param name description of the region.
+  // @param depth number of regions of |provider| open on |tid| when the region
+  //    began.
+  void BeginRegion(RegionProvider provider,
+                   base::Tid tid,
+                   base::Timestamp ts,
+                   const std::string& name,
+                   uint64_t depth);
+
+  // Records the end of the region of |provider| that began at |depth| on
+  // |tid|. Regions that began deeper never ended, and are discarded.
+  // @param ts timestamp of the End event.
+  // @returns false if no region began at |depth| on |tid| since the beginning
+  //    of the trace.
+  bool EndRegion(RegionProvider provider,
+                 base::Tid tid,
+                 base::Timestamp ts,
+                 uint64_t depth);
+
+  // Writes the statistics of each region name, by decreasing total duration,
+  // followed by the nesting paths of the regions in depth-first order.
+  // @param path path of the output file.
+  // @returns true if the report was written successfully.
+  bool Write(const std::wstring& path) const;
+
+  // @returns the number of regions that began and never ended.
+  uint64_t GetNumUnendedRegions() const;
+
+ private:
+  // Regions with the same name nested in the same path of regions. The first
+  // kNumRegionProviders nodes are the roots of the regions of each provider.
+  struct Node {
+    Node(size_t parent, size_t name_id, RegionProvider provider)
+        : parent(parent), name_id(name_id), provider(provider), self_time(0) {}
+
+    size_t parent;
+    size_t name_id;
+    RegionProvider provider;
+
+    // Durations of the regions, including their nested regions.
+    LatencyHistogram durations;
+
+    // Total duration of the regions minus that of their nested regions.
+    base::Timestamp self_time;
+  };
+
+  // A region that has begun and not ended yet.
+  struct OpenRegion {
+    base::Timestamp ts;
+    uint64_t depth;
+    size_t node;
+    // Total duration of the regions nested in this region.
+    base::Timestamp nested_time;
+  };
+
+  typedef std::vector<OpenRegion> OpenRegions;
+
+  size_t GetNameId(const std::string& name);
+  size_t GetNode(size_t parent, size_t name_id);
+
+  // Discards the regions of |regions| that began at |depth| or deeper.
+  void DiscardRegions(uint64_t depth, OpenRegions* regions);
+
+  const RegionOptions options_;
+
+  // Names of the regions, by id.
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, size_t> name_ids_;
+
+  std::vector<Node> nodes_;
+
+  // Node of each (parent node, name id).
+  std::map<std::pair<size_t, size_t>, size_t> child_nodes_;
+
+  // Regions that have begun and not ended, from the outermost, by thread.
+  std::unordered_map<base::Tid, OpenRegions>
+      open_regions_[kNumRegionProviders];
+
+  // Number of regions discarded because they never ended.
+  uint64_t num_discarded_regions_;
+
+  DISALLOW_COPY_AND_ASSIGN(RegionReport);
+};
+
+// Reads the Begin and End events of ETWProviders in a trace in a single pass
+// and writes the duration percentiles of the regions that they delimit, per
+// region name and per nesting path.
+// @param trace_path path to a .etl trace file.
+// @param options options of the analysis.
+// @param output_path path of the output file.
+// @returns true if the report was written successfully.
+bool GenerateRegionReport(const std::wstring& trace_path,
+                          const RegionOptions& options,
+                          const std::wstring& output_path);
+
+}  // namespace etw_insights
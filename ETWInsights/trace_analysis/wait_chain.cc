@@ -0,0 +1,483 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_analysis/wait_chain.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/buffered_writer.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "etw_reader/etw_reader.h"
+#include "etw_reader/symbol_table.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Common fields.
+const char kTimestampField[] = "TimeStamp";
+const char kThreadIDField[] = "ThreadID";
+const char kProcessNameField[] = "Process Name ( PID)";
+
+// CSwitch event.
+const char kCSwitchType[] = "CSwitch";
+const char kCSwitchNewTidField[] = "New TID";
+const char kCSwitchOldTidField[] = "Old TID";
+const char kCSwitchNewProcessNameField[] = "New Process Name ( PID)";
+const char kCSwitchOldProcessNameField[] = "Old Process Name ( PID)";
+
+// ReadyThread event. The readying thread is in the common fields.
+const char kReadyThreadType[] = "ReadyThread";
+const char kReadyThreadRdyTidField[] = "Rdy TID";
+const char kReadyThreadRdyProcessNameField[] = "Rdy Process Name ( PID)";
+const char kReadyThreadInDpcField[] = "InDPC";
+
+// Stack event.
+const char kStackType[] = "Stack";
+const char kStackSymbolField[] = "Image!Function";
+
+// Thread start events.
+const char kThreadStartType[] = "T-Start";
+const char kThreadDCStartType[] = "T-DCStart";
+
+// Chrome event.
+const char kChromeType[] = "Chrome//win:Info";
+const char kChromeNameField[] = "Name";
+
+// Thread id of the idle thread.
+const base::Tid kIdleTid = 0;
+
+const char kCsvHeader[] =
+    "start_ts,end_ts,duration,pid,process_name,tid,state,readying_tid,"
+    "readying_process_name,wake_stack\n";
+
+const char* const kStateNames[] = {"running", "ready", "waiting"};
+
+// Process of each thread, and name of each process.
+class ThreadProcesses {
+ public:
+  ThreadProcesses() {}
+
+  // Records the process of a thread from one of the fields of an event.
+  void SetFromField(const ETWReader::Line& event,
+                    base::Tid tid,
+                    const char* field) {
+    if (!event.GetFieldAsString(field, &field_value_))
+      return;
+    base::Pid pid = base::kInvalidPid;
+    SplitProcessNameField(field_value_, &process_name_, &pid);
+    thread_pids_[tid] = pid;
+    process_names_[pid] = process_name_;
+  }
+
+  bool HasThread(base::Tid tid) const {
+    return thread_pids_.find(tid) != thread_pids_.end();
+  }
+
+  base::Pid GetPid(base::Tid tid) const {
+    auto look = thread_pids_.find(tid);
+    return look != thread_pids_.end() ? look->second : base::kInvalidPid;
+  }
+
+  const std::string& GetProcessName(base::Tid tid) const {
+    auto look = process_names_.find(GetPid(tid));
+    return look != process_names_.end() ? look->second : empty_string_;
+  }
+
+ private:
+  std::unordered_map<base::Tid, base::Pid> thread_pids_;
+  std::unordered_map<base::Pid, std::string> process_names_;
+
+  // Reused for all the events, to avoid allocating memory.
+  std::string field_value_;
+  std::string process_name_;
+
+  const std::string empty_string_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadProcesses);
+};
+
+// Writes a stack from the root to the leaf, with frames separated by ';'.
+std::string FormatStack(StackId stack,
+                        const StackTable& stacks,
+                        const SymbolTable& symbols) {
+  std::string formatted;
+  if (stack == kInvalidStackId)
+    return formatted;
+  const StackFrames& frames = stacks.GetStack(stack);
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    if (!formatted.empty())
+      formatted.push_back(';');
+    formatted.append(symbols.GetSymbol(*it));
+  }
+  return formatted;
+}
+
+bool WriteCriticalPath(const std::vector<CriticalPathSegment>& path,
+                       base::Timestamp end_ts,
+                       base::Tid end_tid,
+                       const ThreadProcesses& thread_processes,
+                       const StackTable& stacks,
+                       const SymbolTable& symbols,
+                       OutputFormat format,
+                       const std::wstring& output_path) {
+  base::BufferedWriter out;
+  if (!out.Open(output_path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(output_path)
+               << " for writing.";
+    return false;
+  }
+
+  bool json = format == kJsonFormat;
+  if (json) {
+    out.Write("{\"end_ts\":");
+    out.WriteUInt(end_ts);
+    out.Write(",\"end_tid\":");
+    out.WriteUInt(end_tid);
+    out.Write(",\"segments\":[\n");
+  } else {
+    out.Write(kCsvHeader);
+  }
+
+  for (size_t i = 0; i < path.size(); ++i) {
+    const CriticalPathSegment& segment = path[i];
+    bool readied = segment.wake.readying_tid != base::kInvalidTid &&
+                   !segment.wake.in_dpc;
+    std::string process_name(
+        json ? base::QuoteJsonString(
+                   thread_processes.GetProcessName(segment.tid))
+             : base::QuoteCsvField(
+                   thread_processes.GetProcessName(segment.tid)));
+
+    if (json) {
+      if (i != 0)
+        out.Write(",\n");
+      out.Write("{\"start_ts\":");
+      out.WriteUInt(segment.start_ts);
+      out.Write(",\"end_ts\":");
+      out.WriteUInt(segment.end_ts);
+      out.Write(",\"pid\":");
+      out.WriteUInt(thread_processes.GetPid(segment.tid));
+      out.Write(",\"process_name\":");
+      out.Write(process_name);
+      out.Write(",\"tid\":");
+      out.WriteUInt(segment.tid);
+      out.Write(",\"state\":\"");
+      out.Write(kStateNames[segment.state]);
+      out.WriteChar('"');
+      if (readied) {
+        out.Write(",\"readying_tid\":");
+        out.WriteUInt(segment.wake.readying_tid);
+        out.Write(",\"readying_process_name\":");
+        out.Write(base::QuoteJsonString(
+            thread_processes.GetProcessName(segment.wake.readying_tid)));
+        out.Write(",\"wake_stack\":");
+        out.Write(base::QuoteJsonString(
+            FormatStack(segment.wake.stack, stacks, symbols)));
+      }
+      out.WriteChar('}');
+    } else {
+      out.WriteUInt(segment.start_ts);
+      out.WriteChar(',');
+      out.WriteUInt(segment.end_ts);
+      out.WriteChar(',');
+      out.WriteUInt(segment.end_ts - segment.start_ts);
+      out.WriteChar(',');
+      out.WriteUInt(thread_processes.GetPid(segment.tid));
+      out.WriteChar(',');
+      out.Write(process_name);
+      out.WriteChar(',');
+      out.WriteUInt(segment.tid);
+      out.WriteChar(',');
+      out.Write(kStateNames[segment.state]);
+      out.WriteChar(',');
+      if (readied) {
+        out.WriteUInt(segment.wake.readying_tid);
+        out.WriteChar(',');
+        out.Write(base::QuoteCsvField(
+            thread_processes.GetProcessName(segment.wake.readying_tid)));
+        out.WriteChar(',');
+        out.Write(base::QuoteCsvField(
+            FormatStack(segment.wake.stack, stacks, symbols)));
+      } else {
+        out.Write(",,");
+      }
+      out.WriteChar('\n');
+    }
+  }
+
+  if (json)
+    out.Write("\n]}\n");
+  return out.Close();
+}
+
+}  // namespace
+
+WaitGraph::WaitGraph() : num_run_periods_(0), num_wake_edges_(0) {}
+
+WaitGraph::~WaitGraph() {}
+
+void WaitGraph::AddReadyThread(base::Timestamp ts,
+                               base::Tid readying_tid,
+                               base::Tid readied_tid,
+                               bool in_dpc) {
+  WakeEdge& wake = pending_wakes_[readied_tid];
+  if (wake.ready_ts != base::kInvalidTimestamp)
+    return;
+  wake.ready_ts = ts;
+  wake.readying_tid = readying_tid;
+  wake.in_dpc = in_dpc;
+}
+
+void WaitGraph::SetReadyThreadStack(base::Tid readied_tid, StackId stack) {
+  auto look = pending_wakes_.find(readied_tid);
+  if (look != pending_wakes_.end())
+    look->second.stack = stack;
+}
+
+void WaitGraph::AddContextSwitch(base::Timestamp ts,
+                                 base::Tid new_tid,
+                                 base::Tid old_tid) {
+  if (old_tid != kIdleTid) {
+    auto look_old = run_periods_.find(old_tid);
+    if (look_old != run_periods_.end()) {
+      auto period = look_old->second.IteratorFromTimestamp(ts);
+      if (period != look_old->second.IteratorEnd())
+        period->value.switch_out_ts = ts;
+    }
+  }
+
+  if (new_tid == kIdleTid)
+    return;
+
+  RunPeriod period;
+  auto look_wake = pending_wakes_.find(new_tid);
+  if (look_wake != pending_wakes_.end()) {
+    period.wake = look_wake->second;
+    pending_wakes_.erase(look_wake);
+    ++num_wake_edges_;
+  }
+  if (run_periods_[new_tid].Insert(ts, period))
+    ++num_run_periods_;
+}
+
+void WaitGraph::GetCriticalPath(base::Timestamp end_ts,
+                                base::Tid end_tid,
+                                std::vector<CriticalPathSegment>* path) const {
+  DCHECK(path != nullptr);
+  path->clear();
+
+  // Each step moves to an earlier run period, so the walk can't take more
+  // steps than there are periods. The bound protects against cycles in
+  // inconsistent traces.
+  base::Tid tid = end_tid;
+  base::Timestamp ts = end_ts;
+  for (size_t steps = 0; steps <= 2 * num_run_periods_; ++steps) {
+    auto look_thread = run_periods_.find(tid);
+    if (look_thread == run_periods_.end())
+      break;
+    const base::History<RunPeriod>& periods = look_thread->second;
+    auto period = periods.IteratorFromTimestamp(ts);
+    if (period == periods.IteratorEnd())
+      break;
+
+    // The thread hadn't run yet at |ts|, e.g. because it was readied before
+    // its first switch in of the trace: what it was doing is unknown.
+    if (period->start_ts > ts)
+      break;
+
+    // The thread was switched out before |ts| and not readied since.
+    if (period->value.switch_out_ts < ts) {
+      path->push_back(CriticalPathSegment(tid, CriticalPathSegment::kWaiting,
+                                          period->value.switch_out_ts, ts));
+      ts = period->value.switch_out_ts;
+    }
+
+    base::Timestamp switch_in_ts = period->start_ts;
+    path->push_back(CriticalPathSegment(tid, CriticalPathSegment::kRunning,
+                                        switch_in_ts, ts));
+
+    // The wait before the first period of a thread is unknown.
+    if (period == periods.IteratorBegin())
+      break;
+    base::Timestamp wait_start_ts = std::prev(period)->value.switch_out_ts;
+    if (wait_start_ts > switch_in_ts)
+      break;
+
+    const WakeEdge& wake = period->value.wake;
+    if (wake.ready_ts == base::kInvalidTimestamp ||
+        wake.ready_ts < wait_start_ts) {
+      // The thread was preempted, and was ready during the whole wait.
+      CriticalPathSegment ready(tid, CriticalPathSegment::kReady,
+                                wait_start_ts, switch_in_ts);
+      path->push_back(ready);
+      ts = wait_start_ts;
+      continue;
+    }
+
+    CriticalPathSegment ready(tid, CriticalPathSegment::kReady, wake.ready_ts,
+                              switch_in_ts);
+    ready.wake = wake;
+    path->push_back(ready);
+
+    if (wake.in_dpc || wake.readying_tid == kIdleTid ||
+        wake.readying_tid == base::kInvalidTid) {
+      // No thread caused the wake-up, e.g. because a device completed an
+      // operation: the wait is on the path.
+      path->push_back(CriticalPathSegment(tid, CriticalPathSegment::kWaiting,
+                                          wait_start_ts, wake.ready_ts));
+      ts = wait_start_ts;
+    } else {
+      // The wait is attributed to the readying thread.
+      tid = wake.readying_tid;
+      ts = wake.ready_ts;
+    }
+  }
+
+  std::reverse(path->begin(), path->end());
+}
+
+bool GenerateWaitChain(const std::wstring& trace_path,
+                       const WaitChainOptions& options,
+                       const std::wstring& output_path) {
+  ETWReader etw_reader;
+  if (!etw_reader.Open(trace_path))
+    return false;
+  etw_reader.set_filter(options.event_filter);
+
+  WaitGraph graph;
+  ThreadProcesses thread_processes;
+  SymbolTable symbols;
+  StackTable stacks;
+
+  bool explicit_end = options.end_ts != base::kInvalidTimestamp &&
+                      options.end_tid != base::kInvalidTid;
+  base::Timestamp end_ts = options.end_ts;
+  base::Tid end_tid = options.end_tid;
+  bool found_end = explicit_end;
+
+  LOG(INFO) << "Reading trace events." << std::endl;
+
+  // Last ReadyThread event, to which the following stack belongs.
+  base::Timestamp ready_ts = base::kInvalidTimestamp;
+  base::Tid readying_tid = base::kInvalidTid;
+  base::Tid readied_tid = base::kInvalidTid;
+
+  // Reused for all the events, to avoid allocating memory.
+  std::string value;
+  StackFrames frames;
+
+  for (auto it = etw_reader.begin(); it != etw_reader.end(); ++it) {
+    const std::string& type = it->type();
+    base::Timestamp ts = 0;
+    if (type == kStackType) {
+      base::Tid tid = 0;
+      if (!it->GetFieldAsULong(kTimestampField, &ts) || ts != ready_ts ||
+          !it->GetFieldAsULong(kThreadIDField, &tid) || tid != readying_tid) {
+        continue;
+      }
+
+      // Intern the stack of the readying thread.
+      frames.clear();
+      while (it->type() == kStackType) {
+        if (it->GetFieldAsString(kStackSymbolField, &value))
+          frames.push_back(symbols.Intern(value));
+        ++it;
+      }
+      DCHECK_EQ(ETWReader::kEmptyEventType, it->type());
+      graph.SetReadyThreadStack(readied_tid, stacks.Intern(frames));
+      ready_ts = base::kInvalidTimestamp;
+      continue;
+    }
+
+    if (!it->GetFieldAsULong(kTimestampField, &ts))
+      continue;
+    if (explicit_end && ts > end_ts)
+      break;
+
+    if (type == kCSwitchType) {
+      base::Tid new_tid = 0;
+      base::Tid old_tid = 0;
+      if (!it->GetFieldAsULong(kCSwitchNewTidField, &new_tid) ||
+          !it->GetFieldAsULong(kCSwitchOldTidField, &old_tid)) {
+        LOG(ERROR) << "Missing some fields in CSwitch event at ts=" << ts
+                   << ".";
+        continue;
+      }
+      if (!thread_processes.HasThread(new_tid))
+        thread_processes.SetFromField(*it, new_tid,
+                                      kCSwitchNewProcessNameField);
+      if (!thread_processes.HasThread(old_tid))
+        thread_processes.SetFromField(*it, old_tid,
+                                      kCSwitchOldProcessNameField);
+      graph.AddContextSwitch(ts, new_tid, old_tid);
+    } else if (type == kReadyThreadType) {
+      uint64_t in_dpc = 0;
+      if (!it->GetFieldAsULong(kThreadIDField, &readying_tid) ||
+          !it->GetFieldAsULong(kReadyThreadRdyTidField, &readied_tid)) {
+        LOG(ERROR) << "Missing some fields in ReadyThread event at ts=" << ts
+                   << ".";
+        continue;
+      }
+      it->GetFieldAsULong(kReadyThreadInDpcField, &in_dpc);
+      if (!thread_processes.HasThread(readied_tid))
+        thread_processes.SetFromField(*it, readied_tid,
+                                      kReadyThreadRdyProcessNameField);
+      graph.AddReadyThread(ts, readying_tid, readied_tid, in_dpc != 0);
+      ready_ts = ts;
+    } else if (type == kThreadStartType || type == kThreadDCStartType) {
+      base::Tid tid = 0;
+      if (it->GetFieldAsULong(kThreadIDField, &tid))
+        thread_processes.SetFromField(*it, tid, kProcessNameField);
+    } else if (type == kChromeType && !explicit_end) {
+      if (it->GetFieldAsString(kChromeNameField, &value) &&
+          base::Unquote(value) == options.end_event &&
+          it->GetFieldAsULong(kThreadIDField, &end_tid)) {
+        end_ts = ts;
+        found_end = true;
+        break;
+      }
+    }
+  }
+
+  if (!found_end) {
+    LOG(ERROR) << "No " << options.end_event << " event in the trace.";
+    return false;
+  }
+
+  LOG(INFO) << "Found " << graph.num_wake_edges() << " wake-up edges and "
+            << stacks.size() << " distinct wake-up stacks." << std::endl;
+
+  std::vector<CriticalPathSegment> path;
+  graph.GetCriticalPath(end_ts, end_tid, &path);
+
+  // Summarize the time spent in each state on the path.
+  base::Timestamp state_durations[] = {0, 0, 0};
+  for (const CriticalPathSegment& segment : path)
+    state_durations[segment.state] += segment.end_ts - segment.start_ts;
+  LOG(INFO) << "Critical path of " << path.size() << " segments: "
+            << state_durations[CriticalPathSegment::kRunning]
+            << " us running, " << state_durations[CriticalPathSegment::kReady]
+            << " us ready, " << state_durations[CriticalPathSegment::kWaiting]
+            << " us waiting." << std::endl;
+
+  return WriteCriticalPath(path, end_ts, end_tid, thread_processes, stacks,
+                           symbols, options.format, output_path);
+}
+
+}  // namespace etw_insights
@@ -0,0 +1,197 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base.h"
+#include "base/history.h"
+#include "base/types.h"
+#include "etw_reader/event_filter.h"
+#include "etw_reader/stack_table.h"
+#include "trace_analysis/output_format.h"
+
+namespace etw_insights {
+
+// Options of a wait chain analysis.
+struct WaitChainOptions {
+  WaitChainOptions()
+      : end_event("Startup.FirstWebContents.NonEmptyPaint"),
+        end_ts(base::kInvalidTimestamp),
+        end_tid(base::kInvalidTid),
+        format(kCsvFormat) {}
+
+  // Name of the Chrome event at which the critical path ends. The first
+  // event with this name is used.
+  std::string end_event;
+
+  // Time and thread at which the critical path ends. When both are valid,
+  // they are used instead of |end_event|.
+  base::Timestamp end_ts;
+  base::Tid end_tid;
+
+  // Only the events that match this filter are analyzed.
+  EventFilter event_filter;
+
+  // Output format.
+  OutputFormat format;
+};
+
+// A wake-up: the thread that made a waiting thread ready to run.
+struct WakeEdge {
+  WakeEdge()
+      : ready_ts(base::kInvalidTimestamp),
+        readying_tid(base::kInvalidTid),
+        in_dpc(false),
+        stack(kInvalidStackId) {}
+
+  bool operator==(const WakeEdge& other) const {
+    return ready_ts == other.ready_ts && readying_tid == other.readying_tid &&
+           in_dpc == other.in_dpc && stack == other.stack;
+  }
+
+  // Time of the ReadyThread event. kInvalidTimestamp if the thread wasn't
+  // readied, e.g. because it was preempted.
+  base::Timestamp ready_ts;
+
+  // Thread that readied the thread. When |in_dpc| is true, it is the thread
+  // interrupted by the DPC that readied the thread, which didn't cause the
+  // wake-up.
+  base::Tid readying_tid;
+  bool in_dpc;
+
+  // Stack of the readying thread.
+  StackId stack;
+};
+
+// A segment of a critical path: a time range during which a thread ran, or
+// waited for a CPU or for an object.
+struct CriticalPathSegment {
+  enum State {
+    kRunning,
+    // Ready to run, waiting for a CPU.
+    kReady,
+    // Waiting, with no thread known to have caused the wake-up.
+    kWaiting,
+  };
+
+  CriticalPathSegment(base::Tid tid,
+                      State state,
+                      base::Timestamp start_ts,
+                      base::Timestamp end_ts)
+      : tid(tid), state(state), start_ts(start_ts), end_ts(end_ts) {}
+
+  base::Tid tid;
+  State state;
+  base::Timestamp start_ts;
+  base::Timestamp end_ts;
+
+  // For a kReady segment, how the thread was readied.
+  WakeEdge wake;
+};
+
+// Joins the ReadyThread events of a trace to the context switches that switch
+// the readied threads in, and walks the resulting wake-up edges backwards to
+// find the critical path that led to an event. Events must be added in
+// timestamp order. Typical usage is:
+//   WaitGraph graph;
+//   graph.AddContextSwitch(ts, new_tid, old_tid);
+//   graph.AddReadyThread(ts, readying_tid, readied_tid, in_dpc);
+//   graph.SetReadyThreadStack(readied_tid, stack);
+//   graph.GetCriticalPath(end_ts, end_tid, &path);
+class WaitGraph {
+ public:
+  WaitGraph();
+  ~WaitGraph();
+
+  // Records that |readied_tid| was made ready by |readying_tid|. Only the
+  // first ReadyThread event before the thread is switched in is kept.
+  void AddReadyThread(base::Timestamp ts,
+                      base::Tid readying_tid,
+                      base::Tid readied_tid,
+                      bool in_dpc);
+
+  // Sets the stack of the last ReadyThread event of |readied_tid|, if the
+  // thread hasn't been switched in since.
+  void SetReadyThreadStack(base::Tid readied_tid, StackId stack);
+
+  // Records a context switch from |old_tid| to |new_tid|. The pending wake-up
+  // of |new_tid|, if any, becomes the edge of the period that starts.
+  void AddContextSwitch(base::Timestamp ts,
+                        base::Tid new_tid,
+                        base::Tid old_tid);
+
+  // Walks the critical path backwards from thread |end_tid| at |end_ts|:
+  // the time that a thread ran is attributed to it, and the time that it
+  // waited is attributed to the thread that readied it, up to the time at
+  // which it readied it. The walk ends at the first context switch of a
+  // thread.
+  // @param end_ts time at which the critical path ends.
+  // @param end_tid thread at which the critical path ends.
+  // @param path receives the segments of the critical path, in timestamp
+  //    order.
+  void GetCriticalPath(base::Timestamp end_ts,
+                       base::Tid end_tid,
+                       std::vector<CriticalPathSegment>* path) const;
+
+  // @returns the number of wake-up edges, i.e. of run periods that started
+  //    with a ReadyThread event.
+  size_t num_wake_edges() const { return num_wake_edges_; }
+
+ private:
+  // A period during which a thread ran on a CPU.
+  struct RunPeriod {
+    RunPeriod() : switch_out_ts(base::kInvalidTimestamp) {}
+
+    bool operator==(const RunPeriod& other) const {
+      return switch_out_ts == other.switch_out_ts && wake == other.wake;
+    }
+
+    // End of the period. kInvalidTimestamp while the thread runs.
+    base::Timestamp switch_out_ts;
+
+    // How the thread was readied before the period.
+    WakeEdge wake;
+  };
+
+  // Run periods of each thread, indexed by switch in time. A period is found
+  // in O(log(periods of the thread)).
+  std::unordered_map<base::Tid, base::History<RunPeriod>> run_periods_;
+
+  // Wake-ups of threads that haven't been switched in yet.
+  std::unordered_map<base::Tid, WakeEdge> pending_wakes_;
+
+  size_t num_run_periods_;
+  size_t num_wake_edges_;
+
+  DISALLOW_COPY_AND_ASSIGN(WaitGraph);
+};
+
+// Reads the CSwitch and ReadyThread events of a trace in a single pass, up to
+// the end event, and writes the critical path that led to it.
+// @param trace_path path to a .etl trace file.
+// @param options options of the analysis.
+// @param output_path path of the output file.
+// @returns true if the critical path was written successfully.
+bool GenerateWaitChain(const std::wstring& trace_path,
+                       const WaitChainOptions& options,
+                       const std::wstring& output_path);
+
+}  // namespace etw_insights
@@ -0,0 +1,139 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+
+#include "base/command_line.h"
+#include "base/logging.h"
+#include "base/numeric_conversions.h"
+#include "base/string_utils.h"
+#include "trace_generator/trace_generator.h"
+
+using namespace etw_insights;
+
+namespace {
+
+// A numeric switch and the option that it sets.
+struct NumericSwitch {
+  const wchar_t* name;
+  uint64_t TraceGeneratorOptions::*option;
+};
+
+const NumericSwitch kNumericSwitches[] = {
+    {L"cpus", &TraceGeneratorOptions::num_cpus},
+    {L"processes", &TraceGeneratorOptions::num_processes},
+    {L"threads", &TraceGeneratorOptions::threads_per_process},
+    {L"functions", &TraceGeneratorOptions::functions_per_process},
+    {L"stack_depth", &TraceGeneratorOptions::max_stack_depth},
+    {L"sampling_interval", &TraceGeneratorOptions::sampling_interval},
+    {L"context_switch_rate", &TraceGeneratorOptions::context_switch_rate},
+    {L"file_io_percent", &TraceGeneratorOptions::file_io_percent},
+    {L"chrome_event_rate", &TraceGeneratorOptions::chrome_event_rate},
+    {L"region_percent", &TraceGeneratorOptions::region_percent},
+    {L"input_rate", &TraceGeneratorOptions::input_rate},
+    {L"duration", &TraceGeneratorOptions::duration},
+    {L"seed", &TraceGeneratorOptions::seed},
+};
+
+void ShowUsage() {
+  base::FlushLogs();
+  std::cout
+      << "Usage: trace_generator.exe --trace <trace_file_path> [options]"
+      << std::endl
+      << std::endl
+      << "Writes a synthetic trace to <trace_file_path>.csv, in the format of "
+         "xperf, and a placeholder to <trace_file_path>. The trace can then "
+         "be opened by the other tools with --trace <trace_file_path>."
+      << std::endl
+      << std::endl
+      << "Options:" << std::endl
+      << "  --cpus: Number of CPUs. Default: 8." << std::endl
+      << "  --processes: Number of processes. Default: 4." << std::endl
+      << "  --threads: Number of threads per process. Default: 8."
+      << std::endl
+      << "  --functions: Number of distinct functions in the stacks of each "
+         "process. Default: 4096."
+      << std::endl
+      << "  --stack_depth: Maximum number of frames in a stack. Default: 32."
+      << std::endl
+      << "  --sampling_interval: Interval between 2 samples of a running "
+         "thread (in microseconds). Default: 1000."
+      << std::endl
+      << "  --context_switch_rate: Number of context switches per thread per "
+         "second. Default: 100."
+      << std::endl
+      << "  --file_io_percent: Percentage of the waits that are file "
+         "operations. Default: 20."
+      << std::endl
+      << "  --chrome_event_rate: Number of Chrome events per second. "
+         "Default: 100."
+      << std::endl
+      << "  --region_percent: Percentage of the samples after which the "
+         "thread begins or ends an ETWBegin/ETWEnd region. Default: 25."
+      << std::endl
+      << "  --input_rate: Number of key presses and mouse clicks per second. "
+         "Default: 4."
+      << std::endl
+      << "  --duration: Duration of the trace (in seconds). Default: 10."
+      << std::endl
+      << "  --seed: Seed of the random number generator. Default: 1."
+      << std::endl;
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[], wchar_t* /*envp */ []) {
+  // Read command line arguments.
+  base::CommandLine command_line(argc, argv);
+
+  if (command_line.GetNumSwitches() == 0) {
+    ShowUsage();
+    return 1;
+  }
+
+  std::wstring trace_path = command_line.GetSwitchValue(L"trace");
+  if (trace_path.empty()) {
+    base::FlushLogs();
+    std::cout << "Please specify a trace path (--trace)." << std::endl
+              << std::endl;
+    ShowUsage();
+    return 1;
+  }
+
+  TraceGeneratorOptions options;
+  for (const NumericSwitch& numeric_switch : kNumericSwitches) {
+    std::wstring value(command_line.GetSwitchValue(numeric_switch.name));
+    if (!value.empty() &&
+        !base::StrToULong(value, &(options.*numeric_switch.option))) {
+      base::FlushLogs();
+      std::cout << "Value must be numeric (--"
+                << base::WStringToString(numeric_switch.name) << ")."
+                << std::endl
+                << std::endl;
+      ShowUsage();
+      return 1;
+    }
+  }
+
+  uint64_t csv_size = 0;
+  if (!GenerateTrace(options, trace_path, &csv_size))
+    return 1;
+
+  LOG(INFO) << "Wrote " << csv_size / (1024 * 1024) << " MB of trace events in "
+            << base::WStringToString(trace_path) << ".csv" << std::endl;
+
+  return 0;
+}
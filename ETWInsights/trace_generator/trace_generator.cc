@@ -0,0 +1,1104 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "trace_generator/trace_generator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <deque>
+#include <queue>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/buffered_writer.h"
+#include "base/file.h"
+#include "base/logging.h"
+#include "base/string_utils.h"
+#include "base/types.h"
+
+namespace etw_insights {
+
+namespace {
+
+// Suffix of the CSV conversion of a trace.
+const wchar_t kCSVFileExtension[] = L".csv";
+
+// First line of the placeholder written at the path of the .etl file. Only
+// files that start with this line are overwritten.
+const char kPlaceholderMarker[] = "ETWInsights synthetic trace";
+
+// Header of the CSV file: the type of each line followed by its columns.
+const char kHeader[] =
+    "BeginHeader\n"
+    "P-Start, TimeStamp, Process Name ( PID), ParentPID, SessionID, "
+    "Command Line\n"
+    "T-Start, TimeStamp, Process Name ( PID), ThreadID, StackBase, "
+    "StackLimit, Win32StartAddr\n"
+    "T-End, TimeStamp, Process Name ( PID), ThreadID, StackBase, StackLimit, "
+    "Win32StartAddr\n"
+    "SampledProfile, TimeStamp, Process Name ( PID), ThreadID, PrgrmCtr, CPU, "
+    "Count, Image!Function\n"
+    "CSwitch, TimeStamp, New Process Name ( PID), New TID, NPri, NQnt, "
+    "TmSinceLast, WaitTime, Old Process Name ( PID), Old TID, OPri, OQnt, "
+    "OldState, Wait Reason, Swapable, InSwitchTime, CPU, IdealProc\n"
+    "ReadyThread, TimeStamp, Process Name ( PID), ThreadID, "
+    "Rdy Process Name ( PID), Rdy TID, AdjustReason, AdjustIncrement, CPU, "
+    "InDPC\n"
+    "Stack, TimeStamp, ThreadID, No., Address, Image!Function\n"
+    "FileIoCreate, TimeStamp, Process Name ( PID), ThreadID, "
+    "LoggingProcessName ( PID), LoggingThreadID, CPU, IrpPtr, FileObject, "
+    "FileName\n"
+    "FileIoRead, TimeStamp, Process Name ( PID), ThreadID, "
+    "LoggingProcessName ( PID), LoggingThreadID, CPU, IrpPtr, FileObject, "
+    "ByteOffset, Size, FileName\n"
+    "FileIoWrite, TimeStamp, Process Name ( PID), ThreadID, "
+    "LoggingProcessName ( PID), LoggingThreadID, CPU, IrpPtr, FileObject, "
+    "ByteOffset, Size, FileName\n"
+    "FileIoOpEnd, TimeStamp, Process Name ( PID), ThreadID, "
+    "LoggingProcessName ( PID), LoggingThreadID, CPU, IrpPtr, FileObject, "
+    "ElapsedTime, Status, ExtraInfo, FileName\n"
+    "DiskRead, TimeStamp, Process Name ( PID), ThreadID, IrpPtr, ByteOffset, "
+    "IOSize, ElapsedTime, DiskNum, IrpFlags, DiskSvcTime, I/O Pri, VolSnap, "
+    "FileObject, FileName\n"
+    "DiskWrite, TimeStamp, Process Name ( PID), ThreadID, IrpPtr, ByteOffset, "
+    "IOSize, ElapsedTime, DiskNum, IrpFlags, DiskSvcTime, I/O Pri, VolSnap, "
+    "FileObject, FileName\n"
+    "Chrome//win:Info, TimeStamp, Process Name ( PID), ThreadID, CPU, Name, "
+    "Phase, Arg Name 1, Arg Value 1\n"
+    "Multi-Main/Block/Begin, TimeStamp, Process Name ( PID), ThreadID, CPU, "
+    "Description, Depth\n"
+    "Multi-Main/Block/End, TimeStamp, Process Name ( PID), ThreadID, CPU, "
+    "Description, Depth, Duration (ms)\n"
+    "Multi-Worker/BlockWorker/Begin, TimeStamp, Process Name ( PID), "
+    "ThreadID, CPU, Description, Depth\n"
+    "Multi-Worker/BlockWorker/End, TimeStamp, Process Name ( PID), ThreadID, "
+    "CPU, Description, Depth, Duration (ms)\n"
+    "Multi-FrameRate/Frame/RenderFrameMark, TimeStamp, Process Name ( PID), "
+    "ThreadID, CPU, Frame number, Duration (ms)\n"
+    "Multi-Input/Keyboard/KeyDown, TimeStamp, Process Name ( PID), ThreadID, "
+    "CPU, Virtual key code, Key name, Repeat count, Flags\n"
+    "Multi-Input/Mouse/MouseDown, TimeStamp, Process Name ( PID), ThreadID, "
+    "CPU, Button Type, Flags, x, y\n"
+    "EndHeader\n"
+    "TraceInfo, Synthetic trace generated by trace_generator.exe\n";
+
+// Names of the processes, assigned in turn.
+const char* const kProcessNames[] = {
+    "chrome.exe", "chrome.exe", "svchost.exe", "chrome.exe", "explorer.exe",
+    "MsMpEng.exe",
+};
+const size_t kNumProcessNames = sizeof(kProcessNames) / sizeof(kProcessNames[0]);
+
+// File operations started before a wait.
+const char* const kFileIoTypes[] = {
+    "FileIoCreate", "FileIoRead", "FileIoWrite",
+};
+const size_t kNumFileIoTypes = sizeof(kFileIoTypes) / sizeof(kFileIoTypes[0]);
+
+// Disk operations that complete the file operations when they miss the cache,
+// in the same order. nullptr if the operation never reaches the disk.
+const char* const kDiskIoTypes[] = {
+    nullptr, "DiskRead", "DiskWrite",
+};
+
+// Functions that issue the file operations, in the same order.
+const char* const kFileIoFunctions[] = {
+    "ntoskrnl.exe!NtCreateFile", "ntoskrnl.exe!NtReadFile",
+    "ntoskrnl.exe!NtWriteFile",
+};
+
+// Names of the Chrome events.
+const char* const kChromeEventNames[] = {
+    "\"MessageLoop::RunTask\"", "\"ThreadProxy::BeginMainFrame\"",
+    "\"RenderWidget::OnSwapBuffersComplete\"",
+    "\"ResourceDispatcher::OnReceivedData\"",
+};
+const size_t kNumChromeEventNames =
+    sizeof(kChromeEventNames) / sizeof(kChromeEventNames[0]);
+
+// Names of the ETWProviders regions.
+const char* const kRegionNames[] = {
+    "\"Frame\"", "\"Update\"", "\"Render\"", "\"Physics\"", "\"LoadAsset\"",
+};
+const size_t kNumRegionNames = sizeof(kRegionNames) / sizeof(kRegionNames[0]);
+
+// Maximum number of nested regions on a thread.
+const size_t kMaxRegionDepth = 4;
+
+// Keys pressed, with the labels of KeyLoggerThread when keyboard details
+// aren't logged.
+struct Key {
+  uint64_t virtual_key_code;
+  const char* name;
+};
+const Key kKeys[] = {
+    {0x41, "\"A\""},       {0x41, "\"A\""},        {0x41, "\"A\""},
+    {0x30, "\"0\""},       {0x41, "\"Shift+A\""},  {0x41, "\"Ctrl+A\""},
+    {0x20, "\"space\""},   {0x0D, "\"enter\""},    {0x08, "\"backspace\""},
+};
+const size_t kNumKeys = sizeof(kKeys) / sizeof(kKeys[0]);
+
+// Percentage of the inputs that are key presses rather than mouse clicks.
+const uint64_t kKeyInputPercent = 75;
+
+// Number of mouse buttons, and size of the screen on which they are clicked.
+const uint64_t kNumMouseButtons = 3;
+const uint64_t kScreenWidth = 1920;
+const uint64_t kScreenHeight = 1080;
+
+// Timestamp of the first event, in microseconds.
+const base::Timestamp kFirstEventTs = 1000;
+
+// Number of files accessed by each process.
+const uint64_t kFilesPerProcess = 64;
+
+// Percentage of the reads and writes that miss the cache and go to the disk.
+const uint64_t kDiskIoPercent = 50;
+
+// Address of the IRP of the first thread and of the first file object. Each
+// thread has at most one pending file operation, so threads reuse their IRP.
+const uint64_t kFirstIrp = 0xFFFFE00012340000;
+const uint64_t kFirstFileObject = 0xFFFFE00056780000;
+
+// Number of functions that a function calls.
+const uint64_t kCalleesPerFunction = 8;
+
+// Maximum number of frames pushed or popped between 2 samples.
+const uint64_t kMaxStackChange = 4;
+
+// Address of the first function.
+const uint64_t kFirstFunctionAddress = 0x7FF600001000;
+
+// Name field of the idle process, whose thread 0 runs on idle CPUs.
+const char kIdleProcessNameField[] = "Idle (0)";
+
+// Thread index of the idle thread.
+const size_t kIdleThread = static_cast<size_t>(-1);
+
+// Process id of the first process and thread id of the first thread.
+const base::Pid kFirstPid = 1000;
+const base::Tid kFirstTid = 5000;
+
+// Random number generator (SplitMix64). Unlike the generators of <random>,
+// it produces the same numbers with every standard library.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  // @returns a number in [0, bound).
+  uint64_t Uniform(uint64_t bound) { return bound == 0 ? 0 : Next() % bound; }
+
+ private:
+  uint64_t state_;
+
+  DISALLOW_COPY_AND_ASSIGN(Random);
+};
+
+// A function that appears in stacks.
+struct Function {
+  std::string address;
+  std::string name;
+};
+
+struct SimulatedProcess {
+  base::Pid pid;
+  // Name of the executable, without extension.
+  std::string short_name;
+  // "<name> (<pid>)".
+  std::string name_field;
+  // Index of the first function of the process in the function table.
+  uint32_t first_function;
+};
+
+struct SimulatedThread {
+  enum State {
+    // Waiting for an object or a file operation.
+    kWaiting,
+    // Ready to run, waiting for a CPU.
+    kReady,
+    // Running on |cpu|.
+    kRunning,
+  };
+
+  size_t process_index;
+  base::Tid tid;
+
+  // Frames of the current stack, from the root to the leaf, as indexes in the
+  // function table.
+  std::vector<uint32_t> stack;
+
+  State state = kWaiting;
+
+  // When the thread is running: its CPU, the time at which it is switched
+  // out, and the time of its next sample.
+  uint64_t cpu = 0;
+  base::Timestamp switch_out_ts = 0;
+  base::Timestamp next_sample_ts = 0;
+
+  // When the thread is waiting or ready: time at which it was switched out,
+  // time at which its wait ends, and pending file operation (-1 if none).
+  base::Timestamp wait_start_ts = 0;
+  base::Timestamp wait_end_ts = 0;
+  int file_io_type = -1;
+  uint64_t file_index = 0;
+  uint64_t file_offset = 0;
+  uint64_t file_io_size = 0;
+
+  // Address of the IRP of the file operations of the thread.
+  uint64_t irp = 0;
+
+  // Whether the regions of the thread are logged by ETWWorkerBegin/End.
+  bool is_worker = false;
+
+  // Regions that have begun and not ended, from the outermost: their start
+  // time and their name.
+  std::vector<std::pair<base::Timestamp, const char*>> regions;
+};
+
+class TraceGenerator {
+ public:
+  TraceGenerator(const TraceGeneratorOptions& options,
+                 base::BufferedWriter* writer);
+
+  void Generate();
+
+ private:
+  // Simulation events, ordered by timestamp. The index identifies a thread,
+  // the Chrome event source if it is equal to the number of threads, or the
+  // input source if it is equal to the number of threads plus one.
+  typedef std::pair<base::Timestamp, size_t> ScheduledEvent;
+
+  uint32_t AddFunction(const std::string& name);
+
+  // Creates the processes, the threads and the functions of their stacks.
+  void CreateProcesses();
+
+  // Schedules the next event of a thread that is waiting or running.
+  void ScheduleThread(size_t thread_index);
+
+  void HandleThreadEvent(base::Timestamp ts, size_t thread_index);
+  // Writes the ReadyThread event that ends the wait of |thread|.
+  void ReadyThread(base::Timestamp ts, const SimulatedThread& thread);
+  void HandleChromeEvent(base::Timestamp ts);
+  // Writes a key press or a mouse click, logged by the last thread like
+  // UIforETW's input logging thread.
+  void HandleInputEvent(base::Timestamp ts);
+  // Begins a region on |thread| or ends its innermost region.
+  void HandleRegionEvent(base::Timestamp ts, SimulatedThread* thread);
+  // Writes a frame mark, logged by the render thread when it is switched out.
+  void WriteFrameMark(base::Timestamp ts, const SimulatedThread& thread);
+  // Writes a duration in milliseconds, with 3 decimals, as the next field.
+  void WriteMillisecondsField(uint64_t duration);
+
+  // Switches thread |thread_index| in on CPU |cpu|, in place of
+  // |old_thread_index| (kIdleThread if the CPU was idle).
+  void SwitchIn(base::Timestamp ts,
+                uint64_t cpu,
+                size_t thread_index,
+                size_t old_thread_index);
+
+  // Randomly moves the stack of a thread deeper or shallower.
+  void MutateStack(SimulatedThread* thread);
+
+  // @returns a duration in [1, 2 * mean], in microseconds.
+  uint64_t RandomDuration(uint64_t mean);
+
+  void WriteProcessStart(base::Timestamp ts, const SimulatedProcess& process);
+  void WriteThreadStartOrEnd(const char* type,
+                             base::Timestamp ts,
+                             const SimulatedThread& thread);
+  void WriteSample(base::Timestamp ts, const SimulatedThread& thread);
+  // Writes a context switch on |cpu|. |new_thread| or |old_thread| is nullptr
+  // for the idle thread.
+  void WriteContextSwitch(base::Timestamp ts,
+                          uint64_t cpu,
+                          const SimulatedThread* new_thread,
+                          const SimulatedThread* old_thread);
+  // Writes a ReadyThread event. |readying_thread| is nullptr for the idle
+  // thread.
+  void WriteReadyThread(base::Timestamp ts,
+                        uint64_t cpu,
+                        const SimulatedThread* readying_thread,
+                        const SimulatedThread& readied_thread,
+                        bool in_dpc);
+  // Writes the event that starts the pending file operation of |thread|.
+  void WriteFileIo(base::Timestamp ts, const SimulatedThread& thread);
+  // Writes the events that complete the pending file operation of |thread|,
+  // which started |elapsed_time| microseconds before |ts|.
+  void WriteFileIoEnd(base::Timestamp ts,
+                      const SimulatedThread& thread,
+                      uint64_t elapsed_time);
+  // @returns the address of the file object of the pending file operation of
+  //    |thread|.
+  uint64_t GetFileObject(const SimulatedThread& thread) const;
+  // Writes the name of the file of the pending file operation of |thread|, as
+  // the last field of an event.
+  void WriteFileName(const SimulatedThread& thread);
+
+  // Writes the Stack lines of a stack, from the leaf to the root, followed by
+  // an empty line. |wait_frames| are written before the frames of the thread.
+  void WriteStack(base::Timestamp ts,
+                  const SimulatedThread& thread,
+                  const std::vector<uint32_t>& wait_frames);
+
+  void WriteField(const std::string& value) {
+    writer_->Write(", ");
+    writer_->Write(value);
+  }
+  void WriteField(const char* value) {
+    writer_->Write(", ");
+    writer_->Write(value);
+  }
+  void WriteField(uint64_t value) {
+    writer_->Write(", ");
+    writer_->WriteUInt(value);
+  }
+  void WriteHexField(uint64_t value);
+
+  const TraceGeneratorOptions options_;
+  base::BufferedWriter* writer_;
+  Random random_;
+
+  std::vector<Function> functions_;
+  std::vector<SimulatedProcess> processes_;
+  std::vector<SimulatedThread> threads_;
+
+  // Frames at the root of every stack.
+  std::vector<uint32_t> root_frames_;
+
+  // Frames at the top of the stack of a waiting thread, from the leaf down,
+  // for a wait without file operation and for each type of file operation.
+  std::vector<uint32_t> wait_frames_;
+  std::vector<uint32_t> file_io_wait_frames_[kNumFileIoTypes];
+
+  // Frames at the top of the stack of a thread that readies another thread,
+  // from the leaf down.
+  std::vector<uint32_t> set_event_frames_;
+
+  // Thread that runs on each CPU.
+  std::vector<size_t> cpus_;
+
+  // Threads that are ready to run, in the order in which they became ready.
+  std::deque<size_t> ready_threads_;
+
+  // Events of the simulation: the next event of each waiting or running
+  // thread, the next Chrome event and the next input event.
+  std::priority_queue<ScheduledEvent,
+                      std::vector<ScheduledEvent>,
+                      std::greater<ScheduledEvent>>
+      events_;
+
+  // Average duration of a running and of a waiting period, in microseconds.
+  uint64_t mean_run_period_;
+  uint64_t mean_wait_period_;
+
+  // Name of the Chrome event that has begun and not ended yet, or nullptr.
+  const char* pending_chrome_event_;
+
+  // Number of frame marks written, and time of the last one.
+  uint64_t num_frames_;
+  base::Timestamp last_frame_ts_;
+
+  base::Timestamp end_ts_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceGenerator);
+};
+
+TraceGenerator::TraceGenerator(const TraceGeneratorOptions& options,
+                               base::BufferedWriter* writer)
+    : options_(options),
+      writer_(writer),
+      random_(options.seed),
+      cpus_(static_cast<size_t>(std::max<uint64_t>(1, options.num_cpus)),
+            kIdleThread),
+      pending_chrome_event_(nullptr),
+      num_frames_(0),
+      last_frame_ts_(0),
+      end_ts_(kFirstEventTs + options.duration * 1000000) {
+  // Threads run a quarter of the time when they don't wait for a CPU.
+  uint64_t period =
+      1000000 / std::max<uint64_t>(1, options.context_switch_rate);
+  mean_run_period_ = std::max<uint64_t>(1, period / 4);
+  mean_wait_period_ = std::max<uint64_t>(1, period - period / 4);
+}
+
+uint32_t TraceGenerator::AddFunction(const std::string& name) {
+  std::ostringstream address;
+  address << "0x" << std::hex << std::uppercase
+          << kFirstFunctionAddress + functions_.size() * 0x40;
+  functions_.push_back({address.str(), name});
+  return static_cast<uint32_t>(functions_.size() - 1);
+}
+
+void TraceGenerator::CreateProcesses() {
+  root_frames_.push_back(AddFunction("ntdll.dll!RtlUserThreadStart"));
+  root_frames_.push_back(AddFunction("kernel32.dll!BaseThreadInitThunk"));
+
+  uint32_t swap_context = AddFunction("ntoskrnl.exe!KiSwapContext");
+  uint32_t commit_wait = AddFunction("ntoskrnl.exe!KiCommitThreadWait");
+  uint32_t wait_for_object = AddFunction("ntoskrnl.exe!KeWaitForSingleObject");
+  wait_frames_ = {swap_context, commit_wait, wait_for_object,
+                  AddFunction("ntdll.dll!NtWaitForSingleObject")};
+  set_event_frames_ = {AddFunction("ntoskrnl.exe!KiReadyThread"),
+                       AddFunction("ntoskrnl.exe!KeSetEvent"),
+                       AddFunction("ntdll.dll!NtSetEvent"),
+                       AddFunction("KernelBase.dll!SetEvent")};
+  for (size_t i = 0; i < kNumFileIoTypes; ++i) {
+    file_io_wait_frames_[i] = {swap_context, commit_wait, wait_for_object,
+                               AddFunction(kFileIoFunctions[i])};
+  }
+
+  for (uint64_t process_index = 0; process_index < options_.num_processes;
+       ++process_index) {
+    SimulatedProcess process;
+    process.pid = (kFirstPid + process_index) * 4;
+    std::string name(kProcessNames[process_index % kNumProcessNames]);
+    process.short_name = name.substr(0, name.find('.'));
+    process.name_field = name + " (" + std::to_string(process.pid) + ")";
+
+    // The functions of each process are spread over 16 modules.
+    process.first_function = static_cast<uint32_t>(functions_.size());
+    std::string module_prefix(process.short_name +
+                              std::to_string(process_index) + "_module");
+    for (uint64_t i = 0; i < options_.functions_per_process; ++i) {
+      AddFunction(module_prefix + std::to_string(i % 16) + ".dll!Function" +
+                  std::to_string(i));
+    }
+    processes_.push_back(process);
+
+    for (uint64_t i = 0; i < options_.threads_per_process; ++i) {
+      SimulatedThread thread;
+      thread.process_index = processes_.size() - 1;
+      thread.tid = (kFirstTid + threads_.size()) * 4;
+      thread.stack = root_frames_;
+      thread.irp = kFirstIrp + threads_.size() * 0x100;
+      thread.is_worker = i != 0;
+      threads_.push_back(thread);
+    }
+  }
+}
+
+uint64_t TraceGenerator::RandomDuration(uint64_t mean) {
+  return 1 + random_.Uniform(2 * mean);
+}
+
+void TraceGenerator::MutateStack(SimulatedThread* thread) {
+  const SimulatedProcess& process = processes_[thread->process_index];
+  std::vector<uint32_t>& stack = thread->stack;
+  size_t min_depth = root_frames_.size();
+  size_t max_depth = std::max<size_t>(
+      min_depth + 1, static_cast<size_t>(options_.max_stack_depth));
+
+  size_t num_pops = static_cast<size_t>(random_.Uniform(kMaxStackChange + 1));
+  while (num_pops-- > 0 && stack.size() > min_depth)
+    stack.pop_back();
+
+  // A function calls one of kCalleesPerFunction functions, so that the stacks
+  // form a tree with hot and cold branches.
+  size_t num_pushes = static_cast<size_t>(random_.Uniform(kMaxStackChange + 1));
+  if (stack.size() == min_depth && num_pushes == 0)
+    num_pushes = 1;
+  while (num_pushes-- > 0 && stack.size() < max_depth) {
+    uint64_t caller = stack.back();
+    uint64_t callee = (caller * 31 + random_.Uniform(kCalleesPerFunction)) %
+                      std::max<uint64_t>(1, options_.functions_per_process);
+    stack.push_back(process.first_function + static_cast<uint32_t>(callee));
+  }
+}
+
+void TraceGenerator::ScheduleThread(size_t thread_index) {
+  const SimulatedThread& thread = threads_[thread_index];
+  DCHECK(thread.state != SimulatedThread::kReady);
+  base::Timestamp ts = thread.state == SimulatedThread::kWaiting
+                           ? thread.wait_end_ts
+                           : std::min(thread.next_sample_ts,
+                                      thread.switch_out_ts);
+  events_.push(ScheduledEvent(ts, thread_index));
+}
+
+void TraceGenerator::SwitchIn(base::Timestamp ts,
+                              uint64_t cpu,
+                              size_t thread_index,
+                              size_t old_thread_index) {
+  SimulatedThread& thread = threads_[thread_index];
+  const SimulatedThread* old_thread =
+      old_thread_index == kIdleThread ? nullptr : &threads_[old_thread_index];
+
+  // The stack of the CSwitch event is the stack at which the thread waited.
+  // The file operation that it waited for ends right after.
+  WriteContextSwitch(ts, cpu, &thread, old_thread);
+  WriteStack(ts, thread,
+             thread.file_io_type == -1
+                 ? wait_frames_
+                 : file_io_wait_frames_[thread.file_io_type]);
+  if (thread.file_io_type != -1) {
+    WriteFileIoEnd(ts, thread, ts - thread.wait_start_ts);
+    thread.file_io_type = -1;
+  }
+
+  cpus_[cpu] = thread_index;
+  thread.state = SimulatedThread::kRunning;
+  thread.cpu = cpu;
+  thread.switch_out_ts = ts + RandomDuration(mean_run_period_);
+  thread.next_sample_ts =
+      ts + 1 +
+      random_.Uniform(std::max<uint64_t>(1, options_.sampling_interval));
+  ScheduleThread(thread_index);
+}
+
+void TraceGenerator::HandleThreadEvent(base::Timestamp ts,
+                                       size_t thread_index) {
+  SimulatedThread& thread = threads_[thread_index];
+
+  if (thread.state == SimulatedThread::kWaiting) {
+    // The wait is over: run on an idle CPU, or wait for one.
+    ReadyThread(ts, thread);
+    auto idle_cpu = std::find(cpus_.begin(), cpus_.end(), kIdleThread);
+    if (idle_cpu != cpus_.end()) {
+      SwitchIn(ts, idle_cpu - cpus_.begin(), thread_index, kIdleThread);
+    } else {
+      thread.state = SimulatedThread::kReady;
+      ready_threads_.push_back(thread_index);
+    }
+    return;
+  }
+
+  DCHECK(thread.state == SimulatedThread::kRunning);
+  if (thread.next_sample_ts < thread.switch_out_ts) {
+    MutateStack(&thread);
+    WriteSample(ts, thread);
+    WriteStack(ts, thread, std::vector<uint32_t>());
+    if (options_.region_percent != 0 &&
+        random_.Uniform(100) < options_.region_percent) {
+      HandleRegionEvent(ts, &thread);
+    }
+    thread.next_sample_ts += std::max<uint64_t>(1, options_.sampling_interval);
+    ScheduleThread(thread_index);
+    return;
+  }
+
+  // The first thread renders a frame in each running period.
+  if (thread_index == 0)
+    WriteFrameMark(ts, thread);
+
+  // Switch the thread out, optionally to wait for a file operation.
+  thread.state = SimulatedThread::kWaiting;
+  thread.wait_start_ts = ts;
+  thread.wait_end_ts = ts + RandomDuration(mean_wait_period_);
+  if (random_.Uniform(100) < options_.file_io_percent) {
+    thread.file_io_type = static_cast<int>(random_.Uniform(kNumFileIoTypes));
+    thread.file_index = random_.Uniform(kFilesPerProcess);
+    thread.file_offset = random_.Uniform(256) * 4096;
+    thread.file_io_size = 4096 << random_.Uniform(5);
+    WriteFileIo(ts, thread);
+  }
+  ScheduleThread(thread_index);
+
+  // Run the next ready thread on the CPU, or leave it idle.
+  uint64_t cpu = thread.cpu;
+  if (ready_threads_.empty()) {
+    WriteContextSwitch(ts, cpu, nullptr, &thread);
+    cpus_[cpu] = kIdleThread;
+  } else {
+    size_t next_thread_index = ready_threads_.front();
+    ready_threads_.pop_front();
+    SwitchIn(ts, cpu, next_thread_index, thread_index);
+  }
+}
+
+void TraceGenerator::ReadyThread(base::Timestamp ts,
+                                 const SimulatedThread& thread) {
+  // A file operation completes in a DPC, which interrupts the thread that runs
+  // on its CPU. Other waits end when the thread that runs on a random CPU sets
+  // the event that the thread waits for.
+  uint64_t cpu = random_.Uniform(cpus_.size());
+  const SimulatedThread* readying_thread =
+      cpus_[cpu] == kIdleThread ? nullptr : &threads_[cpus_[cpu]];
+  bool in_dpc = thread.file_io_type != -1;
+  WriteReadyThread(ts, cpu, readying_thread, thread, in_dpc);
+  if (readying_thread != nullptr && !in_dpc)
+    WriteStack(ts, *readying_thread, set_event_frames_);
+}
+
+void TraceGenerator::HandleChromeEvent(base::Timestamp ts) {
+  const SimulatedThread& thread = threads_.front();
+  const SimulatedProcess& process = processes_[thread.process_index];
+
+  // Events alternately begin and end, so that they never overlap.
+  const char* name = pending_chrome_event_;
+  const char* phase = "\"End\"";
+  if (name == nullptr) {
+    name = kChromeEventNames[random_.Uniform(kNumChromeEventNames)];
+    phase = "\"Begin\"";
+  }
+
+  writer_->Write("Chrome//win:Info");
+  WriteField(ts);
+  WriteField(process.name_field);
+  WriteField(thread.tid);
+  WriteField(thread.cpu);
+  WriteField(name);
+  WriteField(phase);
+  WriteField("\"\"");
+  WriteField("\"\"");
+  writer_->WriteChar('\n');
+
+  pending_chrome_event_ = pending_chrome_event_ == nullptr ? name : nullptr;
+}
+
+void TraceGenerator::HandleInputEvent(base::Timestamp ts) {
+  const SimulatedThread& thread = threads_.back();
+
+  bool is_key = random_.Uniform(100) < kKeyInputPercent;
+  writer_->Write(is_key ? "Multi-Input/Keyboard/KeyDown"
+                        : "Multi-Input/Mouse/MouseDown");
+  WriteField(ts);
+  WriteField(processes_[thread.process_index].name_field);
+  WriteField(thread.tid);
+  WriteField(thread.cpu);
+  if (is_key) {
+    const Key& key = kKeys[random_.Uniform(kNumKeys)];
+    WriteField(key.virtual_key_code);
+    WriteField(key.name);
+    WriteField(static_cast<uint64_t>(1));
+    WriteField(static_cast<uint64_t>(0));
+  } else {
+    WriteField(random_.Uniform(kNumMouseButtons));
+    WriteField(static_cast<uint64_t>(0));
+    WriteField(random_.Uniform(kScreenWidth));
+    WriteField(random_.Uniform(kScreenHeight));
+  }
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::HandleRegionEvent(base::Timestamp ts,
+                                       SimulatedThread* thread) {
+  auto& regions = thread->regions;
+  bool begin = regions.empty() ||
+               (regions.size() < kMaxRegionDepth && random_.Uniform(2) == 0);
+
+  writer_->Write(thread->is_worker ? "Multi-Worker/BlockWorker/"
+                                   : "Multi-Main/Block/");
+  writer_->Write(begin ? "Begin" : "End");
+  WriteField(ts);
+  WriteField(processes_[thread->process_index].name_field);
+  WriteField(thread->tid);
+  WriteField(thread->cpu);
+  if (begin) {
+    const char* name = kRegionNames[random_.Uniform(kNumRegionNames)];
+    WriteField(name);
+    WriteField(static_cast<uint64_t>(regions.size()));
+    regions.push_back(std::make_pair(ts, name));
+  } else {
+    WriteField(regions.back().second);
+    WriteField(static_cast<uint64_t>(regions.size() - 1));
+    WriteMillisecondsField(ts - regions.back().first);
+    regions.pop_back();
+  }
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteFrameMark(base::Timestamp ts,
+                                    const SimulatedThread& thread) {
+  // Like ETWRenderFrameMark(), the first frame has a duration of 0.
+  writer_->Write("Multi-FrameRate/Frame/RenderFrameMark");
+  WriteField(ts);
+  WriteField(processes_[thread.process_index].name_field);
+  WriteField(thread.tid);
+  WriteField(thread.cpu);
+  WriteField(num_frames_);
+  WriteMillisecondsField(num_frames_ != 0 ? ts - last_frame_ts_ : 0);
+  writer_->WriteChar('\n');
+
+  ++num_frames_;
+  last_frame_ts_ = ts;
+}
+
+void TraceGenerator::WriteMillisecondsField(uint64_t duration) {
+  WriteField(duration / 1000);
+  writer_->WriteChar('.');
+  for (uint64_t divisor = 100; divisor != 0; divisor /= 10)
+    writer_->WriteChar(static_cast<char>('0' + duration / divisor % 10));
+}
+
+void TraceGenerator::WriteProcessStart(base::Timestamp ts,
+                                       const SimulatedProcess& process) {
+  writer_->Write("P-Start");
+  WriteField(ts);
+  WriteField(process.name_field);
+  WriteField(static_cast<uint64_t>(4));
+  WriteField(static_cast<uint64_t>(1));
+  WriteField(process.short_name + ".exe");
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteThreadStartOrEnd(const char* type,
+                                           base::Timestamp ts,
+                                           const SimulatedThread& thread) {
+  writer_->Write(type);
+  WriteField(ts);
+  WriteField(processes_[thread.process_index].name_field);
+  WriteField(thread.tid);
+  WriteField("0xFFFFD00012345000");
+  WriteField("0xFFFFD0001233F000");
+  WriteField(functions_[root_frames_.back()].address);
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteSample(base::Timestamp ts,
+                                 const SimulatedThread& thread) {
+  const Function& leaf = functions_[thread.stack.back()];
+  writer_->Write("SampledProfile");
+  WriteField(ts);
+  WriteField(processes_[thread.process_index].name_field);
+  WriteField(thread.tid);
+  WriteField(leaf.address);
+  WriteField(thread.cpu);
+  WriteField(static_cast<uint64_t>(1));
+  WriteField(leaf.name);
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteContextSwitch(base::Timestamp ts,
+                                        uint64_t cpu,
+                                        const SimulatedThread* new_thread,
+                                        const SimulatedThread* old_thread) {
+  uint64_t time_since_last = 0;
+  if (new_thread != nullptr)
+    time_since_last = ts - new_thread->wait_start_ts;
+
+  writer_->Write("CSwitch");
+  WriteField(ts);
+  if (new_thread != nullptr) {
+    WriteField(processes_[new_thread->process_index].name_field);
+    WriteField(new_thread->tid);
+  } else {
+    WriteField(kIdleProcessNameField);
+    WriteField(static_cast<uint64_t>(0));
+  }
+  WriteField(static_cast<uint64_t>(8));
+  WriteField(static_cast<uint64_t>(0));
+  WriteField(time_since_last);
+  WriteField(time_since_last);
+  if (old_thread != nullptr) {
+    WriteField(processes_[old_thread->process_index].name_field);
+    WriteField(old_thread->tid);
+  } else {
+    WriteField(kIdleProcessNameField);
+    WriteField(static_cast<uint64_t>(0));
+  }
+  WriteField(static_cast<uint64_t>(8));
+  WriteField(static_cast<uint64_t>(0));
+  WriteField(old_thread != nullptr ? "Waiting" : "Running");
+  WriteField("Executive");
+  WriteField("Swapable");
+  WriteField(static_cast<uint64_t>(0));
+  WriteField(cpu);
+  WriteField(cpu);
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteReadyThread(base::Timestamp ts,
+                                      uint64_t cpu,
+                                      const SimulatedThread* readying_thread,
+                                      const SimulatedThread& readied_thread,
+                                      bool in_dpc) {
+  writer_->Write("ReadyThread");
+  WriteField(ts);
+  if (readying_thread != nullptr) {
+    WriteField(processes_[readying_thread->process_index].name_field);
+    WriteField(readying_thread->tid);
+  } else {
+    WriteField(kIdleProcessNameField);
+    WriteField(static_cast<uint64_t>(0));
+  }
+  WriteField(processes_[readied_thread.process_index].name_field);
+  WriteField(readied_thread.tid);
+  WriteField("Ignore");
+  WriteField(static_cast<uint64_t>(0));
+  WriteField(cpu);
+  WriteField(static_cast<uint64_t>(in_dpc ? 1 : 0));
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::WriteFileIo(base::Timestamp ts,
+                                 const SimulatedThread& thread) {
+  const SimulatedProcess& process = processes_[thread.process_index];
+  writer_->Write(kFileIoTypes[thread.file_io_type]);
+  WriteField(ts);
+  WriteField(process.name_field);
+  WriteField(thread.tid);
+  WriteField(process.name_field);
+  WriteField(thread.tid);
+  WriteField(thread.cpu);
+  WriteHexField(thread.irp);
+  WriteHexField(GetFileObject(thread));
+  if (kDiskIoTypes[thread.file_io_type] != nullptr) {
+    WriteHexField(thread.file_offset);
+    WriteHexField(thread.file_io_size);
+  }
+  WriteFileName(thread);
+}
+
+void TraceGenerator::WriteFileIoEnd(base::Timestamp ts,
+                                    const SimulatedThread& thread,
+                                    uint64_t elapsed_time) {
+  const SimulatedProcess& process = processes_[thread.process_index];
+  const char* disk_io_type = kDiskIoTypes[thread.file_io_type];
+
+  // Disk operations are logged when they complete, right before the file
+  // operation that they serve.
+  if (disk_io_type != nullptr && random_.Uniform(100) < kDiskIoPercent) {
+    uint64_t disk_time = std::max<uint64_t>(1, elapsed_time * 3 / 4);
+    writer_->Write(disk_io_type);
+    WriteField(ts);
+    WriteField(process.name_field);
+    WriteField(thread.tid);
+    WriteHexField(thread.irp + 0x10);
+    WriteHexField(thread.file_offset);
+    WriteHexField(thread.file_io_size);
+    WriteField(disk_time);
+    WriteField(static_cast<uint64_t>(0));
+    WriteHexField(0x60043);
+    WriteField(disk_time);
+    WriteField("Normal");
+    WriteHexField(0);
+    WriteHexField(GetFileObject(thread));
+    WriteFileName(thread);
+  }
+
+  writer_->Write("FileIoOpEnd");
+  WriteField(ts);
+  WriteField(process.name_field);
+  WriteField(thread.tid);
+  WriteField(process.name_field);
+  WriteField(thread.tid);
+  WriteField(thread.cpu);
+  WriteHexField(thread.irp);
+  WriteHexField(GetFileObject(thread));
+  WriteField(elapsed_time);
+  WriteHexField(0);
+  WriteHexField(disk_io_type != nullptr ? thread.file_io_size : 0);
+  WriteFileName(thread);
+}
+
+uint64_t TraceGenerator::GetFileObject(const SimulatedThread& thread) const {
+  return kFirstFileObject +
+         (thread.process_index * kFilesPerProcess + thread.file_index) * 0x100;
+}
+
+void TraceGenerator::WriteFileName(const SimulatedThread& thread) {
+  writer_->Write(", C:\\Users\\user\\AppData\\Local\\");
+  writer_->Write(processes_[thread.process_index].short_name);
+  writer_->Write("\\file");
+  writer_->WriteUInt(thread.file_index);
+  writer_->Write(".dat\n");
+}
+
+void TraceGenerator::WriteHexField(uint64_t value) {
+  char digits[16];
+  size_t num_digits = 0;
+  do {
+    digits[num_digits++] = "0123456789ABCDEF"[value % 16];
+    value /= 16;
+  } while (value != 0);
+
+  writer_->Write(", 0x");
+  while (num_digits > 0)
+    writer_->WriteChar(digits[--num_digits]);
+}
+
+void TraceGenerator::WriteStack(base::Timestamp ts,
+                                const SimulatedThread& thread,
+                                const std::vector<uint32_t>& wait_frames) {
+  uint64_t frame_number = 1;
+  auto write_frame = [&](uint32_t function_index) {
+    const Function& function = functions_[function_index];
+    writer_->Write("Stack");
+    WriteField(ts);
+    WriteField(thread.tid);
+    WriteField(frame_number++);
+    WriteField(function.address);
+    WriteField(function.name);
+    writer_->WriteChar('\n');
+  };
+  for (uint32_t function_index : wait_frames)
+    write_frame(function_index);
+  for (auto it = thread.stack.rbegin(); it != thread.stack.rend(); ++it)
+    write_frame(*it);
+  writer_->WriteChar('\n');
+}
+
+void TraceGenerator::Generate() {
+  CreateProcesses();
+
+  writer_->Write(kHeader);
+
+  base::Timestamp ts = kFirstEventTs;
+  for (const SimulatedProcess& process : processes_)
+    WriteProcessStart(ts, process);
+  for (const SimulatedThread& thread : threads_)
+    WriteThreadStartOrEnd("T-Start", ts, thread);
+
+  // Every thread starts waiting, and is ready during the first period.
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    SimulatedThread& thread = threads_[i];
+    thread.wait_start_ts = ts;
+    thread.wait_end_ts = ts + RandomDuration(mean_wait_period_);
+    ScheduleThread(i);
+  }
+  if (options_.chrome_event_rate != 0 && !threads_.empty()) {
+    events_.push(ScheduledEvent(
+        ts + RandomDuration(1000000 / options_.chrome_event_rate),
+        threads_.size()));
+  }
+  if (options_.input_rate != 0 && !threads_.empty()) {
+    events_.push(ScheduledEvent(
+        ts + RandomDuration(1000000 / options_.input_rate),
+        threads_.size() + 1));
+  }
+
+  while (!events_.empty() && events_.top().first < end_ts_) {
+    ScheduledEvent event = events_.top();
+    events_.pop();
+
+    if (event.second == threads_.size()) {
+      HandleChromeEvent(event.first);
+      // An event lasts on average a quarter of the interval between 2
+      // events.
+      uint64_t mean_interval = 1000000 / options_.chrome_event_rate;
+      uint64_t mean_duration = std::max<uint64_t>(1, mean_interval / 4);
+      events_.push(ScheduledEvent(
+          event.first + RandomDuration(pending_chrome_event_ == nullptr
+                                           ? mean_interval - mean_duration
+                                           : mean_duration),
+          event.second));
+      continue;
+    }
+    if (event.second == threads_.size() + 1) {
+      HandleInputEvent(event.first);
+      events_.push(ScheduledEvent(
+          event.first + RandomDuration(1000000 / options_.input_rate),
+          event.second));
+      continue;
+    }
+
+    HandleThreadEvent(event.first, event.second);
+  }
+
+  for (const SimulatedThread& thread : threads_)
+    WriteThreadStartOrEnd("T-End", end_ts_, thread);
+}
+
+// Writes the placeholder at the path of the .etl file, unless a file that
+// isn't a placeholder already exists at this path.
+bool WritePlaceholder(const TraceGeneratorOptions& options,
+                      const std::wstring& trace_path) {
+  if (base::FilePathExists(trace_path)) {
+    std::ifstream existing_file(trace_path);
+    std::string first_line;
+    std::getline(existing_file, first_line);
+    if (first_line != kPlaceholderMarker) {
+      LOG(ERROR) << base::WStringToString(trace_path)
+                 << " exists and is not a synthetic trace.";
+      return false;
+    }
+  }
+
+  // The options are written in the placeholder so that its size and last
+  // write time change with the trace, which invalidates the history
+  // snapshots of the previous trace.
+  std::ofstream placeholder(trace_path, std::ios::out | std::ios::trunc);
+  placeholder << kPlaceholderMarker << std::endl
+              << "cpus=" << options.num_cpus
+              << " processes=" << options.num_processes
+              << " threads=" << options.threads_per_process
+              << " functions=" << options.functions_per_process
+              << " stack_depth=" << options.max_stack_depth
+              << " sampling_interval=" << options.sampling_interval
+              << " context_switch_rate=" << options.context_switch_rate
+              << " file_io_percent=" << options.file_io_percent
+              << " chrome_event_rate=" << options.chrome_event_rate
+              << " region_percent=" << options.region_percent
+              << " input_rate=" << options.input_rate
+              << " duration=" << options.duration << " seed=" << options.seed
+              << std::endl;
+  if (!placeholder) {
+    LOG(ERROR) << "Unable to write " << base::WStringToString(trace_path)
+               << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+TraceGeneratorOptions::TraceGeneratorOptions()
+    : num_cpus(8),
+      num_processes(4),
+      threads_per_process(8),
+      functions_per_process(4096),
+      max_stack_depth(32),
+      sampling_interval(1000),
+      context_switch_rate(100),
+      file_io_percent(20),
+      chrome_event_rate(100),
+      region_percent(25),
+      input_rate(4),
+      duration(10),
+      seed(1) {}
+
+bool GenerateTrace(const TraceGeneratorOptions& options,
+                   const std::wstring& trace_path,
+                   uint64_t* csv_size) {
+  DCHECK(csv_size != nullptr);
+
+  if (!WritePlaceholder(options, trace_path))
+    return false;
+
+  std::wstring csv_path(trace_path + kCSVFileExtension);
+  base::BufferedWriter writer;
+  if (!writer.Open(csv_path, base::BufferedWriter::kFlushInBackground)) {
+    LOG(ERROR) << "Unable to open " << base::WStringToString(csv_path)
+               << " for writing.";
+    return false;
+  }
+
+  TraceGenerator generator(options, &writer);
+  generator.Generate();
+
+  if (!writer.Close()) {
+    LOG(ERROR) << "Unable to write " << base::WStringToString(csv_path)
+               << ".";
+    return false;
+  }
+
+  uint64_t last_write_time = 0;
+  return base::GetFileSizeAndLastWriteTime(csv_path, csv_size,
+                                           &last_write_time);
+}
+
+}  // namespace etw_insights
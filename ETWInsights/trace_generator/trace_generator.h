@@ -0,0 +1,89 @@
+/*
+Copyright 2015 Google Inc. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace etw_insights {
+
+// Options of a synthetic trace.
+struct TraceGeneratorOptions {
+  TraceGeneratorOptions();
+
+  // Number of CPUs. A thread that is ready to run waits until a CPU is idle.
+  uint64_t num_cpus;
+
+  // Number of processes.
+  uint64_t num_processes;
+
+  // Number of threads in each process.
+  uint64_t threads_per_process;
+
+  // Number of distinct functions in the stacks of each process.
+  uint64_t functions_per_process;
+
+  // Maximum number of frames in a stack.
+  uint64_t max_stack_depth;
+
+  // Interval between 2 samples of a running thread, in microseconds.
+  uint64_t sampling_interval;
+
+  // Number of times that each thread is switched in, per second, if it
+  // doesn't wait for a CPU. Threads run a quarter of the time and wait for an
+  // object or a file operation the rest of the time.
+  uint64_t context_switch_rate;
+
+  // Percentage of the waits that are file operations.
+  uint64_t file_io_percent;
+
+  // Number of Chrome events per second, on the first thread of the first
+  // process.
+  uint64_t chrome_event_rate;
+
+  // Percentage of the samples after which the thread begins or ends a region
+  // with ETWBegin/ETWEnd, on the first thread of each process, or with
+  // ETWWorkerBegin/ETWWorkerEnd, on the other threads.
+  uint64_t region_percent;
+
+  // Number of key presses and mouse clicks per second, logged by the last
+  // thread of the last process.
+  uint64_t input_rate;
+
+  // Duration of the trace, in seconds.
+  uint64_t duration;
+
+  // Seed of the random number generator. The same options always produce the
+  // same trace.
+  uint64_t seed;
+};
+
+// Generates a synthetic trace in the CSV format of "xperf -i <etl> -symbols",
+// with SampledProfile, CSwitch, Stack, P-Start, T-Start, T-End, FileIo,
+// Chrome and ETWProviders region, frame and input events. The CSV is written to
+// <trace_path>.csv, where ETWReader looks for the conversion of <trace_path>,
+// and a small placeholder file is written to <trace_path> so that the trace
+// can be opened like a real one.
+// @param options options of the trace.
+// @param trace_path path of the .etl placeholder. It must not be a real trace.
+// @param csv_size receives the size of the CSV file, in bytes.
+// @returns true if the trace was generated successfully.
+bool GenerateTrace(const TraceGeneratorOptions& options,
+                   const std::wstring& trace_path,
+                   uint64_t* csv_size);
+
+}  // namespace etw_insights